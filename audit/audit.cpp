@@ -18,37 +18,80 @@
 #include <boost/format.hpp>
 #include <boost/system/error_code.hpp>
 #include <utils/bytes_to_debug_string.hpp>
+#include <pbft/pbft_service_base.hpp>
+#include <openssl/evp.h>
 
 using namespace bzn;
 
+namespace
+{
+    // stays below a typical ethernet MTU once IP and UDP headers are added
+    const size_t MAX_STATSD_PACKET_SIZE = 1432;
+
+    const char* STATSD_TIMER_TYPE = "ms";
+    const char* STATSD_HISTOGRAM_TYPE = "h";
+
+    bzn::commit_digest_t
+    make_commit_digest(const std::string& operation)
+    {
+        bzn::commit_digest_t digest{};
+        EVP_Digest(operation.data(), operation.size(), digest.data(), nullptr, EVP_sha256(), nullptr);
+        return digest;
+    }
+
+    std::string
+    commit_digest_to_debug_string(const bzn::commit_digest_t& digest)
+    {
+        return bzn::bytes_to_debug_string(std::string(digest.begin(), digest.end()));
+    }
+}
+
 audit::audit(std::shared_ptr<bzn::asio::io_context_base> io_context
         , std::shared_ptr<bzn::node_base> node
         , std::optional<boost::asio::ip::udp::endpoint> monitor_endpoint
         , bzn::uuid_t uuid
         , size_t mem_size
+        , std::chrono::milliseconds stats_flush_interval
 )
 
         : uuid(std::move(uuid))
+        , recorded_errors(mem_size)
         , node(std::move(node))
         , io_context(std::move(io_context))
+        , recorded_primaries(mem_size)
+        , recorded_pbft_commits(mem_size)
+        , recorded_pbft_commit_digests(mem_size)
         , primary_alive_timer(this->io_context->make_unique_steady_timer())
+        , stats_flush_timer(this->io_context->make_unique_steady_timer())
         , monitor_endpoint(std::move(monitor_endpoint))
         , socket(this->io_context->make_unique_udp_socket())
+        , stats_flush_interval(stats_flush_interval)
         , statsd_namespace_prefix("com.bluzelle.swarm.singleton.node." + this->uuid + ".")
-        , mem_size(mem_size)
 {
 
 }
 
-const std::list<std::string>&
+std::vector<std::string>
 audit::error_strings() const
 {
-    return this->recorded_errors;
+    std::lock_guard<std::mutex> lock(this->audit_lock);
+
+    std::vector<std::string> result;
+    result.reserve(this->recorded_errors.size());
+
+    for (size_t i = 0; i < this->recorded_errors.size(); i++)
+    {
+        result.push_back(this->recorded_errors[i]);
+    }
+
+    return result;
 }
 
 size_t
 audit::error_count() const
 {
+    std::lock_guard<std::mutex> lock(this->audit_lock);
+
     return this->recorded_errors.size() + this->forgotten_error_count;
 }
 
@@ -62,9 +105,13 @@ audit::start()
 
         if (this->monitor_endpoint)
         {
-            LOG(info) << boost::format("audit module running, will send stats to %1%:%2%")
+            LOG(info) << boost::format("audit module running, will send stats to %1%:%2% every %3%ms")
                 % this->monitor_endpoint->address().to_string()
-                % this->monitor_endpoint->port();
+                % this->monitor_endpoint->port()
+                % this->stats_flush_interval.count();
+
+            this->stats_flush_timer->expires_from_now(this->stats_flush_interval);
+            this->stats_flush_timer->async_wait(std::bind(&audit::handle_stats_flush_timeout, shared_from_this(), std::placeholders::_1));
         }
         else
         {
@@ -72,6 +119,7 @@ audit::start()
         }
 
         LOG(debug) << "starting primary alive timer";
+        std::lock_guard<std::mutex> lock(this->audit_lock);
         this->reset_primary_alive_timer();
     });
 }
@@ -100,6 +148,8 @@ audit::handle_primary_alive_timeout(const boost::system::error_code& ec)
         return;
     }
 
+    // timers complete on whichever io thread is free, so this races with the message handlers otherwise
+    std::lock_guard<std::mutex> lock(this->audit_lock);
 
     this->report_error(bzn::NO_PRIMARY_METRIC_NAME, str(boost::format("No primary alive [%1%]") % ++(this->primary_dead_count)));
     this->primary_alive_timer->expires_from_now(this->primary_timeout);
@@ -109,33 +159,127 @@ audit::handle_primary_alive_timeout(const boost::system::error_code& ec)
 void
 audit::report_error(const std::string& metric_name, const std::string& description)
 {
-    this->recorded_errors.push_back(description);
+    if (this->recorded_errors.push_back(description))
+    {
+        this->forgotten_error_count++;
+    }
 
     std::string metric = this->statsd_namespace_prefix + metric_name;
 
     LOG(fatal) << boost::format("[%1%]: %2%") % metric % description;
-    this->send_to_monitor(metric + bzn::STATSD_COUNTER_FORMAT);
+    this->count(metric);
+
+    // errors are not held back until the next flush...
+    this->flush_stats();
+}
+
+void
+audit::count(const std::string& metric_name)
+{
+    if (!this->monitor_endpoint)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(this->stats_lock);
 
-    this->trim();
+    ++this->pending_counters[metric_name];
 }
 
 void
-audit::send_to_monitor(const std::string& stat)
+audit::record_sample(const std::string& metric_name, uint64_t value, const char* type)
 {
     if (!this->monitor_endpoint)
     {
         return;
     }
 
-    LOG(trace) << boost::format("sending stat '%1%' to monitor at %2%:%3%")
-                  % stat
+    std::lock_guard<std::mutex> lock(this->stats_lock);
+
+    this->pending_samples.emplace_back(metric_name + ":" + std::to_string(value) + "|" + type);
+}
+
+void
+audit::record_timer(const std::string& metric_name, std::chrono::milliseconds elapsed)
+{
+    this->record_sample(metric_name, elapsed.count(), STATSD_TIMER_TYPE);
+}
+
+void
+audit::record_histogram(const std::string& metric_name, uint64_t value)
+{
+    this->record_sample(metric_name, value, STATSD_HISTOGRAM_TYPE);
+}
+
+void
+audit::handle_stats_flush_timeout(const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        LOG(trace) << "stats flush timer canceled " << ec.message();
+        return;
+    }
+
+    this->flush_stats();
+
+    this->stats_flush_timer->expires_from_now(this->stats_flush_interval);
+    this->stats_flush_timer->async_wait(std::bind(&audit::handle_stats_flush_timeout, shared_from_this(), std::placeholders::_1));
+}
+
+void
+audit::flush_stats()
+{
+    std::lock_guard<std::mutex> lock(this->stats_lock);
+
+    // statsd accepts several newline separated metrics per datagram...
+    auto packet = std::make_shared<std::string>();
+
+    auto add_line = [&](const std::string& line)
+    {
+        if (!packet->empty() && packet->size() + 1 + line.size() > MAX_STATSD_PACKET_SIZE)
+        {
+            this->send_to_monitor(std::move(packet));
+            packet = std::make_shared<std::string>();
+        }
+
+        if (!packet->empty())
+        {
+            packet->push_back('\n');
+        }
+
+        packet->append(line);
+    };
+
+    for (const auto& [metric_name, count] : this->pending_counters)
+    {
+        add_line(metric_name + ":" + std::to_string(count) + "|c");
+    }
+
+    for (const auto& sample : this->pending_samples)
+    {
+        add_line(sample);
+    }
+
+    if (!packet->empty())
+    {
+        this->send_to_monitor(std::move(packet));
+    }
+
+    this->pending_counters.clear();
+    this->pending_samples.clear();
+}
+
+void
+audit::send_to_monitor(std::shared_ptr<const std::string> packet)
+{
+    LOG(trace) << boost::format("sending stats '%1%' to monitor at %2%:%3%")
+                  % *packet
                   % this->monitor_endpoint->address().to_string()
                   % this->monitor_endpoint->port();
 
-    std::shared_ptr<boost::asio::const_buffer> buffer = std::make_shared<boost::asio::const_buffer>(stat.c_str(), stat.size());
-
-    this->socket->async_send_to(*buffer, *(this->monitor_endpoint),
-        [buffer](const boost::system::error_code& ec, std::size_t bytes)
+    // the packet is owned by the completion handler so it outlives the send...
+    this->socket->async_send_to(boost::asio::buffer(*packet), *(this->monitor_endpoint),
+        [packet](const boost::system::error_code& ec, std::size_t bytes)
         {
             if (ec)
             {
@@ -144,7 +288,6 @@ audit::send_to_monitor(const std::string& stat)
             }
         }
     );
-
 }
 
 void
@@ -158,10 +301,20 @@ audit::handle(const bzn_envelope& env, std::shared_ptr<bzn::session_base> sessio
 
     LOG(trace) << "got audit message" << message.DebugString();
 
+    // our own reports say how far along the swarm really is, so anchor the windows there rather than trusting peers
+    if (env.sender() == this->uuid)
+    {
+        this->anchor_windows(message);
+    }
+
     if (message.has_pbft_commit())
     {
         this->handle_pbft_commit(message.pbft_commit());
     }
+    else if (message.has_pbft_commit_digest())
+    {
+        this->handle_pbft_commit_digest(message.pbft_commit_digest());
+    }
     else if (message.has_primary_status())
     {
         this->handle_primary_status(message.primary_status());
@@ -178,22 +331,41 @@ audit::handle(const bzn_envelope& env, std::shared_ptr<bzn::session_base> sessio
     session->close();
 }
 
+void
+audit::anchor_windows(const audit_message& message)
+{
+    std::lock_guard<std::mutex> lock(this->audit_lock);
+
+    if (message.has_pbft_commit_digest())
+    {
+        this->recorded_pbft_commits.anchor(message.pbft_commit_digest().last_sequence());
+        this->recorded_pbft_commit_digests.anchor(message.pbft_commit_digest().last_sequence() / CHECKPOINT_INTERVAL);
+    }
+    else if (message.has_primary_status())
+    {
+        this->recorded_primaries.anchor(message.primary_status().view());
+    }
+}
+
 void audit::handle_primary_status(const primary_status& primary_status)
 {
     std::lock_guard<std::mutex> lock(this->audit_lock);
 
-    if (this->recorded_primaries.count(primary_status.view()) == 0)
+    const auto recorded = this->recorded_primaries.find(primary_status.view());
+
+    if (!recorded)
     {
-        LOG(info) << "observed primary of view " << primary_status.view() << " to be '" << primary_status.primary() << "'";
-        this->send_to_monitor(bzn::PRIMARY_HEARD_METRIC_NAME+bzn::STATSD_COUNTER_FORMAT);
-        this->recorded_primaries[primary_status.view()] = primary_status.primary();
-        this->trim();
+        if (this->recorded_primaries.insert(primary_status.view(), primary_status.primary()))
+        {
+            LOG(info) << "observed primary of view " << primary_status.view() << " to be '" << primary_status.primary() << "'";
+            this->count(bzn::PRIMARY_HEARD_METRIC_NAME);
+        }
     }
-    else if (this->recorded_primaries[primary_status.view()] != primary_status.primary())
+    else if (*recorded != primary_status.primary())
     {
         std::string err = str(boost::format(
                 "Conflicting primary detected! '%1%' is the recorded primary of view %2%, but '%3%' claims to be the primary of the same view.")
-                              % this->recorded_primaries[primary_status.view()]
+                              % *recorded
                               % primary_status.view()
                               % primary_status.primary());
         this->report_error(bzn::PRIMARY_CONFLICT_METRIC_NAME, err);
@@ -207,60 +379,77 @@ audit::handle_pbft_commit(const pbft_commit_notification& commit)
 {
     std::lock_guard<std::mutex> lock(this->audit_lock);
 
-    this->send_to_monitor(bzn::PBFT_COMMIT_METRIC_NAME + bzn::STATSD_COUNTER_FORMAT);
+    this->count(bzn::PBFT_COMMIT_METRIC_NAME);
 
-    if (this->recorded_pbft_commits.count(commit.sequence_number()) == 0)
+    const auto digest = make_commit_digest(commit.operation());
+    const auto recorded = this->recorded_pbft_commits.find(commit.sequence_number());
+
+    if (!recorded)
     {
-        LOG(debug) << "observed that message '" << bytes_to_debug_string(commit.operation()) << "' is committed at sequence " << commit.sequence_number();
-        this->recorded_pbft_commits[commit.sequence_number()] = commit.operation();
-        this->trim();
+        if (this->recorded_pbft_commits.insert(commit.sequence_number(), digest))
+        {
+            LOG(debug) << "observed that message '" << bytes_to_debug_string(commit.operation()) << "' is committed at sequence " << commit.sequence_number();
+        }
     }
-    else if (this->recorded_pbft_commits[commit.sequence_number()] != commit.operation())
+    else if (*recorded != digest)
     {
         std::string err = str(boost::format(
-                "Conflicting commit detected! '%1%' is the recorded entry at sequence %2%, but '%3%' has been committed with the same sequence.")
-                              % this->recorded_pbft_commits[commit.sequence_number()]
+                "Conflicting commit detected! '%1%' is the digest of the recorded entry at sequence %2%, but '%3%' has been committed with the same sequence.")
+                              % commit_digest_to_debug_string(*recorded)
                               % commit.sequence_number()
-                              % commit.operation());
+                              % bytes_to_debug_string(commit.operation()));
         this->report_error(bzn::PBFT_COMMIT_CONFLICT_METRIC_NAME, err);
     }
 }
 
 void
-audit::handle_failure_detected(const failure_detected& /*failure*/)
+audit::handle_pbft_commit_digest(const pbft_commit_digest& digest)
 {
-    // TODO KEP-539: more info in this message
     std::lock_guard<std::mutex> lock(this->audit_lock);
 
-    this->send_to_monitor(bzn::FAILURE_DETECTED_METRIC_NAME + bzn::STATSD_COUNTER_FORMAT);
-}
+    this->count(bzn::PBFT_COMMIT_DIGEST_METRIC_NAME);
 
-size_t
-audit::current_memory_size()
-{
-    return this->recorded_pbft_commits.size() + this->recorded_errors.size() + this->recorded_primaries.size();
+    // digests are sent at checkpoints, so index them by checkpoint to keep one slot per range
+    const uint64_t checkpoint = digest.last_sequence() / CHECKPOINT_INTERVAL;
+    const commit_range_digest_t range{digest.first_sequence(), digest.last_sequence(), make_commit_digest(digest.digest())};
+    const auto recorded = this->recorded_pbft_commit_digests.find(checkpoint);
+
+    if (!recorded)
+    {
+        if (this->recorded_pbft_commit_digests.insert(checkpoint, range))
+        {
+            LOG(debug) << "observed commit digest '" << bytes_to_debug_string(digest.digest()) << "' for sequences "
+                       << digest.first_sequence() << " to " << digest.last_sequence();
+        }
+    }
+    else if (recorded->first_sequence == range.first_sequence && recorded->last_sequence == range.last_sequence
+        && recorded->digest != range.digest)
+    {
+        std::string err = str(boost::format(
+                "Conflicting commit detected! '%1%' is the recorded digest of sequences %2% to %3%, but '%4%' reports digest '%5%' for the same sequences.")
+                              % commit_digest_to_debug_string(recorded->digest)
+                              % digest.first_sequence()
+                              % digest.last_sequence()
+                              % digest.sender_uuid()
+                              % commit_digest_to_debug_string(range.digest));
+        this->report_error(bzn::PBFT_COMMIT_CONFLICT_METRIC_NAME, err);
+    }
 }
 
 void
-audit::trim()
+audit::handle_failure_detected(const failure_detected& /*failure*/)
 {
-    while(this->recorded_errors.size() > this->mem_size)
-    {
-        this->recorded_errors.pop_front();
-        this->forgotten_error_count++;
-    }
+    // TODO KEP-539: more info in this message
+    std::lock_guard<std::mutex> lock(this->audit_lock);
 
-    // Here we're removing the lowest term/log index entries, which is sort of like the oldest entries. I'd rather
-    // remove entries at random, but that's not straightforward to do with STL containers without making some onerous
-    // performance compromise.
+    this->count(bzn::FAILURE_DETECTED_METRIC_NAME);
+}
 
-    while(this->recorded_primaries.size() > this->mem_size)
-    {
-        this->recorded_primaries.erase(this->recorded_primaries.begin());
-    }
+size_t
+audit::current_memory_size()
+{
+    std::lock_guard<std::mutex> lock(this->audit_lock);
 
-    while(this->recorded_pbft_commits.size() > this->mem_size)
-    {
-        this->recorded_pbft_commits.erase(this->recorded_pbft_commits.begin());
-    }
+    return this->recorded_pbft_commits.size() + this->recorded_pbft_commit_digests.size() + this->recorded_errors.size()
+        + this->recorded_primaries.size();
 }
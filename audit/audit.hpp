@@ -18,13 +18,21 @@
 #include <node/node_base.hpp>
 #include <include/boost_asio_beast.hpp>
 #include <boost/asio/ip/udp.hpp>
+#include <utils/ring_buffer.hpp>
+#include <utils/sequence_window.hpp>
+#include <array>
+#include <map>
 #include <mutex>
 #include <optional>
+#include <vector>
 
 
 namespace bzn
 {
 
+    // commit operations are remembered by their sha256 so each history entry has the same, small footprint
+    using commit_digest_t = std::array<uint8_t, 32>;
+
     class audit : public audit_base, public std::enable_shared_from_this<audit>
     {
     public:
@@ -33,48 +41,71 @@ namespace bzn
                 , std::optional<boost::asio::ip::udp::endpoint>
                 , bzn::uuid_t uuid
 		        , size_t mem_size
+                , std::chrono::milliseconds stats_flush_interval
         );
 
         size_t error_count() const override;
 
-        const std::list<std::string>& error_strings() const override;
+        std::vector<std::string> error_strings() const override;
 
 
         void handle(const bzn_envelope& message, std::shared_ptr<bzn::session_base> session) override;
 
         void handle_pbft_commit(const pbft_commit_notification&) override;
+        void handle_pbft_commit_digest(const pbft_commit_digest&) override;
         void handle_primary_status(const primary_status&) override;
         void handle_failure_detected(const failure_detected&) override;
 
+        void record_timer(const std::string& metric_name, std::chrono::milliseconds elapsed) override;
+        void record_histogram(const std::string& metric_name, uint64_t value) override;
+
         size_t current_memory_size();
 
         void start() override;
 
     private:
         void handle_primary_alive_timeout(const boost::system::error_code& ec);
-        void reset_primary_alive_timer();
+        void reset_primary_alive_timer(); // caller must hold audit_lock
+
+        void report_error(const std::string& metric_name, const std::string& error_description); // caller must hold audit_lock
+
+        // stats are aggregated here and sent to the monitor in as few datagrams as possible on every flush
+        void count(const std::string& metric_name);
+        void record_sample(const std::string& metric_name, uint64_t value, const char* type);
+        void handle_stats_flush_timeout(const boost::system::error_code& ec);
+        void flush_stats();
+        void send_to_monitor(std::shared_ptr<const std::string> packet);
 
-        void report_error(const std::string& metric_name, const std::string& error_description);
-        void send_to_monitor(const std::string& stat);
+        void anchor_windows(const audit_message& message);
 
         void handle_leader_data(const leader_status&);
         void handle_leader_made_progress(const leader_status&);
 
-        void trim();
         const bzn::uuid_t uuid;
 
-        std::list<std::string> recorded_errors;
+        // history is bounded by mem_size; the oldest entries are overwritten once it is reached
+        bzn::ring_buffer<std::string> recorded_errors;
         const std::shared_ptr<bzn::node_base> node;
         const std::shared_ptr<bzn::asio::io_context_base> io_context;
 
         uint primary_dead_count = 0;
 
-        std::map<uint64_t, bzn::uuid_t> recorded_primaries;
-        std::map<uint64_t, std::string> recorded_pbft_commits;
+        bzn::sequence_window<bzn::uuid_t> recorded_primaries;
+        bzn::sequence_window<commit_digest_t> recorded_pbft_commits;
+
+        // keyed by checkpoint number (last sequence covered / CHECKPOINT_INTERVAL)
+        struct commit_range_digest_t
+        {
+            uint64_t first_sequence;
+            uint64_t last_sequence;
+            commit_digest_t digest;
+        };
+        bzn::sequence_window<commit_range_digest_t> recorded_pbft_commit_digests;
 
         std::once_flag start_once;
-        std::mutex audit_lock;
+        mutable std::mutex audit_lock;
         std::unique_ptr<bzn::asio::steady_timer_base> primary_alive_timer;
+        std::unique_ptr<bzn::asio::steady_timer_base> stats_flush_timer;
 
         // TODO: Make this configurable
         std::chrono::milliseconds primary_timeout{std::chrono::milliseconds(30000)};
@@ -83,9 +114,12 @@ namespace bzn
         std::optional<boost::asio::ip::udp::endpoint> monitor_endpoint;
         std::unique_ptr<bzn::asio::udp_socket_base> socket;
 
-        const std::string statsd_namespace_prefix;
+        const std::chrono::milliseconds stats_flush_interval;
+        std::mutex stats_lock;
+        std::map<std::string, uint64_t> pending_counters;
+        std::vector<std::string> pending_samples;
 
-        size_t mem_size;
+        const std::string statsd_namespace_prefix;
     };
 
 }
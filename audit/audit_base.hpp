@@ -15,8 +15,9 @@
 #pragma once
 
 #include <string>
-#include <list>
+#include <vector>
 #include <memory>
+#include <chrono>
 
 #include <include/bluzelle.hpp>
 #include <node/node_base.hpp>
@@ -26,14 +27,13 @@
 namespace bzn
 {
     const std::string PBFT_COMMIT_METRIC_NAME = "pbft.stats.commit_heard";
+    const std::string PBFT_COMMIT_DIGEST_METRIC_NAME = "pbft.stats.commit_digest_heard";
     const std::string PRIMARY_HEARD_METRIC_NAME = "pbft.stats.primary_heard";
     const std::string FAILURE_DETECTED_METRIC_NAME = "pbft.stats.failure_detected";
     const std::string PBFT_COMMIT_CONFLICT_METRIC_NAME = "pbft.safety.commit_conflict";
     const std::string PRIMARY_CONFLICT_METRIC_NAME = "pbft.safety.primary_conflict";
     const std::string NO_PRIMARY_METRIC_NAME = "pbft.liveness.no_primary";
 
-    const std::string STATSD_COUNTER_FORMAT = ":1|c";
-
     class audit_base
     {
     public:
@@ -44,15 +44,21 @@ namespace bzn
 
         virtual size_t error_count() const = 0;
 
-        virtual const std::list<std::string> &error_strings() const = 0;
+        virtual std::vector<std::string> error_strings() const = 0;
 
         virtual void handle(const bzn_envelope& msg, std::shared_ptr<bzn::session_base> session) = 0;
 
         virtual void handle_pbft_commit(const pbft_commit_notification&) = 0;
 
+        virtual void handle_pbft_commit_digest(const pbft_commit_digest&) = 0;
+
         virtual void handle_primary_status(const primary_status&) = 0;
 
         virtual void handle_failure_detected(const failure_detected&) = 0;
+
+        virtual void record_timer(const std::string& metric_name, std::chrono::milliseconds elapsed) = 0;
+
+        virtual void record_histogram(const std::string& metric_name, uint64_t value) = 0;
     };
 
 }
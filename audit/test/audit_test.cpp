@@ -14,7 +14,9 @@
 
 #include <audit/audit.hpp>
 #include <mocks/mock_node_base.hpp>
+#include <mocks/mock_session_base.hpp>
 #include <mocks/mock_boost_asio_beast.hpp>
+#include <pbft/pbft_service_base.hpp>
 #include <boost/range/irange.hpp>
 #include <boost/asio/buffer.hpp>
 
@@ -31,6 +33,11 @@ public:
 
     bzn::asio::wait_handler primary_alive_timer_callback;
 
+    std::unique_ptr<bzn::asio::Mocksteady_timer_base> stats_flush_timer =
+            std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+
+    bzn::asio::wait_handler stats_flush_timer_callback;
+
     std::optional<boost::asio::ip::udp::endpoint> endpoint;
     std::unique_ptr<bzn::asio::Mockudp_socket_base> socket = std::make_unique<NiceMock<bzn::asio::Mockudp_socket_base>>();
 
@@ -45,6 +52,9 @@ public:
         EXPECT_CALL(*(this->mock_io_context), make_unique_steady_timer())
                 .WillOnce(Invoke(
                 [&](){return std::move(this->primary_alive_timer);}
+        ))
+                .WillOnce(Invoke(
+                [&](){return std::move(this->stats_flush_timer);}
         ));
 
         EXPECT_CALL(*(this->primary_alive_timer), async_wait(_))
@@ -52,17 +62,27 @@ public:
                 [&](auto handler){this->primary_alive_timer_callback = handler;}
         ));
 
+        EXPECT_CALL(*(this->stats_flush_timer), async_wait(_))
+                .WillRepeatedly(Invoke(
+                [&](auto handler){this->stats_flush_timer_callback = handler;}
+        ));
+
         EXPECT_CALL(*(this->mock_io_context), make_unique_udp_socket())
                 .WillOnce(Invoke(
                 [&](){return std::move(this->socket);}
         ));
     }
 
+    void use_monitor()
+    {
+        this->endpoint = boost::asio::ip::udp::endpoint{boost::asio::ip::address::from_string("127.0.0.1"), 8125};
+    }
+
     void build_audit()
     {
         // We cannot construct this during our constructor because doing so invalidates our timer pointers,
         // which prevents tests from setting expectations on them
-        this->audit = std::make_shared<bzn::audit>(this->mock_io_context, this->mock_node, this->endpoint, "audit_test_uuid", this->mem_size);
+        this->audit = std::make_shared<bzn::audit>(this->mock_io_context, this->mock_node, this->endpoint, "audit_test_uuid", this->mem_size, std::chrono::milliseconds(1000));
         this->audit->start();
     }
 };
@@ -121,6 +141,107 @@ TEST_F(audit_test, audit_throws_error_when_pbft_commits_conflict)
     EXPECT_EQ(this->audit->error_count(), 1u);
 }
 
+TEST_F(audit_test, audit_throws_error_when_pbft_commit_digests_conflict)
+{
+    this->use_pbft = true;
+    this->build_audit();
+
+    pbft_commit_digest a, b, c;
+
+    a.set_sender_uuid("uuid0");
+    a.set_first_sequence(1);
+    a.set_last_sequence(100);
+    a.set_digest("digest of 1-100");
+
+    b = a;
+    b.set_sender_uuid("uuid1");
+
+    c = a;
+    c.set_sender_uuid("uuid2");
+    c.set_digest("some other digest");
+
+    this->audit->handle_pbft_commit_digest(a);
+    this->audit->handle_pbft_commit_digest(b);
+    EXPECT_EQ(this->audit->error_count(), 0u);
+
+    this->audit->handle_pbft_commit_digest(c);
+    EXPECT_EQ(this->audit->error_count(), 1u);
+
+    // the same digest over a different range is not a conflict
+    c.set_first_sequence(101);
+    c.set_last_sequence(200);
+    this->audit->handle_pbft_commit_digest(c);
+    EXPECT_EQ(this->audit->error_count(), 1u);
+}
+
+TEST_F(audit_test, audit_remembers_a_commit_digest_for_each_recent_checkpoint)
+{
+    this->mem_size = 10;
+    this->use_pbft = true;
+    this->build_audit();
+
+    pbft_commit_digest digest;
+    digest.set_sender_uuid("uuid0");
+
+    for (uint64_t checkpoint = 1; checkpoint <= this->mem_size; checkpoint++)
+    {
+        digest.set_first_sequence((checkpoint - 1) * bzn::CHECKPOINT_INTERVAL + 1);
+        digest.set_last_sequence(checkpoint * bzn::CHECKPOINT_INTERVAL);
+        digest.set_digest("digest " + std::to_string(checkpoint));
+        this->audit->handle_pbft_commit_digest(digest);
+    }
+
+    // the oldest checkpoint's digest is still around to be contradicted
+    digest.set_sender_uuid("uuid1");
+    digest.set_first_sequence(1);
+    digest.set_last_sequence(bzn::CHECKPOINT_INTERVAL);
+    digest.set_digest("some other digest");
+    this->audit->handle_pbft_commit_digest(digest);
+
+    EXPECT_EQ(this->audit->error_count(), 1u);
+}
+
+TEST_F(audit_test, audit_ignores_a_huge_first_sequence_until_anchored_by_its_own_digest)
+{
+    this->mem_size = 10;
+    this->use_pbft = true;
+    this->build_audit();
+
+    pbft_commit_notification bogus;
+    bogus.set_operation("bogus");
+    bogus.set_sequence_number(uint64_t(1) << 63);
+    this->audit->handle_pbft_commit(bogus);
+
+    // the bogus sequence didn't pin the window, so commits from the start are still checked
+    pbft_commit_notification a, b;
+    a.set_operation("do something");
+    a.set_sequence_number(1);
+    b.set_operation("do something else");
+    b.set_sequence_number(1);
+
+    this->audit->handle_pbft_commit(a);
+    this->audit->handle_pbft_commit(b);
+    EXPECT_EQ(this->audit->error_count(), 1u);
+
+    // a node that restarted far along only learns where the swarm is from its own digest
+    audit_message msg;
+    msg.mutable_pbft_commit_digest()->set_sender_uuid("audit_test_uuid");
+    msg.mutable_pbft_commit_digest()->set_first_sequence(99901);
+    msg.mutable_pbft_commit_digest()->set_last_sequence(100000);
+    msg.mutable_pbft_commit_digest()->set_digest("digest");
+
+    bzn_envelope env;
+    env.set_sender("audit_test_uuid");
+    env.set_audit(msg.SerializeAsString());
+    this->audit->handle(env, std::make_shared<NiceMock<bzn::Mocksession_base>>());
+
+    a.set_sequence_number(100001);
+    b.set_sequence_number(100001);
+    this->audit->handle_pbft_commit(a);
+    this->audit->handle_pbft_commit(b);
+    EXPECT_EQ(this->audit->error_count(), 2u);
+}
+
 TEST_F(audit_test, audit_throws_error_when_no_primary_alive)
 {
     this->use_pbft = true;
@@ -319,3 +440,106 @@ TEST_F(audit_test, audit_sends_monitor_message_when_commit_conflict)
 
     EXPECT_TRUE(error_reported);
 }
+
+TEST_F(audit_test, audit_aggregates_stats_until_flushed)
+{
+    std::vector<std::string> packets;
+
+    EXPECT_CALL(*(this->socket), async_send_to(_,_,_)).WillRepeatedly(Invoke([&](
+         const boost::asio::const_buffer& msg,
+         boost::asio::ip::udp::endpoint /*ep*/,
+         std::function<void(const boost::system::error_code&, size_t)> /*handler*/)
+             {
+                 packets.emplace_back(boost::asio::buffer_cast<const char*>(msg), msg.size());
+             }
+    ));
+
+    this->use_monitor();
+    this->build_audit();
+
+    // one notification per peer per committed operation...
+    for (uint64_t sequence = 1; sequence <= 4; ++sequence)
+    {
+        pbft_commit_notification commit;
+        commit.set_sequence_number(sequence);
+        commit.set_operation("operation " + std::to_string(sequence));
+
+        for (size_t peer = 0; peer < 3; ++peer)
+        {
+            this->audit->handle_pbft_commit(commit);
+        }
+    }
+
+    this->audit->handle_failure_detected(failure_detected());
+    this->audit->record_timer("pbft.stats.commit_time", std::chrono::milliseconds(12));
+    this->audit->record_histogram("pbft.stats.batch_size", 7);
+
+    EXPECT_TRUE(packets.empty());
+
+    this->stats_flush_timer_callback(boost::system::error_code());
+
+    ASSERT_EQ(packets.size(), 1u);
+    EXPECT_EQ(packets[0], bzn::PBFT_COMMIT_METRIC_NAME + ":12|c\n"
+                        + bzn::FAILURE_DETECTED_METRIC_NAME + ":1|c\n"
+                        + "pbft.stats.commit_time:12|ms\n"
+                        + "pbft.stats.batch_size:7|h");
+
+    // nothing new, nothing sent...
+    this->stats_flush_timer_callback(boost::system::error_code());
+    EXPECT_EQ(packets.size(), 1u);
+}
+
+TEST_F(audit_test, audit_splits_large_flushes_into_owned_packets)
+{
+    std::vector<std::pair<boost::asio::const_buffer, std::function<void(const boost::system::error_code&, size_t)>>> sends;
+
+    EXPECT_CALL(*(this->socket), async_send_to(_,_,_)).WillRepeatedly(Invoke([&](
+         const boost::asio::const_buffer& msg,
+         boost::asio::ip::udp::endpoint /*ep*/,
+         std::function<void(const boost::system::error_code&, size_t)> handler)
+             {
+                 sends.emplace_back(msg, handler);
+             }
+    ));
+
+    this->use_monitor();
+    this->build_audit();
+
+    const std::string metric_name(100, 'm');
+
+    for (size_t i = 0; i < 100; ++i)
+    {
+        this->audit->record_timer(metric_name, std::chrono::milliseconds(i));
+    }
+
+    this->stats_flush_timer_callback(boost::system::error_code());
+
+    ASSERT_GT(sends.size(), 1u);
+
+    // buffers stay valid until their send completes, however long after the flush that is...
+    size_t samples = 0;
+
+    for (const auto& [buffer, handler] : sends)
+    {
+        const std::string packet(boost::asio::buffer_cast<const char*>(buffer), buffer.size());
+
+        EXPECT_LE(packet.size(), 1432u);
+        EXPECT_EQ(packet.find(metric_name), 0u);
+        samples += std::count(packet.begin(), packet.end(), '\n') + 1;
+
+        handler(boost::system::error_code(), buffer.size());
+    }
+
+    EXPECT_EQ(samples, 100u);
+}
+
+TEST_F(audit_test, audit_collects_nothing_without_a_monitor)
+{
+    EXPECT_CALL(*(this->socket), async_send_to(_,_,_)).Times(0);
+    EXPECT_CALL(*(this->stats_flush_timer), async_wait(_)).Times(0);
+
+    this->build_audit();
+
+    this->audit->handle_failure_detected(failure_detected());
+    this->audit->record_timer("pbft.stats.commit_time", std::chrono::milliseconds(12));
+}
@@ -0,0 +1,123 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <crud/subscription_manager.hpp>
+#include <simulator/sim_io_context.hpp>
+#include <benchmark/benchmark.h>
+
+namespace
+{
+    const bzn::uuid_t DB_UUID{"bench-db"};
+    const bzn::key_t KEY{"key"};
+
+
+    // a connected client that just counts what it is sent...
+    class counting_session final : public bzn::session_base
+    {
+    public:
+        explicit counting_session(bzn::session_id id)
+            : id(id)
+        {
+        }
+
+        void start(bzn::message_handler /*handler*/, bzn::protobuf_handler /*proto_handler*/) override
+        {
+        }
+
+        void send_message(std::shared_ptr<bzn::json_message> /*msg*/, bool /*end_session*/) override
+        {
+        }
+
+        void send_message(std::shared_ptr<bzn::encoded_message> /*msg*/, bool /*end_session*/) override
+        {
+        }
+
+        void send_datagram(std::shared_ptr<bzn::encoded_message> /*msg*/) override
+        {
+            ++this->datagrams;
+        }
+
+        void close() override
+        {
+        }
+
+        bool is_open() const override
+        {
+            return true;
+        }
+
+        bzn::session_id get_session_id() override
+        {
+            return this->id;
+        }
+
+        size_t datagrams = 0;
+
+    private:
+        const bzn::session_id id;
+    };
+
+
+    // subscription_manager runs on a simulated io_context, so its coalescing timer fires as soon as the
+    // scheduler is drained instead of after a wall clock wait that would swamp the measurement
+    void
+    subscription_manager_inspect_commit(benchmark::State& state, bool prefix)
+    {
+        auto scheduler = std::make_shared<bzn::sim::scheduler>();
+        auto manager = std::make_shared<bzn::subscription_manager>(std::make_shared<bzn::sim::io_context>(scheduler));
+
+        std::vector<std::shared_ptr<counting_session>> sessions;
+        for (int64_t i = 0; i < state.range(0); ++i)
+        {
+            auto session = std::make_shared<counting_session>(i);
+            database_response response;
+
+            if (prefix)
+            {
+                manager->subscribe_prefix(DB_UUID, KEY.substr(0, 1), 1, response, session);
+            }
+            else
+            {
+                manager->subscribe(DB_UUID, KEY, 1, response, session);
+            }
+
+            sessions.emplace_back(std::move(session));
+        }
+
+        database_msg msg;
+        msg.mutable_header()->set_db_uuid(DB_UUID);
+        msg.mutable_update()->set_key(KEY);
+        msg.mutable_update()->set_value(std::string(64, 'x'));
+
+        for (auto _ : state)
+        {
+            manager->inspect_commit(msg);
+
+            while (scheduler->run_one())
+            {
+            }
+        }
+
+        if (sessions.front()->datagrams != size_t(state.iterations()))
+        {
+            state.SkipWithError("subscribers were not notified of every commit");
+        }
+
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+}
+
+BENCHMARK_CAPTURE(subscription_manager_inspect_commit, key, false)->Arg(1)->Arg(100)->Arg(10000);
+BENCHMARK_CAPTURE(subscription_manager_inspect_commit, prefix, true)->Arg(1)->Arg(100)->Arg(10000);
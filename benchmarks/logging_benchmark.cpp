@@ -0,0 +1,153 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <include/bluzelle.hpp>
+#include <proto/bluzelle.pb.h>
+#include <benchmark/benchmark.h>
+#include <boost/filesystem.hpp>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/bounded_fifo_queue.hpp>
+#include <boost/log/sinks/drop_on_overflow.hpp>
+#include <boost/log/sinks/sync_frontend.hpp>
+#include <boost/log/sinks/text_file_backend.hpp>
+#include <boost/log/sinks/text_ostream_backend.hpp>
+#include <boost/core/null_deleter.hpp>
+#include <ostream>
+#include <streambuf>
+
+namespace
+{
+    // same queue as the one swarm installs in init_logging
+    const size_t LOG_QUEUE_CAPACITY = 16384;
+
+    using log_queue_t = boost::log::sinks::bounded_fifo_queue<LOG_QUEUE_CAPACITY, boost::log::sinks::drop_on_overflow>;
+
+
+    bzn_envelope
+    make_envelope()
+    {
+        database_msg msg;
+        msg.mutable_header()->set_db_uuid("bench-db");
+        msg.mutable_header()->set_nonce(42);
+        msg.mutable_create()->set_key("key");
+        msg.mutable_create()->set_value(std::string(64, 'x'));
+
+        bzn_envelope env;
+        env.set_sender("bench-sender");
+        env.set_database_msg(msg.SerializeAsString());
+
+        return env;
+    }
+
+
+    // formatted records are thrown away, so only the cost of producing them is measured
+    class discarding_buffer : public std::streambuf
+    {
+    protected:
+        std::streamsize xsputn(const char* /*s*/, std::streamsize count) override
+        {
+            return count;
+        }
+
+        int_type overflow(int_type ch) override
+        {
+            return traits_type::not_eof(ch);
+        }
+    };
+
+
+    // installs a sink for the duration of a benchmark, with LOG passing everything at or above threshold
+    template <typename Sink>
+    class scoped_sink
+    {
+    public:
+        scoped_sink(boost::shared_ptr<Sink> sink, boost::log::trivial::severity_level threshold)
+            : sink(std::move(sink))
+            , previous_threshold(bzn::utils::log_threshold.exchange(threshold))
+        {
+            this->sink->set_formatter(boost::log::expressions::stream << boost::log::trivial::severity << " " << boost::log::expressions::smessage);
+            boost::log::core::get()->add_sink(this->sink);
+        }
+
+        ~scoped_sink()
+        {
+            boost::log::core::get()->remove_sink(this->sink);
+            this->sink->flush();
+            bzn::utils::log_threshold = this->previous_threshold;
+        }
+
+    private:
+        const boost::shared_ptr<Sink> sink;
+        const boost::log::trivial::severity_level previous_threshold;
+    };
+
+
+    // cost of a LOG line at the calling thread: Arg(0) is below the threshold, Arg(1) is written
+    void
+    log_debug_message(benchmark::State& state)
+    {
+        discarding_buffer buffer;
+        std::ostream output(&buffer);
+
+        auto backend = boost::make_shared<boost::log::sinks::text_ostream_backend>();
+        backend->add_stream(boost::shared_ptr<std::ostream>(&output, boost::null_deleter()));
+
+        scoped_sink sink(boost::make_shared<boost::log::sinks::synchronous_sink<boost::log::sinks::text_ostream_backend>>(backend)
+            , state.range(0) ? boost::log::trivial::debug : boost::log::trivial::info);
+
+        const auto env = make_envelope();
+
+        for (auto _ : state)
+        {
+            LOG(debug) << "Received message: " << env.ShortDebugString().substr(0, MAX_MESSAGE_SIZE);
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+
+
+    // caller side cost of an info record going to the auto-flushing log file, written synchronously or by a sink thread
+    template <typename Sink>
+    void
+    log_to_file(benchmark::State& state)
+    {
+        const auto dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+        boost::filesystem::create_directories(dir);
+
+        {
+            auto backend = boost::make_shared<boost::log::sinks::text_file_backend>(
+                boost::log::keywords::file_name = (dir / "bench-%5N.log").string(),
+                boost::log::keywords::auto_flush = true);
+
+            scoped_sink sink(boost::make_shared<Sink>(backend), boost::log::trivial::info);
+
+            const auto env = make_envelope();
+
+            for (auto _ : state)
+            {
+                LOG(info) << "Executing request " << env.ShortDebugString().substr(0, MAX_MESSAGE_SIZE);
+            }
+
+            state.SetItemsProcessed(state.iterations());
+        }
+
+        boost::filesystem::remove_all(dir);
+    }
+}
+
+BENCHMARK(log_debug_message)->ArgName("enabled")->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(log_to_file, boost::log::sinks::synchronous_sink<boost::log::sinks::text_file_backend>);
+BENCHMARK_TEMPLATE(log_to_file, boost::log::sinks::asynchronous_sink<boost::log::sinks::text_file_backend, log_queue_t>);
@@ -0,0 +1,50 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <options/cached_option.hpp>
+#include <options/options.hpp>
+#include <benchmark/benchmark.h>
+
+namespace
+{
+    // the lookup chaos and crypto used to make for every message...
+    void
+    simple_options_get(benchmark::State& state)
+    {
+        bzn::options options;
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(options.get_simple_options().get<double>(bzn::option_names::CHAOS_MESSAGE_DROP_CHANCE));
+        }
+    }
+
+
+    // ...and what they make now
+    void
+    cached_option_get(benchmark::State& state)
+    {
+        bzn::options options;
+        bzn::cached_option<double> drop_chance(options.get_simple_options(), bzn::option_names::CHAOS_MESSAGE_DROP_CHANCE);
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(drop_chance.get());
+        }
+    }
+}
+
+BENCHMARK(simple_options_get);
+BENCHMARK(cached_option_get);
@@ -0,0 +1,128 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <pbft/operations/pbft_memory_operation.hpp>
+#include <pbft/operations/pbft_persistent_operation.hpp>
+#include <storage/mem_storage.hpp>
+#include <proto/bluzelle.pb.h>
+#include <benchmark/benchmark.h>
+
+namespace
+{
+    const uint64_t VIEW{1};
+    const bzn::hash_t REQUEST_HASH{"request-hash"};
+
+
+    std::shared_ptr<const std::vector<bzn::peer_address_t>>
+    make_peers(size_t count)
+    {
+        auto peers = std::make_shared<std::vector<bzn::peer_address_t>>();
+        for (size_t i = 0; i < count; ++i)
+        {
+            peers->emplace_back("127.0.0.1", 8080 + i, 9080 + i, "name" + std::to_string(i), "uuid" + std::to_string(i));
+        }
+        return peers;
+    }
+
+
+    // the messages one replica sees while an operation goes from preprepare to committed...
+    struct operation_traffic
+    {
+        explicit operation_traffic(const std::vector<bzn::peer_address_t>& peers)
+        {
+            database_msg db_msg;
+            db_msg.mutable_header()->set_db_uuid("bench-db");
+            db_msg.mutable_create()->set_key("key");
+            db_msg.mutable_create()->set_value("value");
+            this->request.set_database_msg(db_msg.SerializeAsString());
+
+            this->preprepare.set_type(PBFT_MSG_PREPREPARE);
+            this->prepare.set_type(PBFT_MSG_PREPARE);
+            this->commit.set_type(PBFT_MSG_COMMIT);
+
+            for (const auto& peer : peers)
+            {
+                bzn_envelope env;
+                env.set_sender(peer.uuid);
+                this->senders.push_back(env);
+            }
+        }
+
+        bzn_envelope request;
+        pbft_msg preprepare;
+        pbft_msg prepare;
+        pbft_msg commit;
+        std::vector<bzn_envelope> senders;
+    };
+
+
+    // feed every prepare and commit through the operation, checking for quorum after each as pbft does
+    void
+    run_operation(bzn::pbft_operation& op, const operation_traffic& traffic)
+    {
+        op.record_request(traffic.request);
+        op.record_pbft_msg(traffic.preprepare, traffic.senders.front());
+
+        for (const auto& sender : traffic.senders)
+        {
+            op.record_pbft_msg(traffic.prepare, sender);
+            benchmark::DoNotOptimize(op.is_prepared());
+        }
+
+        for (const auto& sender : traffic.senders)
+        {
+            op.record_pbft_msg(traffic.commit, sender);
+            benchmark::DoNotOptimize(op.is_committed());
+        }
+    }
+
+
+    void
+    pbft_memory_operation_quorum(benchmark::State& state)
+    {
+        const auto peers = make_peers(state.range(0));
+        const operation_traffic traffic(*peers);
+        uint64_t sequence = 0;
+
+        for (auto _ : state)
+        {
+            bzn::pbft_memory_operation op(VIEW, ++sequence, REQUEST_HASH, peers);
+            run_operation(op, traffic);
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+
+
+    void
+    pbft_persistent_operation_quorum(benchmark::State& state)
+    {
+        const auto peers = make_peers(state.range(0));
+        const operation_traffic traffic(*peers);
+        auto storage = std::make_shared<bzn::mem_storage>();
+        uint64_t sequence = 0;
+
+        for (auto _ : state)
+        {
+            bzn::pbft_persistent_operation op(VIEW, ++sequence, REQUEST_HASH, storage, peers->size());
+            run_operation(op, traffic);
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+}
+
+BENCHMARK(pbft_memory_operation_quorum)->Arg(4)->Arg(16)->Arg(64);
+BENCHMARK(pbft_persistent_operation_quorum)->Arg(4)->Arg(16)->Arg(64);
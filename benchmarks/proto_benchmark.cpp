@@ -0,0 +1,90 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <proto/bluzelle.pb.h>
+#include <benchmark/benchmark.h>
+
+namespace
+{
+    // a signed client write wrapped for the wire, the most common message a node parses...
+    bzn_envelope
+    make_envelope(size_t value_size)
+    {
+        database_msg msg;
+        msg.mutable_header()->set_db_uuid("bench-db");
+        msg.mutable_header()->set_nonce(42);
+        msg.mutable_create()->set_key("key");
+        msg.mutable_create()->set_value(std::string(value_size, 'x'));
+
+        bzn_envelope env;
+        env.set_sender(std::string(120, 's'));
+        env.set_signature(std::string(72, 'g'));
+        env.set_timestamp(1234567890);
+        env.set_database_msg(msg.SerializeAsString());
+        return env;
+    }
+
+
+    void
+    envelope_serialize(benchmark::State& state)
+    {
+        const auto env = make_envelope(state.range(0));
+        std::string buffer;
+
+        for (auto _ : state)
+        {
+            env.SerializeToString(&buffer);
+            benchmark::DoNotOptimize(buffer.data());
+        }
+
+        state.SetBytesProcessed(state.iterations() * buffer.size());
+    }
+
+
+    void
+    envelope_parse(benchmark::State& state)
+    {
+        const auto wire = make_envelope(state.range(0)).SerializeAsString();
+        bzn_envelope env;
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(env.ParseFromString(wire));
+        }
+
+        state.SetBytesProcessed(state.iterations() * wire.size());
+    }
+
+
+    // parsing the envelope and then the database request it carries, as the crud path does...
+    void
+    envelope_parse_database_msg(benchmark::State& state)
+    {
+        const auto wire = make_envelope(state.range(0)).SerializeAsString();
+        bzn_envelope env;
+        database_msg msg;
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(env.ParseFromString(wire) && msg.ParseFromString(env.database_msg()));
+        }
+
+        state.SetBytesProcessed(state.iterations() * wire.size());
+    }
+}
+
+BENCHMARK(envelope_serialize)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK(envelope_parse)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK(envelope_parse_database_msg)->Arg(64)->Arg(1024)->Arg(16384);
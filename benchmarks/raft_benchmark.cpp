@@ -0,0 +1,262 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <raft/raft.hpp>
+#include <raft/raft_log.hpp>
+#include <raft/raft_proto.hpp>
+#include <proto/bluzelle.pb.h>
+#include <benchmark/benchmark.h>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <optional>
+
+namespace
+{
+    // a client write as raft stores it: the database request base64 encoded inside a json envelope...
+    bzn::json_message
+    make_database_entry(uint32_t n)
+    {
+        database_msg msg;
+        msg.mutable_header()->set_db_uuid("bench-db");
+        msg.mutable_header()->set_nonce(n);
+        msg.mutable_create()->set_key("key" + std::to_string(n));
+        msg.mutable_create()->set_value(std::string(100, 'x'));
+
+        bzn::json_message entry;
+        entry["bzn-api"] = "database";
+        entry["msg"] = boost::beast::detail::base64_encode(msg.SerializeAsString());
+        return entry;
+    }
+
+
+    std::string
+    temp_log_path()
+    {
+        return (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    }
+
+
+    std::vector<bzn::log_entry>
+    make_log_entries(size_t count)
+    {
+        bzn::json_message quorum;
+        quorum["msg"]["peers"].append("uuid1");
+
+        std::vector<bzn::log_entry> entries{bzn::log_entry{bzn::log_entry_type::single_quorum, 0, 0, quorum}};
+        for (uint32_t i = 1; i < uint32_t(count); ++i)
+        {
+            entries.push_back(bzn::log_entry{bzn::log_entry_type::database, i, 1, make_database_entry(i)});
+        }
+        return entries;
+    }
+
+
+    // every AppendEntries response, vote and membership check starts by finding the quorum in force; with it at the
+    // start of the log this used to be a scan of the whole log
+    void
+    raft_log_last_quorum_entry(benchmark::State& state)
+    {
+        const auto log_path = temp_log_path();
+
+        if (!bzn::raft_log::write_entries(log_path, make_log_entries(state.range(0))))
+        {
+            state.SkipWithError("failed to write raft log");
+            return;
+        }
+
+        {
+            bzn::raft_log log(log_path);
+
+            for (auto _ : state)
+            {
+                benchmark::DoNotOptimize(log.last_quorum_entry().log_index);
+            }
+        }
+
+        boost::filesystem::remove(log_path);
+
+        state.SetItemsProcessed(state.iterations());
+    }
+
+
+    // a follower that only holds the quorum entry catching up on the leader's whole log, one serialized
+    // AppendEntries batch at a time, the way raft::send_append_entries and handle_request_append_entries do it
+    void
+    raft_follower_catch_up(benchmark::State& state)
+    {
+        const auto leader_path = temp_log_path();
+        const auto follower_path = temp_log_path();
+        const auto entries = make_log_entries(state.range(0));
+
+        if (!bzn::raft_log::write_entries(leader_path, entries))
+        {
+            state.SkipWithError("failed to write raft log");
+            return;
+        }
+
+        bzn::raft_log leader(leader_path);
+        size_t requests = 0;
+
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            boost::filesystem::remove(follower_path);
+            if (!bzn::raft_log::write_entries(follower_path, {entries.front()}))
+            {
+                state.SkipWithError("failed to write raft log");
+                break;
+            }
+            bzn::raft_log follower(follower_path);
+            state.ResumeTiming();
+
+            while (follower.size() < leader.size())
+            {
+                const size_t next_index = follower.size();
+                const size_t end_index = std::min(leader.size(), next_index + bzn::MAX_APPEND_ENTRIES_BATCH_SIZE);
+
+                auto req = bzn::create_raft_append_entries("uuid1", 1, 0, next_index - 1, leader.entry_at(next_index - 1).term);
+                for (size_t i = next_index; i < end_index; ++i)
+                {
+                    bzn::log_entry_to_proto(leader.entry_at(i), *req.mutable_append_entries()->add_entries());
+                }
+
+                raft_msg received;
+                received.ParseFromString(req.SerializeAsString());
+                ++requests;
+
+                const auto& append_entries = received.append_entries();
+                if (!follower.entry_accepted(append_entries.prev_index(), append_entries.prev_term()))
+                {
+                    state.SkipWithError("follower rejected a batch");
+                    break;
+                }
+
+                for (int i = 0; i < append_entries.entries_size(); ++i)
+                {
+                    const uint32_t index = append_entries.prev_index() + 1 + i;
+                    follower.follower_insert_entry(index, bzn::proto_to_log_entry(append_entries.entries(i), index));
+                }
+                follower.sync();
+            }
+        }
+
+        boost::filesystem::remove(leader_path);
+        boost::filesystem::remove(follower_path);
+
+        state.SetItemsProcessed(state.iterations() * (state.range(0) - 1));
+        state.counters["requests"] = benchmark::Counter(requests, benchmark::Counter::kAvgIterations);
+    }
+
+
+    // a follower replacing the last few entries of its log with a new leader's, which should cost the same
+    // however long the log is as only the conflicting suffix is rewritten
+    void
+    raft_log_follower_conflict(benchmark::State& state)
+    {
+        const size_t REPLACED = 5;
+        const auto log_path = temp_log_path();
+        const auto entries = make_log_entries(state.range(0));
+
+        // kept outside the loop so closing it isn't timed either
+        std::optional<bzn::raft_log> log;
+
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            log.reset();
+            if (!bzn::raft_log::write_entries(log_path, entries))
+            {
+                state.SkipWithError("failed to write raft log");
+                break;
+            }
+            log.emplace(log_path);
+            state.ResumeTiming();
+
+            for (uint32_t i = uint32_t(entries.size() - REPLACED); i < entries.size(); ++i)
+            {
+                log->follower_insert_entry(i, bzn::log_entry{bzn::log_entry_type::database, i, 2, make_database_entry(i)});
+            }
+            log->sync();
+        }
+
+        log.reset();
+        boost::filesystem::remove(log_path);
+
+        state.SetItemsProcessed(state.iterations() * REPLACED);
+    }
+
+
+    // time to open a log of the given length, which is what a restarting node pays before it can rejoin
+    void
+    raft_log_load(benchmark::State& state)
+    {
+        const auto log_path = temp_log_path();
+
+        if (!bzn::raft_log::write_entries(log_path, make_log_entries(state.range(0))))
+        {
+            state.SkipWithError("failed to write raft log");
+            return;
+        }
+
+        for (auto _ : state)
+        {
+            bzn::raft_log log(log_path);
+            benchmark::DoNotOptimize(log.size());
+        }
+
+        state.counters["file_bytes"] = boost::filesystem::file_size(log_path);
+        boost::filesystem::remove(log_path);
+
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+
+    // the same for a log still in the old text format, which is what raft_log_load is measured against
+    void
+    raft_log_load_legacy(benchmark::State& state)
+    {
+        const auto log_path = temp_log_path();
+        {
+            std::ofstream out(log_path, std::ios::out | std::ios::binary);
+            for (const auto& entry : make_log_entries(state.range(0)))
+            {
+                out << entry;
+            }
+        }
+
+        for (auto _ : state)
+        {
+            std::ifstream in(log_path, std::ios::in | std::ios::binary);
+            std::vector<bzn::log_entry> entries;
+            bzn::log_entry entry;
+            while (in >> entry)
+            {
+                entries.emplace_back(entry);
+            }
+            benchmark::DoNotOptimize(entries.size());
+        }
+
+        state.counters["file_bytes"] = boost::filesystem::file_size(log_path);
+        boost::filesystem::remove(log_path);
+
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+}
+
+BENCHMARK(raft_log_load)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+BENCHMARK(raft_log_load_legacy)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+BENCHMARK(raft_follower_catch_up)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond);
+BENCHMARK(raft_log_last_quorum_entry)->Arg(1000)->Arg(100000);
+BENCHMARK(raft_log_follower_conflict)->Arg(1000)->Arg(20000)->Unit(benchmark::kMicrosecond);
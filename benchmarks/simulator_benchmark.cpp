@@ -0,0 +1,128 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <simulator/sim_swarm.hpp>
+#include <benchmark/benchmark.h>
+#include <chrono>
+
+namespace
+{
+    const uint64_t SEED{1};
+    const size_t REQUESTS_PER_BATCH{10};
+    const std::chrono::seconds VIRTUAL_TIMEOUT{120};
+
+
+    double
+    to_seconds(bzn::sim::virtual_duration duration)
+    {
+        return std::chrono::duration<double>(duration).count();
+    }
+
+
+    // crashed primaries and view changes are what we are measuring, so don't log them for every replica
+    class quiet_logs
+    {
+    public:
+        quiet_logs()
+            : previous(bzn::utils::log_threshold.exchange(boost::log::trivial::fatal))
+        {
+        }
+
+        ~quiet_logs()
+        {
+            bzn::utils::log_threshold = this->previous;
+        }
+
+    private:
+        const boost::log::trivial::severity_level previous;
+    };
+
+
+    // how many requests the whole swarm gets through per second of (simulated) network time as it grows
+    void
+    simulator_swarm_throughput(benchmark::State& state)
+    {
+        quiet_logs quiet;
+        bzn::sim::swarm swarm(state.range(0), SEED);
+        swarm.start();
+
+        if (!swarm.primary())
+        {
+            state.SkipWithError("swarm has no primary");
+            return;
+        }
+
+        const size_t primary = *swarm.primary();
+        const auto start = swarm.get_scheduler().now();
+        const auto messages_before = swarm.get_network().messages_sent();
+
+        for (auto _ : state)
+        {
+            const uint64_t target = swarm.min_executed() + REQUESTS_PER_BATCH;
+            for (size_t i = 0; i < REQUESTS_PER_BATCH; i++)
+            {
+                swarm.submit(primary);
+            }
+
+            if (!swarm.run_until([&]{ return swarm.min_executed() >= target; }, VIRTUAL_TIMEOUT))
+            {
+                state.SkipWithError("requests were not executed by every replica");
+                return;
+            }
+        }
+
+        const double ops = state.iterations() * REQUESTS_PER_BATCH;
+        state.counters["ops_per_virtual_second"] = ops / to_seconds(swarm.get_scheduler().now() - start);
+        state.counters["messages_per_op"] = (swarm.get_network().messages_sent() - messages_before) / ops;
+        state.SetItemsProcessed(ops);
+    }
+
+
+    // virtual time from the primary crashing to every live replica being in the new view
+    void
+    simulator_swarm_view_change(benchmark::State& state)
+    {
+        quiet_logs quiet;
+        double total_latency = 0;
+
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            bzn::sim::swarm swarm(state.range(0), SEED);
+            swarm.start();
+
+            const size_t old_primary = swarm.primary().value_or(0);
+            const uint64_t old_view = swarm.min_view();
+            swarm.crash(old_primary);
+            state.ResumeTiming();
+
+            // the backups only notice the primary is gone once a request they were handed doesn't execute
+            const auto crashed_at = swarm.get_scheduler().now();
+            swarm.submit_to_all();
+
+            if (!swarm.run_until([&]{ return swarm.min_view() > old_view; }, VIRTUAL_TIMEOUT))
+            {
+                state.SkipWithError("view change did not complete");
+                return;
+            }
+
+            total_latency += to_seconds(swarm.get_scheduler().now() - crashed_at);
+        }
+
+        state.counters["view_change_virtual_ms"] = benchmark::Counter(total_latency * 1000, benchmark::Counter::kAvgIterations);
+    }
+}
+
+BENCHMARK(simulator_swarm_throughput)->Arg(4)->Arg(16)->Arg(49)->Arg(100)->Unit(benchmark::kMillisecond);
+BENCHMARK(simulator_swarm_view_change)->Arg(4)->Arg(16)->Arg(49)->Arg(100)->Unit(benchmark::kMillisecond);
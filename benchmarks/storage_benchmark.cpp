@@ -0,0 +1,177 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <storage/mem_storage.hpp>
+#include <storage/rocksdb_storage.hpp>
+#include <benchmark/benchmark.h>
+#include <boost/filesystem.hpp>
+
+namespace
+{
+    const bzn::uuid_t NODE_UUID{"d1e04722-41f0-4c43-a6c0-86a9e62a88e3"};
+    const bzn::uuid_t USER_UUID{"4bba2aeb-44fe-441e-bb6b-8817561eb716"};
+    const size_t PRELOADED_KEYS{1000};
+
+
+    // a fresh, empty storage for one benchmark run, removed from disk again when it ends...
+    template<typename T>
+    class scoped_storage
+    {
+    public:
+        scoped_storage()
+            : state_dir(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+            , storage(create())
+        {
+        }
+
+        ~scoped_storage()
+        {
+            this->storage.reset();
+            boost::filesystem::remove_all(this->state_dir);
+        }
+
+        bzn::storage_base* operator->() const
+        {
+            return this->storage.get();
+        }
+
+    private:
+        std::shared_ptr<bzn::storage_base> create();
+
+        const boost::filesystem::path state_dir;
+        std::shared_ptr<bzn::storage_base> storage;
+    };
+
+
+    template<>
+    std::shared_ptr<bzn::storage_base>
+    scoped_storage<bzn::mem_storage>::create()
+    {
+        return std::make_shared<bzn::mem_storage>();
+    }
+
+
+    template<>
+    std::shared_ptr<bzn::storage_base>
+    scoped_storage<bzn::rocksdb_storage>::create()
+    {
+        return std::make_shared<bzn::rocksdb_storage>(this->state_dir.string(), "bench", NODE_UUID);
+    }
+
+
+    std::string
+    make_key(size_t n)
+    {
+        return "key" + std::to_string(n);
+    }
+
+
+    template<typename T>
+    void
+    preload(scoped_storage<T>& storage, size_t first, size_t count, const std::string& value)
+    {
+        for (size_t i = first; i < first + count; ++i)
+        {
+            storage->create(USER_UUID, make_key(i), value);
+        }
+    }
+
+
+    template<typename T>
+    void
+    storage_create(benchmark::State& state)
+    {
+        scoped_storage<T> storage;
+        const std::string value(state.range(0), 'x');
+        size_t next_key = 0;
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(storage->create(USER_UUID, make_key(next_key++), value));
+        }
+
+        state.SetBytesProcessed(state.iterations() * state.range(0));
+    }
+
+
+    template<typename T>
+    void
+    storage_read(benchmark::State& state)
+    {
+        scoped_storage<T> storage;
+        preload(storage, 0, PRELOADED_KEYS, std::string(state.range(0), 'x'));
+        size_t next_key = 0;
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(storage->read(USER_UUID, make_key(next_key++ % PRELOADED_KEYS)));
+        }
+
+        state.SetBytesProcessed(state.iterations() * state.range(0));
+    }
+
+
+    template<typename T>
+    void
+    storage_update(benchmark::State& state)
+    {
+        scoped_storage<T> storage;
+        const std::string value(state.range(0), 'y');
+        preload(storage, 0, PRELOADED_KEYS, std::string(state.range(0), 'x'));
+        size_t next_key = 0;
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(storage->update(USER_UUID, make_key(next_key++ % PRELOADED_KEYS), value));
+        }
+
+        state.SetBytesProcessed(state.iterations() * state.range(0));
+    }
+
+
+    template<typename T>
+    void
+    storage_remove(benchmark::State& state)
+    {
+        scoped_storage<T> storage;
+        const std::string value(state.range(0), 'x');
+        size_t next_key = 0;
+        size_t loaded_keys = 0;
+
+        for (auto _ : state)
+        {
+            // refill in batches so the pauses don't swamp what is being measured...
+            if (next_key == loaded_keys)
+            {
+                state.PauseTiming();
+                preload(storage, loaded_keys, PRELOADED_KEYS, value);
+                loaded_keys += PRELOADED_KEYS;
+                state.ResumeTiming();
+            }
+
+            benchmark::DoNotOptimize(storage->remove(USER_UUID, make_key(next_key++)));
+        }
+    }
+}
+
+BENCHMARK_TEMPLATE(storage_create, bzn::mem_storage)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK_TEMPLATE(storage_read, bzn::mem_storage)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK_TEMPLATE(storage_update, bzn::mem_storage)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK_TEMPLATE(storage_remove, bzn::mem_storage)->Arg(64)->Arg(1024)->Arg(16384);
+
+BENCHMARK_TEMPLATE(storage_create, bzn::rocksdb_storage)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK_TEMPLATE(storage_read, bzn::rocksdb_storage)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK_TEMPLATE(storage_update, bzn::rocksdb_storage)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK_TEMPLATE(storage_remove, bzn::rocksdb_storage)->Arg(64)->Arg(1024)->Arg(16384);
@@ -16,6 +16,7 @@
 #include <utils/crypto.hpp>
 #include <utils/http_get.hpp>
 #include <bootstrap/bootstrap_peers.hpp>
+#include <cstdio>
 #include <fstream>
 #include <json/json.h>
 
@@ -40,14 +41,57 @@ bool bootstrap_peers::fetch_peers_from_file(const std::string& filename)
 bool 
 bootstrap_peers::fetch_peers_from_url(const std::string& url)
 {
-    std::string peers = bzn::utils::http::sync_get(url);
+    std::string peers;
+
+    try
+    {
+        peers = bzn::utils::http::sync_get(url);
+    }
+    catch (const std::exception& e)
+    {
+        if (this->url_cache_file.empty())
+        {
+            throw;
+        }
+
+        LOG(warning) << "Failed to download peer list from " << url << " (" << e.what() << "), using last known peers";
+
+        return this->fetch_peers_from_file(this->url_cache_file);
+    }
 
     LOG(info) << "Downloaded peer list from " << url;
 
     std::stringstream stream;
     stream << peers;
 
-    return ingest_json(stream);
+    if (!ingest_json(stream))
+    {
+        return !this->url_cache_file.empty() && this->fetch_peers_from_file(this->url_cache_file);
+    }
+
+    if (!this->url_cache_file.empty())
+    {
+        // write a copy and rename it over the cache so a crash mid-write can't leave a truncated peer list behind
+        const std::string temp_file = this->url_cache_file + ".tmp";
+        std::ofstream cache(temp_file, std::ios::trunc);
+        cache << peers;
+        cache.close();
+
+        if (cache.fail() || std::rename(temp_file.c_str(), this->url_cache_file.c_str()) != 0)
+        {
+            LOG(warning) << "Failed to save peer list to " << this->url_cache_file;
+            std::remove(temp_file.c_str());
+        }
+    }
+
+    return true;
+}
+
+
+void
+bootstrap_peers::set_url_cache_file(const std::string& filename)
+{
+    this->url_cache_file = filename;
 }
 
 
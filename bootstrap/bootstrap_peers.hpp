@@ -30,6 +30,12 @@ namespace bzn
 
         bool fetch_peers_from_url(const std::string& url) override;
 
+        /*
+         * Keep the last peer list downloaded by fetch_peers_from_url in this file, and read peers from it
+         * whenever the download fails or times out
+         */
+        void set_url_cache_file(const std::string& filename);
+
         const bzn::peers_list_t& get_peers() const override;
 
     private:
@@ -42,6 +48,8 @@ namespace bzn
         bool is_peer_validation_enabled() { return this->peer_validation_enabled; }
 
         bool peer_validation_enabled{false};
+
+        std::string url_cache_file;
     };
 
 } // namespace bzn
@@ -132,6 +132,24 @@ TEST_F(bootstrap_file_test, test_duplicate_peers)
 }
 
 
+TEST_F(bootstrap_file_test, test_failed_download_falls_back_to_cached_peers)
+{
+    set_peers_data(valid_peers);
+    bootstrap_peers.set_url_cache_file(test_peers_filename);
+
+    // nothing listens for http on the loopback address here, so the download fails straight away...
+    ASSERT_TRUE(bootstrap_peers.fetch_peers_from_url("127.0.0.1/peers.json"));
+    ASSERT_EQ(bootstrap_peers.get_peers().size(), 2U);
+}
+
+
+TEST(bootstrap_net_test, test_failed_download_without_cache_throws)
+{
+    bzn::bootstrap_peers bootstrap_peers;
+    ASSERT_THROW(bootstrap_peers.fetch_peers_from_url("127.0.0.1/peers.json"), std::exception);
+}
+
+
 TEST(bootstrap_net_test, DISABLED_test_fetch_data)
 {
     bzn::bootstrap_peers bootstrap_peers;
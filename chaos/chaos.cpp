@@ -25,6 +25,10 @@ using namespace bzn::option_names;
 chaos::chaos(std::shared_ptr<bzn::asio::io_context_base> io_context, std::shared_ptr<bzn::options_base> options)
         : io_context(std::move(io_context))
         , options(std::move(options))
+        , chaos_enabled(this->options->get_simple_options(), CHAOS_ENABLED)
+        , message_delay_chance(this->options->get_simple_options(), CHAOS_MESSAGE_DELAY_CHANCE)
+        , message_drop_chance(this->options->get_simple_options(), CHAOS_MESSAGE_DROP_CHANCE)
+        , message_delay_time(this->options->get_simple_options(), CHAOS_MESSAGE_DELAY_TIME)
         , crash_timer(this->io_context->make_unique_steady_timer())
 {
     // We don't need cryptographically secure randomness here, but it does need to be of reasonable quality and differ across processes
@@ -79,14 +83,14 @@ chaos::handle_crash_timer(const boost::system::error_code& /*ec*/)
 bool
 chaos::enabled()
 {
-    return this->options->get_simple_options().get<bool>(CHAOS_ENABLED);
+    return this->chaos_enabled.get();
 }
 
 bool
 chaos::is_message_delayed()
 {
     const bool result = this->enabled() &&
-           this->options->get_simple_options().get<double>(CHAOS_MESSAGE_DELAY_CHANCE) > this->random_float(this->random);
+           this->message_delay_chance.get() > this->random_float(this->random);
 
     if (result)
     {
@@ -100,7 +104,7 @@ bool
 chaos::is_message_dropped()
 {
     bool result = this->enabled() &&
-           this->options->get_simple_options().get<double>(CHAOS_MESSAGE_DROP_CHANCE) > this->random_float(this->random);
+           this->message_drop_chance.get() > this->random_float(this->random);
 
     if (result)
     {
@@ -114,7 +118,7 @@ void
 chaos::reschedule_message(chaos_delay_callback callback) const
 {
     std::shared_ptr<bzn::asio::steady_timer_base> timer = this->io_context->make_unique_steady_timer();
-    auto delay = std::chrono::milliseconds(this->options->get_simple_options().get<uint>(CHAOS_MESSAGE_DELAY_TIME));
+    auto delay = std::chrono::milliseconds(this->message_delay_time.get());
 
     timer->expires_from_now(delay);
     timer->async_wait(
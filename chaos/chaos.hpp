@@ -16,6 +16,7 @@
 
 #include <mutex>
 #include <options/options_base.hpp>
+#include <options/cached_option.hpp>
 #include <include/boost_asio_beast.hpp>
 #include <chaos/chaos_base.hpp>
 #include <random>
@@ -46,6 +47,12 @@ namespace bzn
         const std::shared_ptr<bzn::asio::io_context_base> io_context;
         const std::shared_ptr<bzn::options_base> options;
 
+        // consulted for every message sent, so avoid the variables_map lookup each time
+        const bzn::cached_option<bool> chaos_enabled;
+        const bzn::cached_option<double> message_delay_chance;
+        const bzn::cached_option<double> message_drop_chance;
+        const bzn::cached_option<uint> message_delay_time;
+
         std::unique_ptr<bzn::asio::steady_timer_base> crash_timer;
 
         std::mt19937 random;
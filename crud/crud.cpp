@@ -28,7 +28,7 @@ namespace
 
 
 crud::crud(std::shared_ptr<bzn::storage_base> storage, std::shared_ptr<bzn::subscription_manager_base> subscription_manager)
-           : storage(std::move(storage))
+           : storage(std::make_shared<bzn::undoable_storage>(std::move(storage)))
            , subscription_manager(std::move(subscription_manager))
            , message_handlers{
                  {database_msg::kCreate,        std::bind(&crud::handle_create,         this, _1, _2, _3)},
@@ -322,8 +322,16 @@ crud::handle_subscribe(const bzn::caller_id_t& /*caller_id*/, const database_msg
     {
         database_response response;
 
-        this->subscription_manager->subscribe(request.header().db_uuid(), request.subscribe().key(),
-            request.header().nonce(), response, session);
+        if (request.subscribe().prefix())
+        {
+            this->subscription_manager->subscribe_prefix(request.header().db_uuid(), request.subscribe().key(),
+                request.header().nonce(), response, session);
+        }
+        else
+        {
+            this->subscription_manager->subscribe(request.header().db_uuid(), request.subscribe().key(),
+                request.header().nonce(), response, session);
+        }
 
         this->send_response(request, bzn::storage_result::ok, std::move(response), session);
 
@@ -341,8 +349,16 @@ crud::handle_unsubscribe(const bzn::caller_id_t& /*caller_id*/, const database_m
     {
         database_response response;
 
-        this->subscription_manager->unsubscribe(request.header().db_uuid(), request.unsubscribe().key(),
-            request.unsubscribe().nonce(), response, session);
+        if (request.unsubscribe().prefix())
+        {
+            this->subscription_manager->unsubscribe_prefix(request.header().db_uuid(), request.unsubscribe().key(),
+                request.unsubscribe().nonce(), response, session);
+        }
+        else
+        {
+            this->subscription_manager->unsubscribe(request.header().db_uuid(), request.unsubscribe().key(),
+                request.unsubscribe().nonce(), response, session);
+        }
 
         this->send_response(request, bzn::storage_result::ok, std::move(response), session);
 
@@ -673,9 +689,20 @@ crud::remove_writers(const database_msg& request, Json::Value& perms)
 bool
 crud::save_state()
 {
-    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+    {
+        std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
 
-    return this->storage->create_snapshot();
+        if (!this->storage->create_snapshot())
+        {
+            return false;
+        }
+    }
+
+    // serialize the snapshot now, on the thread that saved it, rather than in whichever thread first asks for it
+    // (pbft answers a lagging peer while holding its consensus lock)...
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+
+    return this->storage->get_snapshot() != nullptr;
 }
 
 
@@ -689,9 +716,45 @@ crud::get_saved_state()
 
 
 bool
-crud::load_state(const std::string& state)
+crud::load_state(const std::string& state, const bzn::hash_t& state_hash)
+{
+    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+
+    return this->storage->load_snapshot(state, state_hash);
+}
+
+
+bzn::hash_t
+crud::get_state_hash()
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+
+    return this->storage->get_state_hash();
+}
+
+
+void
+crud::start_undo_log()
+{
+    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+
+    this->storage->start_undo_log();
+}
+
+
+bool
+crud::undo_writes()
+{
+    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+
+    return this->storage->undo_writes();
+}
+
+
+void
+crud::clear_undo_log()
 {
     std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
 
-    return this->storage->load_snapshot(state);
+    this->storage->clear_undo_log();
 }
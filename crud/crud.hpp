@@ -18,7 +18,7 @@
 #include <crud/crud_base.hpp>
 #include <crud/subscription_manager_base.hpp>
 #include <node/node_base.hpp>
-#include <storage/storage_base.hpp>
+#include <storage/undoable_storage.hpp>
 #include <shared_mutex>
 
 
@@ -37,7 +37,15 @@ namespace bzn
 
         std::shared_ptr<std::string> get_saved_state() override;
 
-        bool load_state(const std::string& state) override;
+        bool load_state(const std::string& state, const bzn::hash_t& state_hash) override;
+
+        bzn::hash_t get_state_hash() override;
+
+        void start_undo_log() override;
+
+        bool undo_writes() override;
+
+        void clear_undo_log() override;
 
     private:
 
@@ -87,7 +95,7 @@ namespace bzn
 
         void remove_writers(const database_msg& request, Json::Value& perms);
 
-        std::shared_ptr<bzn::storage_base> storage;
+        std::shared_ptr<bzn::undoable_storage> storage;
         std::shared_ptr<bzn::subscription_manager_base> subscription_manager;
 
         using message_handler_t = std::function<void(const bzn::caller_id_t& caller_id, const database_msg& request, std::shared_ptr<bzn::session_base> session)>;
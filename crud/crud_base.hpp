@@ -32,6 +32,7 @@ namespace bzn
         const std::string MSG_INVALID_ARGUMENTS = "INVALID_ARGUMENTS";
         const std::string MSG_VALUE_SIZE_TOO_LARGE = "VALUE_SIZE_TOO_LARGE";
         const std::string MSG_KEY_SIZE_TOO_LARGE = "KEY_SIZE_TOO_LARGE";
+        const std::string MSG_BATCH_CONFLICT = "BATCH_CONFLICT";
 
         class crud_base
         {
@@ -46,6 +47,15 @@ namespace bzn
 
             virtual void handle_delete(const bzn::json_message& msg, const database_msg& request, database_response& response) = 0;
 
+            /**
+             * Handle several requests at once. Reads are served in a single storage pass and the writes that
+             * validate are appended to the raft log as one entry. A read or write of a key that an earlier
+             * request in the batch writes is rejected with MSG_BATCH_CONFLICT.
+             * @param batch     create, read, update and delete requests
+             * @param responses one response per request, in order
+             */
+            virtual void handle_batch(const database_batch& batch, std::vector<database_response>& responses) = 0;
+
             virtual void start() = 0;
         };
 
@@ -65,7 +75,29 @@ namespace bzn
 
         virtual std::shared_ptr<std::string> get_saved_state() = 0;
 
-        virtual bool load_state(const std::string& state) = 0;
+        /**
+         * Replace the database with a saved state, keeping the current one if the loaded state doesn't have
+         * state_hash (unless it is empty)
+         */
+        virtual bool load_state(const std::string& state, const bzn::hash_t& state_hash) = 0;
+
+        virtual bzn::hash_t get_state_hash() = 0;
+
+        /**
+         * Remember the writes that follow so they can be taken back by undo_writes
+         */
+        virtual void start_undo_log() = 0;
+
+        /**
+         * Reverse the writes made since start_undo_log
+         * @return false if the previous state could not be restored
+         */
+        virtual bool undo_writes() = 0;
+
+        /**
+         * Keep the writes made since start_undo_log and stop remembering them
+         */
+        virtual void clear_undo_log() = 0;
     };
 
 } // namespace bzn
@@ -16,6 +16,7 @@
 #include <storage/mem_storage.hpp>
 #include <boost/beast/core/detail/base64.hpp>
 #include <numeric>
+#include <set>
 
 using namespace bzn;
 
@@ -65,12 +66,13 @@ raft_crud::start()
                     {
                         if (msg.msg_case() == bzn_msg::kDb)
                         {
-                            if (auto search = self->commit_handlers.find(msg.db().msg_case()); search != self->commit_handlers.end())
+                            self->commit_request(msg.db());
+                        }
+                        else if (msg.msg_case() == bzn_msg::kDbBatch)
+                        {
+                            for (const auto& request : msg.db_batch().requests())
                             {
-                                if (search->second(msg.db()))
-                                {
-                                    self->subscription_manager->inspect_commit(msg.db());
-                                }
+                                self->commit_request(request);
                             }
                         }
                     }
@@ -94,15 +96,31 @@ raft_crud::do_raft_task_routing(const bzn::json_message& msg, const database_msg
     {
         case database_msg::kSubscribe:
         {
-            this->subscription_manager->subscribe(request.header().db_uuid(), request.subscribe().key(),
-                request.header().nonce(), response, session);
+            if (request.subscribe().prefix())
+            {
+                this->subscription_manager->subscribe_prefix(request.header().db_uuid(), request.subscribe().key(),
+                    request.header().nonce(), response, session);
+            }
+            else
+            {
+                this->subscription_manager->subscribe(request.header().db_uuid(), request.subscribe().key(),
+                    request.header().nonce(), response, session);
+            }
         }
         break;
 
         case database_msg::kUnsubscribe:
         {
-            this->subscription_manager->unsubscribe(request.header().db_uuid(), request.unsubscribe().key(),
-                request.unsubscribe().nonce(), response, session);
+            if (request.unsubscribe().prefix())
+            {
+                this->subscription_manager->unsubscribe_prefix(request.header().db_uuid(), request.unsubscribe().key(),
+                    request.unsubscribe().nonce(), response, session);
+            }
+            else
+            {
+                this->subscription_manager->unsubscribe(request.header().db_uuid(), request.unsubscribe().key(),
+                    request.unsubscribe().nonce(), response, session);
+            }
         }
         break;
 
@@ -123,25 +141,69 @@ raft_crud::do_raft_task_routing(const bzn::json_message& msg, const database_msg
 }
 
 
-void
-raft_crud::handle_create(const bzn::json_message& msg, const database_msg& request, database_response& response)
+bool
+raft_crud::validate_create(const database_msg& request, database_response& response)
 {
     if (this->validate_value_size(request.create().value().size()))
     {
         response.mutable_error()->set_message(bzn::deprecated::MSG_VALUE_SIZE_TOO_LARGE);
-        return;
+        return false;
     }
 
     if (this->validate_key_size(request.create().key().size()))
     {
         response.mutable_error()->set_message(bzn::deprecated::MSG_KEY_SIZE_TOO_LARGE);
-        return;
+        return false;
     }
 
     if (this->storage->has(request.header().db_uuid(), request.create().key()))
     {
 
         response.mutable_error()->set_message(bzn::deprecated::MSG_RECORD_EXISTS);
+        return false;
+    }
+
+    return true;
+}
+
+
+bool
+raft_crud::validate_update(const database_msg& request, database_response& response)
+{
+    if (this->validate_value_size(request.update().value().size()))
+    {
+        response.mutable_error()->set_message(bzn::deprecated::MSG_VALUE_SIZE_TOO_LARGE);
+        return false;
+    }
+
+    if (!this->storage->has(request.header().db_uuid(), request.update().key()))
+    {
+        response.mutable_error()->set_message(bzn::deprecated::MSG_RECORD_NOT_FOUND);
+        return false;
+    }
+
+    return true;
+}
+
+
+bool
+raft_crud::validate_delete(const database_msg& request, database_response& response)
+{
+    if (!this->storage->has(request.header().db_uuid(), request.delete_().key()))
+    {
+        response.mutable_error()->set_message(bzn::deprecated::MSG_RECORD_NOT_FOUND);
+        return false;
+    }
+
+    return true;
+}
+
+
+void
+raft_crud::handle_create(const bzn::json_message& msg, const database_msg& request, database_response& response)
+{
+    if (!this->validate_create(request, response))
+    {
         return;
     }
 
@@ -176,15 +238,8 @@ raft_crud::handle_read(const bzn::json_message& /*msg*/, const database_msg& req
 void
 raft_crud::handle_update(const bzn::json_message& msg, const database_msg& request, database_response& response)
 {
-    if (this->validate_value_size(request.update().value().size()))
-    {
-        response.mutable_error()->set_message(bzn::deprecated::MSG_VALUE_SIZE_TOO_LARGE);
-        return;
-    }
-
-    if (!this->storage->has(request.header().db_uuid(), request.update().key()))
+    if (!this->validate_update(request, response))
     {
-        response.mutable_error()->set_message(bzn::deprecated::MSG_RECORD_NOT_FOUND);
         return;
     }
 
@@ -209,13 +264,128 @@ raft_crud::handle_delete(const bzn::json_message& msg, const database_msg& reque
         return;
     }
 
-    if (this->storage->has(request.header().db_uuid(), request.delete_().key()))
+    if (this->validate_delete(request, response))
     {
         this->raft->append_log(msg, bzn::log_entry_type::database);
-        return;
     }
+}
+
+
+void
+raft_crud::handle_batch(const database_batch& batch, std::vector<database_response>& responses)
+{
+    responses.assign(batch.requests_size(), database_response());
+
+    const bool leader = (this->raft->get_state() == bzn::raft_state::leader);
+
+    // reads are grouped by database so each database is read in one pass...
+    std::unordered_map<bzn::uuid_t, std::pair<std::vector<bzn::key_t>, std::vector<size_t>>> reads;
+
+    // keys written earlier in the batch; their committed state no longer says what a later request would see...
+    std::set<std::pair<bzn::uuid_t, bzn::key_t>> pending;
+
+    bzn_msg writes;
+
+    for (int i = 0; i < batch.requests_size(); ++i)
+    {
+        const auto& request = batch.requests(i);
+        auto& response = responses[i];
+
+        *response.mutable_header() = request.header();
+
+        switch (request.msg_case())
+        {
+            case database_msg::kRead:
+            {
+                if (pending.count({request.header().db_uuid(), request.read().key()}))
+                {
+                    response.mutable_error()->set_message(bzn::deprecated::MSG_BATCH_CONFLICT);
+                    break;
+                }
+
+                auto& [keys, positions] = reads[request.header().db_uuid()];
+                keys.emplace_back(request.read().key());
+                positions.emplace_back(i);
+                break;
+            }
+
+            case database_msg::kCreate:
+            case database_msg::kUpdate:
+            case database_msg::kDelete:
+            {
+                if (!leader)
+                {
+                    this->set_leader_info(response);
+                    break;
+                }
+
+                const auto key = (request.msg_case() == database_msg::kCreate) ? request.create().key()
+                    : (request.msg_case() == database_msg::kUpdate) ? request.update().key()
+                    : request.delete_().key();
+
+                if (!pending.emplace(request.header().db_uuid(), key).second)
+                {
+                    response.mutable_error()->set_message(bzn::deprecated::MSG_BATCH_CONFLICT);
+                    break;
+                }
+
+                // validated against committed state, which is safe now that no earlier write in the batch touches the key...
+                const bool valid = (request.msg_case() == database_msg::kCreate) ? this->validate_create(request, response)
+                    : (request.msg_case() == database_msg::kUpdate) ? this->validate_update(request, response)
+                    : this->validate_delete(request, response);
+
+                if (valid)
+                {
+                    *writes.mutable_db_batch()->add_requests() = request;
+                }
+                else
+                {
+                    pending.erase({request.header().db_uuid(), key});
+                }
+                break;
+            }
+
+            default:
+            {
+                response.mutable_error()->set_message(bzn::deprecated::MSG_INVALID_CRUD_COMMAND);
+                break;
+            }
+        }
+    }
+
+    for (const auto& [uuid, read] : reads)
+    {
+        const auto& [keys, positions] = read;
+        const auto values = this->storage->read_many(uuid, keys);
+
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            auto& response = responses[positions[i]];
+
+            if (values[i])
+            {
+                response.mutable_read()->set_key(keys[i]);
+                response.mutable_read()->set_value(*values[i]);
+            }
+            else if (leader)
+            {
+                response.mutable_error()->set_message(bzn::deprecated::MSG_RECORD_NOT_FOUND);
+            }
+            else
+            {
+                this->set_leader_info(response);
+            }
+        }
+    }
+
+    if (writes.has_db_batch())
+    {
+        bzn::json_message msg;
+        msg["bzn-api"] = "crud";
+        msg["msg"] = boost::beast::detail::base64_encode(writes.SerializeAsString());
 
-    response.mutable_error()->set_message(bzn::deprecated::MSG_RECORD_NOT_FOUND);
+        this->raft->append_log(msg, bzn::log_entry_type::database);
+    }
 }
 
 
@@ -255,6 +425,19 @@ raft_crud::handle_size(const bzn::json_message& /*msg*/, const database_msg& req
 }
 
 
+void
+raft_crud::commit_request(const database_msg& msg)
+{
+    if (auto search = this->commit_handlers.find(msg.msg_case()); search != this->commit_handlers.end())
+    {
+        if (search->second(msg))
+        {
+            this->subscription_manager->inspect_commit(msg);
+        }
+    }
+}
+
+
 bool
 raft_crud::commit_create(const database_msg& msg)
 {
@@ -38,6 +38,8 @@ namespace bzn
 
         void handle_delete(const bzn::json_message& msg, const database_msg& request, database_response& response) override;
 
+        void handle_batch(const database_batch& batch, std::vector<database_response>& responses) override;
+
         void start() override;
 
     private:
@@ -55,6 +57,12 @@ namespace bzn
         void      handle_has(const bzn::json_message& msg, const database_msg& request, database_response& response);
         void     handle_size(const bzn::json_message& msg, const database_msg& request, database_response& response);
 
+        bool validate_create(const database_msg& request, database_response& response);
+        bool validate_update(const database_msg& request, database_response& response);
+        bool validate_delete(const database_msg& request, database_response& response);
+
+        void commit_request(const database_msg& msg);
+
         bool commit_create(const database_msg& msg);
         bool commit_update(const database_msg& msg);
         bool commit_delete(const database_msg& msg);
@@ -20,11 +20,16 @@ using namespace bzn;
 namespace
 {
     const std::chrono::seconds DEFAULT_DEAD_SESSION_CHECK{15};
+
+    // updates to the same key inside this window reach each subscriber once
+    const std::chrono::milliseconds NOTIFY_COALESCE_WINDOW{10};
 }
 
 
 subscription_manager::subscription_manager(std::shared_ptr<bzn::asio::io_context_base> io_context)
-    : purge_timer(io_context->make_unique_steady_timer())
+    : io_context(std::move(io_context))
+    , purge_timer(this->io_context->make_unique_steady_timer())
+    , notify_timer(this->io_context->make_unique_steady_timer())
 {
 }
 
@@ -140,48 +145,239 @@ subscription_manager::unsubscribe(const bzn::uuid_t& uuid, const bzn::key_t& key
 
 
 void
-subscription_manager::notify_sessions(const bzn::uuid_t& uuid, const bool update, const bzn::key_t& key, const std::string& value)
+subscription_manager::subscribe_prefix(const bzn::uuid_t& uuid, const bzn::key_t& prefix, uint64_t transaction_id, database_response& response, std::shared_ptr<bzn::session_base> session)
 {
+    LOG(debug) << "session [" << session->get_session_id() << "] prefix subscription request: " << uuid << ":" << transaction_id << ":" << prefix;
+
     std::lock_guard<std::mutex> lock(this->subscribers_lock);
 
-    if (auto database_it = this->subscribers.find(uuid); database_it != this->subscribers.end())
+    prefix_node* node = &this->prefix_subscribers[uuid];
+
+    for (const char c : prefix)
+    {
+        auto& child = node->children[c];
+
+        if (!child)
+        {
+            child = std::make_unique<prefix_node>();
+        }
+
+        node = child.get();
+    }
+
+    if (!node->subscribers[session->get_session_id()].emplace(transaction_id, session).second)
+    {
+        // session already subscribed to this prefix...
+        response.mutable_error()->set_message(MSG_DUPLICATE_SUB);
+
+        LOG(debug) << "session [" << session->get_session_id() << "] has already subscribed to prefix: " << uuid << ":" << transaction_id << ":" << prefix;
+    }
+}
+
+
+void
+subscription_manager::unsubscribe_prefix(const bzn::uuid_t& uuid, const bzn::key_t& prefix, uint64_t transaction_id, database_response& response, std::shared_ptr<bzn::session_base> session)
+{
+    LOG(debug) << "session [" << session->get_session_id() << "] prefix unsubscribe request: " << uuid << ":" << prefix << ":" << transaction_id;
+
+    std::lock_guard<std::mutex> lock(this->subscribers_lock);
+
+    auto database_it = this->prefix_subscribers.find(uuid);
+
+    if (database_it == this->prefix_subscribers.end())
+    {
+        response.mutable_error()->set_message(MSG_INVALID_UUID);
+
+        LOG(debug) << "session [" << session->get_session_id() << "] unknown database & prefix: " << uuid << ":" << prefix << ":" << transaction_id;
+
+        return;
+    }
+
+    prefix_node* node = &database_it->second;
+
+    for (const char c : prefix)
+    {
+        auto child_it = node->children.find(c);
+
+        if (child_it == node->children.end())
+        {
+            response.mutable_error()->set_message(MSG_INVALID_KEY);
+
+            LOG(debug) << "session [" << session->get_session_id() << "] unknown prefix: " << uuid << ":" << prefix << ":" << transaction_id;
+
+            return;
+        }
+
+        node = child_it->second.get();
+    }
+
+    if (auto session_it = node->subscribers.find(session->get_session_id()); session_it != node->subscribers.end() && session_it->second.erase(transaction_id))
+    {
+        // empty nodes are pruned by the next purge...
+        return;
+    }
+
+    response.mutable_error()->set_message(MSG_INVALID_SUB);
+
+    LOG(debug) << "session [" << session->get_session_id() << "] not subscribed to prefix: " << uuid << ":" << prefix << ":" << transaction_id;
+}
+
+
+void
+subscription_manager::for_each_prefix_match(const bzn::uuid_t& uuid, const bzn::key_t& key, const std::function<void(const subscriber_map&)>& handler) const
+{
+    auto database_it = this->prefix_subscribers.find(uuid);
+
+    if (database_it == this->prefix_subscribers.end())
+    {
+        return;
+    }
+
+    // every node on the path spelled by the key is a prefix of it, so a match costs one step per character...
+    const prefix_node* node = &database_it->second;
+
+    for (size_t i = 0;; ++i)
     {
-        if (auto key_it = database_it->second.find(key); key_it != database_it->second.end())
+        if (!node->subscribers.empty())
+        {
+            handler(node->subscribers);
+        }
+
+        if (i == key.size())
+        {
+            return;
+        }
+
+        auto child_it = node->children.find(key[i]);
+
+        if (child_it == node->children.end())
         {
-            for (const auto& sessions : key_it->second)
+            return;
+        }
+
+        node = child_it->second.get();
+    }
+}
+
+
+void
+subscription_manager::queue_update(const bzn::uuid_t& uuid, const bool update, const bzn::key_t& key, const std::string& value)
+{
+    std::lock_guard<std::mutex> lock(this->subscribers_lock);
+
+    bool watched = false;
+
+    if (auto database_it = this->subscribers.find(uuid); database_it != this->subscribers.end() && database_it->second.count(key))
+    {
+        watched = true;
+    }
+    else
+    {
+        this->for_each_prefix_match(uuid, key, [&watched](const subscriber_map&){ watched = true; });
+    }
+
+    if (!watched)
+    {
+        return;
+    }
+
+    // replaces anything still pending for this key...
+    auto& resp = this->pending_updates[uuid][key];
+
+    resp.mutable_subscription_update()->set_key(key);
+    resp.mutable_subscription_update()->set_value(value);
+    resp.mutable_subscription_update()->set_operation(update ? database_subscription_update::UPDATE : database_subscription_update::DELETE);
+
+    if (!this->notify_scheduled)
+    {
+        this->notify_scheduled = true;
+
+        this->notify_timer->expires_from_now(NOTIFY_COALESCE_WINDOW);
+        this->notify_timer->async_wait(std::bind(&subscription_manager::notify_sessions, shared_from_this(), std::placeholders::_1));
+    }
+}
+
+
+void
+subscription_manager::notify_sessions(const boost::system::error_code& ec)
+{
+    // each session's notifications are sent together, away from the commit path...
+    std::unordered_map<bzn::session_id, std::pair<std::shared_ptr<bzn::session_base>, std::vector<std::shared_ptr<std::string>>>> deliveries;
+
+    {
+        std::lock_guard<std::mutex> lock(this->subscribers_lock);
+
+        this->notify_scheduled = false;
+
+        if (ec)
+        {
+            this->pending_updates.clear();
+            return;
+        }
+
+        for (const auto& [uuid, updates] : this->pending_updates)
+        {
+            auto database_it = this->subscribers.find(uuid);
+
+            for (const auto& [key, update] : updates)
             {
-                for (const auto& subscription : sessions.second)
+                // serialize the update once: a message's fields can be concatenated, so each subscriber only adds its own header
+                const std::string update_data = update.SerializeAsString();
+
+                auto add_deliveries = [&](const subscriber_map& subscribers)
                 {
-                    if (auto session_shared_ptr = subscription.second.lock())
+                    for (const auto& [session_id, subscriptions] : subscribers)
                     {
-                        database_response resp;
+                        for (const auto& [nonce, session] : subscriptions)
+                        {
+                            auto session_shared_ptr = session.lock();
 
-                        resp.mutable_header()->set_db_uuid(uuid);
-                        resp.mutable_header()->set_nonce(subscription.first);
-                        resp.mutable_subscription_update()->set_key(key);
+                            if (!session_shared_ptr)
+                            {
+                                continue;
+                            }
 
-                        if (!value.empty())
-                        {
-                            resp.mutable_subscription_update()->set_value(value);
-                        }
+                            database_response header;
+                            header.mutable_header()->set_db_uuid(uuid);
+                            header.mutable_header()->set_nonce(nonce);
 
-                        if (update)
-                        {
-                            resp.mutable_subscription_update()->set_operation(database_subscription_update::UPDATE);
-                        }
-                        else
-                        {
-                            resp.mutable_subscription_update()->set_operation(database_subscription_update::DELETE);
-                        }
+                            auto msg = std::make_shared<std::string>(header.SerializeAsString());
+                            msg->append(update_data);
 
-                        LOG(debug) << "notifying session [" << session_shared_ptr->get_session_id() << "] : " << uuid
-                                   << ":" << key << ":" << subscription.first << ":" << value.substr(0, MAX_MESSAGE_SIZE);
+                            auto& delivery = deliveries[session_id];
+                            delivery.first = std::move(session_shared_ptr);
+                            delivery.second.emplace_back(std::move(msg));
+                        }
+                    }
+                };
 
-                        session_shared_ptr->send_datagram(std::make_shared<std::string>(resp.SerializeAsString()));
+                if (database_it != this->subscribers.end())
+                {
+                    if (auto key_it = database_it->second.find(key); key_it != database_it->second.end())
+                    {
+                        add_deliveries(key_it->second);
                     }
                 }
+
+                this->for_each_prefix_match(uuid, key, add_deliveries);
             }
         }
+
+        this->pending_updates.clear();
+    }
+
+    for (auto& [session_id, delivery] : deliveries)
+    {
+        LOG(debug) << "notifying session [" << session_id << "] of " << delivery.second.size() << " updates";
+
+        this->io_context->post(
+            [session = std::move(delivery.first), msgs = std::move(delivery.second)]()
+            {
+                for (const auto& msg : msgs)
+                {
+                    session->send_datagram(msg);
+                }
+            });
     }
 }
 
@@ -192,15 +388,15 @@ subscription_manager::inspect_commit(const database_msg& msg)
     switch (msg.msg_case())
     {
         case database_msg::kCreate:
-            this->notify_sessions(msg.header().db_uuid(), true, msg.create().key(), msg.create().value());
+            this->queue_update(msg.header().db_uuid(), true, msg.create().key(), msg.create().value());
             break;
 
         case database_msg::kUpdate:
-            this->notify_sessions(msg.header().db_uuid(), true, msg.update().key(), msg.update().value());
+            this->queue_update(msg.header().db_uuid(), true, msg.update().key(), msg.update().value());
             break;
 
         case database_msg::kDelete:
-            this->notify_sessions(msg.header().db_uuid(), false, msg.delete_().key(), "");
+            this->queue_update(msg.header().db_uuid(), false, msg.delete_().key(), "");
             break;
 
         default:
@@ -227,35 +423,7 @@ subscription_manager::purge_closed_sessions(const boost::system::error_code& ec)
 
             while (key_it != database_it->second.end())
             {
-                auto session_it = key_it->second.begin();
-
-                while (session_it != key_it->second.end())
-                {
-                    auto subscribers_it = session_it->second.begin();
-
-                    while (subscribers_it != session_it->second.end())
-                    {
-                        if (auto session_shared_ptr = subscribers_it->second.lock())
-                        {
-                            ++subscribers_it;
-                            continue;
-                        }
-
-                        LOG(debug) << "purged closed session [" << session_it->first << "] for: " << database_it->first;
-
-                        ++purged;
-
-                        subscribers_it = session_it->second.erase(subscribers_it);
-                    }
-
-                    if (session_it->second.empty())
-                    {
-                        session_it = key_it->second.erase(session_it);
-                        continue;
-                    }
-
-                    ++session_it;
-                }
+                purged += purge_closed_subscribers(key_it->second);
 
                 if (key_it->second.empty())
                 {
@@ -280,8 +448,90 @@ subscription_manager::purge_closed_sessions(const boost::system::error_code& ec)
             ++database_it;
         }
 
+        auto prefix_it = this->prefix_subscribers.begin();
+
+        while (prefix_it != this->prefix_subscribers.end())
+        {
+            if (size_t purged = purge_closed_subscribers(prefix_it->second))
+            {
+                LOG(info) << "purged " << purged << " closed prefix sessions for database: " << prefix_it->first;
+            }
+
+            if (prefix_it->second.children.empty() && prefix_it->second.subscribers.empty())
+            {
+                prefix_it = this->prefix_subscribers.erase(prefix_it);
+                continue;
+            }
+
+            ++prefix_it;
+        }
+
         // reschedule...
         this->purge_timer->expires_from_now(DEFAULT_DEAD_SESSION_CHECK);
         this->purge_timer->async_wait(std::bind(&subscription_manager::purge_closed_sessions, shared_from_this(), std::placeholders::_1));
     }
 }
+
+
+size_t
+subscription_manager::purge_closed_subscribers(subscriber_map& subscribers)
+{
+    size_t purged{};
+
+    auto session_it = subscribers.begin();
+
+    while (session_it != subscribers.end())
+    {
+        auto subscribers_it = session_it->second.begin();
+
+        while (subscribers_it != session_it->second.end())
+        {
+            if (auto session_shared_ptr = subscribers_it->second.lock())
+            {
+                ++subscribers_it;
+                continue;
+            }
+
+            LOG(debug) << "purged closed session [" << session_it->first << "]";
+
+            ++purged;
+
+            subscribers_it = session_it->second.erase(subscribers_it);
+        }
+
+        if (session_it->second.empty())
+        {
+            session_it = subscribers.erase(session_it);
+            continue;
+        }
+
+        ++session_it;
+    }
+
+    return purged;
+}
+
+
+size_t
+subscription_manager::purge_closed_subscribers(prefix_node& node)
+{
+    size_t purged = purge_closed_subscribers(node.subscribers);
+
+    auto child_it = node.children.begin();
+
+    while (child_it != node.children.end())
+    {
+        purged += purge_closed_subscribers(*child_it->second);
+
+        // prune branches no longer leading to a subscriber...
+        if (child_it->second->children.empty() && child_it->second->subscribers.empty())
+        {
+            child_it = node.children.erase(child_it);
+            continue;
+        }
+
+        ++child_it;
+    }
+
+    return purged;
+}
@@ -17,8 +17,10 @@
 #include <crud/subscription_manager_base.hpp>
 #include <include/boost_asio_beast.hpp>
 #include <unordered_map>
+#include <functional>
 #include <mutex>
 #include <list>
+#include <map>
 
 
 namespace bzn
@@ -34,19 +36,46 @@ namespace bzn
 
         void unsubscribe(const bzn::uuid_t& uuid, const bzn::key_t& key, uint64_t transaction_id, database_response& response, std::shared_ptr<bzn::session_base> session) override;
 
+        void   subscribe_prefix(const bzn::uuid_t& uuid, const bzn::key_t& prefix, uint64_t transaction_id, database_response& response, std::shared_ptr<bzn::session_base> session) override;
+
+        void unsubscribe_prefix(const bzn::uuid_t& uuid, const bzn::key_t& prefix, uint64_t transaction_id, database_response& response, std::shared_ptr<bzn::session_base> session) override;
+
         void inspect_commit(const database_msg& msg) override;
 
     private:
+        using subscriber_map = std::unordered_map<bzn::session_id, std::unordered_map<uint64_t, std::weak_ptr<bzn::session_base>>>;
+
+        // trie of subscribed prefixes: subscribers on a node watch every key spelled by the path down to it
+        struct prefix_node
+        {
+            std::map<char, std::unique_ptr<prefix_node>> children;
+            subscriber_map subscribers;
+        };
+
+        void for_each_prefix_match(const bzn::uuid_t& uuid, const bzn::key_t& key, const std::function<void(const subscriber_map&)>& handler) const;
+
+        static size_t purge_closed_subscribers(subscriber_map& subscribers);
+
+        static size_t purge_closed_subscribers(prefix_node& node);
 
         void purge_closed_sessions(const boost::system::error_code& ec);
 
-        void notify_sessions(const bzn::uuid_t& uuid, bool update, const bzn::key_t& key, const std::string& value);
+        void queue_update(const bzn::uuid_t& uuid, bool update, const bzn::key_t& key, const std::string& value);
+
+        void notify_sessions(const boost::system::error_code& ec);
+
+        std::unordered_map<bzn::uuid_t, std::unordered_map<bzn::key_t, subscriber_map>> subscribers;
+        std::unordered_map<bzn::uuid_t, prefix_node> prefix_subscribers;
 
-        std::unordered_map<bzn::uuid_t, std::unordered_map<bzn::key_t, std::unordered_map<bzn::session_id, std::unordered_map<uint64_t, std::weak_ptr<bzn::session_base>>>>> subscribers;
+        // latest update per key waiting to go out, so a burst of writes to one key is delivered once...
+        std::unordered_map<bzn::uuid_t, std::unordered_map<bzn::key_t, database_response>> pending_updates;
+        bool notify_scheduled = false;
 
         std::mutex subscribers_lock;
 
+        std::shared_ptr<bzn::asio::io_context_base> io_context;
         std::unique_ptr<bzn::asio::steady_timer_base> purge_timer;
+        std::unique_ptr<bzn::asio::steady_timer_base> notify_timer;
 
         std::once_flag start_once;
     };
@@ -37,6 +37,10 @@ namespace bzn
 
         virtual void unsubscribe(const bzn::uuid_t& uuid, const bzn::key_t& key, uint64_t transaction_id, database_response& response, std::shared_ptr<bzn::session_base> session) = 0;
 
+        virtual void   subscribe_prefix(const bzn::uuid_t& uuid, const bzn::key_t& prefix, uint64_t transaction_id, database_response& response, std::shared_ptr<bzn::session_base> session) = 0;
+
+        virtual void unsubscribe_prefix(const bzn::uuid_t& uuid, const bzn::key_t& prefix, uint64_t transaction_id, database_response& response, std::shared_ptr<bzn::session_base> session) = 0;
+
         virtual void inspect_commit(const database_msg& msg) = 0;
 
     };
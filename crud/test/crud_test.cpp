@@ -15,6 +15,7 @@
 #include <crud/crud.hpp>
 #include <storage/mem_storage.hpp>
 #include <mocks/mock_session_base.hpp>
+#include <mocks/mock_storage_base.hpp>
 #include <mocks/mock_subscription_manager_base.hpp>
 #include <algorithm>
 
@@ -637,6 +638,39 @@ TEST(crud, test_that_unsubscribe_request_calls_subscription_manager)
 }
 
 
+TEST(crud, test_that_prefix_subscribe_requests_call_subscription_manager)
+{
+    auto mock_subscription_manager = std::make_shared<bzn::Mocksubscription_manager_base>();
+
+    bzn::crud crud(std::make_shared<bzn::mem_storage>(), mock_subscription_manager);
+
+    EXPECT_CALL(*mock_subscription_manager, start());
+
+    crud.start();
+
+    auto mock_session = std::make_shared<NiceMock<bzn::Mocksession_base>>();
+
+    database_msg msg;
+
+    msg.mutable_header()->set_db_uuid("uuid");
+    msg.mutable_header()->set_nonce(uint64_t(123));
+    msg.mutable_subscribe()->set_key("user/");
+    msg.mutable_subscribe()->set_prefix(true);
+
+    EXPECT_CALL(*mock_subscription_manager, subscribe_prefix("uuid", "user/", uint64_t(123), _, _));
+
+    crud.handle_request("caller_id", msg, mock_session);
+
+    msg.mutable_unsubscribe()->set_key("user/");
+    msg.mutable_unsubscribe()->set_nonce(123);
+    msg.mutable_unsubscribe()->set_prefix(true);
+
+    EXPECT_CALL(*mock_subscription_manager, unsubscribe_prefix("uuid", "user/", uint64_t(123), _, _));
+
+    crud.handle_request("caller_id", msg, mock_session);
+}
+
+
 TEST(crud, test_that_create_db_request_sends_proper_response)
 {
     bzn::crud crud(std::make_shared<bzn::mem_storage>(), std::make_shared<NiceMock<bzn::Mocksubscription_manager_base>>());
@@ -806,7 +840,25 @@ TEST(crud, test_that_state_can_be_saved_and_retrieved)
 
     ASSERT_TRUE(state);
 
-    ASSERT_TRUE(crud.load_state(*state));
+    ASSERT_TRUE(crud.load_state(*state, crud.get_state_hash()));
+}
+
+
+TEST(crud, test_that_saving_state_serializes_the_snapshot)
+{
+    auto mock_storage = std::make_shared<bzn::Mockstorage_base>();
+    bzn::crud crud(mock_storage, std::make_shared<NiceMock<bzn::Mocksubscription_manager_base>>());
+
+    InSequence seq;
+    EXPECT_CALL(*mock_storage, create_snapshot()).WillOnce(Return(true));
+    EXPECT_CALL(*mock_storage, get_snapshot()).WillOnce(Return(std::make_shared<std::string>("state")));
+
+    EXPECT_TRUE(crud.save_state());
+
+    EXPECT_CALL(*mock_storage, create_snapshot()).WillOnce(Return(true));
+    EXPECT_CALL(*mock_storage, get_snapshot()).WillOnce(Return(nullptr));
+
+    EXPECT_FALSE(crud.save_state());
 }
 
 
@@ -31,6 +31,7 @@ namespace
     const bzn::uuid_t TEST_NODE_UUID{"f0645cc2-476b-485d-b589-217be3ca87d5"};
     const bzn::uuid_t LEADER_UUID{"7110d050-42b3-11e8-842f-0ed5f89f718b"};
     const bzn::uuid_t USER_UUID{"80174b53-2dda-49f1-9d6a-6a780d4cceca"};
+    const bzn::uuid_t OTHER_UUID{"3f1c4a2e-9b7d-4e6a-8c5f-2d1e0b9a7c64"};
     const std::string TEST_VALUE = "I2luY2x1ZGUgPG1vY2tzL21vY2tfbm9kZV9iYXNlLmhwcD4NCiNpbmNsdWRlIDxtb2Nrcy9tb2NrX3Nlc3N"
                                    "pb25fYmFzZS5ocHA+DQojaW5jbHVkZSA8bW9ja3MvbW9ja19yYWZ0X2Jhc2UuaHBwPg0KI2luY2x1ZGUgPG"
                                    "1vY2tzL21vY2tfc3RvcmFnZV9iYXNlLmhwcD4NCg==";
@@ -984,3 +985,156 @@ TEST_F(raft_crud_test, test_that_subscription_and_unsubscription_requests_are_ha
         this->mh(request, this->mock_session);
     }
 }
+
+
+TEST_F(raft_crud_test, test_that_a_leader_appends_a_batch_of_writes_as_one_log_entry)
+{
+    database_batch batch;
+
+    auto add_request = [&](auto&& set_op)
+    {
+        auto request = batch.add_requests();
+        request->mutable_header()->set_db_uuid(USER_UUID);
+        set_op(*request);
+    };
+
+    add_request([](database_msg& msg){ msg.mutable_create()->set_key("key0"); msg.mutable_create()->set_value("value0"); });
+    add_request([](database_msg& msg){ msg.mutable_read()->set_key("key1"); });
+    add_request([](database_msg& msg){ msg.mutable_update()->set_key("key1"); msg.mutable_update()->set_value("value1"); });
+    add_request([](database_msg& msg){ msg.mutable_create()->set_key("key2"); msg.mutable_create()->set_value("value2"); });
+    add_request([](database_msg& msg){ msg.mutable_read()->set_key("key3"); });
+    add_request([](database_msg& msg){ msg.mutable_delete_()->set_key("key4"); });
+
+    EXPECT_CALL(*this->mock_raft, get_state()).WillRepeatedly(Return(bzn::raft_state::leader));
+
+    EXPECT_CALL(*this->mock_storage, has(USER_UUID, "key0")).WillOnce(Return(false));
+    EXPECT_CALL(*this->mock_storage, has(USER_UUID, "key1")).WillOnce(Return(true));
+    EXPECT_CALL(*this->mock_storage, has(USER_UUID, "key2")).WillOnce(Return(true));
+    EXPECT_CALL(*this->mock_storage, has(USER_UUID, "key4")).WillOnce(Return(true));
+
+    // both reads come from a single storage pass...
+    EXPECT_CALL(*this->mock_storage, read_many(USER_UUID, std::vector<bzn::key_t>{"key1", "key3"})).WillOnce(Return(
+        std::vector<std::optional<bzn::value_t>>{std::string("old_value1"), std::nullopt}));
+
+    bzn::json_message entry;
+    EXPECT_CALL(*this->mock_raft, append_log(_, bzn::log_entry_type::database)).WillOnce(Invoke(
+        [&](const bzn::json_message& msg, auto)
+        {
+            entry = msg;
+            return true;
+        }));
+
+    std::vector<database_response> responses;
+    this->crud->handle_batch(batch, responses);
+
+    ASSERT_EQ(responses.size(), size_t(6));
+    EXPECT_EQ(responses[0].response_case(), database_response::RESPONSE_NOT_SET);
+    EXPECT_EQ(responses[1].read().value(), "old_value1");
+    EXPECT_EQ(responses[2].response_case(), database_response::RESPONSE_NOT_SET);
+    EXPECT_EQ(responses[3].error().message(), bzn::deprecated::MSG_RECORD_EXISTS);
+    EXPECT_EQ(responses[4].error().message(), bzn::deprecated::MSG_RECORD_NOT_FOUND);
+    EXPECT_EQ(responses[5].response_case(), database_response::RESPONSE_NOT_SET);
+
+    // the entry carries only the writes that validated, and commits them in order...
+    InSequence seq;
+    EXPECT_CALL(*this->mock_storage, create(USER_UUID, "key0", "value0")).WillOnce(Return(bzn::storage_result::ok));
+    EXPECT_CALL(*this->mock_subscription_manager, inspect_commit(_));
+    EXPECT_CALL(*this->mock_storage, update(USER_UUID, "key1", "value1")).WillOnce(Return(bzn::storage_result::ok));
+    EXPECT_CALL(*this->mock_subscription_manager, inspect_commit(_));
+    EXPECT_CALL(*this->mock_storage, remove(USER_UUID, "key4")).WillOnce(Return(bzn::storage_result::ok));
+    EXPECT_CALL(*this->mock_subscription_manager, inspect_commit(_));
+
+    EXPECT_TRUE(this->ch(entry));
+}
+
+
+TEST_F(raft_crud_test, test_that_a_batch_rejects_requests_for_keys_written_earlier_in_the_batch)
+{
+    database_batch batch;
+
+    auto add_request = [&](const bzn::uuid_t& uuid, auto&& set_op)
+    {
+        auto request = batch.add_requests();
+        request->mutable_header()->set_db_uuid(uuid);
+        set_op(*request);
+    };
+
+    add_request(USER_UUID, [](database_msg& msg){ msg.mutable_create()->set_key("key0"); msg.mutable_create()->set_value("value0"); });
+    add_request(USER_UUID, [](database_msg& msg){ msg.mutable_create()->set_key("key0"); msg.mutable_create()->set_value("again"); });
+    add_request(USER_UUID, [](database_msg& msg){ msg.mutable_update()->set_key("key0"); msg.mutable_update()->set_value("value1"); });
+    add_request(USER_UUID, [](database_msg& msg){ msg.mutable_delete_()->set_key("key0"); });
+    add_request(USER_UUID, [](database_msg& msg){ msg.mutable_read()->set_key("key0"); });
+    add_request(OTHER_UUID, [](database_msg& msg){ msg.mutable_create()->set_key("key0"); msg.mutable_create()->set_value("value0"); });
+
+    // a write that fails validation doesn't claim its key...
+    add_request(USER_UUID, [](database_msg& msg){ msg.mutable_update()->set_key("key1"); msg.mutable_update()->set_value("value1"); });
+    add_request(USER_UUID, [](database_msg& msg){ msg.mutable_create()->set_key("key1"); msg.mutable_create()->set_value("value1"); });
+
+    EXPECT_CALL(*this->mock_raft, get_state()).WillRepeatedly(Return(bzn::raft_state::leader));
+
+    EXPECT_CALL(*this->mock_storage, has(USER_UUID, "key0")).WillOnce(Return(false));
+    EXPECT_CALL(*this->mock_storage, has(OTHER_UUID, "key0")).WillOnce(Return(false));
+    EXPECT_CALL(*this->mock_storage, has(USER_UUID, "key1")).WillRepeatedly(Return(false));
+    EXPECT_CALL(*this->mock_storage, read_many(_, _)).Times(0);
+
+    bzn::json_message entry;
+    EXPECT_CALL(*this->mock_raft, append_log(_, bzn::log_entry_type::database)).WillOnce(Invoke(
+        [&](const bzn::json_message& msg, auto)
+        {
+            entry = msg;
+            return true;
+        }));
+
+    std::vector<database_response> responses;
+    this->crud->handle_batch(batch, responses);
+
+    ASSERT_EQ(responses.size(), size_t(8));
+    EXPECT_EQ(responses[0].response_case(), database_response::RESPONSE_NOT_SET);
+    EXPECT_EQ(responses[1].error().message(), bzn::deprecated::MSG_BATCH_CONFLICT);
+    EXPECT_EQ(responses[2].error().message(), bzn::deprecated::MSG_BATCH_CONFLICT);
+    EXPECT_EQ(responses[3].error().message(), bzn::deprecated::MSG_BATCH_CONFLICT);
+    EXPECT_EQ(responses[4].error().message(), bzn::deprecated::MSG_BATCH_CONFLICT);
+    EXPECT_EQ(responses[5].response_case(), database_response::RESPONSE_NOT_SET);
+    EXPECT_EQ(responses[6].error().message(), bzn::deprecated::MSG_RECORD_NOT_FOUND);
+    EXPECT_EQ(responses[7].response_case(), database_response::RESPONSE_NOT_SET);
+
+    InSequence seq;
+    EXPECT_CALL(*this->mock_storage, create(USER_UUID, "key0", "value0")).WillOnce(Return(bzn::storage_result::ok));
+    EXPECT_CALL(*this->mock_subscription_manager, inspect_commit(_));
+    EXPECT_CALL(*this->mock_storage, create(OTHER_UUID, "key0", "value0")).WillOnce(Return(bzn::storage_result::ok));
+    EXPECT_CALL(*this->mock_subscription_manager, inspect_commit(_));
+    EXPECT_CALL(*this->mock_storage, create(USER_UUID, "key1", "value1")).WillOnce(Return(bzn::storage_result::ok));
+    EXPECT_CALL(*this->mock_subscription_manager, inspect_commit(_));
+
+    EXPECT_TRUE(this->ch(entry));
+}
+
+
+TEST_F(raft_crud_test, test_that_a_follower_serves_batch_reads_and_redirects_batch_writes)
+{
+    database_batch batch;
+
+    auto request = batch.add_requests();
+    request->mutable_header()->set_db_uuid(USER_UUID);
+    request->mutable_read()->set_key("key0");
+
+    request = batch.add_requests();
+    request->mutable_header()->set_db_uuid(USER_UUID);
+    request->mutable_create()->set_key("key1");
+    request->mutable_create()->set_value("value1");
+
+    EXPECT_CALL(*this->mock_raft, get_state()).WillRepeatedly(Return(bzn::raft_state::follower));
+    EXPECT_CALL(*this->mock_raft, get_leader()).WillRepeatedly(Return(bzn::peer_address_t{"127.0.0.1", 8080, 8081, "leader", LEADER_UUID}));
+    EXPECT_CALL(*this->mock_raft, append_log(_, _)).Times(0);
+
+    EXPECT_CALL(*this->mock_storage, read_many(USER_UUID, std::vector<bzn::key_t>{"key0"})).WillOnce(Return(
+        std::vector<std::optional<bzn::value_t>>{std::string("value0")}));
+
+    std::vector<database_response> responses;
+    this->crud->handle_batch(batch, responses);
+
+    ASSERT_EQ(responses.size(), size_t(2));
+    EXPECT_EQ(responses[0].read().value(), "value0");
+    EXPECT_EQ(responses[1].redirect().leader_id(), LEADER_UUID);
+    EXPECT_EQ(responses[1].redirect().leader_http_port(), uint32_t(8081));
+}
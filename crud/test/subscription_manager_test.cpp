@@ -25,6 +25,40 @@ namespace
     const bzn::key_t  TEST_UNKOWN_KEY{"unknown"};
     const bzn::uuid_t TEST_UUID{"uuid"};
     const bzn::uuid_t TEST_UNKOWN_UUID{"67ee0ca8-bd79-4eef-88db-9343aaf6ca7e"};
+
+
+    // io context whose purge and notify timers hand their handlers to the test, and that runs posted work immediately
+    std::shared_ptr<bzn::asio::Mockio_context_base>
+    make_io_context(bzn::asio::wait_handler& purge_handler, bzn::asio::wait_handler& notify_handler)
+    {
+        auto mock_io_context = std::make_shared<NiceMock<bzn::asio::Mockio_context_base>>();
+
+        auto make_timer = [](bzn::asio::wait_handler& handler)
+        {
+            return [&handler]()
+            {
+                auto timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+                EXPECT_CALL(*timer, async_wait(_)).WillRepeatedly(Invoke(
+                    [&handler](auto wh)
+                    {
+                        handler = wh;
+                    }));
+                return timer;
+            };
+        };
+
+        EXPECT_CALL(*mock_io_context, make_unique_steady_timer())
+            .WillOnce(Invoke(make_timer(purge_handler)))
+            .WillOnce(Invoke(make_timer(notify_handler)));
+
+        EXPECT_CALL(*mock_io_context, post(_)).WillRepeatedly(Invoke(
+            [](auto task)
+            {
+                task();
+            }));
+
+        return mock_io_context;
+    }
 }
 
 
@@ -171,14 +205,16 @@ TEST(subscription_manager, test_that_subscriber_is_notified_for_create_and_updat
     EXPECT_CALL(*mock_session1, get_session_id()).WillRepeatedly(Return(bzn::session_id(1)));
     EXPECT_CALL(*mock_session2, get_session_id()).WillRepeatedly(Return(bzn::session_id(2)));
 
-    bzn::subscription_manager sm(std::make_shared<NiceMock<bzn::asio::Mockio_context_base>>());
+    bzn::asio::wait_handler purge_wh;
+    bzn::asio::wait_handler notify_wh;
+    auto sm = std::make_shared<bzn::subscription_manager>(make_io_context(purge_wh, notify_wh));
 
     database_response response;
-    sm.subscribe(TEST_UUID, "0", 0,    response, mock_session1);
-    sm.subscribe(TEST_UUID, "0", 1234, response, mock_session2);
+    sm->subscribe(TEST_UUID, "0", 0,    response, mock_session1);
+    sm->subscribe(TEST_UUID, "0", 1234, response, mock_session2);
 
-    sm.subscribe(TEST_UUID, "1", 4321, response, mock_session1);
-    sm.subscribe(TEST_UUID, "1", 0,    response, mock_session2);
+    sm->subscribe(TEST_UUID, "1", 4321, response, mock_session1);
+    sm->subscribe(TEST_UUID, "1", 0,    response, mock_session2);
 
     // send through a 'create' message...
     {
@@ -215,7 +251,10 @@ TEST(subscription_manager, test_that_subscriber_is_notified_for_create_and_updat
                 ASSERT_EQ(resp.subscription_update().operation(), database_subscription_update::UPDATE);
             }));
 
-        sm.inspect_commit(msg);
+        sm->inspect_commit(msg);
+
+        // delivered once the coalescing window closes...
+        notify_wh(boost::system::error_code());
     }
 
     // send through an 'update' message...
@@ -253,7 +292,10 @@ TEST(subscription_manager, test_that_subscriber_is_notified_for_create_and_updat
                 ASSERT_EQ(resp.subscription_update().operation(), database_subscription_update::UPDATE);
             }));
 
-        sm.inspect_commit(msg);
+        sm->inspect_commit(msg);
+
+        // delivered once the coalescing window closes...
+        notify_wh(boost::system::error_code());
     }
 
     // send a delete... nothing should happen...
@@ -290,32 +332,19 @@ TEST(subscription_manager, test_that_subscriber_is_notified_for_create_and_updat
                 ASSERT_EQ(resp.subscription_update().operation(), database_subscription_update::DELETE);
             }));
 
-        sm.inspect_commit(msg);
+        sm->inspect_commit(msg);
+
+        // delivered once the coalescing window closes...
+        notify_wh(boost::system::error_code());
     }
 }
 
 
 TEST(subscription_manager, test_that_dead_session_is_removed_from_subscriber_list)
 {
-    auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
-    auto mock_steady_timer = std::make_unique<bzn::asio::Mocksteady_timer_base>();
-
-    EXPECT_CALL(*mock_steady_timer, expires_from_now(_)).Times(2);
-
     bzn::asio::wait_handler wh;
-    EXPECT_CALL(*mock_steady_timer, async_wait(_)).WillRepeatedly(Invoke(
-        [&](auto handler)
-        {
-            wh = handler;
-        }));
-
-    EXPECT_CALL(*mock_io_context, make_unique_steady_timer()).WillOnce(Invoke(
-        [&]()
-        {
-            return std::move(mock_steady_timer);
-        }));
-
-    auto sm = std::make_shared<bzn::subscription_manager>(mock_io_context);
+    bzn::asio::wait_handler notify_wh;
+    auto sm = std::make_shared<bzn::subscription_manager>(make_io_context(wh, notify_wh));
 
     sm->start();
 
@@ -365,6 +394,7 @@ TEST(subscription_manager, test_that_dead_session_is_removed_from_subscriber_lis
         }));
 
     sm->inspect_commit(msg);
+    notify_wh(boost::system::error_code());
 
     // kill session...
     mock_session2.reset();
@@ -387,4 +417,225 @@ TEST(subscription_manager, test_that_dead_session_is_removed_from_subscriber_lis
         }));
 
     sm->inspect_commit(msg);
+    notify_wh(boost::system::error_code());
+}
+
+
+TEST(subscription_manager, test_that_updates_to_a_key_are_coalesced_and_sent_off_the_commit_path)
+{
+    auto mock_session1 = std::make_shared<bzn::Mocksession_base>();
+    auto mock_session2 = std::make_shared<bzn::Mocksession_base>();
+
+    EXPECT_CALL(*mock_session1, get_session_id()).WillRepeatedly(Return(bzn::session_id(1)));
+    EXPECT_CALL(*mock_session2, get_session_id()).WillRepeatedly(Return(bzn::session_id(2)));
+
+    bzn::asio::wait_handler purge_wh;
+    bzn::asio::wait_handler notify_wh;
+    auto sm = std::make_shared<bzn::subscription_manager>(make_io_context(purge_wh, notify_wh));
+
+    database_response response;
+    sm->subscribe(TEST_UUID, TEST_KEY, 7, response, mock_session1);
+    sm->subscribe(TEST_UUID, TEST_KEY, 8, response, mock_session1);
+    sm->subscribe(TEST_UUID, TEST_KEY, 9, response, mock_session2);
+
+    // nothing goes out while commits are being applied...
+    EXPECT_CALL(*mock_session1, send_datagram(_)).Times(0);
+    EXPECT_CALL(*mock_session2, send_datagram(_)).Times(0);
+
+    for (const auto& value : {"1", "2", "3"})
+    {
+        database_msg msg;
+        msg.mutable_header()->set_db_uuid(TEST_UUID);
+        msg.mutable_update()->set_key(TEST_KEY);
+        msg.mutable_update()->set_value(value);
+        sm->inspect_commit(msg);
+    }
+
+    // writes to keys nobody watches are ignored...
+    database_msg unwatched;
+    unwatched.mutable_header()->set_db_uuid(TEST_UUID);
+    unwatched.mutable_update()->set_key(TEST_UNKOWN_KEY);
+    unwatched.mutable_update()->set_value("0");
+    sm->inspect_commit(unwatched);
+
+    Mock::VerifyAndClearExpectations(mock_session1.get());
+    Mock::VerifyAndClearExpectations(mock_session2.get());
+
+    // each subscription sees only the latest value...
+    std::vector<uint64_t> nonces;
+    auto check_update = [&](std::shared_ptr<std::string> msg)
+    {
+        database_response resp;
+        ASSERT_TRUE(resp.ParseFromString(*msg));
+        EXPECT_EQ(resp.header().db_uuid(), TEST_UUID);
+        EXPECT_EQ(resp.subscription_update().key(), TEST_KEY);
+        EXPECT_EQ(resp.subscription_update().value(), "3");
+        EXPECT_EQ(resp.subscription_update().operation(), database_subscription_update::UPDATE);
+        nonces.push_back(resp.header().nonce());
+    };
+
+    EXPECT_CALL(*mock_session1, send_datagram(_)).Times(2).WillRepeatedly(Invoke(check_update));
+    EXPECT_CALL(*mock_session2, send_datagram(_)).WillOnce(Invoke(check_update));
+
+    notify_wh(boost::system::error_code());
+
+    std::sort(nonces.begin(), nonces.end());
+    EXPECT_EQ(nonces, (std::vector<uint64_t>{7, 8, 9}));
+
+    // the window is over, so a later delete is sent on its own...
+    EXPECT_CALL(*mock_session1, send_datagram(_)).Times(2);
+    EXPECT_CALL(*mock_session2, send_datagram(_)).WillOnce(Invoke(
+        [](std::shared_ptr<std::string> msg)
+        {
+            database_response resp;
+            ASSERT_TRUE(resp.ParseFromString(*msg));
+            EXPECT_EQ(resp.header().nonce(), uint64_t(9));
+            EXPECT_EQ(resp.subscription_update().operation(), database_subscription_update::DELETE);
+        }));
+
+    database_msg msg;
+    msg.mutable_header()->set_db_uuid(TEST_UUID);
+    msg.mutable_delete_()->set_key(TEST_KEY);
+    sm->inspect_commit(msg);
+
+    notify_wh(boost::system::error_code());
+}
+
+
+TEST(subscription_manager, test_that_session_can_subscribe_and_unsubscribe_by_prefix)
+{
+    auto mock_session1 = std::make_shared<bzn::Mocksession_base>();
+    auto mock_session2 = std::make_shared<bzn::Mocksession_base>();
+
+    EXPECT_CALL(*mock_session1, get_session_id()).WillRepeatedly(Return(bzn::session_id(1)));
+    EXPECT_CALL(*mock_session2, get_session_id()).WillRepeatedly(Return(bzn::session_id(2)));
+
+    bzn::asio::wait_handler purge_wh;
+    bzn::asio::wait_handler notify_wh;
+    auto sm = std::make_shared<bzn::subscription_manager>(make_io_context(purge_wh, notify_wh));
+
+    {
+        database_response response;
+        sm->subscribe_prefix(TEST_UUID, "user/", 1, response, mock_session1);
+        EXPECT_EQ(response.response_case(), database_response::RESPONSE_NOT_SET);
+
+        sm->subscribe_prefix(TEST_UUID, "user/", 1, response, mock_session1);
+        EXPECT_EQ(response.error().message(), bzn::MSG_DUPLICATE_SUB);
+    }
+
+    // an empty prefix watches the whole database...
+    {
+        database_response response;
+        sm->subscribe_prefix(TEST_UUID, "", 2, response, mock_session2);
+        EXPECT_EQ(response.response_case(), database_response::RESPONSE_NOT_SET);
+    }
+
+    auto commit = [&](const bzn::key_t& key)
+    {
+        database_msg msg;
+        msg.mutable_header()->set_db_uuid(TEST_UUID);
+        msg.mutable_create()->set_key(key);
+        msg.mutable_create()->set_value("value");
+        sm->inspect_commit(msg);
+    };
+
+    std::vector<std::pair<uint64_t, bzn::key_t>> session1_updates;
+    std::vector<std::pair<uint64_t, bzn::key_t>> session2_updates;
+
+    auto record = [](auto& updates)
+    {
+        return [&updates](std::shared_ptr<std::string> msg)
+        {
+            database_response resp;
+            ASSERT_TRUE(resp.ParseFromString(*msg));
+            EXPECT_EQ(resp.header().db_uuid(), TEST_UUID);
+            updates.emplace_back(resp.header().nonce(), resp.subscription_update().key());
+        };
+    };
+
+    EXPECT_CALL(*mock_session1, send_datagram(_)).WillRepeatedly(Invoke(record(session1_updates)));
+    EXPECT_CALL(*mock_session2, send_datagram(_)).WillRepeatedly(Invoke(record(session2_updates)));
+
+    commit("user/1");
+    commit("user/2");
+    commit("user");
+    commit("other");
+    notify_wh(boost::system::error_code());
+
+    std::sort(session1_updates.begin(), session1_updates.end());
+    std::sort(session2_updates.begin(), session2_updates.end());
+
+    using updates_t = std::vector<std::pair<uint64_t, bzn::key_t>>;
+    EXPECT_EQ(session1_updates, (updates_t{{1, "user/1"}, {1, "user/2"}}));
+    EXPECT_EQ(session2_updates, (updates_t{{2, "other"}, {2, "user"}, {2, "user/1"}, {2, "user/2"}}));
+
+    // unsubscribe errors...
+    {
+        database_response response;
+        sm->unsubscribe_prefix(TEST_UNKOWN_UUID, "user/", 1, response, mock_session1);
+        EXPECT_EQ(response.error().message(), bzn::MSG_INVALID_UUID);
+
+        sm->unsubscribe_prefix(TEST_UUID, "users", 1, response, mock_session1);
+        EXPECT_EQ(response.error().message(), bzn::MSG_INVALID_KEY);
+
+        sm->unsubscribe_prefix(TEST_UUID, "user/", 1, response, mock_session2);
+        EXPECT_EQ(response.error().message(), bzn::MSG_INVALID_SUB);
+
+        sm->unsubscribe_prefix(TEST_UUID, "user/", 2, response, mock_session1);
+        EXPECT_EQ(response.error().message(), bzn::MSG_INVALID_SUB);
+    }
+
+    {
+        database_response response;
+        sm->unsubscribe_prefix(TEST_UUID, "user/", 1, response, mock_session1);
+        EXPECT_EQ(response.response_case(), database_response::RESPONSE_NOT_SET);
+    }
+
+    session1_updates.clear();
+    session2_updates.clear();
+
+    commit("user/3");
+    notify_wh(boost::system::error_code());
+
+    EXPECT_TRUE(session1_updates.empty());
+    EXPECT_EQ(session2_updates, (updates_t{{2, "user/3"}}));
+}
+
+
+TEST(subscription_manager, test_that_dead_session_is_removed_from_prefix_subscribers)
+{
+    bzn::asio::wait_handler purge_wh;
+    bzn::asio::wait_handler notify_wh;
+    auto sm = std::make_shared<bzn::subscription_manager>(make_io_context(purge_wh, notify_wh));
+
+    sm->start();
+
+    auto mock_session1 = std::make_shared<bzn::Mocksession_base>();
+    auto mock_session2 = std::make_shared<bzn::Mocksession_base>();
+
+    EXPECT_CALL(*mock_session1, get_session_id()).WillRepeatedly(Return(bzn::session_id(1)));
+    EXPECT_CALL(*mock_session2, get_session_id()).WillRepeatedly(Return(bzn::session_id(2)));
+
+    database_response response;
+    sm->subscribe_prefix(TEST_UUID, "k", 0, response, mock_session1);
+    sm->subscribe_prefix(TEST_UUID, "ke", 1, response, mock_session2);
+
+    // kill session and purge...
+    mock_session2.reset();
+    purge_wh(boost::system::error_code());
+
+    // the pruned branch is gone, so unsubscribing from it is an unknown prefix...
+    auto mock_session3 = std::make_shared<bzn::Mocksession_base>();
+    EXPECT_CALL(*mock_session3, get_session_id()).WillRepeatedly(Return(bzn::session_id(2)));
+
+    sm->unsubscribe_prefix(TEST_UUID, "ke", 1, response, mock_session3);
+    EXPECT_EQ(response.error().message(), bzn::MSG_INVALID_KEY);
+
+    EXPECT_CALL(*mock_session1, send_datagram(_));
+
+    database_msg msg;
+    msg.mutable_header()->set_db_uuid(TEST_UUID);
+    msg.mutable_delete_()->set_key(TEST_KEY);
+    sm->inspect_commit(msg);
+    notify_wh(boost::system::error_code());
 }
@@ -13,6 +13,7 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <crypto/crypto.hpp>
+#include <metrics/metrics.hpp>
 #include <openssl/pem.h>
 #include <openssl/err.h>
 #include <openssl/crypto.h>
@@ -23,13 +24,18 @@ namespace
 {
     const std::string PEM_PREFIX = "-----BEGIN PUBLIC KEY-----\n";
     const std::string PEM_SUFFIX = "\n-----END PUBLIC KEY-----\n";
+
+    auto& verify_latency = bzn::metrics::registry::instance().get_histogram("crypto_verify_latency_us");
+    auto& sign_latency = bzn::metrics::registry::instance().get_histogram("crypto_sign_latency_us");
 }
 
 crypto::crypto(std::shared_ptr<bzn::options_base> options)
         : options(std::move(options))
+        , crypto_enabled_outgoing(this->options->get_simple_options(), bzn::option_names::CRYPTO_ENABLED_OUTGOING)
+        , crypto_enabled_incoming(this->options->get_simple_options(), bzn::option_names::CRYPTO_ENABLED_INCOMING)
 {
     LOG(info) << "Using " << SSLeay_version(SSLEAY_VERSION);
-    if(this->options->get_simple_options().get<bool>(bzn::option_names::CRYPTO_ENABLED_OUTGOING))
+    if(this->crypto_enabled_outgoing.get())
     {
         this->load_private_key();
     }
@@ -76,6 +82,10 @@ crypto::extract_payload(const bzn_envelope& msg)
         {
             return msg.status_response();
         }
+        case bzn_envelope::kRaft:
+        {
+            return msg.raft();
+        }
         default :
         {
             throw std::runtime_error(
@@ -109,11 +119,13 @@ crypto::deterministic_serialize(const bzn_envelope& msg)
 bool
 crypto::verify(const bzn_envelope& msg)
 {
-    if (!this->options->get_simple_options().get<bool>(bzn::option_names::CRYPTO_ENABLED_INCOMING))
+    if (!this->crypto_enabled_incoming.get())
     {
         return true;
     }
 
+    bzn::metrics::scoped_timer timer(verify_latency);
+
     BIO_ptr_t bio(BIO_new(BIO_s_mem()), &BIO_free);
     EC_KEY_ptr_t pubkey(nullptr, &EC_KEY_free);
     EVP_PKEY_ptr_t key(EVP_PKEY_new(), &EVP_PKEY_free);
@@ -159,11 +171,13 @@ crypto::verify(const bzn_envelope& msg)
 bool
 crypto::sign(bzn_envelope& msg)
 {
-    if (!this->options->get_simple_options().get<bool>(bzn::option_names::CRYPTO_ENABLED_OUTGOING))
+    if (!this->crypto_enabled_outgoing.get())
     {
         return true;
     }
 
+    bzn::metrics::scoped_timer timer(sign_latency);
+
     if (msg.sender().empty())
     {
         msg.set_sender(this->options->get_uuid());
@@ -17,6 +17,7 @@
 
 #include <crypto/crypto_base.hpp>
 #include <options/options_base.hpp>
+#include <options/cached_option.hpp>
 #include <proto/bluzelle.pb.h>
 #include <openssl/evp.h>
 #include <openssl/ec.h>
@@ -37,6 +38,13 @@ namespace bzn
 
         std::string hash(const bzn_envelope& msg) override;
 
+        /**
+         * The bytes that are signed, verified and hashed for an envelope
+         * @param msg envelope to serialize
+         * @return the length prefixed sender, payload type, payload and timestamp
+         */
+        const std::string deterministic_serialize(const bzn_envelope& msg);
+
     private:
 
         using EC_KEY_ptr_t = std::unique_ptr<EC_KEY, decltype(&::EC_KEY_free)>;
@@ -50,10 +58,12 @@ namespace bzn
 
         const std::string& extract_payload(const bzn_envelope& msg);
 
-        const std::string deterministic_serialize(const bzn_envelope& msg);
-
         std::shared_ptr<bzn::options_base> options;
 
+        // checked on every sign/verify
+        const bzn::cached_option<bool> crypto_enabled_outgoing;
+        const bzn::cached_option<bool> crypto_enabled_incoming;
+
         EVP_PKEY_ptr_t private_key_EVP = EVP_PKEY_ptr_t(nullptr, &EVP_PKEY_free);
         EC_KEY_ptr_t private_key_EC = EC_KEY_ptr_t(nullptr, &EC_KEY_free);
 
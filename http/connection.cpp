@@ -14,26 +14,27 @@
 
 #include <include/bluzelle.hpp>
 #include <http/connection.hpp>
-
-#include <boost/algorithm/string/split.hpp>
-#include <boost/algorithm/string/classification.hpp>
+#include <metrics/metrics.hpp>
+#include <array>
 
 
 namespace
 {
-    const std::string CREATE_REQ = "create";
-    const std::string   READ_REQ = "read";
-    const std::string UPDATE_REQ = "update";
-    const std::string DELETE_REQ = "delete";
+    const boost::beast::string_view CREATE_REQ{"create"};
+    const boost::beast::string_view   READ_REQ{"read"};
+    const boost::beast::string_view UPDATE_REQ{"update"};
+    const boost::beast::string_view DELETE_REQ{"delete"};
+
+    // a keep-alive connection is closed once it has been idle this long...
+    const std::chrono::seconds HTTP_IDLE_TIMEOUT{10};
 
-    const std::chrono::seconds HTTP_TIMEOUT{10};
+    // stop reading ahead once this many responses are waiting to be written
+    const size_t MAX_PIPELINED_REQUESTS = 16;
 
-    //             0   1     2      3
-    // url format:  /<req>/<uuid>/<key>
-    const uint8_t REQUEST_PATH_IDX = 1;
-    const uint8_t    UUID_PATH_IDX = 2;
-    const uint8_t     KEY_PATH_IDX = 3;
-    const size_t     MAX_PATH_SIZE = 4;
+    const boost::beast::string_view BULK_PATH_PREFIX{"/bulk/"};
+
+    // scraped by prometheus...
+    const boost::beast::string_view METRICS_PATH{"/metrics"};
 
     void format_http_response(const boost::beast::string_view& target, const database_response& response, boost::beast::http::response<boost::beast::http::dynamic_body>& http_response)
     {
@@ -62,14 +63,184 @@ namespace
             boost::beast::ostream(http_response.body()) << ((!response.has_error()) ? "ack" : "err");
         }
     }
+
+    // append one bulk operation to the batch: "create" and "update" need a value, "read" and "delete" must not have one
+    bool add_bulk_operation(database_batch& batch, boost::beast::string_view uuid, boost::beast::string_view cmd,
+        boost::beast::string_view key, const std::optional<boost::beast::string_view>& value)
+    {
+        auto request = batch.add_requests();
+        request->mutable_header()->set_db_uuid(uuid.data(), uuid.size());
+
+        if (cmd == CREATE_REQ && value)
+        {
+            request->mutable_create()->set_key(key.data(), key.size());
+            request->mutable_create()->set_value(value->data(), value->size());
+            return true;
+        }
+
+        if (cmd == UPDATE_REQ && value)
+        {
+            request->mutable_update()->set_key(key.data(), key.size());
+            request->mutable_update()->set_value(value->data(), value->size());
+            return true;
+        }
+
+        if (cmd == READ_REQ && !value)
+        {
+            request->mutable_read()->set_key(key.data(), key.size());
+            return true;
+        }
+
+        if (cmd == DELETE_REQ && !value)
+        {
+            request->mutable_delete_()->set_key(key.data(), key.size());
+            return true;
+        }
+
+        return false;
+    }
+
+
+    // [{"cmd": "create", "key": "k", "value": "v"}, {"cmd": "delete", "key": "k"}, ...]
+    bool parse_bulk_json(const std::string& body, boost::beast::string_view uuid, database_batch& batch)
+    {
+        bzn::json_message operations;
+
+        if (!Json::Reader().parse(body, operations) || !operations.isArray())
+        {
+            return false;
+        }
+
+        for (const auto& operation : operations)
+        {
+            if (!operation.isObject() || !operation["cmd"].isString() || !operation["key"].isString() ||
+                (operation.isMember("value") && !operation["value"].isString()))
+            {
+                return false;
+            }
+
+            const std::string cmd = operation["cmd"].asString();
+            const std::string key = operation["key"].asString();
+            const std::string value = operation["value"].asString();
+
+            if (!add_bulk_operation(batch, uuid, cmd, key,
+                operation.isMember("value") ? std::make_optional<boost::beast::string_view>(value) : std::nullopt))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+
+    // one operation per line: "<cmd> <key>" or "<cmd> <key> <value>", the value runs to the end of the line
+    bool parse_bulk_lines(boost::beast::string_view body, boost::beast::string_view uuid, database_batch& batch)
+    {
+        while (!body.empty())
+        {
+            auto line = body.substr(0, body.find('\n'));
+            body.remove_prefix(std::min(line.size() + 1, body.size()));
+
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.remove_suffix(1);
+            }
+
+            if (line.empty())
+            {
+                continue;
+            }
+
+            const auto cmd_end = line.find(' ');
+            if (cmd_end == boost::beast::string_view::npos)
+            {
+                return false;
+            }
+
+            const auto cmd = line.substr(0, cmd_end);
+            auto key = line.substr(cmd_end + 1);
+            std::optional<boost::beast::string_view> value;
+
+            if (const auto key_end = key.find(' '); key_end != boost::beast::string_view::npos)
+            {
+                value = key.substr(key_end + 1);
+                key = key.substr(0, key_end);
+            }
+
+            if (!add_bulk_operation(batch, uuid, cmd, key, value))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+
+    const std::string& bulk_operation_key(const database_msg& request)
+    {
+        switch (request.msg_case())
+        {
+            case database_msg::kCreate: return request.create().key();
+            case database_msg::kUpdate: return request.update().key();
+            case database_msg::kDelete: return request.delete_().key();
+            default: return request.read().key();
+        }
+    }
+
+
+    // one result object per operation, in request order
+    void format_bulk_response(const boost::beast::string_view& target, const database_batch& batch, const std::vector<database_response>& responses,
+        boost::beast::http::response<boost::beast::http::dynamic_body>& http_response)
+    {
+        // if any part of the batch has to go to the leader then all of it does...
+        for (const auto& response : responses)
+        {
+            if (response.response_case() == database_response::kRedirect)
+            {
+                format_http_response(target, response, http_response);
+                return;
+            }
+        }
+
+        bzn::json_message results(Json::arrayValue);
+
+        for (size_t i = 0; i < responses.size(); ++i)
+        {
+            bzn::json_message result;
+            result["key"] = bulk_operation_key(batch.requests(i));
+
+            if (responses[i].has_error())
+            {
+                result["result"] = "err";
+                result["error"] = responses[i].error().message();
+            }
+            else
+            {
+                result["result"] = "ack";
+
+                if (responses[i].has_read())
+                {
+                    result["value"] = responses[i].read().value();
+                }
+            }
+
+            results.append(result);
+        }
+
+        http_response.set(boost::beast::http::field::content_type, "application/json");
+        boost::beast::ostream(http_response.body()) << Json::FastWriter().write(results);
+    }
 }
 
 using namespace bzn::http;
 
 
 connection::connection(std::shared_ptr<bzn::asio::io_context_base> io_context, std::unique_ptr<bzn::beast::http_socket_base> http_socket, std::shared_ptr<bzn::deprecated::crud_base> crud)
-    : http_socket(std::move(http_socket))
-    , deadline_timer(io_context->make_unique_steady_timer())
+    : strand(io_context->make_unique_strand())
+    , http_socket(std::move(http_socket))
+    , idle_timer(io_context->make_unique_steady_timer())
     , crud(std::move(crud))
 {
 }
@@ -82,191 +253,402 @@ connection::start()
 }
 
 
+bool
+connection::parse_bulk_target(boost::beast::string_view target, boost::beast::string_view& uuid, std::vector<boost::beast::string_view>& keys)
+{
+    if (!target.starts_with(BULK_PATH_PREFIX))
+    {
+        return false;
+    }
+
+    target.remove_prefix(BULK_PATH_PREFIX.size());
+
+    auto pos = target.find('/');
+    uuid = target.substr(0, pos);
+    keys.clear();
+
+    if (uuid.empty())
+    {
+        return false;
+    }
+
+    while (pos != boost::beast::string_view::npos)
+    {
+        target.remove_prefix(pos + 1);
+        pos = target.find('/');
+        keys.emplace_back(target.substr(0, pos));
+    }
+
+    return true;
+}
+
+
+bool
+connection::parse_target(boost::beast::string_view target, target_path& path)
+{
+    // url format: /<req>/<uuid>/<key>
+    std::array<boost::beast::string_view*, 3> fields{&path.request, &path.uuid, &path.key};
+
+    if (target.empty() || target.front() != '/')
+    {
+        return false;
+    }
+
+    target.remove_prefix(1);
+
+    for (size_t i = 0; i < fields.size(); ++i)
+    {
+        const auto pos = target.find('/');
+        const bool last = (i + 1 == fields.size());
+
+        // the key is the remainder and may not contain another separator...
+        if (last != (pos == boost::beast::string_view::npos))
+        {
+            return false;
+        }
+
+        *fields[i] = target.substr(0, pos);
+
+        if (!last)
+        {
+            target.remove_prefix(pos + 1);
+        }
+    }
+
+    return true;
+}
+
+
 void
 connection::do_read_request()
 {
-    this->start_deadline_timer();
+    // every request needs a fresh message to parse into...
+    this->request = {};
+    this->reading = true;
+
+    this->start_idle_timer();
 
-    // todo: strands?
-    this->http_socket->async_read(this->buffer, this->request,
+    // a pipelined read may complete while a write is in flight, so every handler runs on the strand...
+    this->http_socket->async_read(this->buffer, this->request, this->strand->wrap(
         [self = shared_from_this()](boost::beast::error_code ec, std::size_t /*bytes_transferred*/)
         {
-            if (!ec)
-            {
-                self->deadline_timer->cancel();
+            self->reading = false;
 
-                // extract the path levels from the target...
-                std::vector<std::string> path;
-                std::string target = self->request.target().to_string();
-                boost::split(path, target, boost::is_any_of("/"));
-
-                // test path...
-                if (path.size() != MAX_PATH_SIZE)
+            if (ec)
+            {
+                if (ec == boost::beast::http::error::end_of_stream)
                 {
-                    self->response.result(boost::beast::http::status::bad_request);
+                    LOG(debug) << "connection closed by client";
                 }
-                else
+                else if (ec != boost::asio::error::operation_aborted)
                 {
-                    switch (self->request.method())
-                    {
-                        case boost::beast::http::verb::get:
-                        {
-                            self->handle_get(path);
-                            break;
-                        }
-
-                        case boost::beast::http::verb::post:
-                        {
-                            self->handle_post(path);
-                            break;
-                        }
-
-                        default:
-                        {
-                            self->response.result(boost::beast::http::status::bad_request);
-                            break;
-                        }
-                    }
+                    LOG(error) << "read failed: " << ec.message();
                 }
 
-                self->write_response();
+                // let any queued responses drain, but read nothing further...
+                self->closing = true;
 
+                if (!self->writing)
+                {
+                    self->idle_timer->cancel();
+                }
                 return;
             }
 
-            LOG(error) << "read failed: " << ec.message();
-        });
+            self->handle_request();
+        }));
 }
 
 
 void
-connection::start_deadline_timer()
+connection::handle_request()
 {
-    this->deadline_timer->expires_from_now(std::chrono::seconds(HTTP_TIMEOUT));
+    this->responses.emplace_back();
+    auto& response = this->responses.back();
 
-    // todo: strands?
-    this->deadline_timer->async_wait(
-        [self = shared_from_this()](auto ec)
+    target_path path;
+    boost::beast::string_view bulk_uuid;
+    std::vector<boost::beast::string_view> bulk_keys;
+
+    if (this->request.target() == METRICS_PATH && this->request.method() == boost::beast::http::verb::get)
+    {
+        boost::beast::ostream(response.body()) << bzn::metrics::registry::instance().to_prometheus();
+        response.set(boost::beast::http::field::content_type, "text/plain; version=0.0.4");
+    }
+    else if (this->request.target().starts_with(BULK_PATH_PREFIX))
+    {
+        if (parse_bulk_target(this->request.target(), bulk_uuid, bulk_keys))
+        {
+            this->handle_bulk(bulk_uuid, bulk_keys, response);
+        }
+        else
+        {
+            response.result(boost::beast::http::status::bad_request);
+        }
+    }
+    else if (!parse_target(this->request.target(), path))
+    {
+        response.result(boost::beast::http::status::bad_request);
+    }
+    else
+    {
+        switch (this->request.method())
+        {
+            case boost::beast::http::verb::get:
+            {
+                this->handle_get(path, response);
+                break;
+            }
+
+            case boost::beast::http::verb::post:
+            {
+                this->handle_post(path, response);
+                break;
+            }
+
+            default:
+            {
+                response.result(boost::beast::http::status::bad_request);
+                break;
+            }
+        }
+    }
+
+    response.version(this->request.version());
+    response.set(boost::beast::http::field::server, "Bluzelle/" SWARM_VERSION);
+    if (response.find(boost::beast::http::field::content_type) == response.end())
+    {
+        response.set(boost::beast::http::field::content_type, "text/plain");
+    }
+    response.content_length(response.body().size());
+    response.keep_alive(this->request.keep_alive());
+
+    if (!response.keep_alive())
+    {
+        this->closing = true;
+    }
+
+    if (!this->writing)
+    {
+        this->write_response();
+    }
+
+    // pipelined requests are read while earlier responses are still being written...
+    if (!this->closing && this->responses.size() < MAX_PIPELINED_REQUESTS)
+    {
+        this->do_read_request();
+    }
+}
+
+
+void
+connection::start_idle_timer()
+{
+    this->idle_timer->expires_from_now(HTTP_IDLE_TIMEOUT);
+
+    this->idle_timer->async_wait(this->strand->wrap(
+        [self = shared_from_this()](const boost::system::error_code& ec)
         {
             if (!ec)
             {
-                LOG(info) << "reached deadline timeout -- closing session";
+                LOG(info) << "reached idle timeout -- closing session";
                 self->http_socket->close();
                 return;
             }
-        });
+        }));
 }
 
 
 void
 connection::write_response()
 {
-    auto self = shared_from_this();
+    this->writing = true;
 
-    this->response.version(this->request.version());
-    this->response.set(boost::beast::http::field::server, "Bluzelle/" SWARM_VERSION);
-    this->response.set(boost::beast::http::field::content_type, "text/plain");
-    this->response.set(boost::beast::http::field::content_length, this->response.body().size());
-    this->response.keep_alive(false);
+    this->start_idle_timer();
 
     this->http_socket->async_write(
-        this->response,
-        [self](boost::beast::error_code ec, std::size_t)
+        this->responses.front(), this->strand->wrap(
+        [self = shared_from_this()](boost::beast::error_code ec, std::size_t)
         {
-            self->http_socket->get_socket().shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
-        });
+            self->writing = false;
+
+            if (ec)
+            {
+                LOG(error) << "write failed: " << ec.message();
+                self->closing = true;
+                self->idle_timer->cancel();
+                self->http_socket->close();
+                return;
+            }
+
+            const bool keep_alive = self->responses.front().keep_alive();
+            self->responses.pop_front();
+
+            if (!keep_alive)
+            {
+                self->idle_timer->cancel();
+                self->http_socket->get_socket().shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
+                return;
+            }
+
+            if (!self->responses.empty())
+            {
+                self->write_response();
+            }
+
+            // resume reading if we stopped because too many responses were queued...
+            if (!self->reading && !self->closing)
+            {
+                self->do_read_request();
+            }
+            else if (!self->writing && self->closing)
+            {
+                self->idle_timer->cancel();
+            }
+        }));
 }
 
 
 void
-connection::handle_get(const std::vector<std::string>& path)
+connection::handle_get(const target_path& path, http_response& response)
 {
     // Only read is supported by a GET...
-    if (path[REQUEST_PATH_IDX] == READ_REQ)
+    if (path.request == READ_REQ)
     {
-        LOG(debug) << "read: " << path[KEY_PATH_IDX];
+        LOG(debug) << "read: " << path.key;
 
         // format request using protobuf...
         database_msg request;
-        database_response response;
+        database_response db_response;
 
-        request.mutable_header()->set_db_uuid(path[UUID_PATH_IDX]);
-        request.mutable_read()->set_key(path[KEY_PATH_IDX]);
+        request.mutable_header()->set_db_uuid(path.uuid.data(), path.uuid.size());
+        request.mutable_read()->set_key(path.key.data(), path.key.size());
 
-        this->crud->handle_read(bzn::json_message(), request, response);
-        format_http_response(this->request.target(), response, this->response);
+        this->crud->handle_read(bzn::json_message(), request, db_response);
+        format_http_response(this->request.target(), db_response, response);
 
         return;
     }
 
-    this->response.result(boost::beast::http::status::bad_request);
+    response.result(boost::beast::http::status::bad_request);
 }
 
 
 void
-connection::handle_post(const std::vector<std::string>& path)
+connection::handle_post(const target_path& path, http_response& response)
 {
     std::stringstream post_data;
     post_data << boost::beast::buffers(this->request.body().data());
 
     // format request using protobuf...
-    database_response response;
+    database_response db_response;
     bzn::json_message crud_msg;
     crud_msg["bzn-api"] = "crud";
 
-    if (path[REQUEST_PATH_IDX] == CREATE_REQ)
-    {
-        LOG(debug) << "create: " << path[KEY_PATH_IDX] << " : " << post_data.str().substr(0, 1024);
+    bzn_msg msg;
+    msg.mutable_db()->mutable_header()->set_db_uuid(path.uuid.data(), path.uuid.size());
 
-        bzn_msg msg;
+    if (path.request == CREATE_REQ)
+    {
+        LOG(debug) << "create: " << path.key << " : " << post_data.str().substr(0, 1024);
 
-        msg.mutable_db()->mutable_header()->set_db_uuid(path[UUID_PATH_IDX]);
-        msg.mutable_db()->mutable_create()->set_key(path[KEY_PATH_IDX]);
+        msg.mutable_db()->mutable_create()->set_key(path.key.data(), path.key.size());
         msg.mutable_db()->mutable_create()->set_value(post_data.str());
 
         // todo: temp until we remove all json api or we store the request instead of the json message...
         crud_msg["msg"] = boost::beast::detail::base64_encode(msg.SerializeAsString());
 
-        this->crud->handle_create(crud_msg, msg.db(), response);
-        format_http_response(this->request.target(), response, this->response);
+        this->crud->handle_create(crud_msg, msg.db(), db_response);
+        format_http_response(this->request.target(), db_response, response);
 
         return;
     }
-    else if (path[REQUEST_PATH_IDX] == UPDATE_REQ)
+    else if (path.request == UPDATE_REQ)
     {
-        LOG(debug) << "update: " << path[KEY_PATH_IDX] << " : " << post_data.str().substr(0, 1024);
+        LOG(debug) << "update: " << path.key << " : " << post_data.str().substr(0, 1024);
 
-        bzn_msg msg;
-
-        msg.mutable_db()->mutable_header()->set_db_uuid(path[UUID_PATH_IDX]);
-        msg.mutable_db()->mutable_update()->set_key(path[KEY_PATH_IDX]);
+        msg.mutable_db()->mutable_update()->set_key(path.key.data(), path.key.size());
         msg.mutable_db()->mutable_update()->set_value(post_data.str());
 
         // todo: temp until we remove all json api or we store the request instead of the json message...
         crud_msg["msg"] = boost::beast::detail::base64_encode(msg.SerializeAsString());
 
-        this->crud->handle_update(crud_msg, msg.db(), response);
-        format_http_response(this->request.target(), response, this->response);
+        this->crud->handle_update(crud_msg, msg.db(), db_response);
+        format_http_response(this->request.target(), db_response, response);
 
         return;
     }
-    else if (path[REQUEST_PATH_IDX] == DELETE_REQ)
+    else if (path.request == DELETE_REQ)
     {
-        LOG(debug) << "delete: " << path[KEY_PATH_IDX] << " : " << post_data.str().substr(0, 1024);
-
-        bzn_msg msg;
+        LOG(debug) << "delete: " << path.key << " : " << post_data.str().substr(0, 1024);
 
-        msg.mutable_db()->mutable_header()->set_db_uuid(path[UUID_PATH_IDX]);
-        msg.mutable_db()->mutable_delete_()->set_key(path[KEY_PATH_IDX]);
+        msg.mutable_db()->mutable_delete_()->set_key(path.key.data(), path.key.size());
 
         // todo: temp until we remove all json api or we store the request instead of the json message...
         crud_msg["msg"] = boost::beast::detail::base64_encode(msg.SerializeAsString());
 
-        this->crud->handle_delete(crud_msg, msg.db(), response);
-        format_http_response(this->request.target(), response, this->response);
+        this->crud->handle_delete(crud_msg, msg.db(), db_response);
+        format_http_response(this->request.target(), db_response, response);
 
         return;
     }
 
-    this->response.result(boost::beast::http::status::bad_request);
+    response.result(boost::beast::http::status::bad_request);
+}
+
+
+void
+connection::handle_bulk(boost::beast::string_view uuid, const std::vector<boost::beast::string_view>& keys, http_response& response)
+{
+    database_batch batch;
+
+    switch (this->request.method())
+    {
+        // GET /bulk/<uuid>/<key>/<key>... reads every key
+        case boost::beast::http::verb::get:
+        {
+            if (keys.empty())
+            {
+                response.result(boost::beast::http::status::bad_request);
+                return;
+            }
+
+            for (const auto& key : keys)
+            {
+                add_bulk_operation(batch, uuid, READ_REQ, key, std::nullopt);
+            }
+            break;
+        }
+
+        // POST /bulk/<uuid> with a JSON array or newline delimited operations in the body
+        case boost::beast::http::verb::post:
+        {
+            const std::string body = boost::beast::buffers_to_string(this->request.body().data());
+            const auto start = body.find_first_not_of(" \t\r\n");
+
+            const bool parsed = (start != std::string::npos && body[start] == '[')
+                ? parse_bulk_json(body, uuid, batch)
+                : parse_bulk_lines(body, uuid, batch);
+
+            if (!keys.empty() || !parsed || batch.requests().empty())
+            {
+                response.result(boost::beast::http::status::bad_request);
+                return;
+            }
+            break;
+        }
+
+        default:
+        {
+            response.result(boost::beast::http::status::bad_request);
+            return;
+        }
+    }
+
+    LOG(debug) << "bulk: " << batch.requests_size() << " operations on " << uuid;
+
+    std::vector<database_response> responses;
+    this->crud->handle_batch(batch, responses);
+
+    format_bulk_response(this->request.target(), batch, responses, response);
 }
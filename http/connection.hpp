@@ -17,6 +17,7 @@
 #include <include/boost_asio_beast.hpp>
 #include <crud/crud_base.hpp>
 #include <storage/storage_base.hpp>
+#include <deque>
 #include <memory>
 
 #include <boost/beast/core.hpp>
@@ -43,21 +44,57 @@ namespace bzn::http
         FRIEND_TEST(http_connection, test_that_post_calls_crud_update_and_returns_success);
         FRIEND_TEST(http_connection, test_that_post_calls_crud_delete_and_returns_success);
 
-        void handle_get(const std::vector<std::string>& path);
-        void handle_post(const std::vector<std::string>& path);
+        FRIEND_TEST(http_connection, test_that_keep_alive_connection_reads_the_next_request);
+        FRIEND_TEST(http_connection, test_that_pipelined_responses_are_written_in_request_order);
+        FRIEND_TEST(http_connection, test_that_a_pipelined_read_during_a_pending_write_runs_on_the_strand);
+        FRIEND_TEST(http_connection, test_that_connection_close_request_stops_reading);
+        FRIEND_TEST(http_connection, test_that_malformed_targets_are_bad_requests);
+        FRIEND_TEST(http_connection, test_that_bulk_get_reads_every_key_in_one_batch);
+        FRIEND_TEST(http_connection, test_that_bulk_post_sends_newline_delimited_writes_as_one_batch);
+        FRIEND_TEST(http_connection, test_that_bulk_post_accepts_a_json_batch);
+        FRIEND_TEST(http_connection, test_that_bulk_post_redirects_to_the_leader);
+        FRIEND_TEST(http_connection, test_that_malformed_bulk_requests_are_bad_requests);
+        FRIEND_TEST(http_connection, test_that_metrics_are_served_as_prometheus_text);
+
+        using http_response = boost::beast::http::response<boost::beast::http::dynamic_body>;
+
+        // views into the request target: /<request>/<uuid>/<key>
+        struct target_path
+        {
+            boost::beast::string_view request;
+            boost::beast::string_view uuid;
+            boost::beast::string_view key;
+        };
+
+        static bool parse_target(boost::beast::string_view target, target_path& path);
+
+        // bulk requests: /bulk/<uuid>[/<key>...]
+        static bool parse_bulk_target(boost::beast::string_view target, boost::beast::string_view& uuid, std::vector<boost::beast::string_view>& keys);
+
+        void handle_get(const target_path& path, http_response& response);
+        void handle_post(const target_path& path, http_response& response);
+        void handle_bulk(boost::beast::string_view uuid, const std::vector<boost::beast::string_view>& keys, http_response& response);
 
         void do_read_request();
+        void handle_request();
         void write_response();
 
-        void start_deadline_timer();
+        void start_idle_timer();
 
+        // serializes the read, write and idle timer handlers, which all touch the state below...
+        std::unique_ptr<bzn::asio::strand_base> strand;
         std::shared_ptr<bzn::beast::http_socket_base> http_socket;
-        std::unique_ptr<bzn::asio::steady_timer_base> deadline_timer;
+        std::unique_ptr<bzn::asio::steady_timer_base> idle_timer;
         std::shared_ptr<bzn::deprecated::crud_base> crud;
 
         boost::beast::flat_buffer buffer{bzn::MAX_VALUE_SIZE + 1024}; // add a bit of room for a header
         boost::beast::http::request<boost::beast::http::dynamic_body> request;
-        boost::beast::http::response<boost::beast::http::dynamic_body> response;
+
+        // responses waiting to be written, in the order their requests arrived...
+        std::deque<http_response> responses;
+        bool reading = false;
+        bool writing = false;
+        bool closing = false;
 
         std::once_flag start_once;
     };
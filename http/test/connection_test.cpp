@@ -15,6 +15,7 @@
 #include <http/connection.hpp>
 #include <mocks/mock_boost_asio_beast.hpp>
 #include <mocks/mock_crud_base.hpp>
+#include <metrics/metrics.hpp>
 
 #include <gmock/gmock.h>
 
@@ -24,10 +25,47 @@ using namespace ::testing;
 
 namespace bzn::http
 {
+    namespace
+    {
+        // strand that hands each handler straight back, counting the calls that went through it...
+        std::shared_ptr<size_t>
+        expect_strand(bzn::asio::Mockio_context_base& mock_io_context)
+        {
+            auto dispatched = std::make_shared<size_t>(0);
+            auto mock_strand = std::make_unique<NiceMock<bzn::asio::Mockstrand_base>>();
+
+            EXPECT_CALL(*mock_strand, wrap(An<bzn::asio::write_handler>())).WillRepeatedly(Invoke(
+                [dispatched](bzn::asio::write_handler handler) -> bzn::asio::write_handler
+                {
+                    return [dispatched, handler](const boost::system::error_code& ec, size_t bytes_transferred)
+                    {
+                        ++*dispatched;
+                        handler(ec, bytes_transferred);
+                    };
+                }));
+
+            EXPECT_CALL(*mock_strand, wrap(An<bzn::asio::close_handler>())).WillRepeatedly(Invoke(
+                [dispatched](bzn::asio::close_handler handler) -> bzn::asio::close_handler
+                {
+                    return [dispatched, handler](const boost::system::error_code& ec)
+                    {
+                        ++*dispatched;
+                        handler(ec);
+                    };
+                }));
+
+            std::unique_ptr<bzn::asio::strand_base> strand = std::move(mock_strand);
+            EXPECT_CALL(mock_io_context, make_unique_strand()).WillOnce(Return(ByMove(std::move(strand))));
+
+            return dispatched;
+        }
+    }
+
 
     TEST(http_connection, test_that_http_get_calls_crud_read_and_returns_error_when_not_found)
     {
         auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+        expect_strand(*mock_io_context);
         auto mock_http_socket = std::make_unique<bzn::beast::Mockhttp_socket_base>();
         auto mock_crud = std::make_shared<bzn::deprecated::Mockcrud_base>();
         auto mock_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
@@ -39,7 +77,7 @@ namespace bzn::http
             [&](auto,auto,auto handler)
             {
                 rh = handler;
-            }));
+            })).WillRepeatedly(Return());
 
         EXPECT_CALL(*mock_io_context, make_unique_steady_timer()).WillOnce(Invoke(
             [&]()
@@ -66,7 +104,7 @@ namespace bzn::http
 
         // should get an error response
         std::stringstream ss;
-        ss << boost::beast::buffers(con->response.body().data());
+        ss << boost::beast::buffers(con->responses.front().body().data());
         EXPECT_EQ(ss.str(), "err");
 
     }
@@ -75,6 +113,7 @@ namespace bzn::http
     TEST(http_connection, test_that_http_get_calls_crud_read_and_returns_value_when_found)
     {
         auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+        expect_strand(*mock_io_context);
         auto mock_http_socket = std::make_unique<bzn::beast::Mockhttp_socket_base>();
         auto mock_crud = std::make_shared<bzn::deprecated::Mockcrud_base>();
         auto mock_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
@@ -86,7 +125,7 @@ namespace bzn::http
             [&](auto,auto,auto handler)
             {
                 rh = handler;
-            }));
+            })).WillRepeatedly(Return());
 
         EXPECT_CALL(*mock_io_context, make_unique_steady_timer()).WillOnce(Invoke(
             [&]()
@@ -115,7 +154,7 @@ namespace bzn::http
 
         // should get the value
         std::stringstream ss;
-        ss << boost::beast::buffers(con->response.body().data());
+        ss << boost::beast::buffers(con->responses.front().body().data());
         EXPECT_EQ(ss.str(), "ackvalue");
     }
 
@@ -123,6 +162,7 @@ namespace bzn::http
     TEST(http_connection, test_that_post_calls_crud_create_and_returns_success)
     {
         auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+        expect_strand(*mock_io_context);
         auto mock_http_socket = std::make_unique<bzn::beast::Mockhttp_socket_base>();
         auto mock_crud = std::make_shared<bzn::deprecated::Mockcrud_base>();
         auto mock_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
@@ -134,7 +174,7 @@ namespace bzn::http
             [&](auto, auto, auto handler)
             {
                 rh = handler;
-            }));
+            })).WillRepeatedly(Return());
 
         EXPECT_CALL(*mock_io_context, make_unique_steady_timer()).WillOnce(Invoke(
             [&]()
@@ -161,7 +201,7 @@ namespace bzn::http
         rh(boost::beast::error_code(), 0);
 
         std::stringstream ss;
-        ss << boost::beast::buffers(con->response.body().data());
+        ss << boost::beast::buffers(con->responses.front().body().data());
         EXPECT_EQ(ss.str(), "ack");
     }
 
@@ -169,6 +209,7 @@ namespace bzn::http
     TEST(http_connection, test_that_post_calls_crud_create_and_returns_redirect_when_not_the_leader)
     {
         auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+        expect_strand(*mock_io_context);
         auto mock_http_socket = std::make_unique<bzn::beast::Mockhttp_socket_base>();
         auto mock_crud = std::make_shared<bzn::deprecated::Mockcrud_base>();
         auto mock_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
@@ -180,7 +221,7 @@ namespace bzn::http
             [&](auto, auto, auto handler)
             {
                 rh = handler;
-            }));
+            })).WillRepeatedly(Return());
 
         EXPECT_CALL(*mock_io_context, make_unique_steady_timer()).WillOnce(Invoke(
             [&]()
@@ -210,14 +251,15 @@ namespace bzn::http
 
         rh(boost::beast::error_code(), 0);
 
-        EXPECT_EQ(con->response.result(), boost::beast::http::status::temporary_redirect);
-        EXPECT_EQ(std::string(con->response.at(boost::beast::http::field::location)), "http://127.0.0.1:8888/create/uuid/key");
+        EXPECT_EQ(con->responses.front().result(), boost::beast::http::status::temporary_redirect);
+        EXPECT_EQ(std::string(con->responses.front().at(boost::beast::http::field::location)), "http://127.0.0.1:8888/create/uuid/key");
     }
 
 
     TEST(http_connection, test_that_post_calls_crud_update_and_returns_success)
     {
         auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+        expect_strand(*mock_io_context);
         auto mock_http_socket = std::make_unique<bzn::beast::Mockhttp_socket_base>();
         auto mock_crud = std::make_shared<bzn::deprecated::Mockcrud_base>();
         auto mock_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
@@ -229,7 +271,7 @@ namespace bzn::http
             [&](auto, auto, auto handler)
             {
                 rh = handler;
-            }));
+            })).WillRepeatedly(Return());
 
         EXPECT_CALL(*mock_io_context, make_unique_steady_timer()).WillOnce(Invoke(
             [&]()
@@ -256,7 +298,7 @@ namespace bzn::http
         rh(boost::beast::error_code(), 0);
 
         std::stringstream ss;
-        ss << boost::beast::buffers(con->response.body().data());
+        ss << boost::beast::buffers(con->responses.front().body().data());
         EXPECT_EQ(ss.str(), "ack");
     }
 
@@ -264,6 +306,7 @@ namespace bzn::http
     TEST(http_connection, test_that_post_calls_crud_delete_and_returns_success)
     {
         auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+        expect_strand(*mock_io_context);
         auto mock_http_socket = std::make_unique<bzn::beast::Mockhttp_socket_base>();
         auto mock_crud = std::make_shared<bzn::deprecated::Mockcrud_base>();
         auto mock_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
@@ -275,7 +318,7 @@ namespace bzn::http
             [&](auto, auto, auto handler)
             {
                 rh = handler;
-            }));
+            })).WillRepeatedly(Return());
 
         EXPECT_CALL(*mock_io_context, make_unique_steady_timer()).WillOnce(Invoke(
             [&]()
@@ -302,7 +345,7 @@ namespace bzn::http
         rh(boost::beast::error_code(), 0);
 
         std::stringstream ss;
-        ss << boost::beast::buffers(con->response.body().data());
+        ss << boost::beast::buffers(con->responses.front().body().data());
         EXPECT_EQ(ss.str(), "ack");
     }
 
@@ -310,6 +353,7 @@ namespace bzn::http
     TEST(http_connection, test_that_post_calls_crud_method_and_timeout_closes_connection)
     {
         auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+        expect_strand(*mock_io_context);
         auto mock_http_socket = std::make_unique<bzn::beast::Mockhttp_socket_base>();
         auto mock_crud = std::make_shared<bzn::deprecated::Mockcrud_base>();
         auto mock_timer = std::make_unique<bzn::asio::Mocksteady_timer_base>();
@@ -343,4 +387,506 @@ namespace bzn::http
 
         wh(boost::system::error_code());
     }
+
+
+    TEST(http_connection, test_that_keep_alive_connection_reads_the_next_request)
+    {
+        auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+        expect_strand(*mock_io_context);
+        auto mock_http_socket = std::make_unique<bzn::beast::Mockhttp_socket_base>();
+        auto mock_crud = std::make_shared<bzn::deprecated::Mockcrud_base>();
+        auto mock_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+
+        bzn::beast::write_handler wh;
+        EXPECT_CALL(*mock_http_socket, async_write(_, _)).Times(2).WillRepeatedly(Invoke(
+            [&](auto, auto handler)
+            {
+                wh = handler;
+            }));
+
+        bzn::beast::read_handler rh;
+        EXPECT_CALL(*mock_http_socket, async_read(_, _, _)).Times(3).WillRepeatedly(Invoke(
+            [&](auto, auto, auto handler)
+            {
+                rh = handler;
+            }));
+
+        EXPECT_CALL(*mock_io_context, make_unique_steady_timer()).WillOnce(Invoke(
+            [&]()
+            {
+                return std::move(mock_timer);
+            }));
+
+        EXPECT_CALL(*mock_crud, handle_read(_, _, _)).Times(2);
+
+        auto con = std::make_shared<bzn::http::connection>(mock_io_context, std::move(mock_http_socket), mock_crud);
+        con->start();
+
+        // both requests are answered on the same connection...
+        for (size_t i = 0; i < 2; ++i)
+        {
+            con->request.method(boost::beast::http::verb::get);
+            con->request.target("/read/uuid/key");
+            auto handler = rh;
+            handler(boost::beast::error_code(), 0);
+
+            ASSERT_EQ(con->responses.size(), size_t(1));
+            EXPECT_TRUE(con->responses.front().keep_alive());
+
+            auto write_handler = wh;
+            write_handler(boost::beast::error_code(), 0);
+            EXPECT_TRUE(con->responses.empty());
+        }
+
+        // client hanging up ends the read loop...
+        rh(boost::beast::http::error::end_of_stream, 0);
+        EXPECT_TRUE(con->closing);
+    }
+
+
+    TEST(http_connection, test_that_pipelined_responses_are_written_in_request_order)
+    {
+        auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+        expect_strand(*mock_io_context);
+        auto mock_http_socket = std::make_unique<bzn::beast::Mockhttp_socket_base>();
+        auto mock_crud = std::make_shared<bzn::deprecated::Mockcrud_base>();
+        auto mock_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+
+        std::vector<std::string> written;
+        bzn::beast::write_handler wh;
+        EXPECT_CALL(*mock_http_socket, async_write(_, _)).WillRepeatedly(Invoke(
+            [&](auto& response, auto handler)
+            {
+                std::stringstream ss;
+                ss << boost::beast::buffers(response.body().data());
+                written.push_back(ss.str());
+                wh = handler;
+            }));
+
+        bzn::beast::read_handler rh;
+        EXPECT_CALL(*mock_http_socket, async_read(_, _, _)).WillRepeatedly(Invoke(
+            [&](auto, auto, auto handler)
+            {
+                rh = handler;
+            }));
+
+        EXPECT_CALL(*mock_io_context, make_unique_steady_timer()).WillOnce(Invoke(
+            [&]()
+            {
+                return std::move(mock_timer);
+            }));
+
+        EXPECT_CALL(*mock_crud, handle_read(_, _, _)).WillRepeatedly(Invoke(
+            [](auto, const database_msg& request, database_response& response)
+            {
+                response.mutable_read()->set_value(request.read().key());
+            }));
+
+        auto con = std::make_shared<bzn::http::connection>(mock_io_context, std::move(mock_http_socket), mock_crud);
+        con->start();
+
+        // three requests arrive before the first response has been written...
+        for (const auto& key : {"key0", "key1", "key2"})
+        {
+            con->request.method(boost::beast::http::verb::get);
+            con->request.target(std::string("/read/uuid/") + key);
+            auto handler = rh;
+            handler(boost::beast::error_code(), 0);
+        }
+
+        EXPECT_EQ(con->responses.size(), size_t(3));
+        ASSERT_EQ(written, std::vector<std::string>{"ackkey0"});
+
+        for (size_t i = 0; i < 2; ++i)
+        {
+            auto handler = wh;
+            handler(boost::beast::error_code(), 0);
+        }
+
+        EXPECT_EQ(written, (std::vector<std::string>{"ackkey0", "ackkey1", "ackkey2"}));
+        EXPECT_EQ(con->responses.size(), size_t(1));
+        EXPECT_TRUE(con->reading);
+    }
+
+
+    TEST(http_connection, test_that_a_pipelined_read_during_a_pending_write_runs_on_the_strand)
+    {
+        auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+        auto dispatched = expect_strand(*mock_io_context);
+        auto mock_http_socket = std::make_unique<bzn::beast::Mockhttp_socket_base>();
+        auto mock_crud = std::make_shared<bzn::deprecated::Mockcrud_base>();
+        auto mock_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+
+        bzn::asio::wait_handler th;
+        EXPECT_CALL(*mock_timer, async_wait(_)).WillRepeatedly(Invoke(
+            [&](auto handler)
+            {
+                th = handler;
+            }));
+
+        std::vector<std::string> written;
+        bzn::beast::write_handler wh;
+        EXPECT_CALL(*mock_http_socket, async_write(_, _)).Times(2).WillRepeatedly(Invoke(
+            [&](auto& response, auto handler)
+            {
+                written.push_back(boost::beast::buffers_to_string(response.body().data()));
+                wh = handler;
+            }));
+
+        bzn::beast::read_handler rh;
+        EXPECT_CALL(*mock_http_socket, async_read(_, _, _)).Times(3).WillRepeatedly(Invoke(
+            [&](auto, auto, auto handler)
+            {
+                rh = handler;
+            }));
+
+        EXPECT_CALL(*mock_io_context, make_unique_steady_timer()).WillOnce(Invoke(
+            [&]()
+            {
+                return std::move(mock_timer);
+            }));
+
+        EXPECT_CALL(*mock_crud, handle_read(_, _, _)).Times(2).WillRepeatedly(Invoke(
+            [](auto, const database_msg& request, database_response& response)
+            {
+                response.mutable_read()->set_value(request.read().key());
+            }));
+
+        auto con = std::make_shared<bzn::http::connection>(mock_io_context, std::move(mock_http_socket), mock_crud);
+        con->start();
+
+        con->request.method(boost::beast::http::verb::get);
+        con->request.target("/read/uuid/key0");
+        auto read_handler = rh;
+        read_handler(boost::beast::error_code(), 0);
+
+        // the first response is still being written when the next request arrives...
+        ASSERT_TRUE(con->writing);
+        auto first_write = wh;
+
+        con->request.method(boost::beast::http::verb::get);
+        con->request.target("/read/uuid/key1");
+        read_handler = rh;
+        read_handler(boost::beast::error_code(), 0);
+
+        EXPECT_EQ(con->responses.size(), size_t(2));
+        EXPECT_EQ(written, std::vector<std::string>{"ackkey0"});
+
+        first_write(boost::beast::error_code(), 0);
+        auto second_write = wh;
+        second_write(boost::beast::error_code(), 0);
+
+        EXPECT_EQ(written, (std::vector<std::string>{"ackkey0", "ackkey1"}));
+        EXPECT_TRUE(con->responses.empty());
+
+        // a cancelled idle timer goes through the strand too...
+        th(boost::asio::error::operation_aborted);
+
+        // two reads, two writes and the timer all completed on the strand...
+        EXPECT_EQ(*dispatched, size_t(5));
+    }
+
+
+    TEST(http_connection, test_that_connection_close_request_stops_reading)
+    {
+        auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+        expect_strand(*mock_io_context);
+        auto mock_http_socket = std::make_unique<bzn::beast::Mockhttp_socket_base>();
+        auto mock_crud = std::make_shared<bzn::deprecated::Mockcrud_base>();
+        auto mock_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+
+        EXPECT_CALL(*mock_http_socket, async_write(_, _));
+
+        bzn::beast::read_handler rh;
+        EXPECT_CALL(*mock_http_socket, async_read(_, _, _)).WillOnce(Invoke(
+            [&](auto, auto, auto handler)
+            {
+                rh = handler;
+            }));
+
+        EXPECT_CALL(*mock_io_context, make_unique_steady_timer()).WillOnce(Invoke(
+            [&]()
+            {
+                return std::move(mock_timer);
+            }));
+
+        EXPECT_CALL(*mock_crud, handle_read(_, _, _));
+
+        auto con = std::make_shared<bzn::http::connection>(mock_io_context, std::move(mock_http_socket), mock_crud);
+        con->start();
+
+        con->request.method(boost::beast::http::verb::get);
+        con->request.target("/read/uuid/key");
+        con->request.keep_alive(false);
+        rh(boost::beast::error_code(), 0);
+
+        ASSERT_EQ(con->responses.size(), size_t(1));
+        EXPECT_FALSE(con->responses.front().keep_alive());
+        EXPECT_TRUE(con->closing);
+        EXPECT_FALSE(con->reading);
+    }
+
+
+    TEST(http_connection, test_that_malformed_targets_are_bad_requests)
+    {
+        bzn::http::connection::target_path path;
+
+        ASSERT_TRUE(bzn::http::connection::parse_target("/read/uuid/key", path));
+        EXPECT_EQ(path.request, "read");
+        EXPECT_EQ(path.uuid, "uuid");
+        EXPECT_EQ(path.key, "key");
+
+        ASSERT_TRUE(bzn::http::connection::parse_target("/read//key", path));
+        EXPECT_EQ(path.uuid, "");
+
+        EXPECT_FALSE(bzn::http::connection::parse_target("", path));
+        EXPECT_FALSE(bzn::http::connection::parse_target("/", path));
+        EXPECT_FALSE(bzn::http::connection::parse_target("read/uuid/key", path));
+        EXPECT_FALSE(bzn::http::connection::parse_target("/read/uuid", path));
+        EXPECT_FALSE(bzn::http::connection::parse_target("/read/uuid/key/more", path));
+    }
+
+
+    namespace
+    {
+        // connection with a single captured read, ready for the test to fill in the request
+        std::shared_ptr<bzn::http::connection>
+        make_bulk_connection(std::shared_ptr<bzn::deprecated::Mockcrud_base> mock_crud, bzn::beast::read_handler& rh)
+        {
+            auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+            expect_strand(*mock_io_context);
+            auto mock_http_socket = std::make_unique<NiceMock<bzn::beast::Mockhttp_socket_base>>();
+            auto mock_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+
+            EXPECT_CALL(*mock_http_socket, async_read(_, _, _)).WillOnce(Invoke(
+                [&](auto, auto, auto handler)
+                {
+                    rh = handler;
+                })).WillRepeatedly(Return());
+
+            EXPECT_CALL(*mock_io_context, make_unique_steady_timer()).WillOnce(Invoke(
+                [&]()
+                {
+                    return std::move(mock_timer);
+                }));
+
+            auto con = std::make_shared<bzn::http::connection>(mock_io_context, std::move(mock_http_socket), mock_crud);
+            con->start();
+
+            return con;
+        }
+
+
+        bzn::json_message
+        response_json(const boost::beast::http::response<boost::beast::http::dynamic_body>& response)
+        {
+            bzn::json_message json;
+            Json::Reader().parse(boost::beast::buffers_to_string(response.body().data()), json);
+            return json;
+        }
+    }
+
+
+    TEST(http_connection, test_that_bulk_get_reads_every_key_in_one_batch)
+    {
+        auto mock_crud = std::make_shared<bzn::deprecated::Mockcrud_base>();
+        bzn::beast::read_handler rh;
+        auto con = make_bulk_connection(mock_crud, rh);
+
+        con->request.method(boost::beast::http::verb::get);
+        con->request.target("/bulk/uuid/key0/key1");
+
+        EXPECT_CALL(*mock_crud, handle_batch(_, _)).WillOnce(Invoke(
+            [](const database_batch& batch, std::vector<database_response>& responses)
+            {
+                ASSERT_EQ(batch.requests_size(), 2);
+                EXPECT_EQ(batch.requests(0).header().db_uuid(), "uuid");
+                EXPECT_EQ(batch.requests(0).read().key(), "key0");
+                EXPECT_EQ(batch.requests(1).read().key(), "key1");
+
+                responses.resize(2);
+                responses[0].mutable_read()->set_value("value0");
+                responses[1].mutable_error()->set_message(bzn::deprecated::MSG_RECORD_NOT_FOUND);
+            }));
+
+        rh(boost::beast::error_code(), 0);
+
+        const auto& response = con->responses.front();
+        EXPECT_EQ(response.result(), boost::beast::http::status::ok);
+        EXPECT_EQ(std::string(response.at(boost::beast::http::field::content_type)), "application/json");
+
+        const auto json = response_json(response);
+        ASSERT_EQ(json.size(), 2u);
+        EXPECT_EQ(json[0]["key"].asString(), "key0");
+        EXPECT_EQ(json[0]["result"].asString(), "ack");
+        EXPECT_EQ(json[0]["value"].asString(), "value0");
+        EXPECT_EQ(json[1]["key"].asString(), "key1");
+        EXPECT_EQ(json[1]["result"].asString(), "err");
+        EXPECT_EQ(json[1]["error"].asString(), bzn::deprecated::MSG_RECORD_NOT_FOUND);
+    }
+
+
+    TEST(http_connection, test_that_bulk_post_sends_newline_delimited_writes_as_one_batch)
+    {
+        auto mock_crud = std::make_shared<bzn::deprecated::Mockcrud_base>();
+        bzn::beast::read_handler rh;
+        auto con = make_bulk_connection(mock_crud, rh);
+
+        con->request.method(boost::beast::http::verb::post);
+        con->request.target("/bulk/uuid");
+        boost::beast::ostream(con->request.body()) << "create key0 a value with spaces\r\n"
+                                                    << "update key1 value1\n"
+                                                    << "\n"
+                                                    << "delete key2\n"
+                                                    << "read key3";
+
+        EXPECT_CALL(*mock_crud, handle_batch(_, _)).WillOnce(Invoke(
+            [](const database_batch& batch, std::vector<database_response>& responses)
+            {
+                ASSERT_EQ(batch.requests_size(), 4);
+                EXPECT_EQ(batch.requests(0).create().key(), "key0");
+                EXPECT_EQ(batch.requests(0).create().value(), "a value with spaces");
+                EXPECT_EQ(batch.requests(1).update().key(), "key1");
+                EXPECT_EQ(batch.requests(1).update().value(), "value1");
+                EXPECT_EQ(batch.requests(2).delete_().key(), "key2");
+                EXPECT_EQ(batch.requests(3).read().key(), "key3");
+
+                for (const auto& request : batch.requests())
+                {
+                    EXPECT_EQ(request.header().db_uuid(), "uuid");
+                }
+
+                responses.resize(4);
+                responses[3].mutable_read()->set_value("value3");
+            }));
+
+        rh(boost::beast::error_code(), 0);
+
+        const auto json = response_json(con->responses.front());
+        ASSERT_EQ(json.size(), 4u);
+        EXPECT_EQ(json[0]["key"].asString(), "key0");
+        EXPECT_EQ(json[0]["result"].asString(), "ack");
+        EXPECT_EQ(json[2]["key"].asString(), "key2");
+        EXPECT_EQ(json[3]["value"].asString(), "value3");
+    }
+
+
+    TEST(http_connection, test_that_bulk_post_accepts_a_json_batch)
+    {
+        auto mock_crud = std::make_shared<bzn::deprecated::Mockcrud_base>();
+        bzn::beast::read_handler rh;
+        auto con = make_bulk_connection(mock_crud, rh);
+
+        con->request.method(boost::beast::http::verb::post);
+        con->request.target("/bulk/uuid");
+        boost::beast::ostream(con->request.body())
+            << R"([{"cmd": "create", "key": "key0", "value": "line one\nline two"}, {"cmd": "delete", "key": "key1"}])";
+
+        EXPECT_CALL(*mock_crud, handle_batch(_, _)).WillOnce(Invoke(
+            [](const database_batch& batch, std::vector<database_response>& responses)
+            {
+                ASSERT_EQ(batch.requests_size(), 2);
+                EXPECT_EQ(batch.requests(0).create().key(), "key0");
+                EXPECT_EQ(batch.requests(0).create().value(), "line one\nline two");
+                EXPECT_EQ(batch.requests(1).delete_().key(), "key1");
+
+                responses.resize(2);
+                responses[1].mutable_error()->set_message(bzn::deprecated::MSG_RECORD_NOT_FOUND);
+            }));
+
+        rh(boost::beast::error_code(), 0);
+
+        const auto json = response_json(con->responses.front());
+        ASSERT_EQ(json.size(), 2u);
+        EXPECT_EQ(json[0]["result"].asString(), "ack");
+        EXPECT_EQ(json[1]["result"].asString(), "err");
+    }
+
+
+    TEST(http_connection, test_that_bulk_post_redirects_to_the_leader)
+    {
+        auto mock_crud = std::make_shared<bzn::deprecated::Mockcrud_base>();
+        bzn::beast::read_handler rh;
+        auto con = make_bulk_connection(mock_crud, rh);
+
+        con->request.method(boost::beast::http::verb::post);
+        con->request.target("/bulk/uuid");
+        boost::beast::ostream(con->request.body()) << "create key0 value0\n";
+
+        EXPECT_CALL(*mock_crud, handle_batch(_, _)).WillOnce(Invoke(
+            [](const database_batch& /*batch*/, std::vector<database_response>& responses)
+            {
+                responses.resize(1);
+                responses[0].mutable_redirect()->set_leader_host("127.0.0.1");
+                responses[0].mutable_redirect()->set_leader_http_port(8888);
+            }));
+
+        rh(boost::beast::error_code(), 0);
+
+        const auto& response = con->responses.front();
+        EXPECT_EQ(response.result(), boost::beast::http::status::temporary_redirect);
+        EXPECT_EQ(std::string(response.at(boost::beast::http::field::location)), "http://127.0.0.1:8888/bulk/uuid");
+    }
+
+
+    TEST(http_connection, test_that_malformed_bulk_requests_are_bad_requests)
+    {
+        const std::vector<std::tuple<boost::beast::http::verb, std::string, std::string>> requests{
+            {boost::beast::http::verb::get,  "/bulk/uuid", ""},
+            {boost::beast::http::verb::get,  "/bulk/", ""},
+            {boost::beast::http::verb::post, "/bulk/uuid", ""},
+            {boost::beast::http::verb::post, "/bulk/uuid/key0", "create key0 value0"},
+            {boost::beast::http::verb::post, "/bulk/uuid", "create key0"},
+            {boost::beast::http::verb::post, "/bulk/uuid", "delete key0 value0"},
+            {boost::beast::http::verb::post, "/bulk/uuid", "truncate key0"},
+            {boost::beast::http::verb::post, "/bulk/uuid", "[{\"cmd\": \"create\", \"key\": \"key0\"}]"},
+            {boost::beast::http::verb::post, "/bulk/uuid", "[{\"cmd\": \"create\""},
+            {boost::beast::http::verb::put,  "/bulk/uuid", "create key0 value0"}};
+
+        for (const auto& [method, target, body] : requests)
+        {
+            auto mock_crud = std::make_shared<bzn::deprecated::Mockcrud_base>();
+            bzn::beast::read_handler rh;
+            auto con = make_bulk_connection(mock_crud, rh);
+
+            EXPECT_CALL(*mock_crud, handle_batch(_, _)).Times(0);
+
+            con->request.method(method);
+            con->request.target(target);
+            boost::beast::ostream(con->request.body()) << body;
+
+            rh(boost::beast::error_code(), 0);
+
+            EXPECT_EQ(con->responses.front().result(), boost::beast::http::status::bad_request) << target << " : " << body;
+        }
+
+        boost::beast::string_view uuid;
+        std::vector<boost::beast::string_view> keys;
+        ASSERT_TRUE(bzn::http::connection::parse_bulk_target("/bulk/uuid/key0/key1", uuid, keys));
+        EXPECT_EQ(uuid, "uuid");
+        EXPECT_EQ(keys, (std::vector<boost::beast::string_view>{"key0", "key1"}));
+
+        ASSERT_TRUE(bzn::http::connection::parse_bulk_target("/bulk/uuid", uuid, keys));
+        EXPECT_TRUE(keys.empty());
+    }
+
+
+    TEST(http_connection, test_that_metrics_are_served_as_prometheus_text)
+    {
+        bzn::metrics::registry::instance().get_counter("http_test_total").increment();
+
+        auto mock_crud = std::make_shared<bzn::deprecated::Mockcrud_base>();
+        bzn::beast::read_handler rh;
+        auto con = make_bulk_connection(mock_crud, rh);
+
+        con->request.method(boost::beast::http::verb::get);
+        con->request.target("/metrics");
+
+        rh(boost::beast::error_code(), 0);
+
+        const auto& response = con->responses.front();
+        EXPECT_EQ(response.result(), boost::beast::http::status::ok);
+        EXPECT_EQ(std::string(response.at(boost::beast::http::field::content_type)), "text/plain; version=0.0.4");
+        EXPECT_NE(boost::beast::buffers_to_string(response.body().data()).find("# TYPE http_test_total counter\nhttp_test_total 1\n"), std::string::npos);
+    }
 }
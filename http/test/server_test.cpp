@@ -54,6 +54,12 @@ namespace bzn::http
                 return std::move(mock_timer);
             }));
 
+        EXPECT_CALL(*mock_io_context, make_unique_strand()).WillOnce(Invoke(
+            [&]()
+            {
+                return std::make_unique<bzn::asio::strand>(io);
+            }));
+
         auto server = std::make_shared<bzn::http::server>(mock_io_context, nullptr, ep);
 
         EXPECT_CALL(*mock_io_context, make_unique_tcp_socket()).Times(2).WillRepeatedly(Invoke(
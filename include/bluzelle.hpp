@@ -15,6 +15,7 @@
 #pragma once
 
 #include <boost/log/trivial.hpp>
+#include <atomic>
 #include <string_view>
 #include <json/json.h>
 #include <swarm_version.hpp>
@@ -50,11 +51,25 @@ namespace bzn::utils
     {
         return path.substr(path.rfind('/') + 1);
     }
+
+
+    // lowest severity the logging core accepts; lets LOG skip opening a record (and evaluating its arguments)
+    // with a single load instead of a pass through boost.log's filter
+    inline std::atomic<boost::log::trivial::severity_level> log_threshold{boost::log::trivial::trace};
+
+
+    inline bool
+    log_enabled(boost::log::trivial::severity_level level)
+    {
+        return level >= log_threshold.load(std::memory_order_relaxed);
+    }
 } // bzn::utils
 
 
 // logging
-#define LOG(x) BOOST_LOG_TRIVIAL(x) << "(" << bzn::utils::basename(__FILE__) << ":"  << __LINE__ << ") - "
+#define LOG(x) \
+    for (bool bzn_log_enabled_ = bzn::utils::log_enabled(boost::log::trivial::x); bzn_log_enabled_; bzn_log_enabled_ = false) \
+        BOOST_LOG_TRIVIAL(x) << "(" << bzn::utils::basename(__FILE__) << ":"  << __LINE__ << ") - "
 
 // This limits the number of characters that are displayed in "LOG(x) <<"  messages.
 const uint16_t MAX_MESSAGE_SIZE = 1024;
@@ -0,0 +1,317 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <metrics/metrics.hpp>
+#include <cmath>
+#include <sstream>
+
+using namespace bzn::metrics;
+
+namespace
+{
+    struct reported_percentile
+    {
+        double percentile;
+        const char* quantile;
+        const char* json_key;
+    };
+
+    const std::array<reported_percentile, 4> REPORTED_PERCENTILES{{
+        {50.0, "0.5", "p50"}, {90.0, "0.9", "p90"}, {99.0, "0.99", "p99"}, {99.9, "0.999", "p999"}}};
+
+
+    size_t
+    this_thread_shard(size_t shard_count)
+    {
+        static std::atomic<size_t> next_shard{0};
+        thread_local const size_t shard = next_shard++;
+
+        return shard % shard_count;
+    }
+}
+
+
+void
+counter::increment(uint64_t n)
+{
+    this->shards[this_thread_shard(SHARD_COUNT)].value.fetch_add(n, std::memory_order_relaxed);
+}
+
+
+uint64_t
+counter::value() const
+{
+    uint64_t value{};
+
+    for (const auto& shard : this->shards)
+    {
+        value += shard.value.load(std::memory_order_relaxed);
+    }
+
+    return value;
+}
+
+
+void
+gauge::set(int64_t value)
+{
+    this->current.store(value, std::memory_order_relaxed);
+}
+
+
+void
+gauge::add(int64_t n)
+{
+    this->current.fetch_add(n, std::memory_order_relaxed);
+}
+
+
+int64_t
+gauge::value() const
+{
+    return this->current.load(std::memory_order_relaxed);
+}
+
+
+size_t
+histogram::bucket_index(uint64_t value)
+{
+    // values below two sub-bucket ranges get a bucket each...
+    if (value < 2 * SUB_BUCKET_COUNT)
+    {
+        return value;
+    }
+
+    // ...above that, keep the top SUB_BUCKET_BITS + 1 bits and count how far they were shifted
+    const size_t shift = (63 - __builtin_clzll(value)) - SUB_BUCKET_BITS;
+
+    return shift * SUB_BUCKET_COUNT + (value >> shift);
+}
+
+
+uint64_t
+histogram::bucket_upper_bound(size_t index)
+{
+    if (index < 2 * SUB_BUCKET_COUNT)
+    {
+        return index;
+    }
+
+    const size_t shift = index / SUB_BUCKET_COUNT - 1;
+    const uint64_t mantissa = index - shift * SUB_BUCKET_COUNT;
+
+    // wraps to the largest uint64_t for the very last bucket...
+    return ((mantissa + 1) << shift) - 1;
+}
+
+
+void
+histogram::record(uint64_t value)
+{
+    this->buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    this->total.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t largest = this->largest.load(std::memory_order_relaxed);
+
+    while (value > largest && !this->largest.compare_exchange_weak(largest, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+
+uint64_t
+histogram::count() const
+{
+    uint64_t count{};
+
+    for (const auto& bucket : this->buckets)
+    {
+        count += bucket.load(std::memory_order_relaxed);
+    }
+
+    return count;
+}
+
+
+uint64_t
+histogram::sum() const
+{
+    return this->total.load(std::memory_order_relaxed);
+}
+
+
+uint64_t
+histogram::max() const
+{
+    return this->largest.load(std::memory_order_relaxed);
+}
+
+
+uint64_t
+histogram::value_at_percentile(double percentile) const
+{
+    const uint64_t count = this->count();
+
+    if (!count)
+    {
+        return 0;
+    }
+
+    const auto rank = std::max(uint64_t(1), uint64_t(std::ceil(std::min(percentile, 100.0) / 100.0 * count)));
+
+    uint64_t seen{};
+
+    for (size_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+        seen += this->buckets[i].load(std::memory_order_relaxed);
+
+        if (seen >= rank)
+        {
+            return std::min(bucket_upper_bound(i), this->max());
+        }
+    }
+
+    // buckets moved on while we were reading them...
+    return this->max();
+}
+
+
+registry&
+registry::instance()
+{
+    static registry metrics_registry;
+
+    return metrics_registry;
+}
+
+
+counter&
+registry::get_counter(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    auto& metric = this->counters[name];
+
+    if (!metric)
+    {
+        metric = std::make_unique<counter>();
+    }
+
+    return *metric;
+}
+
+
+gauge&
+registry::get_gauge(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    auto& metric = this->gauges[name];
+
+    if (!metric)
+    {
+        metric = std::make_unique<gauge>();
+    }
+
+    return *metric;
+}
+
+
+histogram&
+registry::get_histogram(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    auto& metric = this->histograms[name];
+
+    if (!metric)
+    {
+        metric = std::make_unique<histogram>();
+    }
+
+    return *metric;
+}
+
+
+bzn::json_message
+registry::to_json() const
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    bzn::json_message json;
+
+    json["counters"] = Json::objectValue;
+    json["gauges"] = Json::objectValue;
+    json["histograms"] = Json::objectValue;
+
+    for (const auto& [name, metric] : this->counters)
+    {
+        json["counters"][name] = Json::UInt64(metric->value());
+    }
+
+    for (const auto& [name, metric] : this->gauges)
+    {
+        json["gauges"][name] = Json::Int64(metric->value());
+    }
+
+    for (const auto& [name, metric] : this->histograms)
+    {
+        auto& entry = json["histograms"][name];
+
+        entry["count"] = Json::UInt64(metric->count());
+        entry["sum"] = Json::UInt64(metric->sum());
+        entry["max"] = Json::UInt64(metric->max());
+
+        for (const auto& reported : REPORTED_PERCENTILES)
+        {
+            entry[reported.json_key] = Json::UInt64(metric->value_at_percentile(reported.percentile));
+        }
+    }
+
+    return json;
+}
+
+
+std::string
+registry::to_prometheus() const
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    std::stringstream ss;
+
+    for (const auto& [name, metric] : this->counters)
+    {
+        ss << "# TYPE " << name << " counter\n" << name << " " << metric->value() << "\n";
+    }
+
+    for (const auto& [name, metric] : this->gauges)
+    {
+        ss << "# TYPE " << name << " gauge\n" << name << " " << metric->value() << "\n";
+    }
+
+    for (const auto& [name, metric] : this->histograms)
+    {
+        ss << "# TYPE " << name << " summary\n";
+
+        for (const auto& reported : REPORTED_PERCENTILES)
+        {
+            ss << name << "{quantile=\"" << reported.quantile << "\"} " << metric->value_at_percentile(reported.percentile) << "\n";
+        }
+
+        ss << name << "_sum " << metric->sum() << "\n";
+        ss << name << "_count " << metric->count() << "\n";
+    }
+
+    return ss.str();
+}
@@ -0,0 +1,145 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <include/bluzelle.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+
+
+namespace bzn::metrics
+{
+    // monotonically increasing count, sharded so that threads bumping it concurrently do not fight over a cache line
+    class counter
+    {
+    public:
+        void increment(uint64_t n = 1);
+
+        uint64_t value() const;
+
+    private:
+        static constexpr size_t SHARD_COUNT = 16;
+
+        struct alignas(64) shard
+        {
+            std::atomic<uint64_t> value{0};
+        };
+
+        std::array<shard, SHARD_COUNT> shards;
+    };
+
+
+    class gauge
+    {
+    public:
+        void set(int64_t value);
+
+        void add(int64_t n);
+
+        int64_t value() const;
+
+    private:
+        std::atomic<int64_t> current{0};
+    };
+
+
+    // log-linear buckets in the style of HdrHistogram: 16 sub-buckets per power of two keep every recorded value
+    // within ~6% of its bucket's upper bound, from 1 up to 2^64
+    class histogram
+    {
+    public:
+        void record(uint64_t value);
+
+        uint64_t count() const;
+
+        uint64_t sum() const;
+
+        uint64_t max() const;
+
+        /**
+         * @param percentile in the range [0, 100]
+         * @return upper bound of the bucket holding the requested rank, 0 when nothing has been recorded
+         */
+        uint64_t value_at_percentile(double percentile) const;
+
+        static size_t bucket_index(uint64_t value);
+
+        static uint64_t bucket_upper_bound(size_t index);
+
+    private:
+        static constexpr size_t SUB_BUCKET_BITS = 4;
+        static constexpr size_t SUB_BUCKET_COUNT = size_t(1) << SUB_BUCKET_BITS;
+        static constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+        std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets{};
+        std::atomic<uint64_t> total{0};
+        std::atomic<uint64_t> largest{0};
+    };
+
+
+    // records the lifetime of the timer in microseconds
+    class scoped_timer
+    {
+    public:
+        explicit scoped_timer(histogram& target)
+            : target(target)
+            , start(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~scoped_timer()
+        {
+            this->target.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - this->start).count());
+        }
+
+    private:
+        histogram& target;
+        const std::chrono::steady_clock::time_point start;
+    };
+
+
+    // metrics are created on first use and live as long as the registry, so callers can hold on to the returned
+    // reference and update it without taking the registry lock again
+    class registry
+    {
+    public:
+        static registry& instance();
+
+        counter& get_counter(const std::string& name);
+
+        gauge& get_gauge(const std::string& name);
+
+        histogram& get_histogram(const std::string& name);
+
+        bzn::json_message to_json() const;
+
+        /**
+         * @return every metric in the Prometheus text exposition format, histograms as summaries
+         */
+        std::string to_prometheus() const;
+
+    private:
+        mutable std::mutex lock;
+
+        std::map<std::string, std::unique_ptr<counter>> counters;
+        std::map<std::string, std::unique_ptr<gauge>> gauges;
+        std::map<std::string, std::unique_ptr<histogram>> histograms;
+    };
+
+} // namespace bzn::metrics
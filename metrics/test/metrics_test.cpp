@@ -0,0 +1,152 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <metrics/metrics.hpp>
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace ::testing;
+
+
+TEST(metrics, test_that_counters_sum_increments_from_all_threads)
+{
+    bzn::metrics::counter counter;
+
+    std::vector<std::thread> threads;
+
+    for (size_t i = 0; i < 8; ++i)
+    {
+        threads.emplace_back([&counter]()
+        {
+            for (size_t j = 0; j < 1000; ++j)
+            {
+                counter.increment();
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(counter.value(), uint64_t(8000));
+
+    counter.increment(5);
+    EXPECT_EQ(counter.value(), uint64_t(8005));
+}
+
+
+TEST(metrics, test_that_gauge_tracks_current_value)
+{
+    bzn::metrics::gauge gauge;
+
+    gauge.add(3);
+    gauge.add(-1);
+    EXPECT_EQ(gauge.value(), 2);
+
+    gauge.set(-7);
+    EXPECT_EQ(gauge.value(), -7);
+}
+
+
+TEST(metrics, test_that_histogram_buckets_bound_relative_error)
+{
+    // small values are exact...
+    for (uint64_t value = 0; value < 32; ++value)
+    {
+        EXPECT_EQ(bzn::metrics::histogram::bucket_upper_bound(bzn::metrics::histogram::bucket_index(value)), value);
+    }
+
+    // ...larger ones land in a bucket no more than 1/16th wider than the value
+    for (uint64_t value : {uint64_t(32), uint64_t(33), uint64_t(63), uint64_t(64), uint64_t(1000), uint64_t(123456),
+        uint64_t(1) << 40, (uint64_t(1) << 40) + 12345, std::numeric_limits<uint64_t>::max()})
+    {
+        const auto index = bzn::metrics::histogram::bucket_index(value);
+        const auto upper = bzn::metrics::histogram::bucket_upper_bound(index);
+
+        EXPECT_GE(upper, value);
+        EXPECT_LE(upper - value, value / 16);
+
+        // and the bucket starts right after the previous one ends
+        EXPECT_EQ(bzn::metrics::histogram::bucket_index(bzn::metrics::histogram::bucket_upper_bound(index - 1) + 1), index);
+    }
+}
+
+
+TEST(metrics, test_that_histogram_reports_percentiles)
+{
+    bzn::metrics::histogram histogram;
+
+    EXPECT_EQ(histogram.value_at_percentile(50), uint64_t(0));
+
+    for (uint64_t value = 1; value <= 1000; ++value)
+    {
+        histogram.record(value);
+    }
+
+    EXPECT_EQ(histogram.count(), uint64_t(1000));
+    EXPECT_EQ(histogram.sum(), uint64_t(500500));
+    EXPECT_EQ(histogram.max(), uint64_t(1000));
+
+    EXPECT_NEAR(histogram.value_at_percentile(50), 500, 500 / 16);
+    EXPECT_NEAR(histogram.value_at_percentile(99), 990, 990 / 16);
+    EXPECT_EQ(histogram.value_at_percentile(100), uint64_t(1000));
+}
+
+
+TEST(metrics, test_that_registry_returns_the_same_metric_for_a_name)
+{
+    bzn::metrics::registry registry;
+
+    auto& counter = registry.get_counter("requests_total");
+    counter.increment(2);
+
+    EXPECT_EQ(&registry.get_counter("requests_total"), &counter);
+    EXPECT_NE(&registry.get_counter("other_total"), &counter);
+    EXPECT_EQ(&bzn::metrics::registry::instance(), &bzn::metrics::registry::instance());
+
+    {
+        bzn::metrics::scoped_timer timer(registry.get_histogram("latency_us"));
+    }
+
+    EXPECT_EQ(registry.get_histogram("latency_us").count(), uint64_t(1));
+}
+
+
+TEST(metrics, test_that_registry_dumps_json_and_prometheus_text)
+{
+    bzn::metrics::registry registry;
+
+    registry.get_counter("requests_total").increment(3);
+    registry.get_gauge("queue_depth").set(4);
+
+    registry.get_histogram("latency_us").record(2);
+    registry.get_histogram("latency_us").record(10);
+
+    const auto json = registry.to_json();
+
+    EXPECT_EQ(json["counters"]["requests_total"].asUInt64(), uint64_t(3));
+    EXPECT_EQ(json["gauges"]["queue_depth"].asInt64(), 4);
+    EXPECT_EQ(json["histograms"]["latency_us"]["count"].asUInt64(), uint64_t(2));
+    EXPECT_EQ(json["histograms"]["latency_us"]["p999"].asUInt64(), uint64_t(10));
+
+    const auto text = registry.to_prometheus();
+
+    EXPECT_NE(text.find("# TYPE requests_total counter\nrequests_total 3\n"), std::string::npos);
+    EXPECT_NE(text.find("# TYPE queue_depth gauge\nqueue_depth 4\n"), std::string::npos);
+    EXPECT_NE(text.find("# TYPE latency_us summary\n"), std::string::npos);
+    EXPECT_NE(text.find("latency_us{quantile=\"0.999\"} 10\n"), std::string::npos);
+    EXPECT_NE(text.find("latency_us_count 2\n"), std::string::npos);
+}
@@ -31,6 +31,8 @@ namespace bzn {
                 void(const bzn::json_message& msg, const database_msg& request, database_response& response));
             MOCK_METHOD3(handle_delete,
                 void(const bzn::json_message& msg, const database_msg& request, database_response& response));
+            MOCK_METHOD2(handle_batch,
+                void(const database_batch& batch, std::vector<database_response>& responses));
             MOCK_METHOD0(start,
                 void());
         };
@@ -46,8 +48,16 @@ namespace bzn {
             bool());
         MOCK_METHOD0(get_saved_state,
             std::shared_ptr<std::string>());
-        MOCK_METHOD1(load_state,
-            bool(const std::string&));
+        MOCK_METHOD2(load_state,
+            bool(const std::string&, const bzn::hash_t&));
+        MOCK_METHOD0(get_state_hash,
+            bzn::hash_t());
+        MOCK_METHOD0(start_undo_log,
+            void());
+        MOCK_METHOD0(undo_writes,
+            bool());
+        MOCK_METHOD0(clear_undo_log,
+            void());
     };
 
 }  // namespace bzn
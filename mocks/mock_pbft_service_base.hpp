@@ -36,10 +36,16 @@ namespace bzn {
           bool(const bzn_envelope& msg, std::shared_ptr<bzn::session_base> session));
       MOCK_CONST_METHOD1(get_service_state,
           std::shared_ptr<bzn::service_state_t>(uint64_t sequence_number));
-      MOCK_METHOD2(set_service_state,
-          bool(uint64_t sequence_number, const bzn::service_state_t& data));
+      MOCK_METHOD3(set_service_state,
+          bool(uint64_t sequence_number, const bzn::service_state_t& data, const bzn::hash_t& state_hash));
+      MOCK_CONST_METHOD2(get_service_state_delta,
+          std::shared_ptr<std::vector<bzn_envelope>>(uint64_t from_sequence, uint64_t to_sequence));
+      MOCK_METHOD4(apply_service_state_delta,
+          bool(uint64_t from_sequence, uint64_t to_sequence, const bzn::hash_t& state_hash, const std::vector<bzn_envelope>& requests));
       MOCK_METHOD1(save_service_state_at,
             void(uint64_t));
+      MOCK_CONST_METHOD0(is_saturated,
+            bool());
     };
 
 }  // namespace bzn
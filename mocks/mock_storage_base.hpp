@@ -25,6 +25,8 @@ namespace bzn {
                      bzn::storage_result(const bzn::uuid_t& uuid, const std::string& key, const std::string& value));
         MOCK_METHOD2(read,
                      std::optional<bzn::value_t> (const bzn::uuid_t& uuid, const std::string& key));
+        MOCK_METHOD2(read_many,
+                     std::vector<std::optional<bzn::value_t>> (const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys));
         MOCK_METHOD3(update,
                      bzn::storage_result(const bzn::uuid_t& uuid, const std::string& key, const std::string& value));
         MOCK_METHOD2(remove,
@@ -43,14 +45,20 @@ namespace bzn {
                      bool(const bzn::uuid_t& uuid, const std::string& key));
         MOCK_METHOD1(get_size,
                      std::pair<std::size_t, std::size_t>(const bzn::uuid_t& uuid));
+        MOCK_METHOD0(get_approximate_size,
+                     std::size_t());
         MOCK_METHOD1(remove,
                      bzn::storage_result(const bzn::uuid_t& uuid));
         MOCK_METHOD0(create_snapshot,
                      bool());
         MOCK_METHOD0(get_snapshot,
                      std::shared_ptr<std::string>());
-        MOCK_METHOD1(load_snapshot,
-                     bool(const std::string&));
+        MOCK_METHOD2(load_snapshot,
+                     bool(const std::string&, const bzn::hash_t&));
+        MOCK_METHOD0(get_state_hash,
+                     bzn::hash_t());
+        MOCK_METHOD0(get_state_hash_buckets,
+                     std::vector<bzn::hash_t>());
    };
 
 }  // namespace bzn
@@ -27,6 +27,10 @@ class Mocksubscription_manager_base : public subscription_manager_base {
       void(const bzn::uuid_t& uuid, const bzn::key_t& key, uint64_t transaction_id, database_response& response, std::shared_ptr<bzn::session_base> session));
   MOCK_METHOD5(unsubscribe,
       void(const bzn::uuid_t& uuid, const bzn::key_t& key, uint64_t transaction_id, database_response& response, std::shared_ptr<bzn::session_base> session));
+  MOCK_METHOD5(subscribe_prefix,
+      void(const bzn::uuid_t& uuid, const bzn::key_t& prefix, uint64_t transaction_id, database_response& response, std::shared_ptr<bzn::session_base> session));
+  MOCK_METHOD5(unsubscribe_prefix,
+      void(const bzn::uuid_t& uuid, const bzn::key_t& prefix, uint64_t transaction_id, database_response& response, std::shared_ptr<bzn::session_base> session));
   MOCK_METHOD1(inspect_commit,
       void(const database_msg& msg));
 };
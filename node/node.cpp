@@ -47,7 +47,7 @@ node::start()
 bool
 node::register_for_message(const std::string& msg_type, bzn::message_handler msg_handler)
 {
-    std::lock_guard<std::mutex> lock(this->message_map_mutex);
+    std::lock_guard<std::shared_mutex> lock(this->message_map_mutex); // lock for write access
 
     // never allow!
     if (!msg_handler)
@@ -71,7 +71,8 @@ node::register_for_message(const std::string& msg_type, bzn::message_handler msg
 bool
 node::register_for_message(const bzn_envelope::PayloadCase type, bzn::protobuf_handler msg_handler)
 {
-    std::lock_guard<std::mutex> lock(this->message_map_mutex);
+    // only serializes registrations, dispatch never takes this lock...
+    std::lock_guard<std::mutex> lock(this->protobuf_registration_mutex);
 
     // never allow!
     if (!msg_handler)
@@ -79,14 +80,24 @@ node::register_for_message(const bzn_envelope::PayloadCase type, bzn::protobuf_h
         return false;
     }
 
-    if (this->protobuf_map.find(type) != this->protobuf_map.end())
+    if (size_t(type) >= this->protobuf_handlers.size())
+    {
+        LOG(error) << type << " message type is out of range";
+
+        return false;
+    }
+
+    if (this->protobuf_handler_ready[type].load(std::memory_order_acquire))
     {
         LOG(debug) << type << " message type already registered";
 
         return false;
     }
 
-    this->protobuf_map[type] = std::move(msg_handler);
+    this->protobuf_handlers[type] = std::move(msg_handler);
+
+    // publish the handler...
+    this->protobuf_handler_ready[type].store(true, std::memory_order_release);
 
     return true;
 }
@@ -128,11 +139,20 @@ node::priv_msg_handler(const Json::Value& msg, std::shared_ptr<bzn::session_base
 {
     if (msg.isMember(BZN_API_KEY))
     {
-        std::lock_guard<std::mutex> lock(this->message_map_mutex);
+        bzn::message_handler handler;
+        {
+            std::shared_lock<std::shared_mutex> lock(this->message_map_mutex); // lock for read access
 
-        if (auto it = this->message_map.find(msg[BZN_API_KEY].asString()); it != this->message_map.end())
+            if (auto it = this->message_map.find(msg[BZN_API_KEY].asString()); it != this->message_map.end())
+            {
+                handler = it->second;
+            }
+        }
+
+        // handlers run outside of the lock...
+        if (handler)
         {
-            it->second(msg, std::move(session));
+            handler(msg, std::move(session));
             return;
         }
     }
@@ -145,23 +165,22 @@ node::priv_msg_handler(const Json::Value& msg, std::shared_ptr<bzn::session_base
 void
 node::priv_protobuf_handler(const bzn_envelope& msg, std::shared_ptr<bzn::session_base> session)
 {
-    std::lock_guard<std::mutex> lock(this->message_map_mutex);
-
     if ((!msg.sender().empty()) && (!this->crypto->verify(msg)))
     {
         LOG(error) << "Dropping message with invalid signature: " << msg.ShortDebugString().substr(0, MAX_MESSAGE_SIZE);
         return;
     }
 
-    if (auto it = this->protobuf_map.find(msg.payload_case()); it != this->protobuf_map.end())
+    const size_t type = msg.payload_case();
+
+    if (type < this->protobuf_handlers.size() && this->protobuf_handler_ready[type].load(std::memory_order_acquire))
     {
-        it->second(msg, std::move(session));
+        this->protobuf_handlers[type](msg, std::move(session));
     }
     else
     {
         LOG(debug) << "no handler for message type " << msg.payload_case();
     }
-
 }
 
 void
@@ -20,8 +20,10 @@
 #include <crypto/crypto_base.hpp>
 #include <options/options_base.hpp>
 #include <json/json.h>
-#include <mutex>
+#include <array>
 #include <atomic>
+#include <mutex>
+#include <shared_mutex>
 
 #include <gtest/gtest_prod.h>
 
@@ -49,6 +51,7 @@ namespace bzn
     private:
         FRIEND_TEST(node, test_that_registered_message_handler_is_invoked);
         FRIEND_TEST(node, test_that_wrongly_signed_messages_are_dropped);
+        FRIEND_TEST(node, test_that_protobuf_handlers_are_dispatched_without_holding_a_node_lock);
 
         void do_accept();
 
@@ -63,8 +66,14 @@ namespace bzn
         const std::chrono::milliseconds               ws_idle_timeout;
 
         std::unordered_map<std::string, bzn::message_handler> message_map;
-        std::unordered_map<bzn_envelope::PayloadCase, bzn::protobuf_handler> protobuf_map;
-        std::mutex message_map_mutex;
+        std::shared_mutex message_map_mutex;
+
+        // protobuf dispatch table indexed by payload case. Each slot is written once, before its ready flag is
+        // set, and never changes afterwards so lookups need no lock...
+        static constexpr size_t PROTOBUF_HANDLER_TABLE_SIZE = 32;
+        std::array<bzn::protobuf_handler, PROTOBUF_HANDLER_TABLE_SIZE> protobuf_handlers;
+        std::array<std::atomic<bool>, PROTOBUF_HANDLER_TABLE_SIZE> protobuf_handler_ready{};
+        std::mutex protobuf_registration_mutex;
 
         std::once_flag start_once;
 
@@ -13,11 +13,21 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <node/session.hpp>
+#include <metrics/metrics.hpp>
 #include <sstream>
 
 namespace
 {
     const std::chrono::seconds DEFAULT_WS_TIMEOUT_MS{10};
+
+    auto& queued_writes = bzn::metrics::registry::instance().get_gauge("session_queued_writes");
+
+    // counts a write from the moment it starts waiting on the socket until it is done with it
+    struct queued_write
+    {
+        queued_write() { queued_writes.add(1); }
+        ~queued_write() { queued_writes.add(-1); }
+    };
 }
 
 
@@ -133,6 +143,7 @@ session::send_message(std::shared_ptr<bzn::encoded_message> msg, const bool end_
 
     this->idle_timer->cancel(); // kill timer for duration of write...
 
+    queued_write pending;
     std::lock_guard<std::mutex> lock(this->write_lock);
 
     this->websocket->get_websocket().binary(true);
@@ -172,6 +183,7 @@ session::send_datagram(std::shared_ptr<bzn::encoded_message> msg)
         return;
     }
 
+    queued_write pending;
     std::lock_guard<std::mutex> lock(this->write_lock);
 
     this->websocket->get_websocket().binary(true);
@@ -0,0 +1,95 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <node/staged_node.hpp>
+#include <metrics/metrics.hpp>
+
+using namespace bzn;
+
+namespace
+{
+    auto& queued_messages = bzn::metrics::registry::instance().get_gauge("staged_node_queued_messages");
+}
+
+
+staged_node::staged_node(std::shared_ptr<bzn::node_base> node, std::shared_ptr<bzn::asio::io_context_base> stage_context)
+    : node(std::move(node))
+    , stage_context(std::move(stage_context))
+{
+}
+
+
+bool
+staged_node::register_for_message(const std::string& msg_type, bzn::message_handler msg_handler)
+{
+    return this->node->register_for_message(msg_type,
+        [stage_context = this->stage_context, msg_handler = std::move(msg_handler)](const bzn::json_message& msg, std::shared_ptr<bzn::session_base> session)
+        {
+            queued_messages.add(1);
+
+            stage_context->post(
+                [msg_handler, msg, session = std::move(session)]()
+                {
+                    queued_messages.add(-1);
+                    msg_handler(msg, session);
+                });
+        });
+}
+
+
+bool
+staged_node::register_for_message(const bzn_envelope::PayloadCase type, bzn::protobuf_handler msg_handler)
+{
+    return this->node->register_for_message(type,
+        [stage_context = this->stage_context, msg_handler = std::move(msg_handler)](const bzn_envelope& msg, std::shared_ptr<bzn::session_base> session)
+        {
+            queued_messages.add(1);
+
+            stage_context->post(
+                [msg_handler, msg, session = std::move(session)]()
+                {
+                    queued_messages.add(-1);
+                    msg_handler(msg, session);
+                });
+        });
+}
+
+
+void
+staged_node::start()
+{
+    this->node->start();
+}
+
+
+void
+staged_node::send_message_json(const boost::asio::ip::tcp::endpoint& ep, std::shared_ptr<bzn::json_message> msg)
+{
+    this->node->send_message_json(ep, std::move(msg));
+}
+
+
+void
+staged_node::send_message(const boost::asio::ip::tcp::endpoint& ep, std::shared_ptr<bzn_envelope> msg, bool close_session)
+{
+    this->node->send_message(ep, std::move(msg), close_session);
+}
+
+
+void
+staged_node::send_message_str(const boost::asio::ip::tcp::endpoint& ep, std::shared_ptr<bzn::encoded_message> msg, bool close_session)
+{
+    this->node->send_message_str(ep, std::move(msg), close_session);
+}
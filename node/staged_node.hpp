@@ -0,0 +1,50 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <include/boost_asio_beast.hpp>
+#include <node/node_base.hpp>
+
+
+namespace bzn
+{
+    /*
+     * Hands messages received by a node over to another stage: handlers registered through it run on the given
+     * io_context instead of on the io thread that read and verified the message. Sending goes straight through.
+     */
+    class staged_node final : public bzn::node_base
+    {
+    public:
+        staged_node(std::shared_ptr<bzn::node_base> node, std::shared_ptr<bzn::asio::io_context_base> stage_context);
+
+        bool register_for_message(const std::string& msg_type, bzn::message_handler msg_handler) override;
+
+        bool register_for_message(const bzn_envelope::PayloadCase type, bzn::protobuf_handler msg_handler) override;
+
+        void start() override;
+
+        void send_message_json(const boost::asio::ip::tcp::endpoint& ep, std::shared_ptr<bzn::json_message> msg) override;
+
+        void send_message(const boost::asio::ip::tcp::endpoint& ep, std::shared_ptr<bzn_envelope> msg, bool close_session) override;
+
+        void send_message_str(const boost::asio::ip::tcp::endpoint& ep, std::shared_ptr<bzn::encoded_message> msg, bool close_session) override;
+
+    private:
+        const std::shared_ptr<bzn::node_base> node;
+        const std::shared_ptr<bzn::asio::io_context_base> stage_context;
+    };
+
+} // bzn
@@ -171,6 +171,47 @@ namespace  bzn
         EXPECT_EQ(msg_type, "asdf");
     }
 
+    TEST(node, test_that_protobuf_handlers_are_dispatched_without_holding_a_node_lock)
+    {
+        auto mock_chaos = std::make_shared<NiceMock<bzn::mock_chaos_base>>();
+        auto mock_io_context = std::make_shared<NiceMock<bzn::asio::Mockio_context_base>>();
+        auto options = std::shared_ptr<bzn::options>();
+        auto crypto = std::shared_ptr<bzn::crypto>();
+        auto mock_session = std::make_shared<NiceMock<bzn::Mocksession_base>>();
+        auto node = std::make_shared<bzn::node>(mock_io_context, nullptr, mock_chaos, std::chrono::milliseconds(0), TEST_ENDPOINT, crypto, options);
+
+        // test that nulls and out of range types are rejected...
+        ASSERT_FALSE(node->register_for_message(bzn_envelope::kPbft, nullptr));
+        ASSERT_FALSE(node->register_for_message(bzn_envelope::PayloadCase(1000), [](const auto&, auto){}));
+
+        bzn_envelope pbft_msg;
+        pbft_msg.set_pbft("some stuff");
+
+        bzn_envelope db_msg;
+        db_msg.set_database_msg("some stuff");
+
+        // no handler yet...
+        node->priv_protobuf_handler(db_msg, mock_session);
+
+        // a handler may dispatch another message re-entrantly...
+        unsigned int pbft_callback_execute = 0u;
+        ASSERT_TRUE(node->register_for_message(bzn_envelope::kPbft, [&](const auto&, auto)
+        {
+            pbft_callback_execute++;
+        }));
+
+        ASSERT_TRUE(node->register_for_message(bzn_envelope::kDatabaseMsg, [&](const auto&, auto session)
+        {
+            node->priv_protobuf_handler(pbft_msg, session);
+        }));
+
+        ASSERT_FALSE(node->register_for_message(bzn_envelope::kPbft, [](const auto&, auto){}));
+
+        node->priv_protobuf_handler(db_msg, mock_session);
+        EXPECT_EQ(pbft_callback_execute, 1u);
+    }
+
+
     TEST(node, test_that_wrongly_signed_messages_are_dropped)
     {
         auto mock_chaos = std::make_shared<NiceMock<bzn::mock_chaos_base>>();
@@ -0,0 +1,90 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <options/simple_options.hpp>
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+
+namespace bzn
+{
+    /*
+     * Typed handle to a simple option for use on hot paths. The value is resolved from the variables map once and
+     * only looked up again after simple_options::set() (or parse()) has bumped the options generation.
+     */
+    template<typename T>
+    class cached_option
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "cached_option only supports trivially copyable types");
+
+    public:
+        cached_option(const bzn::simple_options& options, std::string option_name)
+            : options(options)
+            , option_name(std::move(option_name))
+        {
+            this->refresh(this->options.generation());
+        }
+
+        cached_option(const cached_option&) = delete;
+        cached_option& operator=(const cached_option&) = delete;
+
+        T
+        get() const
+        {
+            const uint64_t generation = this->options.generation();
+
+            if (generation != this->cached_generation.load(std::memory_order_acquire))
+            {
+                this->refresh(generation);
+            }
+
+            return this->value.load(std::memory_order_relaxed);
+        }
+
+        const std::string&
+        name() const
+        {
+            return this->option_name;
+        }
+
+    private:
+        void
+        refresh(uint64_t generation) const
+        {
+            // refreshes are serialized and never move the generation back, otherwise one that read the value before
+            // a set() could publish it after a newer refresh and leave a stale value under the newest generation
+            std::lock_guard<std::mutex> lock(this->refresh_lock);
+
+            if (generation <= this->cached_generation.load(std::memory_order_relaxed) && this->refreshed)
+            {
+                return;
+            }
+
+            // the value is stored before the generation, so a reader that sees the generation sees the value too
+            this->value.store(this->options.get<T>(this->option_name), std::memory_order_relaxed);
+            this->cached_generation.store(generation, std::memory_order_release);
+            this->refreshed = true;
+        }
+
+        const bzn::simple_options& options;
+        const std::string option_name;
+
+        mutable std::atomic<T> value{};
+        mutable std::atomic<uint64_t> cached_generation{0};
+        mutable std::mutex refresh_lock;
+        mutable bool refreshed = false; // guarded by refresh_lock
+    };
+}
@@ -46,7 +46,11 @@ simple_options::simple_options()
 bool
 simple_options::parse(int argc, const char* argv[])
 {
-    return this->handle_command_line_options(argc, argv) && this->handle_config_file_options() && this->validate_options();
+    const bool result = this->handle_command_line_options(argc, argv) && this->handle_config_file_options() && this->validate_options();
+
+    ++this->current_generation;
+
+    return result;
 }
 
 void
@@ -80,6 +84,12 @@ simple_options::build_options()
                 (MEM_STORAGE.c_str(),
                          po::value<bool>()->default_value(true),
                          "enable in memory storage for debugging")
+                (RAFT_PROTOBUF_ENABLED.c_str(),
+                        po::value<bool>()->default_value(false),
+                        "send raft messages to peers in protobuf (only enable once every node in the swarm can receive them)")
+                (RAFT_SNAPSHOT_THRESHOLD.c_str(),
+                        po::value<size_t>()->default_value(10000),
+                        "committed raft log entries between storage snapshots (0 disables log compaction)")
                 (NODE_UUID.c_str(),
                         po::value<std::string>(),
                         "uuid of this node")
@@ -122,7 +132,10 @@ simple_options::build_options()
                         "address of stats.d listener for audit module")
                 (MONITOR_PORT.c_str(),
                         po::value<uint16_t>(),
-                        "port of stats.d listener for audit module");
+                        "port of stats.d listener for audit module")
+                (MONITOR_FLUSH_INTERVAL.c_str(),
+                        po::value<uint64_t>()->default_value(1000),
+                        "how often aggregated stats are sent to the stats.d listener (milliseconds)");
     this->options_root.add(audit);
 
     po::options_description experimental("Experimental");
@@ -130,6 +143,12 @@ simple_options::build_options()
                 (PBFT_ENABLED.c_str(),
                         po::value<bool>()->default_value(false),
                         "use pbft consensus instead of raft (experimental)")
+                (PBFT_FAST_READS_ENABLED.c_str(),
+                        po::value<bool>()->default_value(false),
+                        "answer reads locally instead of through pbft consensus while state is fresh")
+                (PBFT_FAST_READS_MAX_STALENESS.c_str(),
+                        po::value<uint64_t>()->default_value(5000),
+                        "how long after the last stable checkpoint local reads are allowed (milliseconds)")
                 (PEER_VALIDATION_ENABLED.c_str(),
                         po::value<bool>()->default_value(false),
                         "require signed key for new peers to join swarm")
@@ -138,6 +157,22 @@ simple_options::build_options()
                         "signed key for node's uuid");
     this->options_root.add(experimental);
 
+    po::options_description threading("Threading");
+    threading.add_options()
+                (IO_THREADS.c_str(),
+                        po::value<size_t>()->default_value(0),
+                        "threads handling network io, parsing and signature checks (0 for one per core)")
+                (CONSENSUS_THREAD_ENABLED.c_str(),
+                        po::value<bool>()->default_value(false),
+                        "run pbft on a dedicated thread instead of the io threads")
+                (EXECUTION_THREADS.c_str(),
+                        po::value<size_t>()->default_value(0),
+                        "threads applying committed pbft requests to storage (0 to apply them on the consensus thread)")
+                (PIN_THREADS.c_str(),
+                        po::value<bool>()->default_value(false),
+                        "pin each worker thread to its own cpu core");
+    this->options_root.add(threading);
+
     po::options_description crypto("Cryptography");
     crypto.add_options()
                 (NODE_PUBKEY_FILE.c_str(),
@@ -230,6 +265,13 @@ simple_options::validate_options()
         errors = true;
     }
 
+    // the audit module re-arms its flush timer with this interval, so zero would spin
+    if (this->get<uint64_t>(MONITOR_FLUSH_INTERVAL) == 0)
+    {
+        std::cerr << "Invalid monitor flush interval, it must be at least 1 millisecond";
+        errors = true;
+    }
+
     return !errors;
 }
 
@@ -356,13 +398,19 @@ simple_options::has(const std::string& option_name) const
 void
 simple_options::set(const std::string& option_name, const std::string& option_value)
 {
-    po::basic_option<char> opt;
-    opt.string_key = option_name;
-    opt.value.push_back(option_value);
-
-    boost::program_options::parsed_options parsed(&(this->options_root));
-    parsed.options.push_back(opt);
+    // po::store ignores options it has already stored, so parse the value ourselves and replace it in place
+    boost::any value;
+    this->options_root.find(option_name, false).semantic()->parse(value, {option_value}, true);
 
     this->vm.erase(option_name);
-    po::store(parsed, this->vm);
+    this->vm.emplace(option_name, po::variable_value(value, false));
+
+    ++this->current_generation;
+}
+
+
+uint64_t
+simple_options::generation() const
+{
+    return this->current_generation.load(std::memory_order_acquire);
 }
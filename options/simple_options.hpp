@@ -16,6 +16,7 @@
 
 #include <boost/program_options.hpp>
 #include <boost/program_options/variables_map.hpp>
+#include <atomic>
 #include <string>
 
 namespace bzn::option_names
@@ -37,11 +38,16 @@ namespace bzn::option_names
     const std::string MAX_STORAGE = "max_storage";
     const std::string MEM_STORAGE = "mem_storage";
     const std::string MONITOR_ADDRESS = "monitor_address";
+    const std::string MONITOR_FLUSH_INTERVAL = "monitor_flush_interval_ms";
     const std::string MONITOR_PORT = "monitor_port";
     const std::string NODE_UUID = "uuid";
     const std::string NODE_PUBKEY_FILE = "public_key_file";
     const std::string NODE_PRIVATEKEY_FILE = "private_key_file";
     const std::string PBFT_ENABLED = "use_pbft";
+    const std::string PBFT_FAST_READS_ENABLED = "pbft_fast_reads_enabled";
+    const std::string PBFT_FAST_READS_MAX_STALENESS = "pbft_fast_reads_max_staleness_ms";
+    const std::string RAFT_PROTOBUF_ENABLED = "raft_protobuf_enabled";
+    const std::string RAFT_SNAPSHOT_THRESHOLD = "raft_snapshot_threshold";
     const std::string STATE_DIR = "state_dir";
     const std::string WS_IDLE_TIMEOUT = "ws_idle_timeout";
     const std::string PEER_VALIDATION_ENABLED = "peer_validation_enabled";
@@ -57,6 +63,11 @@ namespace bzn::option_names
     const std::string CRYPTO_ENABLED_OUTGOING = "crypto_enabled_outgoing";
     const std::string CRYPTO_ENABLED_INCOMING = "crypto_enabled_incoming";
 
+    const std::string IO_THREADS = "io_threads";
+    const std::string CONSENSUS_THREAD_ENABLED = "consensus_thread_enabled";
+    const std::string EXECUTION_THREADS = "execution_threads";
+    const std::string PIN_THREADS = "pin_threads";
+
 
 }
 
@@ -100,6 +111,11 @@ namespace bzn
          */
         bool has(const std::string& option_name) const;
 
+        /*
+         * Incremented whenever option values change so cached copies (see cached_option) know to refresh
+         */
+        uint64_t generation() const;
+
     private:
         void build_options();
         bool validate_options();
@@ -109,5 +125,6 @@ namespace bzn
         std::string config_file;
         boost::program_options::options_description options_root;
         boost::program_options::variables_map vm;
+        std::atomic<uint64_t> current_generation{0};
     };
 }
@@ -17,6 +17,7 @@
 
 #include <include/bluzelle.hpp>
 #include <options/options.hpp>
+#include <options/cached_option.hpp>
 #include <boost/lexical_cast.hpp>
 #include <fstream>
 #include <gtest/gtest.h>
@@ -333,6 +334,13 @@ TEST_F(options_file_test, test_that_uuid_and_pubkey_conflict)
     EXPECT_FALSE(options.parse_command_line(1, NO_ARGS));
 }
 
+TEST_F(options_file_test, test_that_zero_monitor_flush_interval_is_rejected)
+{
+    bzn::options options;
+    this->save_options_file(compose_config_data(DEFAULT_CONFIG_CONTENT, "\"" + bzn::option_names::MONITOR_FLUSH_INTERVAL + "\": 0"));
+    EXPECT_FALSE(options.parse_command_line(1, NO_ARGS));
+}
+
 TEST_F(options_file_test, test_set_option_at_runtime)
 {
     bzn::options options;
@@ -343,4 +351,22 @@ TEST_F(options_file_test, test_set_option_at_runtime)
     options.get_mutable_simple_options().set(bzn::option_names::DEBUG_LOGGING, "false");
     EXPECT_FALSE(options.get_simple_options().get<bool>(bzn::option_names::DEBUG_LOGGING));
 
-}
\ No newline at end of file
+}
+
+TEST_F(options_file_test, test_cached_option_follows_runtime_set)
+{
+    bzn::options options;
+    this->save_options_file(DEFAULT_CONFIG_DATA);
+
+    bzn::cached_option<bool> debug_logging(options.get_simple_options(), bzn::option_names::DEBUG_LOGGING);
+    EXPECT_FALSE(debug_logging.get());
+
+    EXPECT_TRUE(options.parse_command_line(1, NO_ARGS));
+    EXPECT_TRUE(debug_logging.get());
+
+    options.get_mutable_simple_options().set(bzn::option_names::DEBUG_LOGGING, "false");
+    EXPECT_FALSE(debug_logging.get());
+
+    options.get_mutable_simple_options().set(bzn::option_names::DEBUG_LOGGING, "true");
+    EXPECT_TRUE(debug_logging.get());
+}
@@ -14,7 +14,10 @@
 
 
 #include <pbft/database_pbft_service.hpp>
+#include <metrics/metrics.hpp>
 #include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <cctype>
 
 
 using namespace bzn;
@@ -22,6 +25,27 @@ using namespace bzn;
 namespace
 {
     const std::string NEXT_REQUEST_SEQUENCE_KEY{"next_request_sequence"};
+    const size_t MAX_CHECKPOINT_STATE_HASHES{4};
+
+    auto& execute_latency = bzn::metrics::registry::instance().get_histogram("pbft_execute_latency_us");
+    auto& request_latency = bzn::metrics::registry::instance().get_histogram("pbft_request_latency_us");
+
+    bool
+    is_read_only(const database_msg& request)
+    {
+        switch (request.msg_case())
+        {
+            case database_msg::kRead:
+            case database_msg::kHas:
+            case database_msg::kKeys:
+            case database_msg::kSize:
+            case database_msg::kHasDb:
+            case database_msg::kWriters:
+                return true;
+            default:
+                return false;
+        }
+    }
 }
 
 
@@ -36,6 +60,7 @@ database_pbft_service::database_pbft_service(
     , uuid(std::move(uuid))
 {
     this->load_next_request_sequence();
+    this->load_persisted_sequences();
 }
 
 database_pbft_service::~database_pbft_service()
@@ -49,27 +74,41 @@ database_pbft_service::apply_operation(const std::shared_ptr<bzn::pbft_operation
 {
     std::lock_guard<std::mutex> lock(this->lock);
 
-    // store op...
-    if (auto result = this->unstable_storage->create(this->uuid, std::to_string(op->get_sequence()), op->get_database_msg().SerializeAsString());
-        result != bzn::storage_result::ok)
+    const uint64_t sequence = op->get_sequence();
+
+    // KEP-899 - We do not want to throw a runtime error for duplicates, as it is possible that
+    // during a view change we may try to perform duplicate operations that have already been
+    // done in previous views.
+    if (sequence < this->next_request_sequence || this->operations_awaiting_result.count(sequence))
     {
-        if (result == bzn::storage_result::exists)
+        LOG(warning) << "ignoring pbft request, possible duplicate? : " << op->get_database_msg().DebugString() << ", sequence: " << sequence;
+        return;
+    }
+
+    // only requests that have to wait for earlier ones are stored...
+    if (sequence > this->next_request_sequence && !this->persisted_sequences.count(sequence))
+    {
+        // the whole envelope is kept so the request is executed on behalf of its original sender
+        if (auto result = this->unstable_storage->create(this->uuid, std::to_string(sequence), op->get_request().SerializeAsString());
+            result != bzn::storage_result::ok)
         {
-            // KEP-899 - We do not want to throw a runtime error for duplicates, as it is possible that
-            // during a view change we may try to perform duplicate operatiosn that have already been
-            // done in previous views.
-            LOG(warning) << "failed to store pbft request, possible duplicate? : " << op->get_database_msg().DebugString() << ", " << uint32_t(result);
-            return;
-        }
+            if (result == bzn::storage_result::exists)
+            {
+                LOG(warning) << "failed to store pbft request, possible duplicate? : " << op->get_database_msg().DebugString() << ", " << uint32_t(result);
+                return;
+            }
+
+            LOG(fatal) << "failed to store pbft request: " << op->get_database_msg().DebugString() << ", " << uint32_t(result);
 
-        LOG(fatal) << "failed to store pbft request: " << op->get_database_msg().DebugString() << ", " << uint32_t(result);
+            // these are fatal... something bad is going on.
+            throw std::runtime_error("Failed to store pbft request! (" + std::to_string(uint8_t(result)) + ")");
+        }
 
-        // these are fatal... something bad is going on.
-        throw std::runtime_error("Failed to store pbft request! (" + std::to_string(uint8_t(result)) + ")");
+        this->persisted_sequences.insert(sequence);
     }
 
     // store requester session for eventual response...
-    this->operations_awaiting_result[op->get_sequence()] = op;
+    this->operations_awaiting_result[sequence] = op;
 
     this->process_awaiting_operations();
 }
@@ -92,6 +131,15 @@ database_pbft_service::apply_operation_now(const bzn_envelope& msg, std::shared_
 
             return true;
         }
+
+        if (is_read_only(db_msg) && this->is_fresh_for_reads())
+        {
+            LOG(debug) << "handling read locally";
+
+            this->crud->handle_request(msg.sender(), db_msg, std::move(session));
+
+            return true;
+        }
     }
 
     return false;
@@ -101,71 +149,108 @@ database_pbft_service::apply_operation_now(const bzn_envelope& msg, std::shared_
 void
 database_pbft_service::process_awaiting_operations()
 {
-    while (this->unstable_storage->has(this->uuid, std::to_string(this->next_request_sequence)))
+    const uint64_t first_sequence = this->next_request_sequence;
+
+    while (true)
     {
         const key_t key{std::to_string(this->next_request_sequence)};
 
-        auto result = this->unstable_storage->read(this->uuid, key);
-
-        if (!result)
+        if (auto op_it = this->operations_awaiting_result.find(this->next_request_sequence); op_it != this->operations_awaiting_result.end())
         {
-            // these are fatal... something bad is going on.
-            throw std::runtime_error("Failed to store pbft request!");
-        }
+            const auto op = op_it->second;
+            this->operations_awaiting_result.erase(op_it);
 
-        database_msg request;
+            this->execute_request(this->next_request_sequence, op->get_request(), op->get_database_msg()
+                , (op->has_session() && op->session()->is_open()) ? op->session() : nullptr);
 
-        if (!request.ParseFromString(*result))
-        {
-            // these are fatal... something bad is going on.
-            throw std::runtime_error("Failed to create pbft_request from database read!");
+            execute_latency.record(op->mark_phase().count());
+            request_latency.record(op->get_age().count());
+
+            this->io_context->post(std::bind(this->execute_handler, op));
         }
+        else if (this->persisted_sequences.count(this->next_request_sequence))
+        {
+            // stored before a restart, so all we have is the request itself...
+            auto result = this->unstable_storage->read(this->uuid, key);
 
-        LOG(info) << "Executing request " << request.DebugString() << "..., sequence: " << key;
+            if (!result)
+            {
+                // these are fatal... something bad is going on.
+                throw std::runtime_error("Failed to read pbft request!");
+            }
 
-        auto op_it = this->operations_awaiting_result.find(this->next_request_sequence);
+            bzn_envelope env;
+            database_msg request;
+
+            if (!env.ParseFromString(*result) || !request.ParseFromString(env.database_msg()))
+            {
+                // these are fatal... something bad is going on.
+                throw std::runtime_error("Failed to create pbft_request from database read!");
+            }
 
-        if (op_it != this->operations_awaiting_result.end() && op_it->second->has_session() && op_it->second->session()->is_open())
-        {
-            this->crud->handle_request(op_it->second->get_request().sender(), request, op_it->second->session());
-        }
-        else
-        {
-            // session not found then this was probably loaded from the database...
             LOG(info) << "We do not have a pending operation for this request";
 
-            this->crud->handle_request(op_it->second->get_request().sender(), request, nullptr);
+            this->execute_request(this->next_request_sequence, env, request, nullptr);
         }
-
-        if (op_it != this->operations_awaiting_result.end())
+        else
         {
-            this->io_context->post(std::bind(this->execute_handler, (*op_it).second));
+            break;
         }
 
-        if (auto result = this->unstable_storage->remove(this->uuid, key); result != bzn::storage_result::ok)
+        if (this->persisted_sequences.erase(this->next_request_sequence))
         {
-            // these are fatal... something bad is going on.
-            throw std::runtime_error("Failed to remove pbft_request from database! (" + std::to_string(uint8_t(result)) + ")");
+            if (auto result = this->unstable_storage->remove(this->uuid, key); result != bzn::storage_result::ok)
+            {
+                // these are fatal... something bad is going on.
+                throw std::runtime_error("Failed to remove pbft_request from database! (" + std::to_string(uint8_t(result)) + ")");
+            }
         }
 
-        if (this->next_request_sequence == this->next_checkpoint)
+        // we may be executing ahead of pbft, so don't wait to be told about the regular checkpoints...
+        if (this->next_request_sequence % CHECKPOINT_INTERVAL == 0 || this->next_request_sequence == this->next_checkpoint)
         {
             if (this->crud->save_state())
             {
                 this->last_checkpoint = this->next_request_sequence;
             }
+
+            this->record_state_hash(this->next_request_sequence);
         }
 
         ++this->next_request_sequence;
+    }
 
+    // advance the persisted cursor once for the whole batch...
+    if (this->next_request_sequence != first_sequence)
+    {
         this->save_next_request_sequence();
     }
 }
 
+
+void
+database_pbft_service::execute_request(uint64_t sequence_number, const bzn_envelope& env, const database_msg& request
+    , std::shared_ptr<bzn::session_base> session)
+{
+    LOG(debug) << "Executing request " << request.ShortDebugString().substr(0, MAX_MESSAGE_SIZE) << "..., sequence: " << sequence_number;
+
+    this->crud->handle_request(env.sender(), request, std::move(session));
+
+    this->record_executed_request(sequence_number, env);
+}
+
+
 bzn::hash_t
-database_pbft_service::service_state_hash(uint64_t /*sequence_number*/) const
+database_pbft_service::service_state_hash(uint64_t sequence_number) const
 {
-    // TODO: not sure how this works...
+    std::lock_guard<std::mutex> lock(this->state_hashes_lock);
+
+    if (auto it = this->state_hashes.find(sequence_number); it != this->state_hashes.end())
+    {
+        return it->second;
+    }
+
+    LOG(warning) << "no state hash recorded for sequence: " << sequence_number;
 
     return "";
 }
@@ -173,6 +258,8 @@ database_pbft_service::service_state_hash(uint64_t /*sequence_number*/) const
 std::shared_ptr<bzn::service_state_t>
 database_pbft_service::get_service_state(uint64_t sequence_number) const
 {
+    std::lock_guard<std::mutex> lock(this->lock);
+
     if (sequence_number == this->last_checkpoint)
     {
         return this->crud->get_saved_state();
@@ -182,51 +269,257 @@ database_pbft_service::get_service_state(uint64_t sequence_number) const
 }
 
 bool
-database_pbft_service::set_service_state(uint64_t sequence_number, const bzn::service_state_t& data)
+database_pbft_service::set_service_state(uint64_t sequence_number, const bzn::service_state_t& data, const bzn::hash_t& state_hash)
 {
-    // initialize database state from checkpoint data
-    if (!this->crud->load_state(data))
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    // initialize database state from checkpoint data (storage keeps what it has if the data isn't that state)
+    if (!this->crud->load_state(data, state_hash))
     {
         return false;
     }
     this->last_checkpoint = sequence_number;
 
+    // the requests we executed before no longer lead up to our state...
+    {
+        std::lock_guard<std::mutex> lock(this->executed_requests_lock);
+        this->executed_requests.clear();
+    }
+
+    this->record_state_hash(sequence_number);
+
     // remove all backlogged requests prior to checkpoint
-    uint64_t seq = this->next_request_sequence;
-    while (seq <= sequence_number)
+    this->discard_requests_until(sequence_number);
+
+    this->next_request_sequence = std::max(this->next_request_sequence, sequence_number + 1);
+    this->process_awaiting_operations();
+    return true;
+}
+
+std::shared_ptr<std::vector<bzn_envelope>>
+database_pbft_service::get_service_state_delta(uint64_t from_sequence, uint64_t to_sequence) const
+{
+    std::lock_guard<std::mutex> lock(this->executed_requests_lock);
+
+    auto requests = std::make_shared<std::vector<bzn_envelope>>();
+    requests->reserve(to_sequence - from_sequence);
+
+    for (uint64_t seq = from_sequence + 1; seq <= to_sequence; ++seq)
     {
-        const key_t key{std::to_string(seq)};
-        this->unstable_storage->remove(uuid, key);
-        seq++;
+        auto it = this->executed_requests.find(seq);
+
+        if (it == this->executed_requests.end())
+        {
+            return nullptr;
+        }
+
+        requests->emplace_back(it->second);
+    }
+
+    return requests;
+}
+
+bool
+database_pbft_service::apply_service_state_delta(uint64_t from_sequence, uint64_t to_sequence, const bzn::hash_t& state_hash
+    , const std::vector<bzn_envelope>& requests)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    if (to_sequence < from_sequence || requests.size() != to_sequence - from_sequence)
+    {
+        LOG(error) << "expected " << (to_sequence - from_sequence) << " requests, but got: " << requests.size();
+        return false;
     }
 
-    this->next_request_sequence = seq;
+    // we can only catch up from here if we have executed everything up to from_sequence...
+    if (this->next_request_sequence <= from_sequence)
+    {
+        LOG(warning) << "unable to catch up from sequence " << from_sequence << ", next request sequence is: " << this->next_request_sequence;
+        return false;
+    }
+
+    // make sure every request we still need is well formed before executing any of them...
+    std::vector<database_msg> parsed_requests;
+    for (uint64_t seq = this->next_request_sequence; seq <= to_sequence; ++seq)
+    {
+        if (!parsed_requests.emplace_back().ParseFromString(requests[seq - from_sequence - 1].database_msg()))
+        {
+            LOG(error) << "failed to parse request for sequence: " << seq;
+            return false;
+        }
+    }
+
+    // the requests aren't covered by the checkpoint proofs, so remember their writes in case they don't produce it
+    const uint64_t rollback_sequence = this->next_request_sequence - 1;
+    this->crud->start_undo_log();
+
+    for (const auto& request : parsed_requests)
+    {
+        this->execute_request(this->next_request_sequence, requests[this->next_request_sequence - from_sequence - 1], request, nullptr);
+        ++this->next_request_sequence;
+    }
+
+    if (const auto hash = this->crud->get_state_hash(); hash != state_hash)
+    {
+        LOG(error) << "state hash " << hash << " after executing requests does not match checkpoint " << state_hash
+            << " at sequence: " << to_sequence;
+
+        if (!this->crud->undo_writes())
+        {
+            // these are fatal... something bad is going on.
+            throw std::runtime_error("Failed to restore state after executing requests!");
+        }
+
+        this->next_request_sequence = rollback_sequence + 1;
+
+        std::lock_guard<std::mutex> requests_lock(this->executed_requests_lock);
+        this->executed_requests.erase(this->executed_requests.upper_bound(rollback_sequence), this->executed_requests.end());
+
+        return false;
+    }
+
+    this->crud->clear_undo_log();
+
+    // some of these may have been backlogged waiting for the requests we missed...
+    this->discard_requests_until(to_sequence);
+
+    if (this->crud->save_state())
+    {
+        this->last_checkpoint = to_sequence;
+    }
+
+    this->record_state_hash(to_sequence);
+
+    this->save_next_request_sequence();
+
     this->process_awaiting_operations();
+
     return true;
 }
 
+void
+database_pbft_service::discard_requests_until(uint64_t sequence_number)
+{
+    this->operations_awaiting_result.erase(this->operations_awaiting_result.begin(),
+        this->operations_awaiting_result.upper_bound(sequence_number));
+
+    const auto end = this->persisted_sequences.upper_bound(sequence_number);
+
+    for (auto it = this->persisted_sequences.begin(); it != end; ++it)
+    {
+        this->unstable_storage->remove(this->uuid, std::to_string(*it));
+    }
+
+    this->persisted_sequences.erase(this->persisted_sequences.begin(), end);
+}
+
 void
 database_pbft_service::save_service_state_at(uint64_t sequence_number)
 {
+    std::lock_guard<std::mutex> lock(this->lock);
+
     this->next_checkpoint = sequence_number;
 }
 
 void
 database_pbft_service::consolidate_log(uint64_t sequence_number)
 {
-    LOG(info) << "TODO: consolidating log at sequence number " << sequence_number;
+    // nothing to compact here (executed requests are pruned as state hashes are recorded), but a stable checkpoint
+    // is what bounds the staleness of local reads
+    LOG(debug) << "checkpoint stabilized at sequence number " << sequence_number;
+
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    this->last_stable_checkpoint = std::max(this->last_stable_checkpoint, sequence_number);
+    this->last_stable_checkpoint_time = std::chrono::steady_clock::now();
+}
+
+
+void
+database_pbft_service::enable_fast_reads(std::chrono::milliseconds max_staleness)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    this->fast_read_max_staleness = max_staleness;
+}
+
+
+bool
+database_pbft_service::is_fresh_for_reads()
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    if (!this->fast_read_max_staleness || !this->last_stable_checkpoint_time)
+    {
+        return false;
+    }
+
+    // committed requests waiting on a gap mean we are behind the swarm...
+    if (!this->operations_awaiting_result.empty() || !this->persisted_sequences.empty()
+        || this->next_request_sequence <= this->last_stable_checkpoint)
+    {
+        return false;
+    }
+
+    // a replica cut off from the swarm stops seeing checkpoints become stable, so bound how long we trust our state
+    return (std::chrono::steady_clock::now() - *this->last_stable_checkpoint_time) <= *this->fast_read_max_staleness;
 }
 
 void
 database_pbft_service::register_execute_handler(bzn::execute_handler_t handler)
 {
+    std::lock_guard<std::mutex> lock(this->lock);
+
     this->execute_handler = std::move(handler);
 }
 
 
+bool
+database_pbft_service::is_saturated() const
+{
+    // executes on whatever thread hands it operations, so it is never behind on its own
+    return false;
+}
+
+
+void
+database_pbft_service::record_state_hash(uint64_t sequence_number)
+{
+    // the storage state tree is updated on every write, so this is cheap...
+    auto hash = this->crud->get_state_hash();
+
+    std::lock_guard<std::mutex> lock(this->state_hashes_lock);
+
+    this->state_hashes[sequence_number] = std::move(hash);
+
+    // checkpoint messages are sent shortly after the checkpoint is executed, so only the most recent few are needed
+    while (this->state_hashes.size() > MAX_CHECKPOINT_STATE_HASHES)
+    {
+        this->state_hashes.erase(this->state_hashes.begin());
+    }
+
+    // keep the requests needed to bring a replica from the oldest of these checkpoints up to date...
+    std::lock_guard<std::mutex> requests_lock(this->executed_requests_lock);
+
+    this->executed_requests.erase(this->executed_requests.begin(),
+        this->executed_requests.upper_bound(this->state_hashes.begin()->first));
+}
+
+
+void
+database_pbft_service::record_executed_request(uint64_t sequence_number, const bzn_envelope& request)
+{
+    std::lock_guard<std::mutex> lock(this->executed_requests_lock);
+
+    this->executed_requests[sequence_number] = request;
+}
+
+
 uint64_t
 database_pbft_service::applied_requests_count() const
 {
+    std::lock_guard<std::mutex> lock(this->lock);
+
     return this->next_request_sequence - 1;
 }
 
@@ -266,3 +559,28 @@ database_pbft_service::save_next_request_sequence()
 
     LOG(debug) << "updated: next_request_sequence: " << this->next_request_sequence;
 }
+
+
+void
+database_pbft_service::load_persisted_sequences()
+{
+    for (const auto& key : this->unstable_storage->get_keys(this->uuid))
+    {
+        if (key.empty() || !std::all_of(key.begin(), key.end(), ::isdigit))
+        {
+            continue;
+        }
+
+        if (const auto sequence = boost::lexical_cast<uint64_t>(key); sequence >= this->next_request_sequence)
+        {
+            this->persisted_sequences.insert(sequence);
+        }
+        else
+        {
+            // already executed...
+            this->unstable_storage->remove(this->uuid, key);
+        }
+    }
+
+    LOG(debug) << "found " << this->persisted_sequences.size() << " stored requests awaiting execution";
+}
@@ -19,7 +19,11 @@
 #include <pbft/pbft_failure_detector_base.hpp>
 #include <pbft/pbft_service_base.hpp>
 #include <storage/storage_base.hpp>
+#include <chrono>
+#include <map>
 #include <memory>
+#include <optional>
+#include <set>
 
 
 namespace bzn
@@ -42,7 +46,12 @@ namespace bzn
 
         std::shared_ptr<bzn::service_state_t> get_service_state(uint64_t sequence_number) const override;
 
-        bool set_service_state(uint64_t sequence_number, const bzn::service_state_t& data) override;
+        bool set_service_state(uint64_t sequence_number, const bzn::service_state_t& data, const bzn::hash_t& state_hash) override;
+
+        std::shared_ptr<std::vector<bzn_envelope>> get_service_state_delta(uint64_t from_sequence, uint64_t to_sequence) const override;
+
+        bool apply_service_state_delta(uint64_t from_sequence, uint64_t to_sequence, const bzn::hash_t& state_hash
+            , const std::vector<bzn_envelope>& requests) override;
 
         void save_service_state_at(uint64_t sequence_number) override;
 
@@ -50,13 +59,31 @@ namespace bzn
 
         void register_execute_handler(bzn::execute_handler_t handler) override;
 
+        bool is_saturated() const override;
+
         uint64_t applied_requests_count() const;
 
+        /*
+         * Answer read only requests from local state, without going through consensus, as long as we have
+         * executed everything committed so far and saw a checkpoint become stable within max_staleness
+         */
+        void enable_fast_reads(std::chrono::milliseconds max_staleness);
+
     private:
         void process_awaiting_operations();
 
+        void execute_request(uint64_t sequence_number, const bzn_envelope& env, const database_msg& request
+            , std::shared_ptr<bzn::session_base> session);
+
         void load_next_request_sequence();
         void save_next_request_sequence();
+        void load_persisted_sequences();
+        void discard_requests_until(uint64_t sequence_number);
+
+        bool is_fresh_for_reads();
+
+        void record_state_hash(uint64_t sequence_number);
+        void record_executed_request(uint64_t sequence_number, const bzn_envelope& request);
 
         std::shared_ptr<bzn::asio::io_context_base> io_context;
         std::shared_ptr<bzn::storage_base> unstable_storage;
@@ -64,14 +91,29 @@ namespace bzn
         uint64_t next_request_sequence = 1;
         const bzn::uuid_t uuid;
 
-        std::unordered_map<uint64_t, std::shared_ptr<bzn::pbft_operation>> operations_awaiting_result;
+        // committed operations that can't be executed until the ones before them are
+        std::map<uint64_t, std::shared_ptr<bzn::pbft_operation>> operations_awaiting_result;
+
+        // sequences of the out of order requests written to unstable storage, so they survive a restart
+        std::set<uint64_t> persisted_sequences;
 
         bzn::execute_handler_t execute_handler;
 
         std::once_flag start_once;
-        std::mutex lock;
+        mutable std::mutex lock;
         uint64_t next_checkpoint = 0;
         uint64_t last_checkpoint = 0;
+
+        std::optional<std::chrono::milliseconds> fast_read_max_staleness;
+        uint64_t last_stable_checkpoint = 0;
+        std::optional<std::chrono::steady_clock::time_point> last_stable_checkpoint_time;
+
+        std::map<uint64_t, bzn::hash_t> state_hashes;
+        mutable std::mutex state_hashes_lock;
+
+        // requests executed since the oldest recorded checkpoint, so lagging replicas can be sent just these
+        std::map<uint64_t, bzn_envelope> executed_requests;
+        mutable std::mutex executed_requests_lock;
     };
 
 } // bzn
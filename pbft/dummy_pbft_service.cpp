@@ -72,6 +72,12 @@ dummy_pbft_service::register_execute_handler(execute_handler_t handler)
     this->execute_handler = std::move(handler);
 }
 
+bool
+dummy_pbft_service::is_saturated() const
+{
+    return false;
+}
+
 bzn::hash_t
 dummy_pbft_service::service_state_hash(uint64_t sequence_number) const
 {
@@ -85,11 +91,24 @@ dummy_pbft_service::get_service_state(uint64_t sequence_number) const
 }
 
 bool
-dummy_pbft_service::set_service_state(uint64_t /*sequence_number*/, const bzn::service_state_t& /*data*/)
+dummy_pbft_service::set_service_state(uint64_t /*sequence_number*/, const bzn::service_state_t& /*data*/, const bzn::hash_t& /*state_hash*/)
 {
     return true;
 }
 
+std::shared_ptr<std::vector<bzn_envelope>>
+dummy_pbft_service::get_service_state_delta(uint64_t /*from_sequence*/, uint64_t /*to_sequence*/) const
+{
+    // no request log, so always fall back to the full state
+    return nullptr;
+}
+
+bool
+dummy_pbft_service::apply_service_state_delta(uint64_t /*from_sequence*/, uint64_t /*to_sequence*/, const bzn::hash_t& /*state_hash*/, const std::vector<bzn_envelope>& /*requests*/)
+{
+    return false;
+}
+
 void
 dummy_pbft_service::save_service_state_at(uint64_t /*sequence_number*/)
 {
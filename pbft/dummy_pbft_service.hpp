@@ -33,9 +33,12 @@ namespace bzn
         bool apply_operation_now(const bzn_envelope& msg, std::shared_ptr<bzn::session_base> session) override;
         void consolidate_log(uint64_t sequence_number) override;
         void register_execute_handler(execute_handler_t handler) override;
+        bool is_saturated() const override;
         bzn::hash_t service_state_hash(uint64_t sequence_number) const override;
         std::shared_ptr<bzn::service_state_t> get_service_state(uint64_t sequence_number) const override;
-        bool set_service_state(uint64_t sequence_number, const bzn::service_state_t& data) override;
+        bool set_service_state(uint64_t sequence_number, const bzn::service_state_t& data, const bzn::hash_t& state_hash) override;
+        std::shared_ptr<std::vector<bzn_envelope>> get_service_state_delta(uint64_t from_sequence, uint64_t to_sequence) const override;
+        bool apply_service_state_delta(uint64_t from_sequence, uint64_t to_sequence, const bzn::hash_t& state_hash, const std::vector<bzn_envelope>& requests) override;
         void save_service_state_at(uint64_t sequence_number) override;
 
         uint64_t applied_requests_count();
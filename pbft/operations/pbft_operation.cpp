@@ -48,6 +48,23 @@ pbft_operation::has_session() const
     return this->session_saved;
 }
 
+std::chrono::microseconds
+pbft_operation::mark_phase()
+{
+    const auto now = std::chrono::steady_clock::now();
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - this->phase_start_time);
+
+    this->phase_start_time = now;
+
+    return elapsed;
+}
+
+std::chrono::microseconds
+pbft_operation::get_age() const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - this->created_time);
+}
+
 uint64_t
 pbft_operation::get_sequence() const
 {
@@ -15,6 +15,7 @@
 #include <proto/pbft.pb.h>
 #include <node/session_base.hpp>
 #include <include/bluzelle.hpp>
+#include <chrono>
 #include <cstdint>
 
 namespace bzn
@@ -57,6 +58,17 @@ namespace bzn
          */
         virtual operation_key_t get_operation_key() const;
 
+        /**
+         * Restart the clock for the operation's next phase (the first phase starts when the operation is created)
+         * @return time spent in the phase that just ended
+         */
+        std::chrono::microseconds mark_phase();
+
+        /**
+         * @return time since the operation was created
+         */
+        std::chrono::microseconds get_age() const;
+
         virtual uint64_t get_sequence() const;
         virtual uint64_t get_view() const;
         virtual const hash_t& get_request_hash() const;
@@ -153,5 +165,8 @@ namespace bzn
         const uint64_t view;
         const uint64_t sequence;
         const bzn::hash_t request_hash;
+
+        const std::chrono::steady_clock::time_point created_time = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point phase_start_time = created_time;
     };
 }
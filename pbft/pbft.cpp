@@ -27,11 +27,22 @@
 #include <optional>
 #include <iterator>
 #include <crud/crud_base.hpp>
+#include <metrics/metrics.hpp>
 #include <random>
 #include <chrono>
 
 using namespace bzn;
 
+namespace
+{
+    // request phases: received -> preprepared -> prepared -> committed (-> executed, recorded by the service)
+    auto& requests_received = bzn::metrics::registry::instance().get_counter("pbft_requests_received_total");
+    auto& requests_rejected_saturated = bzn::metrics::registry::instance().get_counter("pbft_requests_rejected_saturated_total");
+    auto& preprepare_latency = bzn::metrics::registry::instance().get_histogram("pbft_preprepare_latency_us");
+    auto& prepare_latency = bzn::metrics::registry::instance().get_histogram("pbft_prepare_latency_us");
+    auto& commit_latency = bzn::metrics::registry::instance().get_histogram("pbft_commit_latency_us");
+}
+
 pbft::pbft(
     std::shared_ptr<bzn::node_base> node
     , std::shared_ptr<bzn::asio::io_context_base> io_context
@@ -179,6 +190,8 @@ pbft::handle_membership_message(const bzn_envelope& msg, std::shared_ptr<bzn::se
 
     const auto hash = this->crypto->hash(msg);
 
+    std::lock_guard<std::mutex> lock(this->pbft_lock);
+
     switch (inner_msg.type())
     {
         case PBFT_MMSG_JOIN:
@@ -195,7 +208,7 @@ pbft::handle_membership_message(const bzn_envelope& msg, std::shared_ptr<bzn::se
             this->handle_get_state(inner_msg, std::move(session));
             break;
         case PBFT_MMSG_SET_STATE:
-            this->handle_set_state(inner_msg);
+            this->handle_set_state(inner_msg, msg.sender());
             break;
         case PBFT_MMSG_JOIN_RESPONSE:
             this->handle_join_response(inner_msg);
@@ -291,6 +304,18 @@ pbft::setup_request_operation(const bzn_envelope& request_env, const bzn::hash_t
 void
 pbft::handle_request(const bzn_envelope& request_env, const std::shared_ptr<session_base>& session)
 {
+    requests_received.increment();
+
+    // while execution is behind, turn new requests away (forwarded ones included, so the primary stops issuing
+    // preprepares) rather than let the execution queue grow...
+    if (this->service->is_saturated())
+    {
+        // TODO: send error message to client
+        requests_rejected_saturated.increment();
+        LOG(debug) << "Rejecting request because execution is behind: " << request_env.ShortDebugString().substr(0, MAX_MESSAGE_SIZE);
+        return;
+    }
+
     const auto hash = this->crypto->hash(request_env);
 
     if (session)
@@ -329,7 +354,7 @@ pbft::handle_request(const bzn_envelope& request_env, const std::shared_ptr<sess
 void
 pbft::forward_request_to_primary(const bzn_envelope& request_env)
 {
-    LOG(info) << "Forwarding request to primary";
+    LOG(debug) << "Forwarding request to primary";
     this->node->send_message(bzn::make_endpoint(this->get_primary()), std::make_shared<bzn_envelope>(request_env), true);
 
     const bzn::hash_t req_hash = this->crypto->hash(request_env);
@@ -498,6 +523,37 @@ pbft::handle_get_state(const pbft_membership_msg& msg, std::shared_ptr<bzn::sess
 
     if (req_cp == this->latest_stable_checkpoint())
     {
+        pbft_membership_msg reply;
+        reply.set_type(PBFT_MMSG_SET_STATE);
+        reply.set_sequence(req_cp.first);
+        reply.set_state_hash(req_cp.second);
+        if (this->saved_newview)
+        {
+            reply.set_allocated_newview_msg(new bzn_envelope(*this->saved_newview));
+        }
+
+        // a replica that is only a little behind just needs the requests it missed...
+        if (msg.since_sequence() > 0 && msg.since_sequence() < req_cp.first)
+        {
+            if (auto requests = this->service->get_service_state_delta(msg.since_sequence(), req_cp.first))
+            {
+                LOG(debug) << boost::format("Sending %1% requests since seq: %2% for checkpoint: seq: %3%, hash: %4%")
+                    % requests->size() % msg.since_sequence() % req_cp.first % req_cp.second;
+
+                reply.set_since_sequence(msg.since_sequence());
+                for (const auto& request : *requests)
+                {
+                    *reply.add_requests() = request;
+                }
+
+                session->send_datagram(std::make_shared<bzn::encoded_message>(this->wrap_message(reply).SerializeAsString()));
+                return;
+            }
+
+            LOG(debug) << boost::format("Requests since seq: %1% are no longer available, sending full state")
+                % msg.since_sequence();
+        }
+
         auto state = this->get_checkpoint_state(req_cp);
         if (!state)
         {
@@ -507,18 +563,16 @@ pbft::handle_get_state(const pbft_membership_msg& msg, std::shared_ptr<bzn::sess
             return;
         }
 
-        pbft_membership_msg reply;
-        reply.set_type(PBFT_MMSG_SET_STATE);
-        reply.set_sequence(req_cp.first);
-        reply.set_state_hash(req_cp.second);
-        reply.set_state_data(*state);
-        if (this->saved_newview)
+        // send the full state in chunks so that no single message has to hold the whole database
+        const uint32_t chunk_count = std::max<size_t>(1, (state->size() + MAX_STATE_CHUNK_SIZE - 1) / MAX_STATE_CHUNK_SIZE);
+        for (uint32_t chunk = 0; chunk < chunk_count; chunk++)
         {
-            reply.set_allocated_newview_msg(new bzn_envelope(*this->saved_newview));
-        }
+            reply.set_state_chunk(chunk);
+            reply.set_state_chunk_count(chunk_count);
+            reply.set_state_data(state->substr(chunk * MAX_STATE_CHUNK_SIZE, MAX_STATE_CHUNK_SIZE));
 
-        auto msg_ptr = std::make_shared<bzn::encoded_message>(this->wrap_message(reply).SerializeAsString());
-        session->send_datagram(msg_ptr);
+            session->send_datagram(std::make_shared<bzn::encoded_message>(this->wrap_message(reply).SerializeAsString()));
+        }
     }
     else
     {
@@ -529,7 +583,7 @@ pbft::handle_get_state(const pbft_membership_msg& msg, std::shared_ptr<bzn::sess
 }
 
 void
-pbft::handle_set_state(const pbft_membership_msg& msg)
+pbft::handle_set_state(const pbft_membership_msg& msg, const bzn::uuid_t& sender)
 {
     checkpoint_t cp(msg.sequence(), msg.state_hash());
 
@@ -539,11 +593,41 @@ pbft::handle_set_state(const pbft_membership_msg& msg)
     if (this->unstable_checkpoint_proofs[cp].size() >= this->quorum_size() &&
         this->local_unstable_checkpoints.count(cp) == 0)
     {
-        LOG(info) << boost::format("Adopting checkpoint %1% at seq %2%")
-            % cp.second % cp.first;
+        if (msg.since_sequence() > 0)
+        {
+            if (!this->apply_checkpoint_delta(cp, msg))
+            {
+                LOG(warning) << boost::format("Unable to catch up to checkpoint %1% at seq %2% from requests; requesting full state")
+                    % cp.second % cp.first;
+
+                this->request_checkpoint_state(cp, 0);
+                return;
+            }
+
+            LOG(info) << boost::format("Adopted checkpoint %1% at seq %2% by executing %3% requests since seq %4%")
+                % cp.second % cp.first % msg.requests_size() % msg.since_sequence();
+        }
+        else
+        {
+            auto state = this->assemble_checkpoint_state(cp, sender, msg);
+            if (!state)
+            {
+                // waiting for the remaining chunks
+                return;
+            }
 
-        // TODO: validate the state data
-        this->set_checkpoint_state(cp, msg.state_data());
+            LOG(info) << boost::format("Adopting checkpoint %1% at seq %2%")
+                % cp.second % cp.first;
+
+            if (!this->set_checkpoint_state(cp, *state))
+            {
+                LOG(warning) << boost::format("State from %1% is not checkpoint %2% at seq %3%; requesting it again")
+                    % sender % cp.second % cp.first;
+
+                this->request_checkpoint_state(cp, 0);
+                return;
+            }
+        }
 
         if (msg.has_newview_msg())
         {
@@ -616,6 +700,7 @@ void
 pbft::do_preprepared(const std::shared_ptr<pbft_operation>& op)
 {
     LOG(debug) << "Entering prepare phase for operation " << op->get_sequence();
+    preprepare_latency.record(op->mark_phase().count());
 
     pbft_msg msg = this->common_message_setup(op, PBFT_MSG_PREPARE);
 
@@ -637,6 +722,7 @@ pbft::do_prepared(const std::shared_ptr<pbft_operation>& op)
 
     LOG(debug) << "Entering commit phase for operation " << op->get_sequence();
     op->advance_operation_stage(pbft_operation_stage::commit);
+    prepare_latency.record(op->mark_phase().count());
 
     pbft_msg msg = this->common_message_setup(op, PBFT_MSG_COMMIT);
 
@@ -648,6 +734,7 @@ pbft::do_committed(const std::shared_ptr<pbft_operation>& op)
 {
     LOG(debug) << "Operation " << op->get_sequence() << " is committed-local";
     op->advance_operation_stage(pbft_operation_stage::execute);
+    commit_latency.record(op->mark_phase().count());
 
     // If we have a pending session for this request, attach to the operation just before we pass off to the service.
     // If we were to do that before this moment, then maybe the pbft_operation we attached it to never gets executed and
@@ -703,12 +790,7 @@ pbft::do_committed(const std::shared_ptr<pbft_operation>& op)
 
     if (this->audit_enabled)
     {
-        audit_message msg;
-        msg.mutable_pbft_commit()->set_operation(op->get_request_hash());
-        msg.mutable_pbft_commit()->set_sequence_number(op->get_sequence());
-        msg.mutable_pbft_commit()->set_sender_uuid(this->uuid);
-
-        this->broadcast(this->wrap_message(msg));
+        this->audit_commits[op->get_sequence()] = op->get_request_hash();
     }
 
     // TODO: this needs to be refactored to be service-agnostic
@@ -863,9 +945,58 @@ pbft::checkpoint_reached_locally(uint64_t sequence)
 
     this->broadcast(this->wrap_message(cp_msg));
 
+    if (this->audit_enabled)
+    {
+        this->send_audit_commit_digest(sequence);
+    }
+
     this->maybe_stabilize_checkpoint(*cp);
 }
 
+void
+pbft::send_audit_commit_digest(uint64_t sequence)
+{
+    if (sequence <= this->last_audit_digest_sequence)
+    {
+        return;
+    }
+
+    const uint64_t first = this->last_audit_digest_sequence + 1;
+    auto end = this->audit_commits.upper_bound(sequence);
+
+    // a range we did not commit entirely ourselves (eg. skipped by a state transfer) can't be compared with peers
+    bool complete = true;
+    bzn::hash_t digest;
+    uint64_t expected = first;
+    for (auto it = this->audit_commits.lower_bound(first); it != end; ++it, ++expected)
+    {
+        if (it->first != expected)
+        {
+            complete = false;
+            break;
+        }
+
+        digest = this->crypto->hash(digest + std::to_string(it->first) + it->second);
+    }
+
+    this->audit_commits.erase(this->audit_commits.begin(), end);
+    this->last_audit_digest_sequence = sequence;
+
+    if (!complete || expected != sequence + 1)
+    {
+        LOG(debug) << "not sending audit commit digest for sequences " << first << " to " << sequence << ", range incomplete";
+        return;
+    }
+
+    audit_message msg;
+    msg.mutable_pbft_commit_digest()->set_sender_uuid(this->uuid);
+    msg.mutable_pbft_commit_digest()->set_first_sequence(first);
+    msg.mutable_pbft_commit_digest()->set_last_sequence(sequence);
+    msg.mutable_pbft_commit_digest()->set_digest(digest);
+
+    this->broadcast(this->wrap_message(msg));
+}
+
 void
 pbft::handle_checkpoint(const pbft_msg& msg, const bzn_envelope& original_msg)
 {
@@ -920,7 +1051,7 @@ pbft::maybe_stabilize_checkpoint(const checkpoint_t& cp)
     else
     {
         // we don't have this checkpoint, so we need to catch up
-        this->request_checkpoint_state(cp);
+        this->request_checkpoint_state(cp, this->latest_stable_checkpoint().first);
     }
 }
 
@@ -935,7 +1066,10 @@ pbft::stabilize_checkpoint(const checkpoint_t& cp)
 
     this->clear_local_checkpoints_until(cp);
     this->clear_checkpoint_messages_until(cp);
+    this->pending_state_chunks.erase(this->pending_state_chunks.begin(),
+        this->pending_state_chunks.upper_bound(checkpoint_t(cp.first + 1, "")));
     this->operation_manager->delete_operations_until(cp.first);
+    this->service->consolidate_log(cp.first);
 
     this->low_water_mark = std::max(this->low_water_mark, cp.first);
     this->high_water_mark = std::max(this->high_water_mark,
@@ -947,12 +1081,13 @@ pbft::stabilize_checkpoint(const checkpoint_t& cp)
 }
 
 void
-pbft::request_checkpoint_state(const checkpoint_t& cp)
+pbft::request_checkpoint_state(const checkpoint_t& cp, uint64_t since_sequence)
 {
     pbft_membership_msg msg;
     msg.set_type(PBFT_MMSG_GET_STATE);
     msg.set_sequence(cp.first);
     msg.set_state_hash(cp.second);
+    msg.set_since_sequence(since_sequence);
 
     auto selected = this->select_peer_for_checkpoint(cp);
     LOG(info) << boost::format("Requesting checkpoint state for hash %1% at seq %2% from %3%")
@@ -989,13 +1124,99 @@ pbft::get_checkpoint_state(const checkpoint_t& cp) const
     return this->service->get_service_state(cp.first);
 }
 
-void
+bool
 pbft::set_checkpoint_state(const checkpoint_t& cp, const std::string& data)
 {
     // set the service state at the given checkpoint sequence
     // the service is expected to load the state and discard any pending operations
-    // prior to the sequence number, then execute any subsequent operations sequentially
-    this->service->set_service_state(cp.first, data);
+    // prior to the sequence number, then execute any subsequent operations sequentially.
+    // the data itself isn't covered by the checkpoint proofs, so the service keeps its old state unless the
+    // data has the agreed hash...
+    if (!this->service->set_service_state(cp.first, data, cp.second))
+    {
+        return false;
+    }
+
+    // ...which is what it records for the checkpoint
+    if (const auto hash = this->service->service_state_hash(cp.first); hash != cp.second)
+    {
+        LOG(error) << boost::format("Service adopted state %1% for checkpoint %2% at seq %3%")
+            % hash % cp.second % cp.first;
+        return false;
+    }
+
+    return true;
+}
+
+bool
+pbft::apply_checkpoint_delta(const checkpoint_t& cp, const pbft_membership_msg& msg)
+{
+    const std::vector<bzn_envelope> requests(msg.requests().begin(), msg.requests().end());
+
+    // the requests themselves are not covered by the checkpoint proofs, so only execute ones their senders signed;
+    // an unsigned one sends us to the full state instead...
+    for (const auto& request : requests)
+    {
+        if (request.sender().empty() || !this->crypto->verify(request))
+        {
+            LOG(error) << boost::format("Unsigned or invalid request from '%1%' for checkpoint %2% at seq %3%")
+                % request.sender() % cp.second % cp.first;
+            return false;
+        }
+    }
+
+    // ...and let the service undo them if they don't produce the agreed state
+    return this->service->apply_service_state_delta(msg.since_sequence(), cp.first, cp.second, requests);
+}
+
+std::shared_ptr<std::string>
+pbft::assemble_checkpoint_state(const checkpoint_t& cp, const bzn::uuid_t& sender, const pbft_membership_msg& msg)
+{
+    if (msg.state_chunk_count() <= 1)
+    {
+        return std::make_shared<std::string>(msg.state_data());
+    }
+
+    // only peers get to hold on to our memory, and only for as much state as a node could have...
+    if (!this->is_peer(sender) || msg.state_chunk() >= msg.state_chunk_count() || msg.state_chunk_count() > MAX_STATE_CHUNK_COUNT
+        || msg.state_data().size() > MAX_STATE_CHUNK_SIZE)
+    {
+        LOG(error) << boost::format("Invalid state chunk %1% of %2% from %3% for checkpoint: seq: %4%")
+            % msg.state_chunk() % msg.state_chunk_count() % sender % cp.first;
+        return nullptr;
+    }
+
+    auto& pending = this->pending_state_chunks[cp][sender];
+
+    // ...and a send can't change shape part way through
+    if (pending.chunks.empty())
+    {
+        pending.chunk_count = msg.state_chunk_count();
+    }
+    else if (pending.chunk_count != msg.state_chunk_count())
+    {
+        LOG(error) << boost::format("State chunk count from %1% for checkpoint: seq: %2% changed from %3% to %4%; discarding its chunks")
+            % sender % cp.first % pending.chunk_count % msg.state_chunk_count();
+        this->pending_state_chunks[cp].erase(sender);
+        return nullptr;
+    }
+
+    pending.chunks[msg.state_chunk()] = msg.state_data();
+
+    if (pending.chunks.size() < pending.chunk_count)
+    {
+        return nullptr;
+    }
+
+    auto state = std::make_shared<std::string>();
+    for (const auto& chunk : pending.chunks)
+    {
+        state->append(chunk.second);
+    }
+
+    this->pending_state_chunks.erase(cp);
+
+    return state;
 }
 
 void
@@ -1046,6 +1267,8 @@ pbft::handle_database_message(const bzn_envelope& msg, std::shared_ptr<bzn::sess
 
     if (!this->service->apply_operation_now(msg, session))
     {
+        std::lock_guard<std::mutex> lock(this->pbft_lock);
+
         this->handle_request(mutable_msg, session);
     }
 }
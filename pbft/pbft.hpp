@@ -36,10 +36,11 @@ namespace
     const std::chrono::milliseconds HEARTBEAT_INTERVAL{std::chrono::milliseconds(5000)};
     const std::chrono::seconds NEW_CONFIG_INTERVAL{std::chrono::seconds(30)};
     const std::string INITIAL_CHECKPOINT_HASH = "<null db state>";
-    const uint64_t CHECKPOINT_INTERVAL = 100; //TODO: KEP-574
     const double HIGH_WATER_INTERVAL_IN_CHECKPOINTS = 2.0; //TODO: KEP-574
     const uint64_t MAX_REQUEST_AGE_MS = 300000; // 5 minutes
     const std::string NOOP_REQUEST_HASH = "<no op request hash>";
+    const size_t MAX_STATE_CHUNK_SIZE = 1024 * 1024;
+    const uint32_t MAX_STATE_CHUNK_COUNT = 8192; // 8G of state, well past the default maximum storage
 }
 
 namespace bzn
@@ -128,7 +129,7 @@ namespace bzn
         void handle_join_or_leave(const pbft_membership_msg& msg, std::shared_ptr<bzn::session_base> session, const std::string& msg_hash);
         void handle_join_response(const pbft_membership_msg& msg);
         void handle_get_state(const pbft_membership_msg& msg, std::shared_ptr<bzn::session_base> session) const;
-        void handle_set_state(const pbft_membership_msg& msg);
+        void handle_set_state(const pbft_membership_msg& msg, const bzn::uuid_t& sender);
         void handle_config_message(const pbft_msg& msg, const std::shared_ptr<pbft_operation>& op);
         void handle_viewchange(const pbft_msg& msg, const bzn_envelope& original_msg);
         void handle_newview(const pbft_msg& msg, const bzn_envelope& original_msg);
@@ -156,14 +157,17 @@ namespace bzn
         void handle_new_config_timeout(const boost::system::error_code& ec);
 
         void notify_audit_failure_detected();
+        void send_audit_commit_digest(uint64_t sequence);
 
         void checkpoint_reached_locally(uint64_t sequence);
         void maybe_stabilize_checkpoint(const checkpoint_t& cp);
         void stabilize_checkpoint(const checkpoint_t& cp);
         const peer_address_t& select_peer_for_checkpoint(const checkpoint_t& cp);
-        void request_checkpoint_state(const checkpoint_t& cp);
+        void request_checkpoint_state(const checkpoint_t& cp, uint64_t since_sequence);
         std::shared_ptr<std::string> get_checkpoint_state(const checkpoint_t& cp) const;
-        void set_checkpoint_state(const checkpoint_t& cp, const std::string& data);
+        bool set_checkpoint_state(const checkpoint_t& cp, const std::string& data);
+        bool apply_checkpoint_delta(const checkpoint_t& cp, const pbft_membership_msg& msg);
+        std::shared_ptr<std::string> assemble_checkpoint_state(const checkpoint_t& cp, const bzn::uuid_t& sender, const pbft_membership_msg& msg);
 
         inline size_t quorum_size() const;
         size_t max_faulty_nodes() const;
@@ -228,6 +232,10 @@ namespace bzn
 
         bool audit_enabled = true;
 
+        // operations committed since the last audit digest, by sequence; summarized once per checkpoint
+        std::map<uint64_t, bzn::hash_t> audit_commits;
+        uint64_t last_audit_digest_sequence = 0;
+
         enum class swarm_status {not_joined, joining, waiting, joined};
         swarm_status in_swarm = swarm_status::not_joined;
 
@@ -239,6 +247,15 @@ namespace bzn
 
         std::map<checkpoint_t, std::unordered_map<uuid_t, std::string>> unstable_checkpoint_proofs;
 
+        struct pending_state_t
+        {
+            uint32_t chunk_count = 0;
+            std::map<uint32_t, std::string> chunks; // by chunk index
+        };
+
+        // chunks of full checkpoint state received so far, kept apart per sender so no two sends are mixed
+        std::map<checkpoint_t, std::map<bzn::uuid_t, pending_state_t>> pending_state_chunks;
+
         pbft_config_store configurations;
 
         std::multimap<timestamp_t, std::pair<bzn::uuid_t, request_hash_t>> recent_requests;
@@ -18,9 +18,12 @@
 #include <include/bluzelle.hpp>
 #include <proto/bluzelle.pb.h>
 #include <pbft/operations/pbft_operation.hpp>
+#include <vector>
 
 namespace bzn
 {
+    inline constexpr uint64_t CHECKPOINT_INTERVAL = 100; //TODO: KEP-574
+
     using execute_handler_t = std::function<void(std::shared_ptr<bzn::pbft_operation>)>;
 
     class pbft_service_base
@@ -73,8 +76,8 @@ namespace bzn
         virtual bool apply_operation_now(const bzn_envelope& msg, std::shared_ptr<bzn::session_base> session) = 0;
 
         /*
-         * Get the hash of the database state (presumably this will be a merkle tree root, but the details don't matter
-         * for now)- same semantics as query
+         * Get the hash of the database state recorded when the given checkpoint was reached (the root of the
+         * storage merkle tree)- same semantics as query
          */
         virtual bzn::hash_t service_state_hash(uint64_t sequence_number) const = 0;
 
@@ -84,12 +87,28 @@ namespace bzn
         virtual std::shared_ptr<bzn::service_state_t> get_service_state(uint64_t sequence_number) const = 0;
 
         /*
-         * Set the full database state at the given sequence number
+         * Set the full database state at the given sequence number. If the data doesn't have the given state hash,
+         * the service keeps the state it had before and returns false
+         */
+        virtual bool set_service_state(uint64_t sequence_number, const bzn::service_state_t& data, const bzn::hash_t& state_hash) = 0;
+
+        /*
+         * Get the requests executed after from_sequence, up to and including to_sequence, in order. Returns
+         * nullptr if the service no longer has all of them, in which case the full state has to be sent instead
+         */
+        virtual std::shared_ptr<std::vector<bzn_envelope>> get_service_state_delta(uint64_t from_sequence, uint64_t to_sequence) const = 0;
+
+        /*
+         * Bring the database state up to to_sequence by executing the requests from get_service_state_delta that
+         * have not been executed yet. If the result doesn't have the given state hash, the service returns to the
+         * state it had before and returns false
          */
-        virtual bool set_service_state(uint64_t sequence_number, const bzn::service_state_t& data) = 0;
+        virtual bool apply_service_state_delta(uint64_t from_sequence, uint64_t to_sequence, const bzn::hash_t& state_hash
+            , const std::vector<bzn_envelope>& requests) = 0;
 
         /*
-         * Tell the service to checkpoint its state when it reaches this sequence number
+         * Tell the service to also checkpoint its state when it reaches this sequence number. The service saves
+         * its state at every multiple of CHECKPOINT_INTERVAL on its own, since it may be executing ahead of pbft
          */
         virtual void save_service_state_at(uint64_t sequence_number) = 0;
 
@@ -104,6 +123,12 @@ namespace bzn
          */
         virtual void register_execute_handler(bzn::execute_handler_t handler) = 0;
 
+        /*
+         * True while execution is far enough behind consensus that no new requests should be accepted; operations
+         * already committed are still applied.
+         */
+        virtual bool is_saturated() const = 0;
+
     };
 
 }
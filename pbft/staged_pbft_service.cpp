@@ -0,0 +1,158 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <pbft/staged_pbft_service.hpp>
+#include <metrics/metrics.hpp>
+
+using namespace bzn;
+
+namespace
+{
+    auto& queued_operations = bzn::metrics::registry::instance().get_gauge("execution_stage_queued_operations");
+}
+
+
+staged_pbft_service::staged_pbft_service(std::shared_ptr<bzn::pbft_service_base> service, std::shared_ptr<bzn::asio::io_context_base> execution_context,
+    size_t max_queued_operations)
+    : service(std::move(service))
+    , execution_context(std::move(execution_context))
+    , max_queued_operations(max_queued_operations)
+{
+}
+
+
+void
+staged_pbft_service::apply_operation(const std::shared_ptr<bzn::pbft_operation>& op)
+{
+    bool start_draining;
+    {
+        std::lock_guard<std::mutex> lock(this->queue->lock);
+
+        this->queue->operations.push_back(op);
+
+        // new requests have been turned away since the queue filled, so this was already in consensus
+        if (++this->queue->depth > this->max_queued_operations)
+        {
+            LOG(debug) << "execution stage is " << this->queue->depth << " operations behind at sequence " << op->get_sequence();
+        }
+
+        start_draining = !this->queue->draining;
+        this->queue->draining = true;
+    }
+
+    queued_operations.add(1);
+
+    if (start_draining)
+    {
+        this->execution_context->post(std::bind(&staged_pbft_service::drain, this->service, this->queue));
+    }
+}
+
+
+void
+staged_pbft_service::drain(const std::shared_ptr<bzn::pbft_service_base>& service, const std::shared_ptr<queue_t>& queue)
+{
+    while (true)
+    {
+        std::shared_ptr<bzn::pbft_operation> op;
+        {
+            std::lock_guard<std::mutex> lock(queue->lock);
+
+            if (queue->operations.empty())
+            {
+                queue->draining = false;
+                return;
+            }
+
+            op = std::move(queue->operations.front());
+            queue->operations.pop_front();
+        }
+
+        service->apply_operation(op);
+
+        --queue->depth;
+        queued_operations.add(-1);
+    }
+}
+
+
+bool
+staged_pbft_service::is_saturated() const
+{
+    return this->queue->depth >= this->max_queued_operations || this->service->is_saturated();
+}
+
+
+bool
+staged_pbft_service::apply_operation_now(const bzn_envelope& msg, std::shared_ptr<bzn::session_base> session)
+{
+    return this->service->apply_operation_now(msg, std::move(session));
+}
+
+
+bzn::hash_t
+staged_pbft_service::service_state_hash(uint64_t sequence_number) const
+{
+    return this->service->service_state_hash(sequence_number);
+}
+
+
+std::shared_ptr<bzn::service_state_t>
+staged_pbft_service::get_service_state(uint64_t sequence_number) const
+{
+    return this->service->get_service_state(sequence_number);
+}
+
+
+bool
+staged_pbft_service::set_service_state(uint64_t sequence_number, const bzn::service_state_t& data, const bzn::hash_t& state_hash)
+{
+    return this->service->set_service_state(sequence_number, data, state_hash);
+}
+
+
+std::shared_ptr<std::vector<bzn_envelope>>
+staged_pbft_service::get_service_state_delta(uint64_t from_sequence, uint64_t to_sequence) const
+{
+    return this->service->get_service_state_delta(from_sequence, to_sequence);
+}
+
+
+bool
+staged_pbft_service::apply_service_state_delta(uint64_t from_sequence, uint64_t to_sequence, const bzn::hash_t& state_hash, const std::vector<bzn_envelope>& requests)
+{
+    return this->service->apply_service_state_delta(from_sequence, to_sequence, state_hash, requests);
+}
+
+
+void
+staged_pbft_service::save_service_state_at(uint64_t sequence_number)
+{
+    this->service->save_service_state_at(sequence_number);
+}
+
+
+void
+staged_pbft_service::consolidate_log(uint64_t sequence_number)
+{
+    this->service->consolidate_log(sequence_number);
+}
+
+
+void
+staged_pbft_service::register_execute_handler(bzn::execute_handler_t handler)
+{
+    this->service->register_execute_handler(std::move(handler));
+}
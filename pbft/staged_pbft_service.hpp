@@ -0,0 +1,86 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <include/boost_asio_beast.hpp>
+#include <pbft/pbft_service_base.hpp>
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+
+namespace bzn
+{
+    const size_t DEFAULT_MAX_QUEUED_OPERATIONS = 1000;
+
+    /*
+     * Moves execution of committed requests off the consensus thread: apply_operation queues the operation for
+     * the execution io_context and returns immediately, everything else is forwarded to the wrapped service as is.
+     * Queued operations are applied one at a time, in order, by a single task on the execution context. The wrapped
+     * service still orders execution by sequence and posts its execute handler back to its own io_context.
+     *
+     * Once max_queued_operations are waiting to execute the service reports itself saturated, and pbft stops
+     * accepting new requests until execution catches up. Operations that were already in consensus are still
+     * queued (there are at most a high water mark's worth of them), so committed operations are never dropped and
+     * the consensus thread never waits on execution.
+     */
+    class staged_pbft_service final : public bzn::pbft_service_base
+    {
+    public:
+        staged_pbft_service(std::shared_ptr<bzn::pbft_service_base> service, std::shared_ptr<bzn::asio::io_context_base> execution_context,
+            size_t max_queued_operations = DEFAULT_MAX_QUEUED_OPERATIONS);
+
+        void apply_operation(const std::shared_ptr<bzn::pbft_operation>& op) override;
+
+        bool apply_operation_now(const bzn_envelope& msg, std::shared_ptr<bzn::session_base> session) override;
+
+        bzn::hash_t service_state_hash(uint64_t sequence_number) const override;
+
+        std::shared_ptr<bzn::service_state_t> get_service_state(uint64_t sequence_number) const override;
+
+        bool set_service_state(uint64_t sequence_number, const bzn::service_state_t& data, const bzn::hash_t& state_hash) override;
+
+        std::shared_ptr<std::vector<bzn_envelope>> get_service_state_delta(uint64_t from_sequence, uint64_t to_sequence) const override;
+
+        bool apply_service_state_delta(uint64_t from_sequence, uint64_t to_sequence, const bzn::hash_t& state_hash, const std::vector<bzn_envelope>& requests) override;
+
+        void save_service_state_at(uint64_t sequence_number) override;
+
+        void consolidate_log(uint64_t sequence_number) override;
+
+        void register_execute_handler(bzn::execute_handler_t handler) override;
+
+        bool is_saturated() const override;
+
+    private:
+        // shared with the posted drain task, which may outlive this object
+        struct queue_t
+        {
+            std::mutex lock;
+            std::deque<std::shared_ptr<bzn::pbft_operation>> operations;
+            std::atomic<size_t> depth{0};
+            bool draining = false;
+        };
+
+        static void drain(const std::shared_ptr<bzn::pbft_service_base>& service, const std::shared_ptr<queue_t>& queue);
+
+        const std::shared_ptr<bzn::pbft_service_base> service;
+        const std::shared_ptr<bzn::asio::io_context_base> execution_context;
+        const size_t max_queued_operations;
+        const std::shared_ptr<queue_t> queue = std::make_shared<queue_t>();
+    };
+
+} // bzn
@@ -18,6 +18,7 @@
 #include <pbft/operations/pbft_memory_operation.hpp>
 #include <storage/mem_storage.hpp>
 #include <mocks/mock_crud_base.hpp>
+#include <thread>
 
 using namespace ::testing;
 
@@ -74,7 +75,8 @@ TEST(database_pbft_service, test_that_failed_storing_of_operation_does_not_throw
     EXPECT_CALL(*mock_storage, create(_, _, _)).WillOnce(Return(bzn::storage_result::exists));
     EXPECT_CALL(*mock_storage, update(_, _, _)).WillOnce(Return(bzn::storage_result::ok));
 
-    auto operation = std::make_shared<bzn::pbft_memory_operation>(0, 1, "somehash", nullptr);
+    // only out of order operations are stored...
+    auto operation = std::make_shared<bzn::pbft_memory_operation>(0, 2, "somehash", nullptr);
     database_msg dmsg;
     bzn_envelope request;
     request.set_database_msg(dmsg.SerializeAsString());
@@ -293,11 +295,306 @@ TEST(database_pbft_service, test_that_set_state_catches_up_backlogged_operations
         .Times(Exactly(2));
 
     // push state for checkpoint at sequence 100
-    EXPECT_CALL(*mock_crud, load_state(_))
+    EXPECT_CALL(*mock_crud, load_state(_, _))
         .Times(Exactly(1))
-        .WillOnce(Invoke([](auto &) {return true;}));
-    dps.set_service_state(100, "state_at_sequence_100");
+        .WillOnce(Invoke([](auto&, auto&) {return true;}));
+    dps.set_service_state(100, "state_at_sequence_100", "state_hash_at_100");
 
     // operations applied should be caught up now
     ASSERT_EQ(uint64_t(102), dps.applied_requests_count());
 }
+
+
+TEST(database_pbft_service, test_that_state_hash_is_recorded_at_checkpoint)
+{
+    auto mem_storage = std::make_shared<bzn::mem_storage>();
+    auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+    auto mock_crud = std::make_shared<NiceMock<bzn::Mockcrud_base>>();
+
+    bzn::database_pbft_service dps(mock_io_context, mem_storage, mock_crud, TEST_UUID);
+
+    dps.save_service_state_at(2);
+
+    EXPECT_CALL(*mock_crud, save_state()).WillOnce(Return(true));
+    EXPECT_CALL(*mock_crud, get_state_hash()).WillOnce(Return("state_hash_at_2"));
+
+    test::do_operation(1, dps);
+    test::do_operation(2, dps);
+    test::do_operation(3, dps);
+
+    EXPECT_EQ("state_hash_at_2", dps.service_state_hash(2));
+    EXPECT_EQ("", dps.service_state_hash(3));
+
+    // adopting a checkpoint records the hash of the loaded state...
+    EXPECT_CALL(*mock_crud, load_state(_, _)).WillOnce(Return(true));
+    EXPECT_CALL(*mock_crud, get_state_hash()).WillOnce(Return("state_hash_at_100"));
+
+    dps.set_service_state(100, "state_at_sequence_100", "state_hash_at_100");
+
+    EXPECT_EQ("state_hash_at_100", dps.service_state_hash(100));
+}
+
+
+TEST(database_pbft_service, test_that_state_is_saved_at_checkpoint_interval_without_being_told)
+{
+    auto mock_io_context = std::make_shared<NiceMock<bzn::asio::Mockio_context_base>>();
+    auto mock_crud = std::make_shared<NiceMock<bzn::Mockcrud_base>>();
+
+    bzn::database_pbft_service dps(mock_io_context, std::make_shared<bzn::mem_storage>(), mock_crud, TEST_UUID);
+
+    // pbft may only learn that we reached the checkpoint after we have executed past it...
+    EXPECT_CALL(*mock_crud, save_state()).WillOnce(Return(true));
+    EXPECT_CALL(*mock_crud, get_state_hash()).WillOnce(Return("state_hash_at_checkpoint"));
+
+    for (uint64_t seq = 1; seq <= bzn::CHECKPOINT_INTERVAL + 1; ++seq)
+    {
+        test::do_operation(seq, dps);
+    }
+
+    EXPECT_EQ("state_hash_at_checkpoint", dps.service_state_hash(bzn::CHECKPOINT_INTERVAL));
+
+    EXPECT_CALL(*mock_crud, get_saved_state()).WillOnce(Return(std::make_shared<bzn::service_state_t>("state")));
+    EXPECT_TRUE(dps.get_service_state(bzn::CHECKPOINT_INTERVAL));
+    EXPECT_FALSE(dps.get_service_state(bzn::CHECKPOINT_INTERVAL + 1));
+}
+
+
+TEST(database_pbft_service, test_that_lagging_service_catches_up_from_executed_requests)
+{
+    auto mock_io_context = std::make_shared<NiceMock<bzn::asio::Mockio_context_base>>();
+    auto mock_crud = std::make_shared<NiceMock<bzn::Mockcrud_base>>();
+
+    bzn::database_pbft_service dps(mock_io_context, std::make_shared<bzn::mem_storage>(), mock_crud, TEST_UUID);
+
+    EXPECT_CALL(*mock_crud, save_state()).WillRepeatedly(Return(true));
+
+    dps.save_service_state_at(2);
+    test::do_operation(1, dps);
+    test::do_operation(2, dps);
+    dps.save_service_state_at(4);
+    test::do_operation(3, dps);
+    test::do_operation(4, dps);
+
+    auto delta = dps.get_service_state_delta(2, 4);
+    ASSERT_TRUE(delta);
+    ASSERT_EQ(size_t(2), delta->size());
+
+    // requests from before the oldest recorded checkpoint are discarded...
+    EXPECT_FALSE(dps.get_service_state_delta(0, 4));
+
+    // a service that has executed up to the first checkpoint only needs the last two requests
+    auto lagging_crud = std::make_shared<NiceMock<bzn::Mockcrud_base>>();
+    bzn::database_pbft_service lagging_dps(mock_io_context, std::make_shared<bzn::mem_storage>(), lagging_crud, TEST_UUID);
+
+    test::do_operation(1, lagging_dps);
+    test::do_operation(2, lagging_dps);
+
+    {
+        InSequence s;
+
+        EXPECT_CALL(*lagging_crud, start_undo_log());
+        EXPECT_CALL(*lagging_crud, handle_request(_, ResultOf(test::database_msg_seq, 3), _));
+        EXPECT_CALL(*lagging_crud, handle_request(_, ResultOf(test::database_msg_seq, 4), _));
+        EXPECT_CALL(*lagging_crud, get_state_hash()).WillOnce(Return("state_hash_at_4"));
+        EXPECT_CALL(*lagging_crud, clear_undo_log());
+        EXPECT_CALL(*lagging_crud, save_state()).WillOnce(Return(true));
+        EXPECT_CALL(*lagging_crud, get_state_hash()).WillOnce(Return("state_hash_at_4"));
+    }
+
+    EXPECT_TRUE(lagging_dps.apply_service_state_delta(2, 4, "state_hash_at_4", *delta));
+    EXPECT_EQ(uint64_t(4), lagging_dps.applied_requests_count());
+    EXPECT_EQ("state_hash_at_4", lagging_dps.service_state_hash(4));
+
+    // a service that is further behind can't use these requests
+    bzn::database_pbft_service new_dps(mock_io_context, std::make_shared<bzn::mem_storage>(), std::make_shared<NiceMock<bzn::Mockcrud_base>>(), TEST_UUID);
+
+    EXPECT_FALSE(new_dps.apply_service_state_delta(2, 4, "state_hash_at_4", *delta));
+    EXPECT_EQ(uint64_t(0), new_dps.applied_requests_count());
+}
+
+
+TEST(database_pbft_service, test_that_requests_not_producing_the_checkpoint_are_undone)
+{
+    auto mock_io_context = std::make_shared<NiceMock<bzn::asio::Mockio_context_base>>();
+    auto mock_crud = std::make_shared<NiceMock<bzn::Mockcrud_base>>();
+
+    bzn::database_pbft_service dps(mock_io_context, std::make_shared<bzn::mem_storage>(), mock_crud, TEST_UUID);
+
+    test::do_operation(1, dps);
+    test::do_operation(2, dps);
+
+    std::vector<bzn_envelope> requests(2);
+    for (uint64_t seq = 3; seq <= 4; ++seq)
+    {
+        database_msg msg;
+        msg.mutable_header()->set_nonce(seq);
+        requests[seq - 3].set_database_msg(msg.SerializeAsString());
+    }
+
+    {
+        InSequence s;
+
+        EXPECT_CALL(*mock_crud, start_undo_log());
+        EXPECT_CALL(*mock_crud, handle_request(_, _, _)).Times(Exactly(2));
+        EXPECT_CALL(*mock_crud, get_state_hash()).WillOnce(Return("some_other_hash"));
+        EXPECT_CALL(*mock_crud, undo_writes()).WillOnce(Return(true));
+    }
+
+    // the whole database is not snapshotted to roll back a catch up
+    EXPECT_CALL(*mock_crud, save_state()).Times(0);
+    EXPECT_CALL(*mock_crud, load_state(_, _)).Times(0);
+
+    EXPECT_FALSE(dps.apply_service_state_delta(2, 4, "state_hash_at_4", requests));
+    EXPECT_EQ(uint64_t(2), dps.applied_requests_count());
+    EXPECT_FALSE(dps.get_service_state_delta(2, 4));
+
+    // the requests can still be executed normally afterwards
+    EXPECT_CALL(*mock_crud, handle_request(_, ResultOf(test::database_msg_seq, 3), _));
+    test::do_operation(3, dps);
+    EXPECT_EQ(uint64_t(3), dps.applied_requests_count());
+}
+
+
+TEST(database_pbft_service, test_that_stored_operations_are_executed_for_their_sender_after_restart)
+{
+    auto mem_storage = std::make_shared<bzn::mem_storage>();
+    auto mock_io_context = std::make_shared<NiceMock<bzn::asio::Mockio_context_base>>();
+    auto mock_crud = std::make_shared<NiceMock<bzn::Mockcrud_base>>();
+
+    {
+        bzn::database_pbft_service dps(mock_io_context, mem_storage, mock_crud, TEST_UUID);
+
+        auto operation = std::make_shared<bzn::pbft_memory_operation>(0, 2, "somehash2", nullptr);
+        bzn_envelope env;
+        env.set_sender("alice");
+        env.set_database_msg(database_msg().SerializeAsString());
+        operation->record_request(env);
+
+        dps.apply_operation(operation);
+        EXPECT_EQ(uint64_t(0), dps.applied_requests_count());
+    }
+
+    bzn::database_pbft_service restarted_dps(mock_io_context, mem_storage, mock_crud, TEST_UUID);
+
+    {
+        InSequence s;
+
+        EXPECT_CALL(*mock_crud, handle_request(_, ResultOf(test::database_msg_seq, 1), _));
+        EXPECT_CALL(*mock_crud, handle_request("alice", _, _));
+    }
+
+    test::do_operation(1, restarted_dps);
+
+    EXPECT_EQ(uint64_t(2), restarted_dps.applied_requests_count());
+    EXPECT_EQ("alice", restarted_dps.get_service_state_delta(1, 2)->front().sender());
+}
+
+
+TEST(database_pbft_service, test_that_only_out_of_order_operations_are_stored)
+{
+    auto mock_storage = std::make_shared<bzn::Mockstorage_base>();
+    auto mock_io_context = std::make_shared<NiceMock<bzn::asio::Mockio_context_base>>();
+    auto mock_crud = std::make_shared<NiceMock<bzn::Mockcrud_base>>();
+
+    EXPECT_CALL(*mock_storage, read(_, _)).WillOnce(Return(std::optional<bzn::value_t>()));
+    EXPECT_CALL(*mock_storage, create(_, _, DEFAULT_NEXT_REQUEST_SEQUENCE)).WillOnce(Return(bzn::storage_result::ok));
+    EXPECT_CALL(*mock_storage, get_keys(TEST_UUID)).WillOnce(Return(std::vector<bzn::key_t>()));
+
+    bzn::database_pbft_service dps(mock_io_context, mock_storage, mock_crud, TEST_UUID);
+
+    // every operation is executed once, duplicates are ignored
+    EXPECT_CALL(*mock_crud, handle_request(_, _, _)).Times(Exactly(4));
+
+    // operations 2 and 3 have to wait for operation 1...
+    EXPECT_CALL(*mock_storage, create(TEST_UUID, "2", _)).WillOnce(Return(bzn::storage_result::ok));
+    EXPECT_CALL(*mock_storage, create(TEST_UUID, "3", _)).WillOnce(Return(bzn::storage_result::ok));
+    test::do_operation(3, dps);
+    test::do_operation(2, dps);
+
+    // operation 1 is executed directly and the cursor is saved once for all three
+    EXPECT_CALL(*mock_storage, remove(TEST_UUID, "2")).WillOnce(Return(bzn::storage_result::ok));
+    EXPECT_CALL(*mock_storage, remove(TEST_UUID, "3")).WillOnce(Return(bzn::storage_result::ok));
+    EXPECT_CALL(*mock_storage, update(_, _, "4")).WillOnce(Return(bzn::storage_result::ok));
+    test::do_operation(1, dps);
+
+    EXPECT_EQ(uint64_t(3), dps.applied_requests_count());
+
+    // operation 4 is in order so never touches storage apart from the cursor (saved again on destruction)
+    EXPECT_CALL(*mock_storage, update(_, _, "5")).Times(Exactly(2)).WillRepeatedly(Return(bzn::storage_result::ok));
+    test::do_operation(4, dps);
+
+    test::do_operation(2, dps);
+
+    EXPECT_EQ(uint64_t(4), dps.applied_requests_count());
+}
+
+
+TEST(database_pbft_service, test_that_reads_are_handled_locally_only_when_fast_reads_are_enabled_and_state_is_fresh)
+{
+    auto mock_io_context = std::make_shared<NiceMock<bzn::asio::Mockio_context_base>>();
+    auto mock_crud = std::make_shared<NiceMock<bzn::Mockcrud_base>>();
+
+    bzn::database_pbft_service dps(mock_io_context, std::make_shared<bzn::mem_storage>(), mock_crud, TEST_UUID);
+
+    database_msg msg;
+    msg.mutable_header()->set_db_uuid(TEST_UUID);
+    msg.mutable_read()->set_key("key1");
+
+    bzn_envelope env;
+    env.set_database_msg(msg.SerializeAsString());
+
+    EXPECT_CALL(*mock_crud, handle_request(_, _, _)).Times(AnyNumber());
+    EXPECT_CALL(*mock_crud, handle_request(_, Property(&database_msg::msg_case, database_msg::kRead), _))
+        .Times(Exactly(2));
+
+    // disabled by default...
+    dps.consolidate_log(0);
+    EXPECT_FALSE(dps.apply_operation_now(env, nullptr));
+
+    dps.enable_fast_reads(std::chrono::minutes(1));
+    EXPECT_TRUE(dps.apply_operation_now(env, nullptr));
+
+    // writes still go through consensus
+    database_msg write_msg(msg);
+    write_msg.mutable_create()->set_key("key1");
+    env.set_database_msg(write_msg.SerializeAsString());
+    EXPECT_FALSE(dps.apply_operation_now(env, nullptr));
+    env.set_database_msg(msg.SerializeAsString());
+
+    // not while committed requests are waiting on earlier ones
+    test::do_operation(2, dps);
+    EXPECT_FALSE(dps.apply_operation_now(env, nullptr));
+
+    test::do_operation(1, dps);
+    EXPECT_TRUE(dps.apply_operation_now(env, nullptr));
+
+    // not while we are behind the last stable checkpoint
+    dps.consolidate_log(3);
+    EXPECT_FALSE(dps.apply_operation_now(env, nullptr));
+}
+
+
+TEST(database_pbft_service, test_that_fast_reads_expire_without_a_recent_stable_checkpoint)
+{
+    auto mock_io_context = std::make_shared<NiceMock<bzn::asio::Mockio_context_base>>();
+    auto mock_crud = std::make_shared<NiceMock<bzn::Mockcrud_base>>();
+
+    bzn::database_pbft_service dps(mock_io_context, std::make_shared<bzn::mem_storage>(), mock_crud, TEST_UUID);
+
+    database_msg msg;
+    msg.mutable_header()->set_db_uuid(TEST_UUID);
+    msg.mutable_read()->set_key("key1");
+
+    bzn_envelope env;
+    env.set_database_msg(msg.SerializeAsString());
+
+    dps.enable_fast_reads(std::chrono::milliseconds(10));
+
+    // no checkpoint has been seen yet...
+    EXPECT_FALSE(dps.apply_operation_now(env, nullptr));
+
+    dps.consolidate_log(0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    EXPECT_FALSE(dps.apply_operation_now(env, nullptr));
+}
@@ -12,15 +12,16 @@
 // You should have received a copy of the GNU Affero General Public License
 
 #include <pbft/test/pbft_test_common.hpp>
+#include <pbft/operations/pbft_memory_operation.hpp>
 
 namespace bzn::test
 {
-    TEST_F(pbft_test, test_local_commit_sends_audit_messages)
+    TEST_F(pbft_test, test_local_commit_does_not_send_audit_messages)
     {
         EXPECT_CALL(*mock_node, send_message(_, ResultOf(is_audit, Eq(false)), _))
                 .Times(AnyNumber());
         EXPECT_CALL(*mock_node, send_message(_, ResultOf(is_audit, Eq(true)), _))
-                .Times(Exactly(TEST_PEER_LIST.size()));
+                .Times(Exactly(0));
 
         this->build_pbft();
         this->pbft->set_audit_enabled(true);
@@ -45,6 +46,48 @@ namespace bzn::test
         }
     }
 
+    TEST_F(pbft_test, test_checkpoint_sends_audit_commit_digest)
+    {
+        std::vector<audit_message> sent;
+        EXPECT_CALL(*mock_node, send_message(_, ResultOf(is_audit, Eq(false)), _))
+                .Times(AnyNumber());
+        EXPECT_CALL(*mock_node, send_message(_, ResultOf(is_audit, Eq(true)), _))
+                .Times(Exactly(TEST_PEER_LIST.size()))
+                .WillRepeatedly(Invoke([&](auto, auto msg, auto)
+                {
+                    audit_message parsed;
+                    parsed.ParseFromString(msg->audit());
+                    sent.push_back(parsed);
+                }));
+
+        this->uuid = SECOND_NODE_UUID;
+        this->build_pbft();
+        this->pbft->set_audit_enabled(true);
+
+        for (uint64_t seq = 1; seq <= CHECKPOINT_INTERVAL; seq++)
+        {
+            bzn_envelope request(this->request_msg);
+            request.set_timestamp(now() + seq);
+            const auto hash = this->crypto->hash(request);
+
+            this->send_preprepare(1, seq, hash, request);
+            this->send_prepares(1, seq, hash);
+            this->send_commits(1, seq, hash);
+        }
+
+        // no audit traffic until the checkpoint is reached
+        EXPECT_TRUE(sent.empty());
+
+        this->service_execute_handler(std::make_shared<bzn::pbft_memory_operation>(1, CHECKPOINT_INTERVAL, "somehash", nullptr));
+
+        ASSERT_EQ(sent.size(), TEST_PEER_LIST.size());
+        ASSERT_TRUE(sent.front().has_pbft_commit_digest());
+        EXPECT_EQ(sent.front().pbft_commit_digest().sender_uuid(), SECOND_NODE_UUID);
+        EXPECT_EQ(sent.front().pbft_commit_digest().first_sequence(), 1u);
+        EXPECT_EQ(sent.front().pbft_commit_digest().last_sequence(), CHECKPOINT_INTERVAL);
+        EXPECT_FALSE(sent.front().pbft_commit_digest().digest().empty());
+    }
+
     TEST_F(pbft_test, primary_sends_primary_status)
     {
         EXPECT_CALL(*mock_node, send_message(_, ResultOf(is_audit, Eq(true)), _))
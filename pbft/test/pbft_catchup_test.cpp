@@ -49,6 +49,15 @@ namespace bzn
             return msg.type() == PBFT_MMSG_SET_STATE && msg.sequence() > 0 && !(extract_sender(*wrapped_msg).empty())
                    && msg.state_hash() != "";
         }
+
+        bool
+        is_full_get_state(std::shared_ptr<bzn_envelope> wrapped_msg)
+        {
+            pbft_membership_msg msg;
+            msg.ParseFromString(wrapped_msg->pbft_membership());
+
+            return is_get_state(wrapped_msg) && msg.since_sequence() == 0;
+        }
     }
 
     using namespace test;
@@ -57,12 +66,13 @@ namespace bzn
     {
     public:
 
-        void send_get_state_request(uint64_t sequence)
+        void send_get_state_request(uint64_t sequence, uint64_t since_sequence = 0)
         {
             pbft_membership_msg msg;
             msg.set_type(PBFT_MMSG_GET_STATE);
             msg.set_sequence(sequence);
             msg.set_state_hash(std::to_string(sequence));
+            msg.set_since_sequence(since_sequence);
             auto wmsg = wrap_pbft_membership_msg(msg, this->pbft->get_uuid());
 
             this->membership_handler(wmsg, this->mock_session);
@@ -190,6 +200,10 @@ namespace bzn
         reply.set_state_hash("100");
         reply.set_state_data("state_100");
         reply.set_allocated_newview_msg(new bzn_envelope(build_newview_msg(new_view, 100)));
+
+        EXPECT_CALL(*this->mock_service, set_service_state(100, "state_100", "100")).WillOnce(Return(true));
+        EXPECT_CALL(*this->mock_service, service_state_hash(100)).WillRepeatedly(Return("100"));
+
         auto wmsg = wrap_pbft_membership_msg(reply, "see_node_adopts_requested_checkpoint");
         this->membership_handler(wmsg, nullptr);
 
@@ -226,4 +240,272 @@ namespace bzn
 
         EXPECT_NE(this->pbft->latest_stable_checkpoint(), checkpoint_t(200, "200"));
     }
-}
\ No newline at end of file
+
+    TEST_F(pbft_catchup_test, primary_provides_requests_since_stable_checkpoint)
+    {
+        this->build_pbft();
+
+        for (size_t i = 0; i < 99; i++)
+        {
+            run_transaction_through_primary();
+        }
+        prepare_for_checkpoint(100);
+        run_transaction_through_primary();
+        stabilize_checkpoint(100);
+
+        EXPECT_CALL(*this->mock_service, get_service_state_delta(50, 100)).Times(Exactly(1))
+            .WillOnce(Invoke([](auto, auto) {return std::make_shared<std::vector<bzn_envelope>>(50);}));
+        EXPECT_CALL(*this->mock_service, get_service_state(_)).Times(Exactly(0));
+        EXPECT_CALL(*mock_session, send_datagram(ResultOf(is_set_state, Eq(true))))
+            .WillOnce(Invoke([](auto msg)
+            {
+                auto reply = extract_pbft_membership_msg(*msg);
+                EXPECT_EQ(reply.since_sequence(), uint64_t(50));
+                EXPECT_EQ(reply.requests_size(), 50);
+                EXPECT_TRUE(reply.state_data().empty());
+            }));
+        send_get_state_request(100, 50);
+    }
+
+    TEST_F(pbft_catchup_test, primary_provides_chunked_state_when_requests_are_unavailable)
+    {
+        this->build_pbft();
+
+        for (size_t i = 0; i < 99; i++)
+        {
+            run_transaction_through_primary();
+        }
+        prepare_for_checkpoint(100);
+        run_transaction_through_primary();
+        stabilize_checkpoint(100);
+
+        const std::string state(MAX_STATE_CHUNK_SIZE * 2 + 1, 's');
+        std::string received;
+
+        EXPECT_CALL(*this->mock_service, get_service_state_delta(50, 100)).WillOnce(Return(nullptr));
+        EXPECT_CALL(*this->mock_service, get_service_state(100)).Times(Exactly(1))
+            .WillOnce(Invoke([&](auto) {return std::make_shared<std::string>(state);}));
+        EXPECT_CALL(*mock_session, send_datagram(ResultOf(is_set_state, Eq(true))))
+            .Times(Exactly(3))
+            .WillRepeatedly(Invoke([&](auto msg)
+            {
+                auto reply = extract_pbft_membership_msg(*msg);
+                EXPECT_EQ(reply.state_chunk_count(), uint32_t(3));
+                EXPECT_EQ(reply.state_chunk(), uint32_t(received.size() / MAX_STATE_CHUNK_SIZE));
+                received.append(reply.state_data());
+            }));
+        send_get_state_request(100, 50);
+
+        EXPECT_EQ(received, state);
+    }
+
+    TEST_F(pbft_catchup_test, node_adopts_checkpoint_from_requests)
+    {
+        this->uuid = SECOND_NODE_UUID;
+        this->build_pbft();
+
+        auto nodes = TEST_PEER_LIST.begin();
+        size_t req_nodes = 2 * this->faulty_nodes_bound() + 1;
+        for (size_t i = 0; i < req_nodes; i++)
+        {
+            bzn::peer_address_t node(*nodes++);
+            send_checkpoint(node, 100);
+        }
+
+        pbft_membership_msg reply;
+        reply.set_type(PBFT_MMSG_SET_STATE);
+        reply.set_sequence(100);
+        reply.set_state_hash("100");
+        reply.set_since_sequence(50);
+        for (size_t i = 0; i < 50; i++)
+        {
+            reply.add_requests()->set_sender("client");
+        }
+
+        EXPECT_CALL(*this->mock_service, apply_service_state_delta(50, 100, "100", SizeIs(50))).WillOnce(Return(true));
+        EXPECT_CALL(*this->mock_service, set_service_state(_, _, _)).Times(Exactly(0));
+
+        this->membership_handler(wrap_pbft_membership_msg(reply, "node_adopts_checkpoint_from_requests"), nullptr);
+
+        EXPECT_EQ(this->pbft->latest_stable_checkpoint(), checkpoint_t(100, "100"));
+    }
+
+    TEST_F(pbft_catchup_test, node_requests_full_state_if_a_request_is_unsigned)
+    {
+        this->uuid = SECOND_NODE_UUID;
+        this->build_pbft();
+
+        // without a stable checkpoint the first request is for the full state too
+        EXPECT_CALL(*mock_node, send_message(_, ResultOf(is_full_get_state, Eq(true)), _))
+            .Times((Exactly(2)));
+
+        auto nodes = TEST_PEER_LIST.begin();
+        size_t req_nodes = 2 * this->faulty_nodes_bound() + 1;
+        for (size_t i = 0; i < req_nodes; i++)
+        {
+            bzn::peer_address_t node(*nodes++);
+            send_checkpoint(node, 100);
+        }
+
+        pbft_membership_msg reply;
+        reply.set_type(PBFT_MMSG_SET_STATE);
+        reply.set_sequence(100);
+        reply.set_state_hash("100");
+        reply.set_since_sequence(50);
+        for (size_t i = 0; i < 50; i++)
+        {
+            reply.add_requests()->set_sender(i == 25 ? "" : "client");
+        }
+
+        // nothing is executed against the service
+        EXPECT_CALL(*this->mock_service, apply_service_state_delta(_, _, _, _)).Times(Exactly(0));
+
+        this->membership_handler(wrap_pbft_membership_msg(reply, "node_requests_full_state_if_a_request_is_unsigned"), nullptr);
+
+        EXPECT_NE(this->pbft->latest_stable_checkpoint(), checkpoint_t(100, "100"));
+    }
+
+    TEST_F(pbft_catchup_test, node_requests_full_state_if_requests_dont_produce_checkpoint)
+    {
+        this->uuid = SECOND_NODE_UUID;
+        this->build_pbft();
+
+        // without a stable checkpoint the first request is for the full state too
+        EXPECT_CALL(*mock_node, send_message(_, ResultOf(is_full_get_state, Eq(true)), _))
+            .Times((Exactly(2)));
+
+        auto nodes = TEST_PEER_LIST.begin();
+        size_t req_nodes = 2 * this->faulty_nodes_bound() + 1;
+        for (size_t i = 0; i < req_nodes; i++)
+        {
+            bzn::peer_address_t node(*nodes++);
+            send_checkpoint(node, 100);
+        }
+
+        pbft_membership_msg reply;
+        reply.set_type(PBFT_MMSG_SET_STATE);
+        reply.set_sequence(100);
+        reply.set_state_hash("100");
+        reply.set_since_sequence(50);
+
+        // the service undoes the requests when they don't produce the checkpoint
+        EXPECT_CALL(*this->mock_service, apply_service_state_delta(50, 100, "100", _)).WillOnce(Return(false));
+
+        this->membership_handler(wrap_pbft_membership_msg(reply, "node_requests_full_state"), nullptr);
+
+        EXPECT_NE(this->pbft->latest_stable_checkpoint(), checkpoint_t(100, "100"));
+    }
+
+    TEST_F(pbft_catchup_test, node_adopts_checkpoint_once_all_state_chunks_arrive)
+    {
+        this->uuid = SECOND_NODE_UUID;
+        this->build_pbft();
+
+        auto nodes = TEST_PEER_LIST.begin();
+        size_t req_nodes = 2 * this->faulty_nodes_bound() + 1;
+        for (size_t i = 0; i < req_nodes; i++)
+        {
+            bzn::peer_address_t node(*nodes++);
+            send_checkpoint(node, 100);
+        }
+
+        pbft_membership_msg reply;
+        reply.set_type(PBFT_MMSG_SET_STATE);
+        reply.set_sequence(100);
+        reply.set_state_hash("100");
+        reply.set_state_chunk_count(2);
+
+        EXPECT_CALL(*this->mock_service, set_service_state(100, "state_100", "100")).WillOnce(Return(true));
+        EXPECT_CALL(*this->mock_service, service_state_hash(100)).WillRepeatedly(Return("100"));
+
+        // chunks may be delivered in any order
+        reply.set_state_chunk(1);
+        reply.set_state_data("_100");
+        this->membership_handler(wrap_pbft_membership_msg(reply, TEST_PEER_LIST.begin()->uuid), nullptr);
+
+        EXPECT_NE(this->pbft->latest_stable_checkpoint(), checkpoint_t(100, "100"));
+
+        reply.set_state_chunk(0);
+        reply.set_state_data("state");
+        this->membership_handler(wrap_pbft_membership_msg(reply, TEST_PEER_LIST.begin()->uuid), nullptr);
+
+        EXPECT_EQ(this->pbft->latest_stable_checkpoint(), checkpoint_t(100, "100"));
+    }
+
+    TEST_F(pbft_catchup_test, node_doesnt_mix_state_chunks_from_different_sends)
+    {
+        this->uuid = SECOND_NODE_UUID;
+        this->build_pbft();
+
+        auto nodes = TEST_PEER_LIST.begin();
+        size_t req_nodes = 2 * this->faulty_nodes_bound() + 1;
+        for (size_t i = 0; i < req_nodes; i++)
+        {
+            bzn::peer_address_t node(*nodes++);
+            send_checkpoint(node, 100);
+        }
+
+        const auto first_sender = TEST_PEER_LIST.begin()->uuid;
+        const auto second_sender = std::next(TEST_PEER_LIST.begin())->uuid;
+
+        EXPECT_CALL(*this->mock_service, set_service_state(_, _, _)).Times(Exactly(0));
+
+        pbft_membership_msg reply;
+        reply.set_type(PBFT_MMSG_SET_STATE);
+        reply.set_sequence(100);
+        reply.set_state_hash("100");
+
+        // one chunk each from two senders doesn't make a whole state...
+        reply.set_state_chunk_count(2);
+        reply.set_state_chunk(0);
+        reply.set_state_data("state");
+        this->membership_handler(wrap_pbft_membership_msg(reply, first_sender), nullptr);
+
+        reply.set_state_chunk(1);
+        reply.set_state_data("_100");
+        this->membership_handler(wrap_pbft_membership_msg(reply, second_sender), nullptr);
+
+        // ...nor do chunks of a send whose count changes part way through...
+        reply.set_state_chunk_count(3);
+        reply.set_state_chunk(1);
+        this->membership_handler(wrap_pbft_membership_msg(reply, first_sender), nullptr);
+
+        // ...or chunks of more state than any node could hold
+        reply.set_state_chunk_count(MAX_STATE_CHUNK_COUNT + 1);
+        reply.set_state_chunk(0);
+        this->membership_handler(wrap_pbft_membership_msg(reply, second_sender), nullptr);
+
+        EXPECT_NE(this->pbft->latest_stable_checkpoint(), checkpoint_t(100, "100"));
+    }
+
+    TEST_F(pbft_catchup_test, node_requests_state_again_if_it_isnt_the_checkpoint)
+    {
+        this->uuid = SECOND_NODE_UUID;
+        this->build_pbft();
+
+        // once to catch up, and again when the state turns out to be wrong
+        EXPECT_CALL(*mock_node, send_message(_, ResultOf(is_full_get_state, Eq(true)), _))
+            .Times((Exactly(2)));
+
+        auto nodes = TEST_PEER_LIST.begin();
+        size_t req_nodes = 2 * this->faulty_nodes_bound() + 1;
+        for (size_t i = 0; i < req_nodes; i++)
+        {
+            bzn::peer_address_t node(*nodes++);
+            send_checkpoint(node, 100);
+        }
+
+        pbft_membership_msg reply;
+        reply.set_type(PBFT_MMSG_SET_STATE);
+        reply.set_sequence(100);
+        reply.set_state_hash("100");
+        reply.set_state_data("state_99");
+
+        // the service keeps its old state when the data doesn't have the checkpoint's hash
+        EXPECT_CALL(*this->mock_service, set_service_state(100, "state_99", "100")).WillOnce(Return(false));
+
+        this->membership_handler(wrap_pbft_membership_msg(reply, "node_requests_state_again"), nullptr);
+
+        EXPECT_NE(this->pbft->latest_stable_checkpoint(), checkpoint_t(100, "100"));
+    }
+}
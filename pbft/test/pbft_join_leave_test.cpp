@@ -535,6 +535,9 @@ namespace bzn
     {
         this->build_pbft();
 
+        // the node sends asynchronously, so replies are only delivered once the join has been handled
+        std::vector<std::function<void()>> pending_deliveries;
+
         // each peer should be sent a pre-prepare for new_config when the join is received
         for (auto const &p : TEST_PEER_LIST)
         {
@@ -549,25 +552,28 @@ namespace bzn
                     pbft_config_msg cfg_msg;
                     EXPECT_TRUE(cfg_msg.ParseFromString(msg.request().pbft_internal_request()));
 
-                    if (p.uuid == TEST_NODE_UUID)
+                    pending_deliveries.emplace_back([&, msg, preprepare_env = *envelope]()
                     {
-                        EXPECT_CALL(*(mock_node),
-                            send_message(_, ResultOf(test::is_prepare, Eq(true)), _))
-                            .Times(Exactly(TEST_PEER_LIST.size()));
-
-                        // reflect the pre-prepare back
-                        pbft->handle_message(msg, *envelope);
-                    }
-
-                    pbft_msg prepare;
-                    prepare.set_view(msg.view());
-                    prepare.set_sequence(msg.sequence());
-                    prepare.set_type(PBFT_MSG_PREPARE);
-                    prepare.set_request_hash(this->crypto->hash(msg.request()));
-
-                    auto wmsg2 = wrap_pbft_msg(prepare);
-                    wmsg2.set_sender(p.uuid);
-                    pbft->handle_message(prepare, wmsg2);
+                        if (p.uuid == TEST_NODE_UUID)
+                        {
+                            EXPECT_CALL(*(mock_node),
+                                send_message(_, ResultOf(test::is_prepare, Eq(true)), _))
+                                .Times(Exactly(TEST_PEER_LIST.size()));
+
+                            // reflect the pre-prepare back
+                            pbft->handle_message(msg, preprepare_env);
+                        }
+
+                        pbft_msg prepare;
+                        prepare.set_view(msg.view());
+                        prepare.set_sequence(msg.sequence());
+                        prepare.set_type(PBFT_MSG_PREPARE);
+                        prepare.set_request_hash(this->crypto->hash(msg.request()));
+
+                        auto wmsg2 = wrap_pbft_msg(prepare);
+                        wmsg2.set_sender(p.uuid);
+                        pbft->handle_message(prepare, wmsg2);
+                    });
                 }));
         }
 
@@ -613,6 +619,11 @@ namespace bzn
 
         // here we go...
         this->handle_membership_message(test::wrap_pbft_membership_msg(join_msg, this->pbft->get_uuid()), this->mock_session);
+
+        for (const auto& deliver : pending_deliveries)
+        {
+            deliver();
+        }
     }
 
     TEST_F(pbft_join_leave_test, existing_node_cant_join_swarm)
@@ -40,6 +40,22 @@ namespace bzn::test
         pbft->handle_database_message(this->request_msg, this->mock_session);
     }
 
+    TEST_F(pbft_test, test_requests_rejected_while_service_is_saturated)
+    {
+        this->build_pbft();
+        EXPECT_CALL(*mock_service, is_saturated()).WillOnce(Return(true)).WillRepeatedly(Return(false));
+        EXPECT_CALL(*mock_node, send_message(_, ResultOf(is_preprepare, Eq(true)), _))
+                .Times(Exactly(TEST_PEER_LIST.size()));
+
+        // no preprepare while execution is behind...
+        pbft->handle_database_message(this->request_msg, this->mock_session);
+        ASSERT_EQ(0u, this->operation_manager->held_operations_count());
+
+        // ...and the request is taken once it has caught up
+        pbft->handle_database_message(this->request_msg, this->mock_session);
+        ASSERT_EQ(1u, this->operation_manager->held_operations_count());
+    }
+
     TEST_F(pbft_test, test_forwarded_to_primary_when_not_primary)
     {
         EXPECT_CALL(*mock_node, send_message(_, A<std::shared_ptr<bzn_envelope>>(), _)).Times(1).WillRepeatedly(Invoke(
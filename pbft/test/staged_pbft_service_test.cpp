@@ -0,0 +1,120 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <pbft/staged_pbft_service.hpp>
+#include <pbft/operations/pbft_memory_operation.hpp>
+#include <mocks/mock_boost_asio_beast.hpp>
+#include <mocks/mock_pbft_service_base.hpp>
+#include <gmock/gmock.h>
+
+using namespace ::testing;
+
+
+TEST(staged_pbft_service, test_that_operations_are_applied_on_the_execution_context)
+{
+    auto mock_service = std::make_shared<bzn::mock_pbft_service_base>();
+    auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+
+    bzn::asio::task posted_task;
+    EXPECT_CALL(*mock_io_context, post(_)).WillOnce(SaveArg<0>(&posted_task));
+
+    bzn::staged_pbft_service service(mock_service, mock_io_context);
+
+    auto op = std::make_shared<bzn::pbft_memory_operation>(1, 1, "somehash", nullptr);
+
+    EXPECT_CALL(*mock_service, apply_operation(_)).Times(0);
+    service.apply_operation(op);
+    Mock::VerifyAndClearExpectations(mock_service.get());
+
+    EXPECT_CALL(*mock_service, apply_operation(std::shared_ptr<bzn::pbft_operation>(op)));
+    posted_task();
+}
+
+
+TEST(staged_pbft_service, test_that_state_queries_are_forwarded_directly)
+{
+    auto mock_service = std::make_shared<bzn::mock_pbft_service_base>();
+    auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+
+    EXPECT_CALL(*mock_io_context, post(_)).Times(0);
+    EXPECT_CALL(*mock_service, service_state_hash(100)).WillOnce(Return("hash"));
+    EXPECT_CALL(*mock_service, save_service_state_at(200));
+    EXPECT_CALL(*mock_service, register_execute_handler(_));
+
+    bzn::staged_pbft_service service(mock_service, mock_io_context);
+
+    EXPECT_EQ(service.service_state_hash(100), "hash");
+    service.save_service_state_at(200);
+    service.register_execute_handler([](auto){});
+}
+
+
+TEST(staged_pbft_service, test_that_queued_operations_are_applied_in_order_by_one_task)
+{
+    auto mock_service = std::make_shared<NiceMock<bzn::mock_pbft_service_base>>();
+    auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+
+    bzn::asio::task posted_task;
+    EXPECT_CALL(*mock_io_context, post(_)).WillOnce(SaveArg<0>(&posted_task));
+
+    bzn::staged_pbft_service service(mock_service, mock_io_context);
+
+    std::vector<uint64_t> applied;
+    EXPECT_CALL(*mock_service, apply_operation(_)).WillRepeatedly(Invoke(
+        [&](const auto& op)
+        {
+            applied.push_back(op->get_sequence());
+        }));
+
+    for (uint64_t seq = 1; seq <= 3; ++seq)
+    {
+        service.apply_operation(std::make_shared<bzn::pbft_memory_operation>(1, seq, "somehash", nullptr));
+    }
+
+    posted_task();
+    EXPECT_EQ(std::vector<uint64_t>({1, 2, 3}), applied);
+
+    // the queue emptied, so the next operation needs a task of its own
+    EXPECT_CALL(*mock_io_context, post(_)).WillOnce(SaveArg<0>(&posted_task));
+    service.apply_operation(std::make_shared<bzn::pbft_memory_operation>(1, 4, "somehash", nullptr));
+    posted_task();
+    EXPECT_EQ(std::vector<uint64_t>({1, 2, 3, 4}), applied);
+}
+
+
+TEST(staged_pbft_service, test_that_a_full_execution_queue_saturates_without_holding_back_the_caller)
+{
+    auto mock_service = std::make_shared<NiceMock<bzn::mock_pbft_service_base>>();
+    auto mock_io_context = std::make_shared<bzn::asio::Mockio_context_base>();
+
+    bzn::asio::task posted_task;
+    EXPECT_CALL(*mock_io_context, post(_)).WillOnce(SaveArg<0>(&posted_task));
+
+    bzn::staged_pbft_service service(mock_service, mock_io_context, 2);
+
+    service.apply_operation(std::make_shared<bzn::pbft_memory_operation>(1, 1, "somehash", nullptr));
+    EXPECT_FALSE(service.is_saturated());
+
+    service.apply_operation(std::make_shared<bzn::pbft_memory_operation>(1, 2, "somehash", nullptr));
+    EXPECT_TRUE(service.is_saturated());
+
+    // nothing is executing, but operations already in consensus are still taken and kept
+    EXPECT_CALL(*mock_service, apply_operation(_)).Times(Exactly(3));
+    service.apply_operation(std::make_shared<bzn::pbft_memory_operation>(1, 3, "somehash", nullptr));
+    EXPECT_TRUE(service.is_saturated());
+
+    posted_task();
+    EXPECT_FALSE(service.is_saturated());
+}
@@ -16,6 +16,7 @@
 
 #include <ostream>
 #include <boost/beast/core/detail/base64.hpp>
+#include <optional>
 #include <string>
 
 
@@ -43,11 +44,26 @@ namespace bzn
     }
 
 
+    // true for {"bzn-api": api, "msg": base64} messages whose msg decodes and encodes back to exactly the same
+    // string, so they can be stored or sent as the raw bytes and restored later
+    inline bool
+    is_database_message(const bzn::json_message& msg)
+    {
+        if (!msg.isObject() || msg.size() != 2 || !msg["bzn-api"].isString() || !msg["msg"].isString())
+        {
+            return false;
+        }
+
+        const std::string encoded = msg["msg"].asString();
+        return boost::beast::detail::base64_encode(boost::beast::detail::base64_decode(encoded)) == encoded;
+    }
+
+
     struct log_entry
     {
         friend std::ostream &operator<<(std::ostream& out, const log_entry& obj)
         {
-            out << static_cast<uint8_t >(obj.entry_type) << " " << obj.log_index << " " << obj.term << " " << boost::beast::detail::base64_encode(obj.json_to_string(obj.msg)) << "\n";
+            out << static_cast<uint8_t >(obj.entry_type) << " " << obj.log_index << " " << obj.term << " " << boost::beast::detail::base64_encode(obj.json_to_string(obj.message())) << "\n";
             return out;
         }
 
@@ -81,10 +97,65 @@ namespace bzn
             return fastWriter.write(msg);
         }
 
+
+        // the entry as the message it was appended with
+        inline bzn::json_message
+        message() const
+        {
+            if (!this->data)
+            {
+                return this->msg;
+            }
+
+            bzn::json_message result = this->msg;
+            result["msg"] = boost::beast::detail::base64_encode(*this->data);
+            return result;
+        }
+
         log_entry_type  entry_type;
         uint32_t        log_index;
         uint32_t        term;
         bzn::json_message    msg;
+
+        // raw bytes of a database message's "msg", in which case msg only holds its "bzn-api" -- kept this way so they
+        // can be stored and sent without going through base64 (see make_log_entry)
+        std::optional<std::string> data{};
     };
+
+
+    inline log_entry
+    make_log_entry(log_entry_type entry_type, uint32_t log_index, uint32_t term, const bzn::json_message& msg)
+    {
+        if (!bzn::is_database_message(msg))
+        {
+            return log_entry{entry_type, log_index, term, msg, std::nullopt};
+        }
+
+        bzn::json_message header;
+        header["bzn-api"] = msg["bzn-api"];
+        return log_entry{entry_type, log_index, term, header, boost::beast::detail::base64_decode(msg["msg"].asString())};
+    }
+
+
+    // entries carry no type on the wire, so it is recovered from the message
+    inline log_entry_type
+    deduce_log_entry_type(const bzn::json_message& message)
+    {
+        if (message["msg"].isString())
+        {
+            return log_entry_type::database;
+        }
+
+        if (message["msg"]["peers"].isArray())
+        {
+            return log_entry_type::single_quorum;
+        }
+
+        if (message["msg"]["peers"].isMember("new"))
+        {
+            return log_entry_type::joint_quorum;
+        }
+        return log_entry_type::undefined;
+    }
 }
 
@@ -13,14 +13,18 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <raft/raft.hpp>
+#include <raft/raft_proto.hpp>
 #include <boost/range/adaptor/reversed.hpp>
 #include <string>
 #include <random>
 #include <algorithm>
+#include <cstring>
 #include <boost/filesystem.hpp>
 #include <proto/audit.pb.h>
 #include <utils/crypto.hpp>
 #include <utils/blacklist.hpp>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace
 {
@@ -29,10 +33,14 @@ namespace
     const std::string MSG_ERROR_EMPTY_LOG_ENTRY_FILE{"Empty log entry file. Please delete .state folder."};
     const std::string MSG_ERROR_INVALID_STATE_FILE{"Invalid state file. Please delete the .state folder."};
     const std::string MSG_NO_PEERS_IN_LOG{"Unable to find peers in log entries."};
+    const std::string MSG_ERROR_MISSING_SNAPSHOT{"Raft log has been compacted but its snapshot is missing. Please delete .state folder."};
 
     const std::chrono::milliseconds DEFAULT_HEARTBEAT_TIMER_LEN{std::chrono::milliseconds(250)};
     const std::chrono::milliseconds  DEFAULT_ELECTION_TIMER_LEN{std::chrono::milliseconds(1250)};
 
+    // a snapshot can be large, so give the follower a while to install it before sending it again
+    const std::chrono::seconds SNAPSHOT_RESEND_INTERVAL{std::chrono::seconds(5)};
+
     const std::string RAFT_TIMEOUT_SCALE = "RAFT_TIMEOUT_SCALE";
 
     std::mt19937 gen(std::time(0)); //Standard mersenne_twister_engine seeded with rd()
@@ -50,6 +58,89 @@ namespace
         }
         return all_peers.end();
     }
+
+
+    // apply a committed write straight to storage, as raft_crud would have when it was first committed
+    void
+    apply_to_storage(bzn::storage_base& storage, const database_msg& request)
+    {
+        const bzn::uuid_t& uuid = request.header().db_uuid();
+
+        switch (request.msg_case())
+        {
+            case database_msg::kCreate:
+                storage.create(uuid, request.create().key(), request.create().value());
+                break;
+
+            case database_msg::kUpdate:
+                storage.update(uuid, request.update().key(), request.update().value());
+                break;
+
+            case database_msg::kDelete:
+                storage.remove(uuid, request.delete_().key());
+                break;
+
+            default:
+                break;
+        }
+    }
+
+
+    // a peer that sent us json gets its replies in json, everything else passes straight through
+    class raft_json_session final : public bzn::session_base
+    {
+    public:
+        explicit raft_json_session(std::shared_ptr<bzn::session_base> session)
+            : session(std::move(session))
+        {
+        }
+
+        void start(bzn::message_handler handler, bzn::protobuf_handler proto_handler) override
+        {
+            this->session->start(std::move(handler), std::move(proto_handler));
+        }
+
+        void send_message(std::shared_ptr<bzn::json_message> msg, bool end_session) override
+        {
+            this->session->send_message(std::move(msg), end_session);
+        }
+
+        void send_message(std::shared_ptr<bzn::encoded_message> msg, bool end_session) override
+        {
+            bzn_envelope env;
+            raft_msg wire_msg;
+            if (!env.ParseFromString(*msg) || env.payload_case() != bzn_envelope::kRaft || !wire_msg.ParseFromString(env.raft()))
+            {
+                this->session->send_message(std::move(msg), end_session);
+                return;
+            }
+
+            this->session->send_message(std::make_shared<bzn::json_message>(bzn::raft_proto_to_json(wire_msg)), end_session);
+        }
+
+        void send_datagram(std::shared_ptr<bzn::encoded_message> msg) override
+        {
+            this->session->send_datagram(std::move(msg));
+        }
+
+        void close() override
+        {
+            this->session->close();
+        }
+
+        bool is_open() const override
+        {
+            return this->session->is_open();
+        }
+
+        bzn::session_id get_session_id() override
+        {
+            return this->session->get_session_id();
+        }
+
+    private:
+        const std::shared_ptr<bzn::session_base> session;
+    };
 }
 
 
@@ -87,6 +178,20 @@ raft::raft(
 
     this->raft_log = std::make_shared<bzn::raft_log>(this->entries_log_path(), maximum_raft_storage);
 
+    if (this->raft_log->first_index())
+    {
+        // the log only goes back as far as the snapshot...
+        bzn::json_message snapshot;
+        if (!this->read_snapshot_file(snapshot, nullptr) || snapshot["index"].asUInt() < this->raft_log->first_index())
+        {
+            throw std::runtime_error(MSG_ERROR_MISSING_SNAPSHOT);
+        }
+
+        this->raft_log->set_compacted_quorum_entry(log_entry{bzn::log_entry_type(snapshot["quorumType"].asUInt()),
+            snapshot["quorumIndex"].asUInt(), snapshot["quorumTerm"].asUInt(), snapshot["quorum"]});
+        this->commit_index = uint32_t(this->raft_log->first_index()) + 1;
+    }
+
     this->shutdown_on_exceeded_max_storage(true);
 }
 
@@ -139,10 +244,57 @@ raft::start()
             this->node->register_for_message(
                     "raft"
                     , std::bind(&raft::handle_ws_raft_messages, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+
+            // peers running with protobuf enabled send the RPCs this way, whatever our own setting...
+            this->node->register_for_message(bzn_envelope::PayloadCase::kRaft,
+                    std::bind(&raft::handle_raft_protobuf_message, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
         });
 }
 
 
+void
+raft::handle_raft_protobuf_message(const bzn_envelope& msg, std::shared_ptr<bzn::session_base> session)
+{
+    raft_msg wire_msg;
+    if (!wire_msg.ParseFromString(msg.raft()) || wire_msg.msg_case() == raft_msg::MSG_NOT_SET)
+    {
+        LOG(error) << "Failed to decode raft message from: " << msg.sender();
+        return;
+    }
+
+    this->shutdown_on_exceeded_max_storage();
+    std::lock_guard<std::mutex> lock(this->raft_lock);
+
+    this->handle_raft_message(wire_msg, std::move(session));
+}
+
+
+void
+raft::send_raft_message(const boost::asio::ip::tcp::endpoint& ep, const raft_msg& msg)
+{
+    if (this->enable_protobuf)
+    {
+        auto env = std::make_shared<bzn_envelope>();
+        env->set_raft(msg.SerializeAsString());
+        this->node->send_message(ep, env, true);
+        return;
+    }
+
+    this->node->send_message_json(ep, std::make_shared<bzn::json_message>(bzn::raft_proto_to_json(msg)));
+}
+
+
+void
+raft::send_raft_reply(std::shared_ptr<bzn::session_base> session, const raft_msg& msg)
+{
+    LOG(debug) << "Sending reply:\n" << msg.ShortDebugString().substr(0, MAX_MESSAGE_SIZE) << "...";
+
+    bzn_envelope env;
+    env.set_raft(msg.SerializeAsString());
+    session->send_message(std::make_shared<bzn::encoded_message>(env.SerializeAsString()), true);
+}
+
+
 void
 raft::start_election_timer()
 {
@@ -227,12 +379,7 @@ raft::request_vote_request()
             // todo: use resolver on hostname...
             auto ep = boost::asio::ip::tcp::endpoint{boost::asio::ip::address_v4::from_string(peer.host), peer.port};
 
-            this->node->send_message_json(ep, std::make_shared<bzn::json_message>(bzn::create_request_vote_request(
-                                        this->uuid
-                                        , this->current_term
-                                        , this->raft_log->size()
-                                        , this->last_log_term
-                                )));
+            this->send_raft_message(ep, bzn::create_raft_request_vote(this->uuid, this->current_term, this->raft_log->size(), this->last_log_term));
         }
         catch(const std::exception& ex)
         {
@@ -246,20 +393,19 @@ raft::request_vote_request()
 
 
 void
-raft::handle_request_vote_response(const bzn::json_message& msg, std::shared_ptr<bzn::session_base> /*session*/)
+raft::handle_request_vote_response(const raft_msg& msg, std::shared_ptr<bzn::session_base> /*session*/)
 {
-    LOG(debug) << '\n' << msg.toStyledString().substr(0, MAX_MESSAGE_SIZE) << "...";
+    LOG(debug) << '\n' << msg.ShortDebugString().substr(0, MAX_MESSAGE_SIZE) << "...";
 
     // If I'm the leader and my term is less than vote request then I should step down and become a follower.
     if (this->current_state == bzn::raft_state::leader)
     {
-        if (this->current_term < msg["data"]["term"].asUInt())
+        if (this->current_term < msg.term())
         {
-            LOG(error) << "vote from: " << msg["data"]["from"].asString() << " in wrong term: "
-                       << msg["data"]["term"].asUInt();
+            LOG(error) << "vote from: " << msg.from() << " in wrong term: " << msg.term();
 
             // reset ourselves to follower...
-            this->update_raft_state(msg["data"]["term"].asUInt(), bzn::raft_state::follower);
+            this->update_raft_state(msg.term(), bzn::raft_state::follower);
 
             this->start_election_timer();
 
@@ -269,15 +415,15 @@ raft::handle_request_vote_response(const bzn::json_message& msg, std::shared_ptr
 
     if (this->current_state != bzn::raft_state::candidate)
     {
-        LOG(warning) << "No longer a candidate. Ignoring message from peer: " << msg["data"]["from"].asString();
+        LOG(warning) << "No longer a candidate. Ignoring message from peer: " << msg.from();
 
         return;
     }
 
     // tally the votes...
-    if (msg["data"]["granted"].asBool())
+    if (msg.response_vote().granted())
     {
-        this->yes_votes.emplace(msg["data"]["from"].asString());
+        this->yes_votes.emplace(msg.from());
         if (this->is_majority(this->yes_votes))
         {
             this->update_raft_state(this->current_term, bzn::raft_state::leader);
@@ -287,6 +433,8 @@ raft::handle_request_vote_response(const bzn::json_message& msg, std::shared_ptr
             {
                 entry.second = 1;
             }
+            this->peer_next_index.clear();
+            this->peer_in_flight.clear();
 
             this->request_append_entries();
 
@@ -295,7 +443,7 @@ raft::handle_request_vote_response(const bzn::json_message& msg, std::shared_ptr
     }
     else
     {
-        this->no_votes.emplace(msg["data"]["from"].asString());
+        this->no_votes.emplace(msg.from());
         if (this->is_majority(this->no_votes))
         {
             this->update_raft_state(this->current_term, bzn::raft_state::follower);
@@ -309,32 +457,33 @@ raft::handle_request_vote_response(const bzn::json_message& msg, std::shared_ptr
 
 
 void
-raft::handle_ws_request_vote(const bzn::json_message& msg, std::shared_ptr<bzn::session_base> session)
+raft::handle_request_vote(const raft_msg& msg, std::shared_ptr<bzn::session_base> session)
 {
     if (this->current_state == bzn::raft_state::leader || this->voted_for)
     {
-        session->send_message(std::make_shared<bzn::json_message>(bzn::create_request_vote_response(this->uuid, this->current_term, false)), true);
+        this->send_raft_reply(session, bzn::create_raft_vote_response(this->uuid, this->current_term, false));
 
         return;
     }
 
     // vote for this peer...
-    this->voted_for = msg["data"]["from"].asString();
+    this->voted_for = msg.from();
 
-    bool vote = msg["data"]["lastLogIndex"].asUInt() >= this->raft_log->size();
+    bool vote = msg.request_vote().last_log_index() >= this->raft_log->size();
 
-    session->send_message(std::make_shared<bzn::json_message>(bzn::create_request_vote_response(this->uuid, this->current_term, vote)), true);
+    this->send_raft_reply(session, bzn::create_raft_vote_response(this->uuid, this->current_term, vote));
 }
 
 
 void
-raft::handle_ws_append_entries(const bzn::json_message& msg, std::shared_ptr<bzn::session_base> session)
+raft::handle_append_entries(const raft_msg& msg, std::shared_ptr<bzn::session_base> session)
 {
-    uint32_t term = msg["data"]["term"].asUInt();
+    const auto& request = msg.append_entries();
+    uint32_t term = msg.term();
 
     // We've received an append entries from another node, we are in
     // a swarm.
-    if(!this->in_a_swarm && (msg["data"]["from"].asString() != this->get_uuid()))
+    if(!this->in_a_swarm && (msg.from() != this->get_uuid()))
     {
         LOG(debug) << "RAFT - just received an append entries - auto add peer is unecessary";
         this->in_a_swarm = true;
@@ -351,13 +500,13 @@ raft::handle_ws_append_entries(const bzn::json_message& msg, std::shared_ptr<bzn
         return;
     }
 
-    this->leader = msg["data"]["from"].asString();
+    this->leader = msg.from();
 
     bool success = false;
-    uint32_t leader_prev_term  = msg["data"]["prevTerm"].asUInt();
-    uint32_t leader_prev_index = msg["data"]["prevIndex"].asUInt();
-    uint32_t entry_term = msg["data"]["entryTerm"].asUInt();
+    uint32_t leader_prev_term  = request.prev_term();
+    uint32_t leader_prev_index = request.prev_index();
     uint32_t msg_index = leader_prev_index + 1;
+    size_t match_index = 0;
 
     // Accept the message if its previous index and previous term are consistent with our log
     if (this->raft_log->entry_accepted(leader_prev_index, leader_prev_term))
@@ -366,11 +515,20 @@ raft::handle_ws_append_entries(const bzn::json_message& msg, std::shared_ptr<bzn
 
         // Now if the message actually has data, and we don't have that data, we can append it.
         // If it has data but our log is longer, raft guarentees that the data is the same.
-        if (!msg["data"]["entries"].empty() )
+        const size_t entry_count = size_t(request.entries_size());
+        if (entry_count)
+        {
+            LOG(debug) << "Follower inserting " << entry_count << " entries from message index:" << msg_index;
+        }
+
+        for (size_t i = 0; i < entry_count; ++i)
         {
-            LOG(debug) << "Follower inserting entry with message index:" << msg_index;
-            this->raft_log->follower_insert_entry(msg_index, log_entry{raft::deduce_type_from_message(msg["data"]["entries"]), msg_index, entry_term, msg["data"]["entries"]});
+            const uint32_t index = msg_index + uint32_t(i);
+            this->raft_log->follower_insert_entry(index, bzn::proto_to_log_entry(request.entries(int(i)), index));
         }
+
+        // only what this request checked or carried is known to match: a heartbeat confirms up to prevIndex
+        match_index = size_t(msg_index) + entry_count;
     }
     else
     {
@@ -379,28 +537,39 @@ raft::handle_ws_append_entries(const bzn::json_message& msg, std::shared_ptr<bzn
         if (leader_prev_index >= this->raft_log->size())
         {
             LOG(debug) << "Rejecting AppendEntries because I do not have the previous index";
+
+            match_index = this->raft_log->size();
         }
         else
         {
             LOG(debug) << "Rejecting AppendEntries because I do not agree with the previous index";
+
+            // everything written in the conflicting term is suspect, so point the leader at the start of that
+            // term instead of letting it walk back one entry per round trip (committed entries always agree)
+            const uint32_t conflict_term = this->raft_log->entry_at(leader_prev_index).term;
+
+            match_index = leader_prev_index;
+            while (match_index > this->commit_index && this->raft_log->entry_at(match_index - 1).term == conflict_term)
+            {
+                --match_index;
+            }
+
+            match_index = std::max(match_index, size_t(this->commit_index));
         }
         success = false;
     }
 
-    size_t match_index = std::min(this->raft_log->size(), (size_t) msg_index+1);
-
-    auto resp_msg = std::make_shared<bzn::json_message>(bzn::create_append_entries_response(this->uuid, this->current_term, success, match_index));
-
-    LOG(debug) << "Sending WS message:\n" << resp_msg->toStyledString().substr(0, MAX_MESSAGE_SIZE) << "...";
+    // whatever this request added has to be on disk before we say we have it...
+    this->raft_log->sync();
 
-    session->send_message(resp_msg, true);
+    this->send_raft_reply(session, bzn::create_raft_append_entries_reply(this->uuid, this->current_term, success, match_index));
 
-    // update commit index...
+    // update commit index, but only over entries the leader has just confirmed we agree on...
     if (success)
     {
-        if (this->commit_index < msg["data"]["commitIndex"].asUInt())
+        if (this->commit_index < request.commit_index())
         {
-            for(size_t i = this->commit_index; i < std::min(this->raft_log->size(), size_t(msg["data"]["commitIndex"].asUInt())); ++i)
+            for(size_t i = this->commit_index; i < std::min(match_index, size_t(request.commit_index())); ++i)
             {
                 this->perform_commit(commit_index, this->raft_log->entry_at(i));
             }
@@ -408,7 +577,95 @@ raft::handle_ws_append_entries(const bzn::json_message& msg, std::shared_ptr<bzn
     }
 
     // update leader's peer index
-    this->peer_match_index[this->leader] = msg["data"]["commitIndex"].asUInt();
+    this->peer_match_index[this->leader] = request.commit_index();
+
+    this->start_election_timer();
+}
+
+
+void
+raft::handle_install_snapshot(const raft_msg& msg, std::shared_ptr<bzn::session_base> session)
+{
+    // a deposed leader must not get to replace our storage and log...
+    if (msg.term() < this->current_term)
+    {
+        LOG(debug) << "Rejecting InstallSnapshot from " << msg.from() << " in stale term: " << msg.term();
+
+        this->send_raft_reply(session, bzn::create_raft_append_entries_reply(this->uuid, this->current_term, false, this->raft_log->size()));
+        return;
+    }
+
+    if ((this->current_state == bzn::raft_state::candidate || this->current_state == bzn::raft_state::leader) &&
+        this->current_term >= msg.term())
+    {
+        LOG(debug) << "received InstallSnapshot -- aborting election.";
+
+        this->update_raft_state(msg.term(), bzn::raft_state::follower);
+        this->start_election_timer();
+        session->close();
+        return;
+    }
+
+    if (this->current_term < msg.term())
+    {
+        this->update_raft_state(msg.term(), bzn::raft_state::follower);
+        this->voted_for.reset();
+    }
+
+    this->leader = msg.from();
+    this->in_a_swarm = true;
+
+    bzn::json_message snapshot;
+    if (!Json::Reader().parse(msg.install_snapshot().snapshot(), snapshot) || !snapshot.isObject() || !snapshot["index"].isUInt())
+    {
+        LOG(error) << "Rejecting malformed snapshot from " << msg.from();
+
+        this->send_raft_reply(session, bzn::create_raft_append_entries_reply(this->uuid, this->current_term, false, this->raft_log->size()));
+        this->start_election_timer();
+        return;
+    }
+
+    const uint32_t index = snapshot["index"].asUInt();
+    bool success = true;
+
+    // we may have caught up some other way while the snapshot was in flight...
+    if (index >= this->commit_index)
+    {
+        // our own snapshot has to be out of the way before the leader's replaces it
+        this->complete_snapshot(true);
+
+        const std::string& data = msg.install_snapshot().data();
+
+        // raft snapshots carry no state hash, the leader's term and index are what vouch for them
+        success = this->storage && this->storage->load_snapshot(data, {}) && this->write_snapshot_file(snapshot, data);
+
+        if (success)
+        {
+            const auto base_entry = bzn::make_log_entry(bzn::log_entry_type(snapshot["entryType"].asUInt()), index, snapshot["term"].asUInt(), snapshot["entry"]);
+
+            // keep whatever follows the snapshot if it agrees with the leader, otherwise start again from it
+            if (index >= this->raft_log->first_index() && index < this->raft_log->size() && this->raft_log->entry_at(index).term == base_entry.term)
+            {
+                this->raft_log->compact(index);
+            }
+            else
+            {
+                this->raft_log->reset(base_entry, log_entry{bzn::log_entry_type(snapshot["quorumType"].asUInt()),
+                    snapshot["quorumIndex"].asUInt(), snapshot["quorumTerm"].asUInt(), snapshot["quorum"]});
+            }
+
+            this->commit_index = index + 1;
+
+            LOG(info) << "Installed snapshot from " << this->leader << " at index " << index;
+        }
+        else
+        {
+            LOG(error) << "Failed to install snapshot from " << this->leader << " at index " << index;
+        }
+    }
+
+    this->send_raft_reply(session, bzn::create_raft_append_entries_reply(this->uuid, this->current_term, success,
+        success ? std::min(size_t(index) + 1, this->raft_log->size()) : this->raft_log->size()));
 
     this->start_election_timer();
 }
@@ -729,87 +986,102 @@ raft::handle_ws_raft_messages(const bzn::json_message& msg, std::shared_ptr<bzn:
         return;
     }
 
+    // RPCs from peers still sending json are converted and handled like the protobuf ones
+    raft_msg wire_msg;
+    if (!bzn::raft_json_to_proto(msg, wire_msg))
+    {
+        LOG(error) << "unhandled raft msg: " << msg["cmd"];
+        return;
+    }
+
+    this->handle_raft_message(wire_msg, std::make_shared<raft_json_session>(std::move(session)));
+}
+
+
+void
+raft::handle_raft_message(const raft_msg& msg, std::shared_ptr<bzn::session_base> session)
+{
     // check that the message is from a node in the most recent quorum
-    if (!in_quorum(msg["data"]["from"].asString()))
+    if (!in_quorum(msg.from()))
     {
         return;
     }
 
-    uint32_t term = msg["data"]["term"].asUInt();
+    // InstallSnapshot deals with the term itself: it refuses a stale leader and installs from a newer one...
+    if (msg.msg_case() == raft_msg::kInstallSnapshot)
+    {
+        this->handle_install_snapshot(msg, session);
+        return;
+    }
+
+    uint32_t term = msg.term();
 
     if (this->current_term == term)
     {
-        // bleh!
-        if (msg["cmd"].asString() == "RequestVote")
-        {
-            this->handle_ws_request_vote(msg, session);
-        }
-        else if (msg["cmd"].asString() == "AppendEntries")
-        {
-            this->handle_ws_append_entries(msg, session);
-        }
-        else if (msg["cmd"].asString() == "AppendEntriesReply")
-        {
-            this->handle_request_append_entries_response(msg, session);
-            session->close();
-        }
-        else if (msg["cmd"].asString() == "ResponseVote")
+        switch (msg.msg_case())
         {
-            this->handle_request_vote_response(msg, session);
-            session->close();
+            case raft_msg::kRequestVote:
+                this->handle_request_vote(msg, session);
+                break;
+
+            case raft_msg::kAppendEntries:
+                this->handle_append_entries(msg, session);
+                break;
+
+            case raft_msg::kAppendEntriesReply:
+                this->handle_request_append_entries_response(msg, session);
+                session->close();
+                break;
+
+            case raft_msg::kResponseVote:
+                this->handle_request_vote_response(msg, session);
+                session->close();
+                break;
+
+            default:
+                LOG(error) << "unhandled raft msg: " << msg.msg_case();
+                break;
         }
 
         return;
     }
-    else
-    {
-        // todo: We are the leader and we need to step down when term is out of sync?
-        if (this->current_term < term)
-        {
-            this->current_term = msg["data"]["term"].asUInt();
-
-            if (msg["cmd"].asString() == "RequestVote")
-            {
-                this->voted_for = msg["data"]["uuid"].asString();
-
-                session->send_message(std::make_shared<bzn::json_message>(bzn::create_request_vote_response(this->uuid, this->current_term, true)), true);
-
-                return;
-            }
-
-            if (msg["cmd"].asString() == "AppendEntries")
-            {
-                // TODO: We should either process this message properly, or just drop it after updating term
-                this->leader = msg["data"]["from"].asString();
-
-                auto resp_msg = std::make_shared<bzn::json_message>(bzn::create_append_entries_response(this->uuid, this->current_term, false, this->raft_log->size()));
 
-                LOG(debug) << "Sending WS message:\n" << resp_msg->toStyledString().substr(0, MAX_MESSAGE_SIZE) << "...";
+    // todo: We are the leader and we need to step down when term is out of sync?
+    if (this->current_term < term)
+    {
+        this->current_term = term;
 
-                session->send_message(resp_msg, true);
-            }
+        if (msg.msg_case() == raft_msg::kRequestVote)
+        {
+            this->voted_for = msg.from();
 
-            LOG(info) << "current term out of sync: " << this->current_term;
+            this->send_raft_reply(session, bzn::create_raft_vote_response(this->uuid, this->current_term, true));
 
-            this->update_raft_state(this->current_term, bzn::raft_state::follower);
-            this->voted_for.reset();
-            this->start_election_timer();
             return;
         }
 
-        // todo: drop back to follower and restart the election?
-        if (this->current_term > term)
+        if (msg.msg_case() == raft_msg::kAppendEntries)
         {
-            LOG(error) << "request had term out of sync: " << this->current_term << " > " << term;
+            // TODO: We should either process this message properly, or just drop it after updating term
+            this->leader = msg.from();
 
-            this->update_raft_state(msg["data"]["term"].asUInt(), bzn::raft_state::follower);
-            this->voted_for.reset();
-            this->start_election_timer();
-            return;
+            this->send_raft_reply(session, bzn::create_raft_append_entries_reply(this->uuid, this->current_term, false, this->raft_log->size()));
         }
+
+        LOG(info) << "current term out of sync: " << this->current_term;
+
+        this->update_raft_state(this->current_term, bzn::raft_state::follower);
+        this->voted_for.reset();
+        this->start_election_timer();
+        return;
     }
 
-    LOG(error) << "unhandled raft msg: " << msg["cmd"];
+    // todo: drop back to follower and restart the election?
+    LOG(error) << "request had term out of sync: " << this->current_term << " > " << term;
+
+    this->update_raft_state(term, bzn::raft_state::follower);
+    this->voted_for.reset();
+    this->start_election_timer();
 }
 
 
@@ -885,6 +1157,9 @@ raft::notify_commit(size_t log_index, const std::string& operation)
 void
 raft::request_append_entries()
 {
+    // one fsync covers everything appended since the last heartbeat
+    this->raft_log->sync();
+
     for (const auto& peer : this->get_all_peers())
     {
         // skip ourselves...
@@ -895,34 +1170,17 @@ raft::request_append_entries()
 
         try
         {
-            bzn::json_message msg;
-            uint32_t prev_index{};
-            uint32_t prev_term{};
-            uint32_t entry_term{};
-
-            if (this->peer_match_index[peer.uuid] < this->raft_log->size())
+            // requests still unanswered from the last interval are presumed lost, so resend from what the peer has
+            // acknowledged...
+            if (this->peer_in_flight[peer.uuid])
             {
-                auto index = this->peer_match_index[peer.uuid];
-                prev_index = index-1;
-                prev_term = this->raft_log->entry_at(prev_index).term;
-
-                msg = this->raft_log->entry_at(index).msg;
-                entry_term = this->raft_log->entry_at(index).term;
-            }
-            else
-            {
-                prev_index = this->raft_log->size()-1;
-                prev_term = this->raft_log->entry_at(prev_index).term;
+                this->peer_next_index[peer.uuid] = this->peer_match_index[peer.uuid];
+                this->peer_in_flight[peer.uuid] = 0;
             }
 
-            // todo: use resolver on hostname...
-            auto ep = boost::asio::ip::tcp::endpoint{boost::asio::ip::address_v4::from_string(peer.host), peer.port};
-
-            auto req = std::make_shared<bzn::json_message>(bzn::create_append_entries_request(this->uuid, this->current_term, this->commit_index, prev_index, prev_term, entry_term, msg));
-
-            LOG(debug) << "Sending request:\n" << req->toStyledString().substr(0, MAX_MESSAGE_SIZE) << "...";
-
-            this->node->send_message_json(ep, req);
+            // always send at least a heartbeat, then keep the pipeline full while the peer is behind...
+            this->send_append_entries(peer);
+            this->fill_append_entries_pipeline(peer);
         }
         catch(const std::exception& ex)
         {
@@ -936,30 +1194,166 @@ raft::request_append_entries()
 
 
 void
-raft::handle_request_append_entries_response(const bzn::json_message& msg, std::shared_ptr<bzn::session_base> /*session*/)
+raft::send_append_entries(const bzn::peer_address_t& peer)
+{
+    auto& next_index = this->peer_next_index[peer.uuid];
+
+    next_index = std::max(next_index, this->peer_match_index[peer.uuid]);
+    next_index = std::max(std::min(next_index, uint32_t(this->raft_log->size())), uint32_t(1));
+
+    // the peer needs entries we have compacted away...
+    bool probe = false;
+    if (next_index <= this->raft_log->first_index())
+    {
+        if (this->peers_needing_snapshot.count(peer.uuid))
+        {
+            const auto sent = this->peer_snapshot_sent.find(peer.uuid);
+            if (sent == this->peer_snapshot_sent.end() || std::chrono::steady_clock::now() - sent->second >= SNAPSHOT_RESEND_INTERVAL)
+            {
+                this->send_snapshot(peer);
+                return;
+            }
+
+            // still installing the last one, so just keep its election timer quiet
+            probe = true;
+        }
+
+        next_index = uint32_t(this->raft_log->first_index()) + 1;
+    }
+
+    const uint32_t prev_index = next_index - 1;
+    const uint32_t prev_term = this->raft_log->entry_at(prev_index).term;
+    const size_t end_index = probe ? next_index : std::min(this->raft_log->size(), size_t(next_index) + MAX_APPEND_ENTRIES_BATCH_SIZE);
+
+    auto req = bzn::create_raft_append_entries(this->uuid, this->current_term, this->commit_index, prev_index, prev_term);
+
+    for (size_t i = next_index; i < end_index; ++i)
+    {
+        bzn::log_entry_to_proto(this->raft_log->entry_at(i), *req.mutable_append_entries()->add_entries());
+    }
+
+    // todo: use resolver on hostname...
+    auto ep = boost::asio::ip::tcp::endpoint{boost::asio::ip::address_v4::from_string(peer.host), peer.port};
+
+    LOG(debug) << "Sending request:\n" << req.ShortDebugString().substr(0, MAX_MESSAGE_SIZE) << "...";
+
+    this->send_raft_message(ep, req);
+
+    // assume the peer will accept it so the next batch can go out before the response arrives...
+    next_index = uint32_t(end_index);
+    ++this->peer_in_flight[peer.uuid];
+}
+
+
+void
+raft::fill_append_entries_pipeline(const bzn::peer_address_t& peer)
+{
+    while (this->peer_in_flight[peer.uuid] < MAX_APPEND_ENTRIES_IN_FLIGHT &&
+           this->peer_next_index[peer.uuid] < this->raft_log->size() &&
+           !this->peers_needing_snapshot.count(peer.uuid))
+    {
+        this->send_append_entries(peer);
+    }
+}
+
+
+void
+raft::send_snapshot(const bzn::peer_address_t& peer)
+{
+    // one snapshot is read at a time, other peers get theirs on a later heartbeat
+    if (this->snapshot_reader.valid())
+    {
+        if (this->snapshot_reader.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            return;
+        }
+
+        this->snapshot_reader.get();
+    }
+
+    // keeps the peer quiet (and this from being called again) while the snapshot is read
+    this->peer_snapshot_sent[peer.uuid] = std::chrono::steady_clock::now();
+
+    // the snapshot can be large, so it is read off the raft thread and sent from there if we are still leading this term
+    this->snapshot_reader = std::async(std::launch::async, [this, peer, term = this->current_term]()
+    {
+        bzn::json_message snapshot;
+        std::string data;
+
+        if (!this->read_snapshot_file(snapshot, &data))
+        {
+            LOG(error) << "unable to read snapshot for peer: " << peer.name;
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(this->raft_lock);
+
+        if (this->current_state != bzn::raft_state::leader || this->current_term != term)
+        {
+            return;
+        }
+
+        // todo: use resolver on hostname...
+        auto ep = boost::asio::ip::tcp::endpoint{boost::asio::ip::address_v4::from_string(peer.host), peer.port};
+
+        LOG(info) << "Sending snapshot at index " << snapshot["index"].asUInt() << " (" << data.size() << " bytes) to peer: " << peer.name;
+
+        this->send_raft_message(ep, bzn::create_raft_install_snapshot(this->uuid, this->current_term, this->commit_index, snapshot, std::move(data)));
+
+        this->peer_next_index[peer.uuid] = snapshot["index"].asUInt() + 1;
+        ++this->peer_in_flight[peer.uuid];
+    });
+}
+
+
+void
+raft::handle_request_append_entries_response(const raft_msg& msg, std::shared_ptr<bzn::session_base> /*session*/)
 {
     if (this->current_state != bzn::raft_state::leader)
     {
-        LOG(warning) << "No longer the leader. Ignoring message from peer: " << msg["data"]["from"].asString();
+        LOG(warning) << "No longer the leader. Ignoring message from peer: " << msg.from();
         return;
     }
 
     // check match index for bad peers...
-    if (msg["data"]["matchIndex"].asUInt() > this->raft_log->size() ||
-        msg["data"]["term"].asUInt() != this->current_term)
+    if (msg.append_entries_reply().match_index() > this->raft_log->size() || msg.term() != this->current_term)
     {
-        LOG(error) << "received bad match index or term: \n" << msg.toStyledString().substr(0, MAX_MESSAGE_SIZE) << "...";
+        LOG(error) << "received bad match index or term: \n" << msg.ShortDebugString().substr(0, MAX_MESSAGE_SIZE) << "...";
         return;
     }
 
-    this->peer_match_index[msg["data"]["from"].asString()] = msg["data"]["matchIndex"].asUInt();
+    const bzn::uuid_t& peer_uuid = msg.from();
+    const uint32_t match_index = msg.append_entries_reply().match_index();
 
-    if (!msg["data"]["success"].asBool())
+    if (!msg.append_entries_reply().success())
     {
-        LOG(debug) << "append entry failed for peer: " << msg["data"]["uuid"].asString();
+        LOG(debug) << "append entry failed for peer: " << peer_uuid;
+
+        // the peer told us where its log stops agreeing with ours, so the next heartbeat resends from there and
+        // anything else in flight is void...
+        this->peer_next_index[peer_uuid] = std::max(match_index, this->peer_match_index[peer_uuid]);
+        this->peer_in_flight[peer_uuid] = 0;
+
+        // ...unless what it is missing has been compacted away
+        if (this->raft_log->first_index() && this->peer_next_index[peer_uuid] <= this->raft_log->first_index())
+        {
+            this->peers_needing_snapshot.insert(peer_uuid);
+        }
         return;
     }
 
+    this->peers_needing_snapshot.erase(peer_uuid);
+    this->peer_match_index[peer_uuid] = std::max(match_index, this->peer_match_index[peer_uuid]);
+    this->peer_next_index[peer_uuid] = std::max(this->peer_next_index[peer_uuid], this->peer_match_index[peer_uuid]);
+
+    if (this->peer_in_flight[peer_uuid])
+    {
+        --this->peer_in_flight[peer_uuid];
+    }
+
+    // the leader counts itself towards the majority, so its own entries must be durable too
+    this->raft_log->sync();
+
     uint32_t last_majority_replicated_log_index = this->last_majority_replicated_log_index();
     // TODO: Review the last_majority_replicated_log_index w.r.t. it's bad return values.
     // Intermittently the last_majority_replicated_log_index method returns invalid values
@@ -975,6 +1369,23 @@ raft::handle_request_append_entries_response(const bzn::json_message& msg, std::
     {
         this->perform_commit(this->commit_index, this->raft_log->entry_at(this->commit_index));
     }
+
+    // a lagging peer gets its next batch now rather than on the next heartbeat...
+    for (const auto& peer : this->get_all_peers())
+    {
+        if (peer.uuid == peer_uuid)
+        {
+            try
+            {
+                this->fill_append_entries_pipeline(peer);
+            }
+            catch(const std::exception& ex)
+            {
+                LOG(error) << "could not send AppendEntries request to peer: " << peer.name << " [" << ex.what() << "]";
+            }
+            break;
+        }
+    }
 }
 
 
@@ -989,7 +1400,7 @@ raft::append_log_unsafe(const bzn::json_message& msg, const bzn::log_entry_type
 
     LOG(debug) << "Appending " << log_entry_type_to_string(entry_type) << " to my log: " << msg.toStyledString();
 
-    this->raft_log->leader_append_entry(log_entry{entry_type, uint32_t(this->raft_log->size()), this->current_term, msg});
+    this->raft_log->leader_append_entry(bzn::make_log_entry(entry_type, uint32_t(this->raft_log->size()), this->current_term, msg));
 
     return true;
 }
@@ -1059,40 +1470,53 @@ raft::get_leader()
 void
 raft::initialize_storage_from_log(std::shared_ptr<bzn::storage_base> storage)
 {
+    this->storage = storage;
+
+    // start from the snapshot if there is one, then replay what followed it
+    size_t replay_from = this->raft_log->first_index();
+
+    bzn::json_message snapshot;
+    std::string data;
+    if (this->read_snapshot_file(snapshot, &data) && snapshot["index"].asUInt() >= replay_from && snapshot["index"].asUInt() < this->raft_log->size())
+    {
+        LOG(info) << "Initializing storage from snapshot at index " << snapshot["index"].asUInt();
+
+        if (!storage->load_snapshot(data, {}))
+        {
+            throw std::runtime_error(MSG_ERROR_MISSING_SNAPSHOT);
+        }
+
+        replay_from = snapshot["index"].asUInt() + 1;
+        this->commit_index = std::max(this->commit_index, uint32_t(replay_from));
+    }
+
     LOG(info) << "Initializng storage from log entries";
-    for (const auto& log_entry : this->raft_log->get_log_entries())
+    for (size_t i = replay_from; i < this->raft_log->size(); ++i)
     {
+        const auto& log_entry = this->raft_log->entry_at(i);
+
         if (log_entry.entry_type == bzn::log_entry_type::database)
         {
             bzn_msg msg;
+            const std::string data = log_entry.data ? *log_entry.data : boost::beast::detail::base64_decode(log_entry.msg["msg"].asString());
 
-            if (!msg.ParseFromString(boost::beast::detail::base64_decode(log_entry.msg["msg"].asString())))
-            {
-                LOG(error) << "Failed to decode message: " << boost::beast::detail::base64_decode(log_entry.msg["msg"].asString()).substr(0,MAX_MESSAGE_SIZE) << "...";
-                continue;
-            }
-
-            const bzn::uuid_t uuid = msg.db().header().db_uuid();
-
-            if (msg.db().has_create())
+            if (!msg.ParseFromString(data))
             {
-                const database_create& create_command = msg.db().create();
-                storage->create(uuid, create_command.key(), create_command.value());
+                LOG(error) << "Failed to decode message: " << data.substr(0,MAX_MESSAGE_SIZE) << "...";
                 continue;
             }
 
-            if (msg.db().has_update())
+            if (msg.msg_case() == bzn_msg::kDb)
             {
-                const database_update& update_command = msg.db().update();
-                storage->update(uuid, update_command.key(), update_command.value());
-                continue;
+                apply_to_storage(*storage, msg.db());
             }
-
-            if (msg.db().has_delete_())
+            else if (msg.msg_case() == bzn_msg::kDbBatch)
             {
-                const database_delete& delete_command = msg.db().delete_();
-                storage->remove(uuid,delete_command.key());
-                continue;
+                // a bulk write is one entry, applied in the order it was sent
+                for (const auto& request : msg.db_batch().requests())
+                {
+                    apply_to_storage(*storage, request);
+                }
             }
         }
     }
@@ -1113,8 +1537,9 @@ raft::entries_log_path()
 void
 raft::perform_commit(uint32_t& commit_index, const bzn::log_entry& log_entry)
 {
-    this->notify_commit(commit_index, log_entry.json_to_string(log_entry.msg));
-    this->commit_handler(log_entry.msg);
+    const auto msg = log_entry.message();
+    this->notify_commit(commit_index, log_entry.json_to_string(msg));
+    this->commit_handler(msg);
     commit_index++;
 
     if (this->get_state() == bzn::raft_state::leader && log_entry.entry_type == bzn::log_entry_type::joint_quorum)
@@ -1123,6 +1548,15 @@ raft::perform_commit(uint32_t& commit_index, const bzn::log_entry& log_entry)
                 this->create_single_quorum_from_joint_quorum(log_entry.msg),
                 bzn::log_entry_type::single_quorum);
     }
+
+    // last, as compacting the log invalidates log_entry...
+    this->complete_snapshot(false);
+
+    if (this->snapshot_threshold && this->storage && !this->snapshot_writer.valid() &&
+        commit_index - 1 >= this->raft_log->first_index() + this->snapshot_threshold)
+    {
+        this->take_snapshot(commit_index - 1);
+    }
 }
 
 
@@ -1134,6 +1568,7 @@ raft::last_majority_replicated_log_index()
     for(const auto& uuids: this->get_active_quorum())
     {
         std::vector<size_t> match_indices;
+        match_indices.reserve(uuids.size());
         std::transform(uuids.begin(), uuids.end(),
                        std::back_inserter(match_indices),
                        [&](const auto& uuid)
@@ -1141,26 +1576,41 @@ raft::last_majority_replicated_log_index()
                            return this->peer_match_index[uuid];
                        });
 
-        std::sort(match_indices.begin(), match_indices.end());
-        uint32_t median = match_indices[uint32_t(std::ceil(match_indices.size()/2.0))];
-        result = std::min(result, median);
+        // only the median is needed, so select it rather than sorting the lot
+        const auto median = match_indices.begin() + uint32_t(std::ceil(match_indices.size()/2.0));
+        std::nth_element(match_indices.begin(), median, match_indices.end());
+        result = std::min(result, uint32_t(*median));
     }
 
     return result;
 }
 
 
-std::list<std::set<bzn::uuid_t>>
+const std::list<std::set<bzn::uuid_t>>&
 raft::get_active_quorum()
 {
-    // TODO: cache this method when the active quorum is updated
+    const bzn::log_entry& log_entry = this->raft_log->last_quorum_entry();
+
+    // the quorum only changes when a new quorum entry is appended (or truncated away), so reuse the last parse until then
+    const auto quorum_entry = std::make_pair(log_entry.log_index, log_entry.term);
+    if (this->active_quorum_entry != quorum_entry)
+    {
+        this->active_quorum = raft::parse_active_quorum(log_entry);
+        this->active_quorum_entry = quorum_entry;
+    }
+
+    return this->active_quorum;
+}
 
+
+std::list<std::set<bzn::uuid_t>>
+raft::parse_active_quorum(const bzn::log_entry& log_entry)
+{
     auto extract_uuid = [](const auto& node_json) -> bzn::uuid_t
         {
             return node_json["uuid"].asString();
         };
 
-    bzn::log_entry log_entry = this->raft_log->last_quorum_entry();
     switch(log_entry.entry_type)
     {
         case bzn::log_entry_type::single_quorum:
@@ -1254,7 +1704,7 @@ raft::get_all_peers()
 bool
 raft::in_quorum(const bzn::uuid_t& uuid)
 {
-    for(const auto q : this->get_active_quorum())
+    for(const auto& q : this->get_active_quorum())
     {
         if (std::find(q.begin(), q.end(),uuid) != q.end())
         {
@@ -1289,13 +1739,10 @@ raft::create_dat_file(const std::string& log_path, const bzn::peers_list_t& peer
 
     const bzn::log_entry entry{bzn::log_entry_type::single_quorum, 0, 0, root};
 
-    std::ofstream os( log_path ,std::ios::out | std::ios::binary);
-    if (!os)
+    if (!bzn::raft_log::write_entries(log_path, {entry}))
     {
         throw std::runtime_error(ERROR_UNABLE_TO_CREATE_LOG_FILE_FOR_WRITING + log_path);
     }
-    os << entry;
-    os.close();
 }
 
 
@@ -1310,27 +1757,6 @@ raft::import_state_files()
 }
 
 
-bzn::log_entry_type
-raft::deduce_type_from_message(const bzn::json_message& message)
-{
-    if (message["msg"].isString())
-    {
-        return bzn::log_entry_type::database;
-    }
-
-    if (message["msg"]["peers"].isArray())
-    {
-        return bzn::log_entry_type::single_quorum;
-    }
-
-    if (message["msg"]["peers"].isMember("new"))
-    {
-        return bzn::log_entry_type::joint_quorum;
-    }
-    return bzn::log_entry_type::undefined;
-}
-
-
 std::string
 raft::get_name()
 {
@@ -1368,6 +1794,166 @@ raft::get_status()
 }
 
 
+std::string
+raft::snapshot_path()
+{
+    boost::filesystem::path out{this->state_dir};
+    out.append(this->get_uuid() + ".snapshot");
+    return out.string();
+}
+
+
+void
+raft::take_snapshot(uint32_t index)
+{
+    // capture storage as of this commit here (a checkpoint or copy), serializing it happens on the writer's thread
+    if (!this->storage->create_snapshot())
+    {
+        LOG(error) << "Unable to snapshot storage at index " << index;
+        return;
+    }
+
+    const auto& entry = this->raft_log->entry_at(index);
+    const auto quorum = this->raft_log->last_quorum_entry_before(index);
+
+    bzn::json_message snapshot;
+    snapshot["index"] = index;
+    snapshot["term"] = entry.term;
+    snapshot["entryType"] = uint32_t(entry.entry_type);
+    snapshot["entry"] = entry.message();
+    snapshot["quorumType"] = uint32_t(quorum.entry_type);
+    snapshot["quorumIndex"] = quorum.log_index;
+    snapshot["quorumTerm"] = quorum.term;
+    snapshot["quorum"] = quorum.msg;
+
+    this->snapshot_writer_index = index;
+    this->snapshot_writer = std::async(std::launch::async, [this, storage = this->storage, snapshot = std::move(snapshot), index]()
+    {
+        const auto data = storage->get_snapshot();
+        if (!data)
+        {
+            LOG(error) << "Unable to read storage snapshot at index " << index;
+            return false;
+        }
+
+        return this->write_snapshot_file(snapshot, *data);
+    });
+}
+
+
+void
+raft::complete_snapshot(bool wait)
+{
+    if (!this->snapshot_writer.valid())
+    {
+        return;
+    }
+
+    if (!wait && this->snapshot_writer.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+        return;
+    }
+
+    const uint32_t index = this->snapshot_writer_index;
+
+    // the snapshot has to be safely on disk before the entries it replaces are dropped
+    if (!this->snapshot_writer.get())
+    {
+        LOG(error) << "Unable to save snapshot at index " << index;
+        return;
+    }
+
+    if (index <= this->raft_log->first_index() || index >= this->raft_log->size())
+    {
+        return;
+    }
+
+    const auto dropped = index - this->raft_log->first_index();
+    this->raft_log->compact(index);
+
+    LOG(info) << "Snapshot taken at index " << index << ", " << dropped << " log entries compacted";
+}
+
+
+bool
+raft::write_snapshot_file(const bzn::json_message& snapshot, const std::string& data)
+{
+    // snapshot description on the first line, storage snapshot after it
+    const std::string tmp_path = this->snapshot_path() + ".tmp";
+    const int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        LOG(error) << "Unable to create " << tmp_path << ": " << std::strerror(errno);
+        return false;
+    }
+
+    // the log is compacted as soon as this returns, so the snapshot must already be on disk
+    const bool written = write_fully(fd, Json::FastWriter().write(snapshot)) && write_fully(fd, data) && ::fsync(fd) == 0;
+    if (!written)
+    {
+        LOG(error) << "Unable to write " << tmp_path << ": " << std::strerror(errno);
+    }
+    ::close(fd);
+
+    if (!written)
+    {
+        return false;
+    }
+
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmp_path, this->snapshot_path(), ec);
+    if (ec)
+    {
+        LOG(error) << "Unable to rename " << tmp_path << ": " << ec.message();
+        return false;
+    }
+
+    if (!sync_directory(this->state_dir.empty() ? "." : this->state_dir))
+    {
+        LOG(error) << "Unable to sync " << this->state_dir << ": " << std::strerror(errno);
+        return false;
+    }
+
+    return true;
+}
+
+
+bool
+raft::read_snapshot_file(bzn::json_message& snapshot, std::string* data)
+{
+    std::ifstream is(this->snapshot_path(), std::ios::in | std::ios::binary);
+    std::string line;
+
+    if (!is || !std::getline(is, line) || !Json::Reader().parse(line, snapshot))
+    {
+        return false;
+    }
+
+    if (data)
+    {
+        std::stringstream rest;
+        rest << is.rdbuf();
+        *data = rest.str();
+    }
+
+    return true;
+}
+
+
+void
+raft::set_protobuf_enabled(bool val)
+{
+    this->enable_protobuf = val;
+}
+
+
+void
+raft::set_snapshot_threshold(size_t threshold)
+{
+    this->snapshot_threshold = threshold;
+}
+
+
 void
 raft::shutdown_on_exceeded_max_storage(bool do_throw)
 {
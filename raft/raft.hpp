@@ -20,10 +20,12 @@
 #include <raft/raft_base.hpp>
 #include <raft/log_entry.hpp>
 #include <raft/raft_log.hpp>
+#include <proto/raft.pb.h>
 #include <storage/mem_storage.hpp>
 #include <node/node_base.hpp>
 #include <gtest/gtest_prod.h>
 #include <fstream>
+#include <future>
 #include <optional>
 
 namespace
@@ -51,6 +53,11 @@ namespace
 
 namespace bzn
 {
+    // most consecutive log entries carried by one AppendEntries request
+    const size_t MAX_APPEND_ENTRIES_BATCH_SIZE = 64;
+
+    // most unacknowledged AppendEntries requests outstanding to one peer
+    const size_t MAX_APPEND_ENTRIES_IN_FLIGHT = 4;
 
     class raft final : public bzn::raft_base, public bzn::status_provider_base, public std::enable_shared_from_this<raft>
     {
@@ -86,11 +93,24 @@ namespace bzn
 
         void set_audit_enabled(bool val);
 
+        /**
+         * Snapshot storage and compact the log every time this many entries have been committed since the last snapshot
+         * @param threshold number of entries, zero disables snapshots
+         */
+        void set_snapshot_threshold(size_t threshold);
+
+        /**
+         * Send raft RPCs to peers in protobuf rather than JSON. Both are always accepted, and replies go back in the
+         * encoding of the request, so this can stay off while older nodes are still in the swarm.
+         */
+        void set_protobuf_enabled(bool val);
+
     private:
         friend class raft_log;
         FRIEND_TEST(raft, test_raft_timeout_scale_can_get_set);
         FRIEND_TEST(raft, test_that_raft_can_rehydrate_state_and_log_entries);
         FRIEND_TEST(raft_test, test_that_raft_can_rehydrate_storage);
+        FRIEND_TEST(raft_test, test_that_leader_sends_protobuf_rpcs_when_enabled);
         FRIEND_TEST(raft_test, test_that_in_a_leader_state_will_send_a_heartbeat_to_its_peers);
         FRIEND_TEST(raft_test, test_that_leader_sends_entries_and_commits_when_enough_peers_have_saved_them);
         FRIEND_TEST(raft_test, test_that_start_randomly_schedules_callback_for_starting_an_election_and_wins);
@@ -123,6 +143,15 @@ namespace bzn
         FRIEND_TEST(raft_peers_test, test_that_raft_tries_again_when_encountering_a_candidate);
         FRIEND_TEST(raft_test, test_that_non_leaders_cannot_add_peers);
         FRIEND_TEST(raft_test, test_that_non_leaders_cannot_remove_peers);
+        FRIEND_TEST(raft_test, test_that_lagging_follower_catches_up_in_batches);
+        FRIEND_TEST(raft_test, test_that_rejected_append_entries_backtracks_to_the_conflicting_term);
+        FRIEND_TEST(raft_test, test_that_raft_snapshots_storage_and_compacts_its_log);
+        FRIEND_TEST(raft_test, test_that_raft_restarts_from_snapshot_and_log_tail);
+        FRIEND_TEST(raft_test, test_that_raft_restarts_with_batched_writes_in_its_log);
+        FRIEND_TEST(raft_test, test_that_leader_sends_snapshot_to_follower_behind_compacted_log);
+        FRIEND_TEST(raft_test, test_that_commit_checks_use_the_quorum_at_the_start_of_a_long_log);
+        FRIEND_TEST(raft_test, test_that_install_snapshot_is_refused_from_a_stale_term_or_when_malformed);
+        FRIEND_TEST(raft_test, test_that_install_snapshot_from_a_newer_term_is_installed);
 
         bzn::peer_address_t get_leader_unsafe();
 
@@ -132,17 +161,25 @@ namespace bzn
         void handle_heartbeat_timeout(const boost::system::error_code& ec);
 
         void request_append_entries();
-        void handle_request_append_entries_response(const bzn::json_message& msg, std::shared_ptr<bzn::session_base> session);
+        void send_append_entries(const bzn::peer_address_t& peer);
+        void fill_append_entries_pipeline(const bzn::peer_address_t& peer);
+        void send_snapshot(const bzn::peer_address_t& peer);
+        void handle_request_append_entries_response(const raft_msg& msg, std::shared_ptr<bzn::session_base> session);
 
         void start_election_timer();
         void handle_election_timeout(const boost::system::error_code& ec);
 
         void request_vote_request();
-        void handle_request_vote_response(const bzn::json_message& msg, std::shared_ptr<bzn::session_base> session);
+        void handle_request_vote_response(const raft_msg& msg, std::shared_ptr<bzn::session_base> session);
 
         void handle_ws_raft_messages(const bzn::json_message& msg, std::shared_ptr<bzn::session_base> session);
-        void handle_ws_request_vote(const bzn::json_message& msg, std::shared_ptr<bzn::session_base> session);
-        void handle_ws_append_entries(const bzn::json_message& msg, std::shared_ptr<bzn::session_base> session);
+        void handle_raft_protobuf_message(const bzn_envelope& msg, std::shared_ptr<bzn::session_base> session);
+        void handle_raft_message(const raft_msg& msg, std::shared_ptr<bzn::session_base> session);
+        void send_raft_message(const boost::asio::ip::tcp::endpoint& ep, const raft_msg& msg);
+        void send_raft_reply(std::shared_ptr<bzn::session_base> session, const raft_msg& msg);
+        void handle_request_vote(const raft_msg& msg, std::shared_ptr<bzn::session_base> session);
+        void handle_append_entries(const raft_msg& msg, std::shared_ptr<bzn::session_base> session);
+        void handle_install_snapshot(const raft_msg& msg, std::shared_ptr<bzn::session_base> session);
 
         void update_raft_state(uint32_t term, bzn::raft_state state);
 
@@ -168,16 +205,22 @@ namespace bzn
 
         bool is_majority(const std::set<bzn::uuid_t>& votes);
         uint32_t last_majority_replicated_log_index();
-        std::list<std::set<bzn::uuid_t>> get_active_quorum();
+        const std::list<std::set<bzn::uuid_t>>& get_active_quorum();
+        static std::list<std::set<bzn::uuid_t>> parse_active_quorum(const bzn::log_entry& log_entry);
         bool in_quorum(const bzn::uuid_t& uuid);
         bzn::peers_list_t get_all_peers();
 
         void notify_leader_status();
         void notify_commit(size_t log_index, const std::string& operation);
-        bzn::log_entry_type deduce_type_from_message(const bzn::json_message& message);
 
         void shutdown_on_exceeded_max_storage(bool do_throw = false);
 
+        std::string snapshot_path();
+        void take_snapshot(uint32_t index);
+        void complete_snapshot(bool wait);
+        bool write_snapshot_file(const bzn::json_message& snapshot, const std::string& data);
+        bool read_snapshot_file(bzn::json_message& snapshot, std::string* data);
+
         void send_session_error_message(std::shared_ptr<bzn::session_base> session, const std::string& error_message);
 
         bool validate_new_peer(std::shared_ptr<bzn::session_base> session, const bzn::json_message &peer);
@@ -209,6 +252,14 @@ namespace bzn
         // track peer's match index...
         std::map<bzn::uuid_t, uint32_t> peer_match_index;
 
+        // next entry to send each peer (ahead of the match index while requests are in flight)...
+        std::map<bzn::uuid_t, uint32_t> peer_next_index;
+        std::map<bzn::uuid_t, size_t> peer_in_flight;
+
+        // peers that need entries we no longer have, and when each was last sent our snapshot...
+        std::set<bzn::uuid_t> peers_needing_snapshot;
+        std::map<bzn::uuid_t, std::chrono::steady_clock::time_point> peer_snapshot_sent;
+
         // misc...
         bzn::uuid_t uuid;
         bzn::uuid_t leader;
@@ -220,13 +271,28 @@ namespace bzn
 
         std::shared_ptr<bzn::raft_log> raft_log;
 
+        // active quorum as parsed from the quorum entry at (index, term)...
+        std::optional<std::pair<uint32_t, uint32_t>> active_quorum_entry;
+        std::list<std::set<bzn::uuid_t>> active_quorum;
+        std::shared_ptr<bzn::storage_base> storage;
+        size_t snapshot_threshold = 0;
+
         const std::string state_dir;
 
         bool enable_audit = true;
+        bool enable_protobuf = false;
 
         bool enable_peer_validation{false}; // TODO: RHN - this is only temporary, until the security functionality is tested and in use.
         std::string signed_key;
 
         bool in_a_swarm = false;
+
+        // snapshot being written off the raft thread and the index the log can be compacted to once it is on disk;
+        // declared last so that destruction waits for the writer before anything it uses goes away
+        std::future<bool> snapshot_writer;
+        uint32_t snapshot_writer_index = 0;
+
+        // snapshot being read and sent to a peer off the raft thread; it takes raft_lock to send, so it goes first of all
+        std::future<void> snapshot_reader;
     };
 } // bzn
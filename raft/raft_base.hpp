@@ -85,6 +85,19 @@ namespace bzn
     }
 
 
+    // entries following the one in "entries" travel in "batch" so peers that only read "entries" still make progress
+    inline void
+    add_append_entries_batch_entry(bzn::json_message& msg, const bzn::log_entry& entry)
+    {
+        bzn::json_message batch_entry;
+
+        batch_entry["entryTerm"] = entry.term;
+        batch_entry["entries"] = entry.message();
+
+        msg["data"]["batch"].append(batch_entry);
+    }
+
+
     inline bzn::json_message
     create_append_entries_response(const bzn::uuid_t& uuid, uint32_t current_term, bool success, uint32_t match_index)
     {
@@ -102,6 +115,26 @@ namespace bzn
     }
 
 
+    // snapshot describes the last entry the storage snapshot includes, data is the base64 encoded storage snapshot
+    inline bzn::json_message
+    create_install_snapshot_request(const bzn::uuid_t& uuid, uint32_t current_term, uint32_t commit_index, const bzn::json_message& snapshot,
+        const std::string& data)
+    {
+        bzn::json_message msg;
+
+        msg["bzn-api"] = "raft";
+        msg["cmd"] = "InstallSnapshot";
+        msg["data"] = bzn::json_message();
+        msg["data"]["from"] = uuid;
+        msg["data"]["term"] = current_term;
+        msg["data"]["commitIndex"] = commit_index;
+        msg["data"]["snapshot"] = snapshot;
+        msg["data"]["data"] = data;
+
+        return msg;
+    }
+
+
     class raft_base
     {
     public:
@@ -15,80 +15,684 @@
 #include "raft_log.hpp"
 
 #include <fstream>
+#include <boost/crc.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <iostream>
+#include <limits>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace
+{
+    // The log file starts with RAFT_LOG_MAGIC followed by one record per entry:
+    //
+    //   uint32 payload size | uint32 crc32 of payload | uint32 crc32 of the previous 8 bytes | payload
+    //
+    // where the payload is:
+    //
+    //   uint8 entry type | uint32 log index | uint32 term | uint8 message encoding | message
+    //
+    // Integers are little endian. A record cut short by a crash can only be the last one in the file and is
+    // dropped on load, any other damage is fatal. The header checksum is what tells the two apart: a size that
+    // points past the end of the file is only trusted to be a torn append if the header it came from is intact.
+    const std::string RAFT_LOG_MAGIC{"BZNRLOG1"};
+    const size_t RECORD_HEADER_SIZE = 12;
+    const size_t PAYLOAD_HEADER_SIZE = 10;
+
+    enum class message_encoding : uint8_t
+    {
+        json = 0,   // Json::FastWriter text
+        database    // {"bzn-api": api, "msg": base64} stored as uint8 api length, api and the decoded msg bytes
+    };
+
+
+    void
+    put_uint32(std::string& out, uint32_t value)
+    {
+        for (size_t i = 0; i < 4; ++i)
+        {
+            out.push_back(char((value >> (8 * i)) & 0xff));
+        }
+    }
+
+
+    uint32_t
+    get_uint32(const char* data)
+    {
+        uint32_t value = 0;
+        for (size_t i = 0; i < 4; ++i)
+        {
+            value |= uint32_t(uint8_t(data[i])) << (8 * i);
+        }
+        return value;
+    }
+
+
+    uint32_t
+    checksum(const char* data, size_t size)
+    {
+        boost::crc_32_type crc;
+        crc.process_bytes(data, size);
+        return crc.checksum();
+    }
+
+
+    bool
+    is_quorum_entry(const bzn::log_entry& entry)
+    {
+        return entry.entry_type == bzn::log_entry_type::single_quorum || entry.entry_type == bzn::log_entry_type::joint_quorum;
+    }
+
+
+    std::string
+    encode_record(const bzn::log_entry& entry)
+    {
+        std::string payload;
+        payload.push_back(char(entry.entry_type));
+        put_uint32(payload, entry.log_index);
+        put_uint32(payload, entry.term);
+
+        const bool database = entry.data || bzn::is_database_message(entry.msg);
+        const std::string api = database ? entry.msg["bzn-api"].asString() : std::string();
+
+        if (database && api.size() <= std::numeric_limits<uint8_t>::max())
+        {
+            payload.push_back(char(message_encoding::database));
+            payload.push_back(char(api.size()));
+            payload.append(api);
+            if (entry.data)
+            {
+                payload.append(*entry.data);
+            }
+            else
+            {
+                payload.append(boost::beast::detail::base64_decode(entry.msg["msg"].asString()));
+            }
+        }
+        else
+        {
+            payload.push_back(char(message_encoding::json));
+            payload.append(entry.json_to_string(entry.message()));
+        }
+
+        std::string record;
+        record.reserve(RECORD_HEADER_SIZE + payload.size());
+        put_uint32(record, uint32_t(payload.size()));
+        put_uint32(record, checksum(payload.data(), payload.size()));
+        put_uint32(record, checksum(record.data(), record.size()));
+        record.append(payload);
+
+        return record;
+    }
+
+
+    bool
+    decode_payload(const char* data, size_t size, bzn::log_entry& entry)
+    {
+        if (size < PAYLOAD_HEADER_SIZE)
+        {
+            return false;
+        }
+
+        entry.entry_type = static_cast<bzn::log_entry_type>(data[0]);
+        entry.log_index = get_uint32(data + 1);
+        entry.term = get_uint32(data + 5);
+        entry.msg = bzn::json_message();
+        entry.data.reset();
+
+        const auto encoding = static_cast<message_encoding>(data[9]);
+        const char* message = data + PAYLOAD_HEADER_SIZE;
+        const size_t message_size = size - PAYLOAD_HEADER_SIZE;
+
+        switch (encoding)
+        {
+            case message_encoding::json:
+            {
+                Json::Reader reader;
+                return reader.parse(message, message + message_size, entry.msg);
+            }
+
+            case message_encoding::database:
+            {
+                const size_t api_size = message_size ? uint8_t(message[0]) : 0;
+                if (!message_size || api_size + 1 > message_size)
+                {
+                    return false;
+                }
+
+                entry.msg["bzn-api"] = std::string(message + 1, api_size);
+                entry.data = std::string(message + 1 + api_size, message_size - 1 - api_size);
+                return true;
+            }
+
+            default:
+                return false;
+        }
+    }
+}
 
 
 namespace bzn
 {
+    bool
+    write_fully(int fd, const std::string& buffer)
+    {
+        const char* data = buffer.data();
+        size_t remaining = buffer.size();
+        while (remaining)
+        {
+            const ssize_t written = ::write(fd, data, remaining);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            data += written;
+            remaining -= size_t(written);
+        }
+        return true;
+    }
+
+
+    bool
+    sync_directory(const std::string& path)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        const bool synced = ::fsync(fd) == 0;
+        ::close(fd);
+        return synced;
+    }
+
+
     raft_log::raft_log(const std::string& log_path, const size_t maximum_storage)
             :  maximum_storage(maximum_storage), entries_log_path(log_path)
     {
         if (boost::filesystem::exists(this->entries_log_path))
+        {
+            raft_log::convert_legacy_log(this->entries_log_path);
+
+            this->load_entries();
+        }
+
+        if (this->log_entries.empty())
+        {
+            throw std::runtime_error(MSG_ERROR_EMPTY_LOG_ENTRY_FILE);
+        }
+    }
+
+
+    raft_log::~raft_log()
+    {
+        try
+        {
+            this->sync();
+        }
+        catch (const std::exception& ex)
+        {
+            LOG(error) << ex.what();
+        }
+
+        this->close_log_file();
+    }
+
+
+    void
+    raft_log::load_entries()
+    {
+        std::string data(boost::filesystem::file_size(this->entries_log_path), '\0');
         {
             std::ifstream is(this->entries_log_path, std::ios::in | std::ios::binary);
+            if (!is.read(&data[0], data.size()))
+            {
+                throw std::runtime_error(MSG_ERROR_CORRUPT_LOG_ENTRY);
+            }
+        }
+
+        if (data.empty())
+        {
+            return;
+        }
+
+        if (data.compare(0, RAFT_LOG_MAGIC.size(), RAFT_LOG_MAGIC) != 0)
+        {
+            throw std::runtime_error(MSG_ERROR_CORRUPT_LOG_ENTRY);
+        }
+
+        size_t offset = RAFT_LOG_MAGIC.size();
+        while (offset < data.size())
+        {
+            const size_t remaining = data.size() - offset;
+            const char* header = data.data() + offset;
+
+            if (remaining < RECORD_HEADER_SIZE)
+            {
+                this->discard_torn_tail(offset);
+                break;
+            }
+
+            if (checksum(header, 8) != get_uint32(header + 8))
+            {
+                throw std::runtime_error(MSG_ERROR_CORRUPT_LOG_ENTRY);
+            }
+
+            const size_t payload_size = get_uint32(header);
+            const char* payload = header + RECORD_HEADER_SIZE;
+
+            // the size is genuine, so a record running past the end of the file is the append a crash cut short, as
+            // is a damaged payload when it is the last thing in the file...
+            if (remaining - RECORD_HEADER_SIZE < payload_size)
+            {
+                this->discard_torn_tail(offset);
+                break;
+            }
+
+            if (checksum(payload, payload_size) != get_uint32(header + 4))
+            {
+                if (remaining - RECORD_HEADER_SIZE == payload_size)
+                {
+                    this->discard_torn_tail(offset);
+                    break;
+                }
+
+                throw std::runtime_error(MSG_ERROR_CORRUPT_LOG_ENTRY);
+            }
+
+            bzn::log_entry log_entry;
+            if (!decode_payload(payload, payload_size, log_entry))
+            {
+                throw std::runtime_error(MSG_ERROR_CORRUPT_LOG_ENTRY);
+            }
+
+            if (is_quorum_entry(log_entry))
+            {
+                this->quorum_entry_index = log_entry.log_index;
+            }
+
+            this->log_entries.emplace_back(std::move(log_entry));
+            this->entry_offsets.emplace_back(offset);
+            offset += RECORD_HEADER_SIZE + payload_size;
+        }
+
+        // a compacted log starts with the last entry covered by the snapshot rather than at zero
+        if (!this->log_entries.empty())
+        {
+            this->start_index = this->log_entries.front().log_index;
+        }
+
+        this->total_memory_used = boost::filesystem::file_size(this->entries_log_path);
+    }
+
+
+    void
+    raft_log::discard_torn_tail(size_t offset)
+    {
+        LOG(warning) << "Discarding incomplete entry at the end of the raft log: " << this->entries_log_path;
+
+        boost::filesystem::resize_file(this->entries_log_path, offset);
+    }
+
+
+    bool
+    raft_log::write_entries(const std::string& log_path, const std::vector<bzn::log_entry>& entries, std::vector<size_t>* offsets)
+    {
+        const int fd = ::open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        if (offsets)
+        {
+            offsets->clear();
+        }
+
+        // written in chunks, as a whole log held in memory twice over would be too much...
+        const size_t CHUNK_SIZE = 1 << 20;
+
+        bool written = true;
+        size_t offset = RAFT_LOG_MAGIC.size();
+        std::string buffer = RAFT_LOG_MAGIC;
+        for (const auto& entry : entries)
+        {
+            const std::string record = encode_record(entry);
+            if (offsets)
+            {
+                offsets->emplace_back(offset);
+            }
+            buffer.append(record);
+            offset += record.size();
+
+            if (buffer.size() >= CHUNK_SIZE)
+            {
+                written = written && write_fully(fd, buffer);
+                buffer.clear();
+            }
+        }
+
+        // callers rename this over a log, so it has to be on disk before it replaces the entries it holds
+        written = written && write_fully(fd, buffer) && ::fsync(fd) == 0;
+        ::close(fd);
+
+        return written;
+    }
+
+
+    bool
+    raft_log::convert_legacy_log(const std::string& log_path)
+    {
+        {
+            std::ifstream is(log_path, std::ios::in | std::ios::binary);
+            std::string magic(RAFT_LOG_MAGIC.size(), '\0');
+            if (is.read(&magic[0], magic.size()) && magic == RAFT_LOG_MAGIC)
+            {
+                return false;
+            }
+        }
+
+        std::vector<bzn::log_entry> entries;
+        {
+            std::ifstream is(log_path, std::ios::in | std::ios::binary);
             bzn::log_entry log_entry;
             while (is >> log_entry)
             {
-                this->log_entries.emplace_back(log_entry);
+                entries.emplace_back(log_entry);
             }
-            this->total_memory_used = boost::filesystem::file_size(this->entries_log_path);
         }
 
-        if (this->log_entries.empty())
+        if (entries.empty())
         {
-            throw std::runtime_error(MSG_ERROR_EMPTY_LOG_ENTRY_FILE);
+            return false;
+        }
+
+        // convert into a copy so a crash part way through leaves the legacy log intact (write_entries syncs the copy
+        // before it can replace the original, and the directory is synced so the rename itself survives)
+        const std::string converted_path = log_path + ".converting";
+        if (!raft_log::write_entries(converted_path, entries))
+        {
+            throw std::runtime_error(MSG_UNABLE_TO_CREATE_LOG_PATH_NAMED + converted_path);
         }
+        boost::filesystem::rename(converted_path, log_path);
+
+        const auto dir = boost::filesystem::path(log_path).parent_path().string();
+        if (!sync_directory(dir.empty() ? "." : dir))
+        {
+            throw std::runtime_error(MSG_ERROR_WRITING_LOG + log_path + ": " + std::strerror(errno));
+        }
+
+        LOG(info) << "Converted legacy raft log " << log_path << " (" << entries.size() << " entries) to the binary format";
+
+        return true;
     }
 
 
     const bzn::log_entry&
     raft_log::entry_at(size_t i) const
     {
-        return this->log_entries.at(i);
+        if (i < this->start_index)
+        {
+            throw std::out_of_range(MSG_ENTRY_COMPACTED);
+        }
+        return this->log_entries.at(i - this->start_index);
+    }
+
+
+    size_t
+    raft_log::first_index() const
+    {
+        return this->start_index;
     }
 
 
     const bzn::log_entry&
     raft_log::last_quorum_entry() const
     {
-        // TODO: Speed this up by not doing a search, when a quorum entry is added, simply store the index. Perhaps only do the search if the index is wrong.
-        auto result = std::find_if(
-            this->log_entries.crbegin(),
-            this->log_entries.crend(),
-            [](const auto &entry)
+        if (this->quorum_entry_index)
+        {
+            return this->entry_at(*this->quorum_entry_index);
+        }
+
+        if (this->compacted_quorum_entry)
+        {
+            return *this->compacted_quorum_entry;
+        }
+
+        throw std::runtime_error(MSG_NO_PEERS_IN_LOG);
+    }
+
+
+    void
+    raft_log::set_compacted_quorum_entry(const bzn::log_entry& quorum_entry)
+    {
+        this->compacted_quorum_entry = quorum_entry;
+    }
+
+
+    void
+    raft_log::compact(size_t index)
+    {
+        if (index <= this->start_index || index >= this->size())
+        {
+            return;
+        }
+
+        // the quorum in force at the cut has to survive it...
+        const auto quorum_entry = this->last_quorum_entry_before(index);
+        if (this->quorum_entry_index && *this->quorum_entry_index < index)
+        {
+            this->quorum_entry_index.reset();
+        }
+
+        // keep the entry at index itself so its term is still around to check the entries that follow it
+        this->log_entries.erase(this->log_entries.begin(), this->log_entries.begin() + (index - this->start_index));
+        this->entry_offsets.erase(this->entry_offsets.begin(), this->entry_offsets.begin() + (index - this->start_index));
+        this->start_index = index;
+        this->compacted_quorum_entry = quorum_entry;
+
+        this->replace_log_file();
+    }
+
+
+    void
+    raft_log::reset(const bzn::log_entry& base_entry, const bzn::log_entry& quorum_entry)
+    {
+        this->log_entries.clear();
+        this->log_entries.emplace_back(base_entry);
+        this->start_index = base_entry.log_index;
+        this->compacted_quorum_entry = quorum_entry;
+        this->quorum_entry_index.reset();
+        if (is_quorum_entry(base_entry))
+        {
+            this->quorum_entry_index = base_entry.log_index;
+        }
+
+        this->replace_log_file();
+    }
+
+
+    bzn::log_entry
+    raft_log::last_quorum_entry_before(size_t index) const
+    {
+        if (this->quorum_entry_index && *this->quorum_entry_index <= index)
+        {
+            return this->entry_at(*this->quorum_entry_index);
+        }
+
+        for (size_t i = std::min(index, this->size() - 1) + 1; i-- > this->start_index;)
+        {
+            if (is_quorum_entry(this->entry_at(i)))
+            {
+                return this->entry_at(i);
+            }
+        }
+
+        if (this->compacted_quorum_entry)
+        {
+            return *this->compacted_quorum_entry;
+        }
+
+        throw std::runtime_error(MSG_NO_PEERS_IN_LOG);
+    }
+
+
+    void
+    raft_log::replace_log_file()
+    {
+        // write the retained entries next to the log and swap them in, so a crash leaves one or the other
+        const std::string replacement_path = this->entries_log_path + ".compacting";
+        if (!raft_log::write_entries(replacement_path, this->log_entries, &this->entry_offsets))
+        {
+            throw std::runtime_error(MSG_UNABLE_TO_CREATE_LOG_PATH_NAMED + replacement_path);
+        }
+
+        // the replacement already holds anything still pending
+        this->pending_records.clear();
+        this->close_log_file();
+        boost::filesystem::rename(replacement_path, this->entries_log_path);
+        this->sync_log_directory();
+        this->total_memory_used = boost::filesystem::file_size(this->entries_log_path);
+    }
+
+
+    void
+    raft_log::sync_log_directory()
+    {
+        const auto dir = boost::filesystem::path(this->entries_log_path).parent_path().string();
+        if (!sync_directory(dir.empty() ? "." : dir))
+        {
+            throw std::runtime_error(MSG_ERROR_WRITING_LOG + this->entries_log_path + ": " + std::strerror(errno));
+        }
+    }
+
+
+    void
+    raft_log::open_log_file()
+    {
+        if (this->log_fd >= 0)
+        {
+            return;
+        }
+
+        boost::filesystem::path path{this->entries_log_path};
+        if (!boost::filesystem::exists(path.parent_path()))
+        {
+            boost::system::error_code ec;
+            if (!boost::filesystem::create_directories(path.parent_path(), ec))
             {
-                return (entry.entry_type == bzn::log_entry_type::single_quorum) ||
-                       (entry.entry_type == bzn::log_entry_type::joint_quorum);
-            });
-        if (result == this->log_entries.crend())
+                LOG(error) << "Unable to create path " << path.parent_path() << " with error code " << ec <<".";
+                throw std::runtime_error(MSG_EXITING_DUE_TO_LOG_PATH_CREATION_FAILURE);
+            }
+        }
+
+        this->log_fd = ::open(path.string().c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (this->log_fd < 0)
+        {
+            throw std::runtime_error(MSG_ERROR_WRITING_LOG + this->entries_log_path + ": " + std::strerror(errno));
+        }
+
+        const auto file_size = boost::filesystem::file_size(path);
+        if (file_size == 0 && this->pending_records.empty())
+        {
+            this->pending_records = RAFT_LOG_MAGIC;
+        }
+        this->total_memory_used = file_size + this->pending_records.size();
+    }
+
+
+    void
+    raft_log::close_log_file()
+    {
+        if (this->log_fd >= 0)
+        {
+            ::close(this->log_fd);
+            this->log_fd = -1;
+        }
+    }
+
+
+    void
+    raft_log::append_entry(const bzn::log_entry& log_entry)
+    {
+        if (is_quorum_entry(log_entry))
         {
-            throw std::runtime_error(MSG_NO_PEERS_IN_LOG);
+            this->quorum_entry_index = this->size();
         }
-        return *result;
+
+        this->log_entries.emplace_back(log_entry);
+        this->append_log_disk(log_entry);
     }
 
 
     void
     raft_log::append_log_disk(const bzn::log_entry& log_entry)
     {
-        if (!this->log_entry_out_stream.is_open())
+        this->open_log_file();
+
+        const std::string record = encode_record(log_entry);
+        this->entry_offsets.emplace_back(this->total_memory_used);
+        this->pending_records.append(record);
+        this->total_memory_used += record.size();
+    }
+
+
+    void
+    raft_log::sync()
+    {
+        if (this->pending_records.empty())
+        {
+            return;
+        }
+
+        this->open_log_file();
+
+        if (!write_fully(this->log_fd, this->pending_records) || ::fsync(this->log_fd) != 0)
+        {
+            throw std::runtime_error(MSG_ERROR_WRITING_LOG + this->entries_log_path + ": " + std::strerror(errno));
+        }
+
+        this->pending_records.clear();
+    }
+
+
+    void
+    raft_log::truncate_log(size_t position)
+    {
+        // everything before the cut stays where it is on disk, so only the discarded suffix costs anything
+        this->sync();
+        this->open_log_file();
+
+        const size_t offset = this->entry_offsets[position];
+        if (::ftruncate(this->log_fd, off_t(offset)) != 0)
         {
-            boost::filesystem::path path{this->entries_log_path};
-            if (!boost::filesystem::exists(path.parent_path()))
+            throw std::runtime_error(MSG_ERROR_WRITING_LOG + this->entries_log_path + ": " + std::strerror(errno));
+        }
+
+        this->log_entries.erase(this->log_entries.begin() + position, this->log_entries.end());
+        this->entry_offsets.erase(this->entry_offsets.begin() + position, this->entry_offsets.end());
+        this->total_memory_used = offset;
+
+        // a membership change the leader never committed may have gone with the suffix
+        if (this->quorum_entry_index && *this->quorum_entry_index >= this->size())
+        {
+            this->quorum_entry_index.reset();
+            for (size_t i = this->log_entries.size(); i-- > 0;)
             {
-                boost::system::error_code ec;
-                if (!boost::filesystem::create_directories(path.parent_path(), ec))
+                if (is_quorum_entry(this->log_entries[i]))
                 {
-                    LOG(error) << "Unable to create path " << path.parent_path() << " with error code " << ec <<".";
-                    throw std::runtime_error(MSG_EXITING_DUE_TO_LOG_PATH_CREATION_FAILURE);
+                    this->quorum_entry_index = this->start_index + i;
+                    break;
                 }
             }
-            this->log_entry_out_stream.open(path.string(), std::ios::out |  std::ios::binary | std::ios::app);
         }
-        this->log_entry_out_stream << log_entry;
-        this->log_entry_out_stream.flush();
-        this->total_memory_used = this->log_entry_out_stream.tellp();
     }
 
 
@@ -97,8 +701,7 @@ namespace bzn
     {
         LOG(debug) << "Appending " << log_entry_type_to_string(log_entry.entry_type) << " to my log: " << log_entry.msg.toStyledString();
 
-        this->log_entries.emplace_back(log_entry);
-        this->append_log_disk(log_entry);
+        this->append_entry(log_entry);
     }
 
 
@@ -110,31 +713,36 @@ namespace bzn
         // case 2: the index is right after the log
         // case 3: the index is after the log
 
-        if (index < this->log_entries.size() &&  log_entry.term == this->log_entries[index].term)
+        if (index <= this->start_index)
+        {
+            // already covered by the snapshot
+            return;
+        }
+
+        const size_t position = index - this->start_index;
+
+        if (position < this->log_entries.size() &&  log_entry.term == this->log_entries[position].term)
         {
             // we already have accepted this entry
             return;
         }
 
-        if (index < this->log_entries.size() &&  log_entry.term != this->log_entries[index].term)
+        if (position < this->log_entries.size() &&  log_entry.term != this->log_entries[position].term)
         {
             // throw away vector from index
-            this->log_entries.erase( this->log_entries.begin() + index, this->log_entries.end());
-            this->log_entries.emplace_back(log_entry);
+            this->truncate_log(position);
 
-            this->rewrite_log();
-            this->append_log_disk(log_entry);
+            this->append_entry(log_entry);
             return;
         }
 
-        if (index == this->log_entries.size())
+        if (position == this->log_entries.size())
         {
-            this->log_entries.emplace_back(log_entry);
-            this->append_log_disk(log_entry);
+            this->append_entry(log_entry);
             return;
         }
 
-        if (index > this->log_entries.size())
+        if (position > this->log_entries.size())
         {
             throw std::runtime_error(MSG_TRYING_TO_INSERT_INVALID_ENTRY);
         }
@@ -144,29 +752,23 @@ namespace bzn
     bool
     raft_log::entry_accepted(size_t previous_index, size_t previous_term) const
     {
-        if (previous_index < this->log_entries.size()-1)
+        if (previous_index >= this->size())
         {
             return false;
         }
-        return previous_term == this->log_entries[previous_index].term;
-    }
-
-
-    void
-    raft_log::rewrite_log()
-    {
-        boost::filesystem::remove(this->entries_log_path);
 
-        for(const auto& log_entry : this->log_entries)
+        // everything up to the snapshot was committed, so it matches whatever the leader has
+        if (previous_index < this->start_index)
         {
-            this->append_log_disk(log_entry);
+            return true;
         }
+        return previous_term == this->entry_at(previous_index).term;
     }
 
 
     size_t
     raft_log::size() const
     {
-        return this->log_entries.size();
+        return this->start_index + this->log_entries.size();
     }
 }
\ No newline at end of file
@@ -19,6 +19,7 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <optional>
 
 
 namespace bzn {
@@ -29,23 +30,74 @@ namespace bzn {
     const std::string MSG_UNABLE_TO_CREATE_LOG_PATH_NAMED{"Unable to create log path: "};
     const std::string MSG_EXITING_DUE_TO_LOG_PATH_CREATION_FAILURE{"MSG_EXITING_DUE_TO_LOG_PATH_CREATION_FAILURE"};
     const std::string MSG_ERROR_MAXIMUM_STORAGE_EXCEEDED{"Maximum storage has been exceeded, please update the options file."};
+    const std::string MSG_ERROR_CORRUPT_LOG_ENTRY{"Corrupt entry in raft log. Please delete .state folder."};
+    const std::string MSG_ENTRY_COMPACTED{"Log entry has been compacted into a snapshot."};
+    const std::string MSG_ERROR_WRITING_LOG{"Unable to write raft log: "};
     const size_t DEFAULT_MAX_STORAGE_SIZE{2147483648}; // The default maximum allowed storage for a node is 2G
 
+    /**
+     * Write the whole buffer to fd, retrying interrupted and partial writes
+     * @return false on error, with errno set
+     */
+    bool write_fully(int fd, const std::string& buffer);
+
+    /**
+     * fsync a directory, which is what makes a file created or renamed in it durable
+     * @return false on error, with errno set
+     */
+    bool sync_directory(const std::string& path);
+
     class raft_log
     {
     public:
         raft_log(const std::string& log_path, const size_t max_storage = bzn::DEFAULT_MAX_STORAGE_SIZE);
 
+        raft_log(const raft_log&) = delete;
+        raft_log& operator=(const raft_log&) = delete;
+
+        ~raft_log();
+
         const bzn::log_entry& entry_at(size_t i) const;
         const bzn::log_entry& last_quorum_entry() const;
 
         void leader_append_entry(const bzn::log_entry& log_entry);
         void follower_insert_entry(size_t index, const bzn::log_entry& log_entry);
 
+        /**
+         * Make every entry appended or inserted so far durable (a single write and fsync). Appends are only
+         * buffered until then, so call this before acknowledging them.
+         */
+        void sync();
+
         bool entry_accepted(size_t previous_index, size_t previous_term) const;
 
+        /**
+         * Index one past the last entry. Entries before first_index() have been compacted into a snapshot.
+         */
         size_t size() const;
 
+        /**
+         * Index of the oldest entry still held: the last entry covered by the snapshot, or 0 if there is none
+         */
+        size_t first_index() const;
+
+        /**
+         * Drop every entry before index, which must already be captured by a snapshot
+         */
+        void compact(size_t index);
+
+        /**
+         * Replace the whole log with a snapshot's last entry (used when a snapshot is installed from the leader)
+         */
+        void reset(const bzn::log_entry& base_entry, const bzn::log_entry& quorum_entry);
+
+        /**
+         * The quorum in force at the snapshot, answered by last_quorum_entry() when no later one is in the log
+         */
+        void set_compacted_quorum_entry(const bzn::log_entry& quorum_entry);
+
+        bzn::log_entry last_quorum_entry_before(size_t index) const;
+
         inline size_t memory_used() const {return this->total_memory_used;};
 
         inline const std::vector<log_entry>& get_log_entries()
@@ -59,15 +111,40 @@ namespace bzn {
             return this->maximum_storage < this->total_memory_used;
         }
 
+        /**
+         * Write a new log containing the given entries, replacing any existing file, and fsync it
+         * @return false if the file could not be written
+         */
+        static bool write_entries(const std::string& log_path, const std::vector<bzn::log_entry>& entries, std::vector<size_t>* offsets = nullptr);
+
+        /**
+         * Rewrite a log in the old text format (one line of base64 encoded JSON per entry) in the binary format.
+         * The constructor does this automatically.
+         * @return true if the log was converted, false if it was already binary or held no entries
+         */
+        static bool convert_legacy_log(const std::string& log_path);
+
     private:
+        void load_entries();
+        void discard_torn_tail(size_t offset);
+        void open_log_file();
+        void close_log_file();
+        void append_entry(const bzn::log_entry& log_entry);
         void append_log_disk(const bzn::log_entry& log_entry);
-        void rewrite_log();
+        void truncate_log(size_t position);
+        void replace_log_file();
+        void sync_log_directory();
 
         std::vector<log_entry> log_entries;
+        std::vector<size_t>     entry_offsets; // where each entry's record starts in the file
+        size_t                  start_index = 0;
+        std::optional<log_entry> compacted_quorum_entry;
+        std::optional<size_t>   quorum_entry_index; // latest quorum entry still in the log
         size_t                  total_memory_used = 0;
         const size_t            maximum_storage;
 
-        std::ofstream log_entry_out_stream;
+        int         log_fd = -1;
+        std::string pending_records; // appended but not yet written to the file
         const std::string entries_log_path;
     };
 }
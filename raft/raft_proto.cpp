@@ -0,0 +1,303 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <raft/raft_proto.hpp>
+#include <raft/log_entry.hpp>
+
+
+namespace
+{
+    void
+    entry_to_proto(uint32_t term, const bzn::json_message& entry, raft_entry& out)
+    {
+        out.set_term(term);
+
+        if (bzn::is_database_message(entry))
+        {
+            out.mutable_api_entry()->set_api(entry["bzn-api"].asString());
+            out.mutable_api_entry()->set_msg(boost::beast::detail::base64_decode(entry["msg"].asString()));
+        }
+        else
+        {
+            out.set_json(Json::FastWriter().write(entry));
+        }
+    }
+
+
+    bzn::json_message
+    entry_to_json(const raft_entry& entry)
+    {
+        bzn::json_message result;
+
+        if (entry.has_api_entry())
+        {
+            result["bzn-api"] = entry.api_entry().api();
+            result["msg"] = boost::beast::detail::base64_encode(entry.api_entry().msg());
+        }
+        else
+        {
+            Json::Reader().parse(entry.json(), result);
+        }
+
+        return result;
+    }
+
+
+    bzn::json_message
+    json_header(const std::string& cmd, const raft_msg& msg)
+    {
+        bzn::json_message result;
+
+        result["bzn-api"] = "raft";
+        result["cmd"] = cmd;
+        result["data"] = bzn::json_message();
+        result["data"]["from"] = msg.from();
+        result["data"]["term"] = msg.term();
+
+        return result;
+    }
+}
+
+
+namespace bzn
+{
+    raft_msg
+    create_raft_request_vote(const bzn::uuid_t& uuid, uint32_t term, uint32_t last_log_index, uint32_t last_log_term)
+    {
+        raft_msg msg;
+        msg.set_from(uuid);
+        msg.set_term(term);
+        msg.mutable_request_vote()->set_last_log_index(last_log_index);
+        msg.mutable_request_vote()->set_last_log_term(last_log_term);
+        return msg;
+    }
+
+
+    raft_msg
+    create_raft_vote_response(const bzn::uuid_t& uuid, uint32_t term, bool granted)
+    {
+        raft_msg msg;
+        msg.set_from(uuid);
+        msg.set_term(term);
+        msg.mutable_response_vote()->set_granted(granted);
+        return msg;
+    }
+
+
+    raft_msg
+    create_raft_append_entries(const bzn::uuid_t& uuid, uint32_t term, uint32_t commit_index, uint32_t prev_index, uint32_t prev_term)
+    {
+        raft_msg msg;
+        msg.set_from(uuid);
+        msg.set_term(term);
+        msg.mutable_append_entries()->set_prev_index(prev_index);
+        msg.mutable_append_entries()->set_prev_term(prev_term);
+        msg.mutable_append_entries()->set_commit_index(commit_index);
+        return msg;
+    }
+
+
+    raft_msg
+    create_raft_append_entries_reply(const bzn::uuid_t& uuid, uint32_t term, bool success, uint32_t match_index)
+    {
+        raft_msg msg;
+        msg.set_from(uuid);
+        msg.set_term(term);
+        msg.mutable_append_entries_reply()->set_success(success);
+        msg.mutable_append_entries_reply()->set_match_index(match_index);
+        return msg;
+    }
+
+
+    raft_msg
+    create_raft_install_snapshot(const bzn::uuid_t& uuid, uint32_t term, uint32_t commit_index, const bzn::json_message& snapshot, std::string data)
+    {
+        raft_msg msg;
+        msg.set_from(uuid);
+        msg.set_term(term);
+        msg.mutable_install_snapshot()->set_commit_index(commit_index);
+        msg.mutable_install_snapshot()->set_snapshot(Json::FastWriter().write(snapshot));
+        msg.mutable_install_snapshot()->set_data(std::move(data));
+        return msg;
+    }
+
+
+    void
+    log_entry_to_proto(const bzn::log_entry& entry, raft_entry& out)
+    {
+        if (!entry.data)
+        {
+            entry_to_proto(entry.term, entry.msg, out);
+            return;
+        }
+
+        out.set_term(entry.term);
+        out.mutable_api_entry()->set_api(entry.msg["bzn-api"].asString());
+        out.mutable_api_entry()->set_msg(*entry.data);
+    }
+
+
+    bzn::log_entry
+    proto_to_log_entry(const raft_entry& entry, uint32_t log_index)
+    {
+        if (entry.has_api_entry())
+        {
+            bzn::json_message header;
+            header["bzn-api"] = entry.api_entry().api();
+            return bzn::log_entry{bzn::log_entry_type::database, log_index, entry.term(), header, entry.api_entry().msg()};
+        }
+
+        bzn::json_message msg;
+        Json::Reader().parse(entry.json(), msg);
+        return bzn::make_log_entry(bzn::deduce_log_entry_type(msg), log_index, entry.term(), msg);
+    }
+
+
+    bool
+    raft_json_to_proto(const bzn::json_message& msg, raft_msg& out)
+    {
+        const std::string cmd = msg["cmd"].asString();
+        const bzn::json_message& data = msg["data"];
+
+        out.Clear();
+        out.set_from(data["from"].asString());
+        out.set_term(data["term"].asUInt());
+
+        if (cmd == "RequestVote")
+        {
+            out.mutable_request_vote()->set_last_log_index(data["lastLogIndex"].asUInt());
+            out.mutable_request_vote()->set_last_log_term(data["lastLogTerm"].asUInt());
+            return true;
+        }
+
+        if (cmd == "ResponseVote")
+        {
+            out.mutable_response_vote()->set_granted(data["granted"].asBool());
+            return true;
+        }
+
+        if (cmd == "AppendEntries")
+        {
+            auto append_entries = out.mutable_append_entries();
+            append_entries->set_prev_index(data["prevIndex"].asUInt());
+            append_entries->set_prev_term(data["prevTerm"].asUInt());
+            append_entries->set_commit_index(data["commitIndex"].asUInt());
+
+            // a heartbeat carries no entries at all...
+            if (!data["entries"].empty())
+            {
+                entry_to_proto(data["entryTerm"].asUInt(), data["entries"], *append_entries->add_entries());
+
+                for (const auto& batch_entry : data["batch"])
+                {
+                    entry_to_proto(batch_entry["entryTerm"].asUInt(), batch_entry["entries"], *append_entries->add_entries());
+                }
+            }
+            return true;
+        }
+
+        if (cmd == "AppendEntriesReply")
+        {
+            out.mutable_append_entries_reply()->set_success(data["success"].asBool());
+            out.mutable_append_entries_reply()->set_match_index(data["matchIndex"].asUInt());
+            return true;
+        }
+
+        if (cmd == "InstallSnapshot")
+        {
+            auto install_snapshot = out.mutable_install_snapshot();
+            install_snapshot->set_commit_index(data["commitIndex"].asUInt());
+            install_snapshot->set_snapshot(Json::FastWriter().write(data["snapshot"]));
+            install_snapshot->set_data(boost::beast::detail::base64_decode(data["data"].asString()));
+            return true;
+        }
+
+        return false;
+    }
+
+
+    bzn::json_message
+    raft_proto_to_json(const raft_msg& msg)
+    {
+        switch (msg.msg_case())
+        {
+            case raft_msg::kRequestVote:
+            {
+                auto result = json_header("RequestVote", msg);
+                result["data"]["lastLogIndex"] = msg.request_vote().last_log_index();
+                result["data"]["lastLogTerm"] = msg.request_vote().last_log_term();
+                return result;
+            }
+
+            case raft_msg::kResponseVote:
+            {
+                auto result = json_header("ResponseVote", msg);
+                result["data"]["granted"] = msg.response_vote().granted();
+                result["data"]["lastLogIndex"] = 0;
+                result["data"]["lastLogTerm"] = 0;
+                return result;
+            }
+
+            case raft_msg::kAppendEntries:
+            {
+                const auto& append_entries = msg.append_entries();
+
+                auto result = json_header("AppendEntries", msg);
+                result["data"]["prevIndex"] = append_entries.prev_index();
+                result["data"]["prevTerm"] = append_entries.prev_term();
+                result["data"]["commitIndex"] = append_entries.commit_index();
+                result["data"]["entries"] = bzn::json_message();
+                result["data"]["entryTerm"] = Json::UInt(0);
+
+                for (int i = 0; i < append_entries.entries_size(); ++i)
+                {
+                    const auto& entry = append_entries.entries(i);
+                    if (i == 0)
+                    {
+                        result["data"]["entries"] = entry_to_json(entry);
+                        result["data"]["entryTerm"] = entry.term();
+                        continue;
+                    }
+
+                    bzn::json_message batch_entry;
+                    batch_entry["entryTerm"] = entry.term();
+                    batch_entry["entries"] = entry_to_json(entry);
+                    result["data"]["batch"].append(batch_entry);
+                }
+                return result;
+            }
+
+            case raft_msg::kAppendEntriesReply:
+            {
+                auto result = json_header("AppendEntriesReply", msg);
+                result["data"]["success"] = msg.append_entries_reply().success();
+                result["data"]["matchIndex"] = msg.append_entries_reply().match_index();
+                return result;
+            }
+
+            case raft_msg::kInstallSnapshot:
+            {
+                auto result = json_header("InstallSnapshot", msg);
+                result["data"]["commitIndex"] = msg.install_snapshot().commit_index();
+                Json::Reader().parse(msg.install_snapshot().snapshot(), result["data"]["snapshot"]);
+                result["data"]["data"] = boost::beast::detail::base64_encode(msg.install_snapshot().data());
+                return result;
+            }
+
+            default:
+                return bzn::json_message();
+        }
+    }
+
+} // bzn
@@ -0,0 +1,68 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <include/bluzelle.hpp>
+#include <raft/log_entry.hpp>
+#include <proto/raft.pb.h>
+
+
+namespace bzn
+{
+    raft_msg create_raft_request_vote(const bzn::uuid_t& uuid, uint32_t term, uint32_t last_log_index, uint32_t last_log_term);
+
+    raft_msg create_raft_vote_response(const bzn::uuid_t& uuid, uint32_t term, bool granted);
+
+    /**
+     * AppendEntries without any entries (a heartbeat), add them with log_entry_to_proto
+     */
+    raft_msg create_raft_append_entries(const bzn::uuid_t& uuid, uint32_t term, uint32_t commit_index, uint32_t prev_index, uint32_t prev_term);
+
+    raft_msg create_raft_append_entries_reply(const bzn::uuid_t& uuid, uint32_t term, bool success, uint32_t match_index);
+
+    raft_msg create_raft_install_snapshot(const bzn::uuid_t& uuid, uint32_t term, uint32_t commit_index, const bzn::json_message& snapshot, std::string data);
+
+    /**
+     * Copy a log entry into an AppendEntries entry, database messages go as their raw bytes
+     * @param entry log entry
+     * @param out   wire entry
+     */
+    void log_entry_to_proto(const bzn::log_entry& entry, raft_entry& out);
+
+    /**
+     * Log entry for an AppendEntries entry received from the leader
+     * @param entry     wire entry
+     * @param log_index where it goes in the log
+     * @return the log entry
+     */
+    bzn::log_entry proto_to_log_entry(const raft_entry& entry, uint32_t log_index);
+
+    /**
+     * Convert a raft RPC (RequestVote, ResponseVote, AppendEntries, AppendEntriesReply or InstallSnapshot) received
+     * in JSON from a peer that does not send protobuf yet
+     * @param msg   message as built by the create_*_request/response helpers in raft_base.hpp
+     * @param out   wire message
+     * @return false if msg is not one of those RPCs (they stay JSON)
+     */
+    bool raft_json_to_proto(const bzn::json_message& msg, raft_msg& out);
+
+    /**
+     * Convert a raft RPC to the JSON understood by peers that do not receive protobuf yet
+     * @param msg   wire message
+     * @return the equivalent JSON message, null if msg holds no RPC
+     */
+    bzn::json_message raft_proto_to_json(const raft_msg& msg);
+
+} // bzn
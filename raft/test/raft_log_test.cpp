@@ -20,6 +20,7 @@
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
 #include <boost/filesystem/operations.hpp>
+#include <algorithm>
 
 using namespace ::testing;
 
@@ -70,6 +71,45 @@ namespace
         out.close();
     }
 
+    bzn::json_message
+    generate_database_message()
+    {
+        // same shape as the crud requests raft replicates: a base64 encoded protobuf in "msg"
+        bzn::json_message msg;
+        msg["bzn-api"] = "database";
+        msg["msg"] = boost::beast::detail::base64_encode(generate_test_string(120));
+        return msg;
+    }
+
+
+    void
+    create_legacy_entries_log(const std::string& path, size_t count)
+    {
+        std::ofstream out(path, std::ios::out | std::ios::binary);
+        out << bzn::log_entry{bzn::log_entry_type::single_quorum, 0, 0, bzn::json_message{}};
+
+        for (uint32_t i = 1; i < count; ++i)
+        {
+            out << bzn::log_entry{bzn::log_entry_type::database, i, 1, generate_database_message()};
+        }
+        out.close();
+    }
+
+
+    std::vector<bzn::log_entry>
+    read_legacy_entries_log(const std::string& path)
+    {
+        std::vector<bzn::log_entry> entries;
+        std::ifstream is(path, std::ios::in | std::ios::binary);
+        bzn::log_entry log_entry;
+        while (is >> log_entry)
+        {
+            entries.emplace_back(log_entry);
+        }
+        return entries;
+    }
+
+
     void
     create_state_file(const std::string& path, size_t term, size_t index)
     {
@@ -106,6 +146,7 @@ namespace bzn
         {
             sut.leader_append_entry(bzn::log_entry{bzn::log_entry_type::database, i, 1, generate_test_message()});
         }
+        sut.sync();
         EXPECT_EQ(size_t(boost::filesystem::file_size(test_path)), sut.memory_used());
 
         unlink(test_path.c_str());
@@ -113,7 +154,7 @@ namespace bzn
 
     TEST(raft_log, test_that_raft_throws_on_start_when_max_storage_is_exceeded)
     {
-        const size_t MAX_STORAGE_BYTES = 1000;
+        const size_t MAX_STORAGE_BYTES = 500;
         const std::string TEST_STATE_DIR = "./.raft_test_state";
         const std::string ENTRIES_LOG = TEST_STATE_DIR + "/" + TEST_NODE_UUID + ".dat";
         const std::string STATE_LOG = TEST_STATE_DIR + "/" + TEST_NODE_UUID + ".state";
@@ -142,4 +183,256 @@ namespace bzn
         }
         remove_folder(TEST_STATE_DIR);
     }
-}
\ No newline at end of file
+
+
+    TEST(raft_log, test_that_legacy_log_is_converted_to_binary)
+    {
+        const std::string test_path{"./raft_log_test.dat"};
+        unlink(test_path.c_str());
+
+        create_legacy_entries_log(test_path, 50);
+        const auto legacy_entries = read_legacy_entries_log(test_path);
+        const auto legacy_size = boost::filesystem::file_size(test_path);
+
+        {
+            bzn::raft_log sut(test_path);
+            EXPECT_EQ(sut.size(), legacy_entries.size());
+            EXPECT_LT(boost::filesystem::file_size(test_path), legacy_size);
+        }
+
+        // already converted...
+        EXPECT_FALSE(bzn::raft_log::convert_legacy_log(test_path));
+
+        bzn::raft_log sut(test_path);
+        ASSERT_EQ(sut.size(), legacy_entries.size());
+        for (size_t i = 0; i < sut.size(); ++i)
+        {
+            EXPECT_EQ(sut.entry_at(i).entry_type, legacy_entries[i].entry_type);
+            EXPECT_EQ(sut.entry_at(i).log_index, legacy_entries[i].log_index);
+            EXPECT_EQ(sut.entry_at(i).term, legacy_entries[i].term);
+            EXPECT_EQ(sut.entry_at(i).message(), legacy_entries[i].message());
+        }
+
+        unlink(test_path.c_str());
+    }
+
+
+    TEST(raft_log, test_that_raft_log_drops_torn_tail_and_rejects_corruption)
+    {
+        const std::string test_path{"./raft_log_test.dat"};
+        unlink(test_path.c_str());
+
+        ASSERT_TRUE(bzn::raft_log::write_entries(test_path, {bzn::log_entry{bzn::log_entry_type::single_quorum, 0, 0, bzn::json_message{}}}));
+        {
+            bzn::raft_log sut(test_path);
+            for (uint32_t i = 1; i < 10; ++i)
+            {
+                sut.leader_append_entry(bzn::log_entry{bzn::log_entry_type::database, i, 1, (i % 2) ? generate_database_message() : generate_test_message()});
+            }
+        }
+        const auto good_size = boost::filesystem::file_size(test_path);
+
+        // a crash part way through an append leaves a partial record at the end...
+        {
+            std::ofstream out(test_path, std::ios::out | std::ios::binary | std::ios::app);
+            out << std::string("\x40\x00\x00\x00\x01\x02", 6);
+        }
+        {
+            bzn::raft_log sut(test_path);
+            EXPECT_EQ(sut.size(), size_t(10));
+            EXPECT_EQ(boost::filesystem::file_size(test_path), good_size);
+        }
+
+        // ...but damage anywhere else is fatal
+        {
+            std::fstream io(test_path, std::ios::in | std::ios::out | std::ios::binary);
+            io.seekp(good_size / 2);
+            io.put('#');
+        }
+        EXPECT_THROW(bzn::raft_log sut(test_path), std::runtime_error);
+
+        unlink(test_path.c_str());
+    }
+
+
+    TEST(raft_log, test_that_raft_log_rejects_a_corrupt_record_length)
+    {
+        const std::string test_path{"./raft_log_test.dat"};
+        unlink(test_path.c_str());
+
+        ASSERT_TRUE(bzn::raft_log::write_entries(test_path, {bzn::log_entry{bzn::log_entry_type::single_quorum, 0, 0, bzn::json_message{}}}));
+        {
+            bzn::raft_log sut(test_path);
+            for (uint32_t i = 1; i < 10; ++i)
+            {
+                sut.leader_append_entry(bzn::log_entry{bzn::log_entry_type::database, i, 1, generate_database_message()});
+            }
+        }
+        const auto good_size = boost::filesystem::file_size(test_path);
+
+        // point the second record's length past the end of the file, which would pass for a torn append if the
+        // header weren't checked...
+        {
+            std::fstream io(test_path, std::ios::in | std::ios::out | std::ios::binary);
+            const size_t first_record = 8;
+            io.seekg(first_record);
+            unsigned char size[4];
+            io.read(reinterpret_cast<char*>(size), sizeof(size));
+            const size_t second_record = first_record + 12 + (size[0] | size[1] << 8 | size[2] << 16 | size[3] << 24);
+
+            io.seekp(second_record + 3);
+            io.put('\x7f');
+        }
+
+        // ...and none of the entries after it may be dropped
+        EXPECT_THROW(bzn::raft_log sut(test_path), std::runtime_error);
+        EXPECT_EQ(boost::filesystem::file_size(test_path), good_size);
+
+        unlink(test_path.c_str());
+    }
+
+
+    TEST(raft_log, test_that_raft_log_compacts_its_prefix)
+    {
+        const std::string test_path{"./raft_log_test.dat"};
+        unlink(test_path.c_str());
+
+        ASSERT_TRUE(bzn::raft_log::write_entries(test_path, {bzn::log_entry{bzn::log_entry_type::single_quorum, 0, 0, bzn::json_message{}}}));
+        {
+            bzn::raft_log sut(test_path);
+            for (uint32_t i = 1; i < 100; ++i)
+            {
+                sut.leader_append_entry(bzn::log_entry{bzn::log_entry_type::database, i, 1, generate_database_message()});
+            }
+            const auto full_size = sut.memory_used();
+
+            sut.compact(60);
+
+            EXPECT_EQ(sut.first_index(), size_t(60));
+            EXPECT_EQ(sut.size(), size_t(100));
+            EXPECT_LT(sut.memory_used(), full_size);
+            EXPECT_THROW(sut.entry_at(59), std::out_of_range);
+            EXPECT_EQ(sut.entry_at(60).log_index, uint32_t(60));
+
+            // the quorum entry went with the prefix but is still known...
+            EXPECT_EQ(sut.last_quorum_entry().entry_type, bzn::log_entry_type::single_quorum);
+
+            // ...and entries keep their indexes as the log grows
+            sut.leader_append_entry(bzn::log_entry{bzn::log_entry_type::database, 100, 2, generate_database_message()});
+            EXPECT_EQ(sut.entry_at(100).term, uint32_t(2));
+            EXPECT_TRUE(sut.entry_accepted(10, 1));
+            EXPECT_TRUE(sut.entry_accepted(100, 2));
+            EXPECT_FALSE(sut.entry_accepted(101, 2));
+        }
+
+        bzn::raft_log sut(test_path);
+        EXPECT_EQ(sut.first_index(), size_t(60));
+        EXPECT_EQ(sut.size(), size_t(101));
+        EXPECT_EQ(sut.entry_at(100).term, uint32_t(2));
+
+        // installing a snapshot from the leader replaces the whole log...
+        sut.reset(bzn::log_entry{bzn::log_entry_type::database, 500, 3, generate_database_message()},
+            bzn::log_entry{bzn::log_entry_type::single_quorum, 450, 3, bzn::json_message{}});
+        EXPECT_EQ(sut.first_index(), size_t(500));
+        EXPECT_EQ(sut.size(), size_t(501));
+        EXPECT_EQ(sut.last_quorum_entry().log_index, uint32_t(450));
+
+        unlink(test_path.c_str());
+    }
+
+
+    TEST(raft_log, test_that_follower_conflict_truncates_only_the_suffix)
+    {
+        const size_t ENTRY_COUNT = 20000;
+        const std::string test_path{"./raft_log_test.dat"};
+        unlink(test_path.c_str());
+
+        std::vector<bzn::log_entry> entries{bzn::log_entry{bzn::log_entry_type::single_quorum, 0, 0, bzn::json_message{}}};
+        ASSERT_TRUE(bzn::raft_log::write_entries(test_path, entries));
+        std::string prefix;
+        {
+            bzn::raft_log sut(test_path);
+            for (uint32_t i = 1; i < ENTRY_COUNT; ++i)
+            {
+                entries.emplace_back(bzn::log_entry{bzn::log_entry_type::database, i, 1, generate_database_message()});
+                sut.follower_insert_entry(i, entries.back());
+            }
+            sut.sync();
+
+            std::ifstream is(test_path, std::ios::in | std::ios::binary);
+            prefix.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+
+            // a new leader overwrites the last few entries...
+            for (uint32_t i = ENTRY_COUNT - 5; i < ENTRY_COUNT - 2; ++i)
+            {
+                sut.follower_insert_entry(i, bzn::log_entry{bzn::log_entry_type::database, i, 2, generate_database_message()});
+            }
+            sut.sync();
+
+            EXPECT_EQ(sut.size(), ENTRY_COUNT - 2);
+            EXPECT_EQ(sut.memory_used(), boost::filesystem::file_size(test_path));
+        }
+
+        // the surviving entries written on their own give the length of the untouched prefix
+        entries.resize(ENTRY_COUNT - 5);
+        ASSERT_TRUE(bzn::raft_log::write_entries(test_path + ".prefix", entries));
+        prefix.resize(boost::filesystem::file_size(test_path + ".prefix"));
+        unlink((test_path + ".prefix").c_str());
+
+        // ...and everything before them is left alone on disk
+        {
+            std::ifstream is(test_path, std::ios::in | std::ios::binary);
+            std::string data(prefix.size(), '\0');
+            ASSERT_TRUE(bool(is.read(&data[0], data.size())));
+            EXPECT_TRUE(data == prefix);
+        }
+
+        bzn::raft_log sut(test_path);
+        ASSERT_EQ(sut.size(), ENTRY_COUNT - 2);
+        EXPECT_EQ(sut.entry_at(ENTRY_COUNT - 6).term, uint32_t(1));
+        EXPECT_EQ(sut.entry_at(ENTRY_COUNT - 5).term, uint32_t(2));
+        EXPECT_EQ(sut.entry_at(ENTRY_COUNT - 3).term, uint32_t(2));
+        EXPECT_EQ(sut.entry_at(ENTRY_COUNT - 3).log_index, uint32_t(ENTRY_COUNT - 3));
+
+        unlink(test_path.c_str());
+    }
+
+
+    TEST(raft_log, test_that_raft_log_tracks_its_latest_quorum_entry)
+    {
+        const std::string test_path{"./raft_log_test.dat"};
+        unlink(test_path.c_str());
+
+        ASSERT_TRUE(bzn::raft_log::write_entries(test_path, {bzn::log_entry{bzn::log_entry_type::single_quorum, 0, 0, bzn::json_message{}}}));
+        bzn::raft_log sut(test_path);
+        for (uint32_t i = 1; i < 10; ++i)
+        {
+            sut.follower_insert_entry(i, bzn::log_entry{bzn::log_entry_type::database, i, 1, generate_database_message()});
+        }
+        EXPECT_EQ(sut.last_quorum_entry().log_index, uint32_t(0));
+
+        sut.follower_insert_entry(10, bzn::log_entry{bzn::log_entry_type::joint_quorum, 10, 1, bzn::json_message{}});
+        sut.follower_insert_entry(11, bzn::log_entry{bzn::log_entry_type::database, 11, 1, generate_database_message()});
+        EXPECT_EQ(sut.last_quorum_entry().log_index, uint32_t(10));
+        EXPECT_EQ(sut.last_quorum_entry().entry_type, bzn::log_entry_type::joint_quorum);
+
+        // a new leader that never saw the membership change overwrites it...
+        sut.follower_insert_entry(9, bzn::log_entry{bzn::log_entry_type::database, 9, 2, generate_database_message()});
+        EXPECT_EQ(sut.last_quorum_entry().log_index, uint32_t(0));
+
+        // ...and the tracked entry survives reloading and compaction
+        sut.follower_insert_entry(10, bzn::log_entry{bzn::log_entry_type::single_quorum, 10, 2, bzn::json_message{}});
+        sut.sync();
+        {
+            bzn::raft_log reloaded(test_path);
+            EXPECT_EQ(reloaded.last_quorum_entry().log_index, uint32_t(10));
+        }
+
+        sut.follower_insert_entry(11, bzn::log_entry{bzn::log_entry_type::database, 11, 2, generate_database_message()});
+        sut.compact(11);
+        EXPECT_EQ(sut.last_quorum_entry().log_index, uint32_t(10));
+        EXPECT_EQ(sut.last_quorum_entry().term, uint32_t(2));
+
+        unlink(test_path.c_str());
+    }
+}
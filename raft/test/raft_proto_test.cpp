@@ -0,0 +1,189 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <raft/raft_proto.hpp>
+#include <raft/raft_base.hpp>
+#include <proto/bluzelle.pb.h>
+#include <gtest/gtest.h>
+
+using namespace ::testing;
+
+namespace
+{
+    const bzn::uuid_t TEST_NODE_UUID{"f0645cc2-476b-485d-b589-217be3ca87d5"};
+
+
+    bzn::json_message
+    make_database_entry(const std::string& key, const std::string& value)
+    {
+        bzn_msg msg;
+        msg.mutable_db()->mutable_header()->set_db_uuid("fea3de28-72b1-4ed8-8469-f664d2ddb81f");
+        msg.mutable_db()->mutable_header()->set_nonce(42);
+        msg.mutable_db()->mutable_create()->set_key(key);
+        msg.mutable_db()->mutable_create()->set_value(value);
+
+        bzn::json_message entry;
+        entry["bzn-api"] = "database";
+        entry["msg"] = boost::beast::detail::base64_encode(msg.SerializeAsString());
+        return entry;
+    }
+
+
+    bzn::json_message
+    round_trip(const bzn::json_message& msg)
+    {
+        raft_msg wire_msg;
+        EXPECT_TRUE(bzn::raft_json_to_proto(msg, wire_msg));
+
+        raft_msg received;
+        EXPECT_TRUE(received.ParseFromString(wire_msg.SerializeAsString()));
+
+        return bzn::raft_proto_to_json(received);
+    }
+}
+
+
+TEST(raft_proto, test_that_vote_messages_round_trip)
+{
+    auto request = bzn::create_request_vote_request(TEST_NODE_UUID, 3, 17, 2);
+    EXPECT_EQ(round_trip(request), request);
+
+    auto response = bzn::create_request_vote_response(TEST_NODE_UUID, 3, true);
+    EXPECT_EQ(round_trip(response), response);
+
+    response = bzn::create_request_vote_response(TEST_NODE_UUID, 4, false);
+    EXPECT_EQ(round_trip(response), response);
+}
+
+
+TEST(raft_proto, test_that_heartbeat_round_trips)
+{
+    auto heartbeat = bzn::create_append_entries_request(TEST_NODE_UUID, 2, 5, 6, 2, 0, bzn::json_message());
+
+    raft_msg wire_msg;
+    ASSERT_TRUE(bzn::raft_json_to_proto(heartbeat, wire_msg));
+    EXPECT_EQ(wire_msg.append_entries().entries_size(), 0);
+
+    EXPECT_EQ(round_trip(heartbeat), heartbeat);
+}
+
+
+TEST(raft_proto, test_that_append_entries_batch_round_trips)
+{
+    bzn::json_message quorum;
+    quorum["msg"]["peers"].append("uuid1");
+
+    auto msg = bzn::create_append_entries_request(TEST_NODE_UUID, 2, 5, 6, 2, 2, make_database_entry("key0", "value0"));
+    bzn::add_append_entries_batch_entry(msg, bzn::log_entry{bzn::log_entry_type::database, 8, 2, make_database_entry("key1", "value1")});
+    bzn::add_append_entries_batch_entry(msg, bzn::log_entry{bzn::log_entry_type::single_quorum, 9, 3, quorum});
+
+    raft_msg wire_msg;
+    ASSERT_TRUE(bzn::raft_json_to_proto(msg, wire_msg));
+    ASSERT_EQ(wire_msg.append_entries().entries_size(), 3);
+
+    // database requests travel as raw bytes rather than base64 inside a json document...
+    EXPECT_TRUE(wire_msg.append_entries().entries(0).has_api_entry());
+    EXPECT_TRUE(wire_msg.append_entries().entries(1).has_api_entry());
+    EXPECT_FALSE(wire_msg.append_entries().entries(2).has_api_entry());
+    EXPECT_EQ(wire_msg.append_entries().entries(2).term(), uint32_t(3));
+
+    EXPECT_LT(wire_msg.ByteSizeLong(), Json::FastWriter().write(msg).size());
+
+    EXPECT_EQ(round_trip(msg), msg);
+}
+
+
+TEST(raft_proto, test_that_log_entries_travel_as_their_bytes)
+{
+    const auto database_msg = make_database_entry("key0", "value0");
+    const auto entry = bzn::make_log_entry(bzn::log_entry_type::database, 7, 2, database_msg);
+
+    // the log keeps the bytes rather than the base64...
+    ASSERT_TRUE(entry.data.has_value());
+    EXPECT_FALSE(entry.msg.isMember("msg"));
+    EXPECT_EQ(entry.message(), database_msg);
+
+    // ...and so does the wire
+    auto msg = bzn::create_raft_append_entries(TEST_NODE_UUID, 2, 5, 6, 2);
+    bzn::log_entry_to_proto(entry, *msg.mutable_append_entries()->add_entries());
+
+    bzn::json_message quorum;
+    quorum["msg"]["peers"].append("uuid1");
+    bzn::log_entry_to_proto(bzn::make_log_entry(bzn::log_entry_type::single_quorum, 8, 3, quorum), *msg.mutable_append_entries()->add_entries());
+
+    raft_msg received;
+    ASSERT_TRUE(received.ParseFromString(msg.SerializeAsString()));
+    ASSERT_EQ(received.append_entries().entries_size(), 2);
+    ASSERT_TRUE(received.append_entries().entries(0).has_api_entry());
+    EXPECT_EQ(received.append_entries().entries(0).api_entry().msg(), *entry.data);
+
+    const auto database_entry = bzn::proto_to_log_entry(received.append_entries().entries(0), 7);
+    EXPECT_EQ(database_entry.entry_type, bzn::log_entry_type::database);
+    EXPECT_EQ(database_entry.log_index, uint32_t(7));
+    EXPECT_EQ(database_entry.term, uint32_t(2));
+    EXPECT_EQ(database_entry.data, entry.data);
+    EXPECT_EQ(database_entry.message(), database_msg);
+
+    const auto quorum_entry = bzn::proto_to_log_entry(received.append_entries().entries(1), 8);
+    EXPECT_EQ(quorum_entry.entry_type, bzn::log_entry_type::single_quorum);
+    EXPECT_EQ(quorum_entry.term, uint32_t(3));
+    EXPECT_FALSE(quorum_entry.data.has_value());
+    EXPECT_EQ(quorum_entry.msg, quorum);
+
+    // peers still on json see the same message they always did
+    const auto json = bzn::raft_proto_to_json(received);
+    EXPECT_EQ(json["data"]["entries"], database_msg);
+    EXPECT_EQ(json["data"]["batch"][0]["entries"], quorum);
+}
+
+
+TEST(raft_proto, test_that_append_entries_reply_round_trips)
+{
+    auto reply = bzn::create_append_entries_response(TEST_NODE_UUID, 2, true, 11);
+    EXPECT_EQ(round_trip(reply), reply);
+
+    reply = bzn::create_append_entries_response(TEST_NODE_UUID, 2, false, 0);
+    EXPECT_EQ(round_trip(reply), reply);
+}
+
+
+TEST(raft_proto, test_that_install_snapshot_round_trips)
+{
+    bzn::json_message snapshot;
+    snapshot["index"] = 100;
+    snapshot["term"] = 4;
+    snapshot["quorum"]["peers"].append("uuid1");
+
+    auto msg = bzn::create_install_snapshot_request(TEST_NODE_UUID, 4, 100, snapshot,
+        boost::beast::detail::base64_encode(std::string("\0\1\2storage", 10)));
+
+    raft_msg wire_msg;
+    ASSERT_TRUE(bzn::raft_json_to_proto(msg, wire_msg));
+    EXPECT_EQ(wire_msg.install_snapshot().data(), std::string("\0\1\2storage", 10));
+
+    EXPECT_EQ(round_trip(msg), msg);
+}
+
+
+TEST(raft_proto, test_that_non_rpc_messages_are_not_converted)
+{
+    bzn::json_message msg;
+    msg["bzn-api"] = "raft";
+    msg["cmd"] = "get_peers";
+
+    raft_msg wire_msg;
+    EXPECT_FALSE(bzn::raft_json_to_proto(msg, wire_msg));
+
+    EXPECT_TRUE(bzn::raft_proto_to_json(raft_msg()).isNull());
+}
@@ -18,10 +18,12 @@
 #include <raft/raft.hpp>
 #include <raft/log_entry.hpp>
 #include <raft/raft_log.hpp>
+#include <raft/raft_proto.hpp>
 #include <storage/mem_storage.hpp>
 #include <boost/filesystem.hpp>
 #include <algorithm>
 #include <vector>
+#include <deque>
 #include <random>
 #include <stdlib.h>
 #include <proto/bluzelle.pb.h>
@@ -132,7 +134,7 @@ namespace
     {
         return rhs.log_index == lhs.log_index
                && rhs.term == lhs.term
-               && rhs.msg.toStyledString() == lhs.msg.toStyledString();
+               && rhs.message().toStyledString() == lhs.message().toStyledString();
     };
 
 
@@ -301,6 +303,28 @@ namespace
         message["msg"] = boost::beast::detail::base64_encode(msg.SerializeAsString());
         return message;
     }
+
+
+    // applies committed creates and deletes the way the crud module would
+    bzn::raft_base::commit_handler make_storage_commit_handler(std::shared_ptr<bzn::storage_base> storage)
+    {
+        return [storage](const bzn::json_message& entry)
+        {
+            bzn_msg msg;
+            if (msg.ParseFromString(boost::beast::detail::base64_decode(entry["msg"].asString())))
+            {
+                if (msg.db().has_create())
+                {
+                    storage->create(msg.db().header().db_uuid(), msg.db().create().key(), msg.db().create().value());
+                }
+                else if (msg.db().has_delete_())
+                {
+                    storage->remove(msg.db().header().db_uuid(), msg.db().delete_().key());
+                }
+            }
+            return true;
+        };
+    }
 }
 
 
@@ -443,8 +467,8 @@ namespace bzn
         wh(boost::system::error_code());
 
         // now send in each vote...
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid1", 1, true), this->mock_session);
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid2", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid1", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid2", 1, true), this->mock_session);
 
         EXPECT_EQ(raft->get_state(), bzn::raft_state::leader);
     }
@@ -556,8 +580,8 @@ namespace bzn
             }));
 
         // now send in each vote...
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid1", 1, true), mock_session);
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid2", 1, true), mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid1", 1, true), mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid2", 1, true), mock_session);
 
         EXPECT_EQ(raft->get_state(), bzn::raft_state::leader);
 
@@ -658,8 +682,8 @@ namespace bzn
         EXPECT_EQ(raft->get_state(), bzn::raft_state::candidate);
 
         // now send in each vote...
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid1", 1, true), mock_session);
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid2", 1, true), mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid1", 1, true), mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid2", 1, true), mock_session);
 
         EXPECT_EQ(raft->get_state(), bzn::raft_state::leader);
 
@@ -689,13 +713,13 @@ namespace bzn
         wh(boost::system::error_code());
 
         // send false so second peer will achieve consensus and leader will commit the entries..
-        raft->handle_request_append_entries_response(bzn::create_append_entries_response("uuid1", 1, false, 1), mock_session);
+        raft->handle_request_append_entries_response(bzn::create_raft_append_entries_reply("uuid1", 1, false, 1), mock_session);
 
         EXPECT_EQ(commit_handler_times_called, 0);
         ASSERT_FALSE(commit_handler_called);
 
         // enough peers have stored the first entry
-        raft->handle_request_append_entries_response(bzn::create_append_entries_response("uuid2", 1, true, 2), this->mock_session);
+        raft->handle_request_append_entries_response(bzn::create_raft_append_entries_reply("uuid2", 1, true, 2), this->mock_session);
 
         EXPECT_EQ(commit_handler_times_called, 1);
 
@@ -705,7 +729,7 @@ namespace bzn
         // enough peers have stored the first entry
         commit_handler_times_called = 0;
         commit_handler_called = false;
-        raft->handle_request_append_entries_response(bzn::create_append_entries_response("uuid2", 1, true, 3), this->mock_session);
+        raft->handle_request_append_entries_response(bzn::create_raft_append_entries_reply("uuid2", 1, true, 3), this->mock_session);
 
         EXPECT_EQ(commit_handler_times_called, 1);
         ASSERT_TRUE(commit_handler_called);
@@ -822,6 +846,333 @@ namespace bzn
     }
 
 
+    TEST_F(raft_test, test_that_protobuf_append_entries_are_answered_in_protobuf)
+    {
+        auto mock_steady_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+
+        bzn::asio::wait_handler wh;
+        EXPECT_CALL(*mock_steady_timer, async_wait(_)).WillRepeatedly(Invoke(
+            [&](auto handler)
+            { wh = handler; }));
+
+        EXPECT_CALL(*this->mock_io_context, make_unique_steady_timer()).WillOnce(Invoke(
+            [&]()
+            { return std::move(mock_steady_timer); }));
+
+        auto raft = std::make_shared<bzn::raft>(this->mock_io_context, this->mock_node, TEST_PEER_LIST, "uuid1", TEST_STATE_DIR);
+
+        bzn::message_handler mh;
+        EXPECT_CALL(*mock_node, register_for_message("raft", _)).WillOnce(Invoke(
+            [&](const auto&, auto handler)
+            {
+                mh = handler;
+                return true;
+            }));
+
+        bzn::protobuf_handler ph;
+        EXPECT_CALL(*mock_node, register_for_message(bzn_envelope::PayloadCase::kRaft, _)).WillOnce(Invoke(
+            [&](const auto&, auto handler)
+            {
+                ph = handler;
+                return true;
+            }));
+
+        raft->start();
+
+        bzn::json_message json_resp;
+        EXPECT_CALL(*this->mock_session, send_message(An<std::shared_ptr<bzn::json_message>>(), _)).WillRepeatedly(Invoke(
+            [&](const auto& msg, auto /*handler*/)
+            {
+                json_resp = *msg;
+            }));
+
+        bzn_envelope proto_resp;
+        EXPECT_CALL(*this->mock_session, send_message(An<std::shared_ptr<bzn::encoded_message>>(), _)).WillRepeatedly(Invoke(
+            [&](const auto& msg, auto /*handler*/)
+            {
+                ASSERT_TRUE(proto_resp.ParseFromString(*msg));
+            }));
+
+        bzn::json_message entry;
+        entry["bzn-api"] = "utest";
+
+        auto send_protobuf = [&](const bzn::json_message& msg)
+        {
+            raft_msg wire_msg;
+            ASSERT_TRUE(bzn::raft_json_to_proto(msg, wire_msg));
+
+            bzn_envelope env;
+            env.set_raft(wire_msg.SerializeAsString());
+            ph(env, this->mock_session);
+        };
+
+        // heartbeat from the new leader brings us up to its term...
+        send_protobuf(bzn::create_append_entries_request(TEST_NODE_UUID, 2, 1, 0, 0, 0, bzn::json_message()));
+        proto_resp.Clear();
+
+        send_protobuf(bzn::create_append_entries_request(TEST_NODE_UUID, 2, 1, 0, 0, 2, entry));
+
+        // the reply comes back in the encoding the request used...
+        ASSERT_EQ(proto_resp.payload_case(), bzn_envelope::kRaft);
+        EXPECT_TRUE(json_resp.isNull());
+
+        raft_msg reply;
+        ASSERT_TRUE(reply.ParseFromString(proto_resp.raft()));
+        ASSERT_EQ(reply.msg_case(), raft_msg::kAppendEntriesReply);
+        EXPECT_EQ(reply.from(), "uuid1");
+        EXPECT_EQ(reply.term(), uint32_t(2));
+        EXPECT_TRUE(reply.append_entries_reply().success());
+        EXPECT_EQ(reply.append_entries_reply().match_index(), uint32_t(2));
+        EXPECT_EQ(raft->get_leader().uuid, TEST_NODE_UUID);
+
+        // peers still speaking json are answered in json...
+        proto_resp.Clear();
+        mh(bzn::create_append_entries_request(TEST_NODE_UUID, 2, 1, 1, 2, 2, entry), this->mock_session);
+
+        EXPECT_EQ(proto_resp.payload_case(), bzn_envelope::PAYLOAD_NOT_SET);
+        EXPECT_EQ(json_resp["cmd"].asString(), "AppendEntriesReply");
+        EXPECT_TRUE(json_resp["data"]["success"].asBool());
+        EXPECT_EQ(json_resp["data"]["matchIndex"].asUInt(), Json::UInt(3));
+    }
+
+
+    TEST_F(raft_test, test_that_leader_sends_protobuf_rpcs_when_enabled)
+    {
+        bzn::asio::wait_handler wh;
+        bzn::message_handler mh;
+        auto raft = this->start_raft(TEST_PEER_LIST, wh, mh);
+        raft->set_protobuf_enabled(true);
+
+        std::vector<raft_msg> sent;
+        EXPECT_CALL(*this->mock_node, send_message(_, _, true)).WillRepeatedly(Invoke(
+            [&](const auto& /*ep*/, auto env, auto /*close_session*/)
+            {
+                ASSERT_EQ(env->payload_case(), bzn_envelope::kRaft);
+                raft_msg msg;
+                ASSERT_TRUE(msg.ParseFromString(env->raft()));
+                sent.push_back(msg);
+            }));
+
+        // election timeout: vote requests go out as protobuf...
+        wh(boost::system::error_code());
+
+        ASSERT_EQ(sent.size(), TEST_PEER_LIST.size() - 1);
+        for (const auto& msg : sent)
+        {
+            ASSERT_EQ(msg.msg_case(), raft_msg::kRequestVote);
+            EXPECT_EQ(msg.from(), TEST_NODE_UUID);
+            EXPECT_EQ(msg.term(), uint32_t(1));
+        }
+
+        // and so do the heartbeats once elected...
+        sent.clear();
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid1", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid2", 1, true), this->mock_session);
+        ASSERT_EQ(raft->get_state(), bzn::raft_state::leader);
+
+        sent.clear();
+        wh(boost::system::error_code());
+
+        ASSERT_FALSE(sent.empty());
+        for (const auto& msg : sent)
+        {
+            ASSERT_EQ(msg.msg_case(), raft_msg::kAppendEntries);
+            EXPECT_EQ(msg.term(), uint32_t(1));
+        }
+    }
+
+
+    TEST_F(raft_test, test_that_rejected_append_entries_backtracks_to_the_conflicting_term)
+    {
+        auto mock_steady_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+
+        EXPECT_CALL(*this->mock_io_context, make_unique_steady_timer()).WillOnce(Invoke(
+            [&]()
+            { return std::move(mock_steady_timer); }));
+
+        auto raft = std::make_shared<bzn::raft>(this->mock_io_context, this->mock_node, TEST_PEER_LIST, "uuid1", TEST_STATE_DIR);
+        raft->enable_audit = false;
+
+        bzn::message_handler mh;
+        EXPECT_CALL(*mock_node, register_for_message("raft", _)).WillOnce(Invoke(
+            [&](const auto&, auto handler)
+            {
+                mh = handler;
+                return true;
+            }));
+
+        raft->start();
+        raft->register_commit_handler([](const bzn::json_message&){ return true; });
+
+        bzn::json_message resp;
+        EXPECT_CALL(*this->mock_session, send_message(An<std::shared_ptr<bzn::json_message>>(), _)).WillRepeatedly(Invoke(
+            [&](const auto& msg, auto /*handler*/)
+            {
+                resp = *msg;
+            }));
+
+        // sync up the term...
+        mh(bzn::create_append_entries_request(TEST_NODE_UUID, 2, 1, 0, 0, 0, bzn::json_message()), this->mock_session);
+
+        // one request carries three entries from term 2...
+        bzn::json_message entry;
+        entry["bzn-api"] = "crud";
+        entry["msg"] = "utest";
+
+        auto msg = bzn::create_append_entries_request(TEST_NODE_UUID, 2, 1, 0, 0, 2, entry);
+        bzn::add_append_entries_batch_entry(msg, bzn::log_entry{bzn::log_entry_type::database, 2, 2, entry});
+        bzn::add_append_entries_batch_entry(msg, bzn::log_entry{bzn::log_entry_type::database, 3, 2, entry});
+        mh(msg, this->mock_session);
+
+        ASSERT_TRUE(resp["data"]["success"].asBool());
+        EXPECT_EQ(resp["data"]["matchIndex"].asUInt(), Json::UInt(4));
+        EXPECT_EQ(raft->raft_log->size(), size_t(4));
+        EXPECT_EQ(raft->raft_log->entry_at(3).term, uint32_t(2));
+
+        // a heartbeat only vouches for the entries up to its prevIndex, not for the one after it...
+        resp.clear();
+        mh(bzn::create_append_entries_request(TEST_NODE_UUID, 2, 1, 1, 2, 0, bzn::json_message()), this->mock_session);
+
+        ASSERT_TRUE(resp["data"]["success"].asBool());
+        EXPECT_EQ(resp["data"]["matchIndex"].asUInt(), Json::UInt(2));
+
+        // a leader that disagrees about the last entry is pointed at the first entry of term 2, not at index 2...
+        resp.clear();
+        mh(bzn::create_append_entries_request(TEST_NODE_UUID, 2, 1, 3, 3, 3, entry), this->mock_session);
+
+        ASSERT_FALSE(resp["data"]["success"].asBool());
+        EXPECT_EQ(resp["data"]["matchIndex"].asUInt(), Json::UInt(1));
+
+        // ...and the follower asks for what it is missing when it is behind
+        resp.clear();
+        mh(bzn::create_append_entries_request(TEST_NODE_UUID, 2, 1, 9, 3, 3, entry), this->mock_session);
+
+        ASSERT_FALSE(resp["data"]["success"].asBool());
+        EXPECT_EQ(resp["data"]["matchIndex"].asUInt(), Json::UInt(4));
+    }
+
+
+    TEST_F(raft_test, test_that_lagging_follower_catches_up_in_batches)
+    {
+        const size_t ENTRY_COUNT = 10000;
+
+        auto leader_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+        auto follower_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+
+        bzn::asio::wait_handler wh;
+        EXPECT_CALL(*leader_timer, async_wait(_)).WillRepeatedly(Invoke(
+            [&](auto handler)
+            { wh = handler; }));
+
+        EXPECT_CALL(*this->mock_io_context, make_unique_steady_timer())
+            .WillOnce(Invoke([&]() { return std::move(leader_timer); }))
+            .WillOnce(Invoke([&]() { return std::move(follower_timer); }));
+
+        // leader -> follower and follower -> leader traffic is queued and delivered in order...
+        std::deque<std::shared_ptr<bzn::json_message>> to_follower;
+        std::deque<std::shared_ptr<bzn::json_message>> to_leader;
+        size_t append_entries_sent = 0;
+
+        EXPECT_CALL(*this->mock_node, send_message_json(_, _)).WillRepeatedly(Invoke(
+            [&](const auto& ep, const auto& msg)
+            {
+                if (ep.port() == 8081)
+                {
+                    to_follower.push_back(msg);
+                    append_entries_sent += (*msg)["cmd"].asString() == "AppendEntries" ? 1 : 0;
+                }
+            }));
+
+        auto follower_node = std::make_shared<NiceMock<bzn::Mocknode_base>>();
+        auto follower_session = std::make_shared<NiceMock<bzn::Mocksession_base>>();
+        auto leader_session = std::make_shared<NiceMock<bzn::Mocksession_base>>();
+
+        EXPECT_CALL(*follower_session, send_message(An<std::shared_ptr<bzn::json_message>>(), _)).WillRepeatedly(Invoke(
+            [&](const auto& msg, auto /*handler*/)
+            {
+                to_leader.push_back(msg);
+            }));
+
+        bzn::message_handler leader_mh;
+        EXPECT_CALL(*this->mock_node, register_for_message("raft", _)).WillOnce(Invoke(
+            [&](const auto&, auto handler)
+            {
+                leader_mh = handler;
+                return true;
+            }));
+
+        bzn::message_handler follower_mh;
+        EXPECT_CALL(*follower_node, register_for_message("raft", _)).WillOnce(Invoke(
+            [&](const auto&, auto handler)
+            {
+                follower_mh = handler;
+                return true;
+            }));
+
+        auto leader = std::make_shared<bzn::raft>(this->mock_io_context, this->mock_node, TEST_PEER_LIST, TEST_NODE_UUID, TEST_STATE_DIR);
+        auto follower = std::make_shared<bzn::raft>(this->mock_io_context, follower_node, TEST_PEER_LIST, "uuid1", TEST_STATE_DIR);
+        leader->enable_audit = false;
+        follower->enable_audit = false;
+        leader->register_commit_handler([](const bzn::json_message&){ return true; });
+        follower->register_commit_handler([](const bzn::json_message&){ return true; });
+
+        leader->start();
+        follower->start();
+
+        auto deliver = [&]()
+        {
+            while (!to_follower.empty() || !to_leader.empty())
+            {
+                if (!to_follower.empty())
+                {
+                    auto msg = to_follower.front();
+                    to_follower.pop_front();
+                    follower_mh(*msg, follower_session);
+                }
+
+                if (!to_leader.empty())
+                {
+                    auto msg = to_leader.front();
+                    to_leader.pop_front();
+                    leader_mh(*msg, leader_session);
+                }
+            }
+        };
+
+        // win the election and settle the follower's term...
+        wh(boost::system::error_code());
+        to_follower.clear();
+        leader_mh(bzn::create_request_vote_response("uuid1", 1, true), leader_session);
+        ASSERT_EQ(leader->get_state(), bzn::raft_state::leader);
+        deliver();
+
+        bzn::json_message entry;
+        entry["bzn-api"] = "crud";
+        entry["msg"] = "utest";
+        for (size_t i = 0; i < ENTRY_COUNT; ++i)
+        {
+            ASSERT_TRUE(leader->append_log(entry, bzn::log_entry_type::database));
+        }
+
+        append_entries_sent = 0;
+        size_t heartbeats = 0;
+
+        while (follower->raft_log->size() < leader->raft_log->size() && heartbeats < ENTRY_COUNT)
+        {
+            wh(boost::system::error_code());
+            ++heartbeats;
+            deliver();
+        }
+
+        EXPECT_EQ(follower->raft_log->size(), leader->raft_log->size());
+
+        // previously this took one heartbeat per entry...
+        EXPECT_EQ(heartbeats, size_t(1));
+        EXPECT_LE(append_entries_sent, ENTRY_COUNT / bzn::MAX_APPEND_ENTRIES_BATCH_SIZE + bzn::MAX_APPEND_ENTRIES_IN_FLIGHT + 1);
+    }
+
+
+
     TEST(raft, test_raft_timeout_scale_can_get_set)
     {
         // none set
@@ -962,6 +1313,412 @@ namespace bzn
     }
 
 
+    TEST_F(raft_test, test_that_raft_restarts_with_batched_writes_in_its_log)
+    {
+        const bzn::uuid_t db_uuid{"66fa99f9-a397-4ec2-8bcd-63f9784966f3"};
+
+        bzn::asio::wait_handler asio_wait_handler;
+        bzn::message_handler bzn_msg_handler;
+
+        {
+            auto raft = this->start_raft(TEST_PEER_LIST, asio_wait_handler, bzn_msg_handler);
+            raft->current_state = bzn::raft_state::leader;
+
+            EXPECT_TRUE(raft->append_log_unsafe(make_bzn_message(build_create_bzn_msg(db_uuid, 1, "key_0", "value")), bzn::log_entry_type::database));
+
+            // one entry holding a bulk write, as raft_crud::handle_batch appends it...
+            bzn_msg batch;
+            *batch.mutable_db_batch()->add_requests() = build_create_bzn_msg(db_uuid, 2, "key_1", "created").db();
+            *batch.mutable_db_batch()->add_requests() = build_create_bzn_msg(db_uuid, 3, "key_2", "created").db();
+            *batch.mutable_db_batch()->add_requests() = build_update_bzn_msg(db_uuid, 4, "key_1", "updated").db();
+            *batch.mutable_db_batch()->add_requests() = build_delete_bzn_msg(db_uuid, 5, "key_0").db();
+            EXPECT_TRUE(raft->append_log_unsafe(make_bzn_message(batch), bzn::log_entry_type::database));
+
+            raft->raft_log->sync();
+        }
+
+        auto raft = this->start_raft(TEST_PEER_LIST, asio_wait_handler, bzn_msg_handler);
+
+        auto storage = std::make_shared<bzn::mem_storage>();
+        raft->initialize_storage_from_log(storage);
+
+        EXPECT_EQ(storage->get_keys(db_uuid).size(), size_t(2));
+        EXPECT_FALSE(storage->has(db_uuid, "key_0"));
+        EXPECT_EQ(*storage->read(db_uuid, "key_1"), "updated");
+        EXPECT_EQ(*storage->read(db_uuid, "key_2"), "created");
+    }
+
+
+    TEST_F(raft_test, test_that_raft_snapshots_storage_and_compacts_its_log)
+    {
+        const bzn::uuid_t db_uuid{"66fa99f9-a397-4ec2-8bcd-63f9784966f3"};
+
+        bzn::asio::wait_handler asio_wait_handler;
+        bzn::message_handler bzn_msg_handler;
+
+        auto raft = this->start_raft(TEST_PEER_LIST, asio_wait_handler, bzn_msg_handler);
+        raft->enable_audit = false;
+        raft->current_state = bzn::raft_state::leader;
+
+        auto storage = std::make_shared<bzn::mem_storage>();
+        raft->initialize_storage_from_log(storage);
+        raft->register_commit_handler(make_storage_commit_handler(storage));
+        raft->set_snapshot_threshold(10);
+
+        for (size_t i = 0; i < 25; ++i)
+        {
+            EXPECT_TRUE(raft->append_log_unsafe(make_bzn_message(build_create_bzn_msg(db_uuid, i, "key_" + std::to_string(i), "value")), bzn::log_entry_type::database));
+        }
+
+        while (raft->commit_index < raft->raft_log->size())
+        {
+            const auto entry = raft->raft_log->entry_at(raft->commit_index);
+            raft->perform_commit(raft->commit_index, entry);
+
+            // let each snapshot reach the disk and compact the log before the next is due
+            raft->complete_snapshot(true);
+        }
+
+        EXPECT_EQ(storage->get_keys(db_uuid).size(), size_t(25));
+
+        // snapshots were taken at 10 and 20...
+        EXPECT_EQ(raft->raft_log->first_index(), size_t(20));
+        EXPECT_EQ(raft->raft_log->size(), size_t(26));
+        EXPECT_THROW(raft->raft_log->entry_at(19), std::out_of_range);
+        EXPECT_TRUE(boost::filesystem::exists(raft->snapshot_path()));
+
+        // ...without losing track of the quorum
+        EXPECT_EQ(raft->raft_log->last_quorum_entry().entry_type, bzn::log_entry_type::single_quorum);
+        EXPECT_EQ(raft->get_all_peers().size(), TEST_PEER_LIST.size());
+    }
+
+
+    TEST_F(raft_test, test_that_raft_restarts_from_snapshot_and_log_tail)
+    {
+        const bzn::uuid_t db_uuid{"66fa99f9-a397-4ec2-8bcd-63f9784966f3"};
+
+        bzn::asio::wait_handler asio_wait_handler;
+        bzn::message_handler bzn_msg_handler;
+
+        {
+            auto raft = this->start_raft(TEST_PEER_LIST, asio_wait_handler, bzn_msg_handler);
+            raft->enable_audit = false;
+            raft->current_state = bzn::raft_state::leader;
+
+            auto storage = std::make_shared<bzn::mem_storage>();
+            raft->initialize_storage_from_log(storage);
+            raft->register_commit_handler(make_storage_commit_handler(storage));
+            raft->set_snapshot_threshold(10);
+
+            for (size_t i = 0; i < 15; ++i)
+            {
+                EXPECT_TRUE(raft->append_log_unsafe(make_bzn_message(build_create_bzn_msg(db_uuid, i, "key_" + std::to_string(i), "value")), bzn::log_entry_type::database));
+            }
+
+            while (raft->commit_index < raft->raft_log->size())
+            {
+                const auto entry = raft->raft_log->entry_at(raft->commit_index);
+                raft->perform_commit(raft->commit_index, entry);
+                raft->complete_snapshot(true);
+            }
+
+            // deletes after the snapshot only live in the log tail...
+            EXPECT_TRUE(raft->append_log_unsafe(make_bzn_message(build_delete_bzn_msg(db_uuid, 100, "key_3")), bzn::log_entry_type::database));
+            raft->raft_log->sync();
+
+            ASSERT_EQ(raft->raft_log->first_index(), size_t(10));
+        }
+
+        auto raft = this->start_raft(TEST_PEER_LIST, asio_wait_handler, bzn_msg_handler);
+
+        EXPECT_EQ(raft->raft_log->first_index(), size_t(10));
+        EXPECT_EQ(raft->raft_log->size(), size_t(17));
+        EXPECT_EQ(raft->raft_log->last_quorum_entry().entry_type, bzn::log_entry_type::single_quorum);
+
+        auto storage = std::make_shared<bzn::mem_storage>();
+        raft->initialize_storage_from_log(storage);
+
+        // snapshot for the first ten, then the tail replayed on top...
+        const auto keys = storage->get_keys(db_uuid);
+        EXPECT_EQ(keys.size(), size_t(14));
+        EXPECT_TRUE(storage->has(db_uuid, "key_0"));
+        EXPECT_TRUE(storage->has(db_uuid, "key_14"));
+        EXPECT_FALSE(storage->has(db_uuid, "key_3"));
+        EXPECT_GE(raft->commit_index, uint32_t(11));
+    }
+
+
+    TEST_F(raft_test, test_that_leader_sends_snapshot_to_follower_behind_compacted_log)
+    {
+        const bzn::uuid_t db_uuid{"66fa99f9-a397-4ec2-8bcd-63f9784966f3"};
+
+        auto leader_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+        auto follower_timer = std::make_unique<NiceMock<bzn::asio::Mocksteady_timer_base>>();
+
+        bzn::asio::wait_handler wh;
+        EXPECT_CALL(*leader_timer, async_wait(_)).WillRepeatedly(Invoke(
+            [&](auto handler)
+            { wh = handler; }));
+
+        EXPECT_CALL(*this->mock_io_context, make_unique_steady_timer())
+            .WillOnce(Invoke([&]() { return std::move(leader_timer); }))
+            .WillOnce(Invoke([&]() { return std::move(follower_timer); }));
+
+        std::deque<std::shared_ptr<bzn::json_message>> to_follower;
+        std::deque<std::shared_ptr<bzn::json_message>> to_leader;
+        size_t snapshots_sent = 0;
+
+        EXPECT_CALL(*this->mock_node, send_message_json(_, _)).WillRepeatedly(Invoke(
+            [&](const auto& ep, const auto& msg)
+            {
+                if (ep.port() == 8081)
+                {
+                    to_follower.push_back(msg);
+                    snapshots_sent += (*msg)["cmd"].asString() == "InstallSnapshot" ? 1 : 0;
+                }
+            }));
+
+        auto follower_node = std::make_shared<NiceMock<bzn::Mocknode_base>>();
+        auto follower_session = std::make_shared<NiceMock<bzn::Mocksession_base>>();
+        auto leader_session = std::make_shared<NiceMock<bzn::Mocksession_base>>();
+
+        EXPECT_CALL(*follower_session, send_message(An<std::shared_ptr<bzn::json_message>>(), _)).WillRepeatedly(Invoke(
+            [&](const auto& msg, auto /*handler*/)
+            {
+                to_leader.push_back(msg);
+            }));
+
+        bzn::message_handler leader_mh;
+        EXPECT_CALL(*this->mock_node, register_for_message("raft", _)).WillOnce(Invoke(
+            [&](const auto&, auto handler)
+            {
+                leader_mh = handler;
+                return true;
+            }));
+
+        bzn::message_handler follower_mh;
+        EXPECT_CALL(*follower_node, register_for_message("raft", _)).WillOnce(Invoke(
+            [&](const auto&, auto handler)
+            {
+                follower_mh = handler;
+                return true;
+            }));
+
+        auto leader = std::make_shared<bzn::raft>(this->mock_io_context, this->mock_node, TEST_PEER_LIST, TEST_NODE_UUID, TEST_STATE_DIR);
+        auto follower = std::make_shared<bzn::raft>(this->mock_io_context, follower_node, TEST_PEER_LIST, "uuid1", TEST_STATE_DIR);
+        leader->enable_audit = false;
+        follower->enable_audit = false;
+
+        auto leader_storage = std::make_shared<bzn::mem_storage>();
+        auto follower_storage = std::make_shared<bzn::mem_storage>();
+        leader->initialize_storage_from_log(leader_storage);
+        follower->initialize_storage_from_log(follower_storage);
+        leader->register_commit_handler(make_storage_commit_handler(leader_storage));
+        follower->register_commit_handler(make_storage_commit_handler(follower_storage));
+        leader->set_snapshot_threshold(10);
+
+        leader->start();
+        follower->start();
+
+        auto deliver = [&]()
+        {
+            while (!to_follower.empty() || !to_leader.empty())
+            {
+                if (!to_follower.empty())
+                {
+                    auto msg = to_follower.front();
+                    to_follower.pop_front();
+                    follower_mh(*msg, follower_session);
+                }
+
+                if (!to_leader.empty())
+                {
+                    auto msg = to_leader.front();
+                    to_leader.pop_front();
+                    leader_mh(*msg, leader_session);
+                }
+            }
+        };
+
+        wh(boost::system::error_code());
+        to_follower.clear();
+        leader_mh(bzn::create_request_vote_response("uuid1", 1, true), leader_session);
+        ASSERT_EQ(leader->get_state(), bzn::raft_state::leader);
+        deliver();
+
+        // the other peer alone gets the leader to commit (and compact) everything while the follower hears nothing...
+        for (size_t i = 0; i < 25; ++i)
+        {
+            ASSERT_TRUE(leader->append_log(make_bzn_message(build_create_bzn_msg(db_uuid, i, "key_" + std::to_string(i), "value")), bzn::log_entry_type::database));
+        }
+        leader_mh(bzn::create_append_entries_response("uuid2", 1, true, uint32_t(leader->raft_log->size())), leader_session);
+        to_follower.clear();
+
+        // snapshots are written in the background, so how far the log has been compacted depends on how quickly they landed
+        leader->complete_snapshot(true);
+        const size_t compacted_to = leader->raft_log->first_index();
+        ASSERT_GE(compacted_to, size_t(10));
+        ASSERT_EQ(follower->raft_log->size(), size_t(1));
+
+        // ...so it has to be sent the snapshot before it can take the rest of the log
+        for (size_t i = 0; i < 3 && follower->raft_log->size() < leader->raft_log->size(); ++i)
+        {
+            wh(boost::system::error_code());
+
+            // the snapshot is read and sent in the background
+            if (leader->snapshot_reader.valid())
+            {
+                leader->snapshot_reader.wait();
+            }
+            deliver();
+        }
+
+        EXPECT_EQ(snapshots_sent, size_t(1));
+        EXPECT_EQ(follower->raft_log->first_index(), compacted_to);
+        EXPECT_EQ(follower->raft_log->size(), leader->raft_log->size());
+        EXPECT_EQ(follower->commit_index, leader->commit_index);
+        EXPECT_EQ(follower_storage->get_keys(db_uuid).size(), size_t(25));
+    }
+
+
+    TEST_F(raft_test, test_that_install_snapshot_is_refused_from_a_stale_term_or_when_malformed)
+    {
+        bzn::asio::wait_handler asio_wait_handler;
+        bzn::message_handler bzn_msg_handler;
+
+        auto raft = this->start_raft(TEST_PEER_LIST, asio_wait_handler, bzn_msg_handler);
+        auto storage = std::make_shared<bzn::mem_storage>();
+        raft->storage = storage;
+        raft->current_term = 2;
+        const auto commit_index = raft->commit_index;
+
+        std::vector<raft_msg> replies;
+        EXPECT_CALL(*this->mock_session, send_message(An<std::shared_ptr<bzn::encoded_message>>(), _)).WillRepeatedly(Invoke(
+            [&](const auto& msg, auto /*end_session*/)
+            {
+                bzn_envelope env;
+                ASSERT_TRUE(env.ParseFromString(*msg));
+                replies.emplace_back();
+                ASSERT_TRUE(replies.back().ParseFromString(env.raft()));
+            }));
+
+        // a snapshot of some other storage holding one record...
+        bzn::mem_storage leader_storage;
+        leader_storage.create("uuid", "key", "value");
+        leader_storage.create_snapshot();
+
+        bzn::json_message snapshot;
+        snapshot["index"] = 10;
+        snapshot["term"] = 1;
+        snapshot["entryType"] = uint32_t(bzn::log_entry_type::database);
+        snapshot["quorumType"] = uint32_t(bzn::log_entry_type::single_quorum);
+
+        // ...sent by a leader that has since been deposed
+        raft->handle_raft_message(bzn::create_raft_install_snapshot("uuid1", 1, 10, snapshot, *leader_storage.get_snapshot()), this->mock_session);
+
+        ASSERT_EQ(replies.size(), size_t(1));
+        EXPECT_FALSE(replies.back().append_entries_reply().success());
+        EXPECT_EQ(replies.back().term(), uint32_t(2));
+        EXPECT_FALSE(storage->has("uuid", "key"));
+        EXPECT_EQ(raft->commit_index, commit_index);
+
+        // a description that doesn't parse is not a snapshot at index 0
+        auto malformed = bzn::create_raft_install_snapshot("uuid1", 2, 10, snapshot, *leader_storage.get_snapshot());
+        malformed.mutable_install_snapshot()->set_snapshot("{not json");
+        raft->handle_raft_message(malformed, this->mock_session);
+
+        ASSERT_EQ(replies.size(), size_t(2));
+        EXPECT_FALSE(replies.back().append_entries_reply().success());
+        EXPECT_FALSE(storage->has("uuid", "key"));
+
+        // and a leader of the same term steps down rather than letting another one overwrite it
+        raft->current_state = bzn::raft_state::leader;
+        EXPECT_CALL(*this->mock_session, close());
+        raft->handle_raft_message(bzn::create_raft_install_snapshot("uuid1", 2, 10, snapshot, *leader_storage.get_snapshot()), this->mock_session);
+
+        EXPECT_EQ(raft->get_state(), bzn::raft_state::follower);
+        EXPECT_EQ(replies.size(), size_t(2));
+        EXPECT_FALSE(storage->has("uuid", "key"));
+    }
+
+
+    TEST_F(raft_test, test_that_install_snapshot_from_a_newer_term_is_installed)
+    {
+        bzn::asio::wait_handler asio_wait_handler;
+        bzn::message_handler bzn_msg_handler;
+
+        auto raft = this->start_raft(TEST_PEER_LIST, asio_wait_handler, bzn_msg_handler);
+        auto storage = std::make_shared<bzn::mem_storage>();
+        raft->storage = storage;
+        raft->current_term = 2;
+        raft->current_state = bzn::raft_state::leader;
+        raft->voted_for = TEST_NODE_UUID;
+
+        std::vector<raft_msg> replies;
+        EXPECT_CALL(*this->mock_session, send_message(An<std::shared_ptr<bzn::encoded_message>>(), _)).WillRepeatedly(Invoke(
+            [&](const auto& msg, auto /*end_session*/)
+            {
+                bzn_envelope env;
+                ASSERT_TRUE(env.ParseFromString(*msg));
+                replies.emplace_back();
+                ASSERT_TRUE(replies.back().ParseFromString(env.raft()));
+            }));
+
+        bzn::mem_storage leader_storage;
+        leader_storage.create("uuid", "key", "value");
+        leader_storage.create_snapshot();
+
+        bzn::json_message snapshot;
+        snapshot["index"] = 10;
+        snapshot["term"] = 3;
+        snapshot["entryType"] = uint32_t(bzn::log_entry_type::database);
+        snapshot["quorumType"] = uint32_t(bzn::log_entry_type::single_quorum);
+
+        // the leader of a later term replaces our state outright, we don't only adopt its term
+        raft->handle_raft_message(bzn::create_raft_install_snapshot("uuid1", 3, 10, snapshot, *leader_storage.get_snapshot()), this->mock_session);
+
+        ASSERT_EQ(replies.size(), size_t(1));
+        EXPECT_TRUE(replies.back().append_entries_reply().success());
+        EXPECT_EQ(replies.back().term(), uint32_t(3));
+        EXPECT_EQ(raft->get_state(), bzn::raft_state::follower);
+        EXPECT_EQ(raft->current_term, uint32_t(3));
+        EXPECT_FALSE(raft->voted_for);
+        EXPECT_EQ(raft->leader, "uuid1");
+        EXPECT_TRUE(storage->has("uuid", "key"));
+        EXPECT_EQ(raft->commit_index, uint32_t(11));
+    }
+
+
+    TEST_F(raft_test, test_that_commit_checks_use_the_quorum_at_the_start_of_a_long_log)
+    {
+        const size_t ENTRY_COUNT = 1000;
+
+        bzn::asio::wait_handler asio_wait_handler;
+        bzn::message_handler bzn_msg_handler;
+
+        auto raft = this->start_raft(TEST_PEER_LIST, asio_wait_handler, bzn_msg_handler);
+        raft->current_state = bzn::raft_state::leader;
+
+        bzn::json_message entry;
+        entry["bzn-api"] = "crud";
+        entry["msg"] = "utest";
+        for (size_t i = 1; i < ENTRY_COUNT; ++i)
+        {
+            ASSERT_TRUE(raft->append_log_unsafe(entry, bzn::log_entry_type::database));
+        }
+
+        // the quorum entry is far behind the end of the log, but the commit index, majority and membership still come from it...
+        raft->peer_match_index["uuid1"] = ENTRY_COUNT / 2;
+        raft->peer_match_index["uuid2"] = ENTRY_COUNT;
+
+        EXPECT_EQ(raft->last_majority_replicated_log_index(), ENTRY_COUNT);
+        EXPECT_TRUE(raft->is_majority({TEST_NODE_UUID, "uuid1"}));
+        EXPECT_FALSE(raft->is_majority({"uuid1"}));
+        EXPECT_TRUE(raft->in_quorum("uuid2"));
+        EXPECT_FALSE(raft->in_quorum("uuid3"));
+    }
+
+
     TEST(raft, test_raft_can_find_last_quorum_log_entry)
     {
         const std::string log_path = TEST_STATE_DIR + TEST_NODE_UUID + ".dat";
@@ -980,13 +1737,14 @@ namespace bzn
         }
         {
             // append a few entries onto the existing log
-            std::ofstream log(log_path, std::ios::out | std::ios::binary | std::ios::app);
+            {
+                bzn::raft_log log(log_path);
 
-            log << bzn::log_entry{bzn::log_entry_type::database, 1, 1, msg};
-            log << bzn::log_entry{bzn::log_entry_type::database, 2, 1, msg};
-            log << bzn::log_entry{bzn::log_entry_type::database, 3, 1, msg};
-            log << bzn::log_entry{bzn::log_entry_type::database, 4, 1, msg};
-            log.close();
+                log.leader_append_entry(bzn::log_entry{bzn::log_entry_type::database, 1, 1, msg});
+                log.leader_append_entry(bzn::log_entry{bzn::log_entry_type::database, 2, 1, msg});
+                log.leader_append_entry(bzn::log_entry{bzn::log_entry_type::database, 3, 1, msg});
+                log.leader_append_entry(bzn::log_entry{bzn::log_entry_type::database, 4, 1, msg});
+            }
             auto raft = bzn::raft(std::make_shared<NiceMock<bzn::asio::Mockio_context_base>>(), nullptr, TEST_PEER_LIST, TEST_NODE_UUID, TEST_STATE_DIR);
             const auto quorum = raft.raft_log->last_quorum_entry();
             EXPECT_EQ(quorum.entry_type, bzn::log_entry_type::single_quorum);
@@ -995,16 +1753,17 @@ namespace bzn
         }
         {
             // add a joint quorum, and then a few more log entries
-            std::ofstream log(log_path, std::ios::out | std::ios::binary | std::ios::app);
-
-            bzn::json_message jq_msg;
-            jq_msg["msg"]["peers"]["new"].append(make_dummy_peer());
-            jq_msg["msg"]["peers"]["old"].append(make_dummy_peer());
-            log << bzn::log_entry{bzn::log_entry_type::joint_quorum, 5, 1, jq_msg};
-            log << bzn::log_entry{bzn::log_entry_type::database, 6, 1, msg};
-            log << bzn::log_entry{bzn::log_entry_type::database, 7, 1, msg};
-            log << bzn::log_entry{bzn::log_entry_type::database, 8, 1, msg};
-            log.close();
+            {
+                bzn::raft_log log(log_path);
+
+                bzn::json_message jq_msg;
+                jq_msg["msg"]["peers"]["new"].append(make_dummy_peer());
+                jq_msg["msg"]["peers"]["old"].append(make_dummy_peer());
+                log.leader_append_entry(bzn::log_entry{bzn::log_entry_type::joint_quorum, 5, 1, jq_msg});
+                log.leader_append_entry(bzn::log_entry{bzn::log_entry_type::database, 6, 1, msg});
+                log.leader_append_entry(bzn::log_entry{bzn::log_entry_type::database, 7, 1, msg});
+                log.leader_append_entry(bzn::log_entry{bzn::log_entry_type::database, 8, 1, msg});
+            }
             auto raft = bzn::raft(std::make_shared<NiceMock<bzn::asio::Mockio_context_base>>(), nullptr, TEST_PEER_LIST, TEST_NODE_UUID, TEST_STATE_DIR);
             const auto quorum = raft.raft_log->last_quorum_entry();
             EXPECT_EQ(quorum.entry_type, bzn::log_entry_type::joint_quorum);
@@ -1208,8 +1967,8 @@ namespace bzn
         wh(boost::system::error_code());
 
         // send the votes
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid1", 1, true), this->mock_session);
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid2", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid1", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid2", 1, true), this->mock_session);
 
         EXPECT_EQ(raft->get_state(), bzn::raft_state::leader);
 
@@ -1276,8 +2035,8 @@ namespace bzn
         wh(boost::system::error_code());
 
         // send the votes
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid1", 1, true), this->mock_session);
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid2", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid1", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid2", 1, true), this->mock_session);
 
         EXPECT_EQ(raft->get_state(), bzn::raft_state::leader);
 
@@ -1376,8 +2135,8 @@ namespace bzn
         wh(boost::system::error_code());
 
         // send the votes
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid1", 1, true), this->mock_session);
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid2", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid1", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid2", 1, true), this->mock_session);
 
         EXPECT_EQ(raft->get_state(), bzn::raft_state::leader);
 
@@ -1422,9 +2181,9 @@ namespace bzn
         // expire timer...
         wh(boost::system::error_code());
 
-        raft->handle_request_append_entries_response(bzn::create_append_entries_response("uuid1", 1, true, 1), mock_session);
-        raft->handle_request_append_entries_response(bzn::create_append_entries_response("uuid2", 1, true, 1), mock_session);
-        raft->handle_request_append_entries_response(bzn::create_append_entries_response(TEST_NODE_UUID, 1, true, 1), mock_session);
+        raft->handle_request_append_entries_response(bzn::create_raft_append_entries_reply("uuid1", 1, true, 1), mock_session);
+        raft->handle_request_append_entries_response(bzn::create_raft_append_entries_reply("uuid2", 1, true, 1), mock_session);
+        raft->handle_request_append_entries_response(bzn::create_raft_append_entries_reply(TEST_NODE_UUID, 1, true, 1), mock_session);
         wh(boost::system::error_code());
 }
 
@@ -1466,8 +2225,8 @@ namespace bzn
         wh(boost::system::error_code());
 
         // send the votes
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid1", 1, true), this->mock_session);
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid2", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid1", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid2", 1, true), this->mock_session);
 
         EXPECT_EQ(raft->get_state(), bzn::raft_state::leader);
 
@@ -1544,8 +2303,8 @@ namespace bzn
         wh(boost::system::error_code());
 
         // send the votes
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid1", 1, true), this->mock_session);
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid2", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid1", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid2", 1, true), this->mock_session);
 
         EXPECT_EQ(raft->get_state(), bzn::raft_state::leader);
 
@@ -1599,8 +2358,8 @@ namespace bzn
         wh(boost::system::error_code());
 
         // send the votes
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid1", 1, true), this->mock_session);
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid2", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid1", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid2", 1, true), this->mock_session);
 
         EXPECT_EQ(raft->get_state(), bzn::raft_state::leader);
 
@@ -1838,8 +2597,8 @@ namespace bzn
         EXPECT_EQ(raft->get_state(), bzn::raft_state::candidate);
 
         // now send in each vote...
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid1", 1, true), this->mock_session);
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid2", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid1", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid2", 1, true), this->mock_session);
 
         EXPECT_EQ(raft->get_state(), bzn::raft_state::leader);
 
@@ -1854,15 +2613,15 @@ namespace bzn
         wh(boost::system::error_code());
 
         // send false so second peer will achieve consensus and leader will commit the entries..
-        raft->handle_request_append_entries_response(bzn::create_append_entries_response("uuid1", 1, false, 1), this->mock_session);
+        raft->handle_request_append_entries_response(bzn::create_raft_append_entries_reply("uuid1", 1, false, 1), this->mock_session);
 
         EXPECT_EQ(commit_handler_times_called, 0);
         ASSERT_FALSE(commit_handler_called);
 
         // enough peers have stored the first entry
-        raft->handle_request_append_entries_response(bzn::create_append_entries_response("uuid1", 1, true, 2), this->mock_session);
-        raft->handle_request_append_entries_response(bzn::create_append_entries_response("uuid2", 1, true, 2), this->mock_session);
-        raft->handle_request_append_entries_response(bzn::create_append_entries_response(TEST_NODE_UUID, 1, true, 2), this->mock_session);
+        raft->handle_request_append_entries_response(bzn::create_raft_append_entries_reply("uuid1", 1, true, 2), this->mock_session);
+        raft->handle_request_append_entries_response(bzn::create_raft_append_entries_reply("uuid2", 1, true, 2), this->mock_session);
+        raft->handle_request_append_entries_response(bzn::create_raft_append_entries_reply(TEST_NODE_UUID, 1, true, 2), this->mock_session);
         
         EXPECT_EQ(commit_handler_times_called, 1);
 
@@ -1871,10 +2630,10 @@ namespace bzn
         // expire heart beat
         wh(boost::system::error_code());
 
-        raft->handle_request_append_entries_response(bzn::create_append_entries_response("uuid1", 1, true, 3), this->mock_session);
-        raft->handle_request_append_entries_response(bzn::create_append_entries_response("uuid2", 1, true, 3), this->mock_session);
-        raft->handle_request_append_entries_response(bzn::create_append_entries_response("uuid_new", 1, true, 3), this->mock_session);
-        raft->handle_request_append_entries_response(bzn::create_append_entries_response(TEST_NODE_UUID, 1, true, 3), this->mock_session);
+        raft->handle_request_append_entries_response(bzn::create_raft_append_entries_reply("uuid1", 1, true, 3), this->mock_session);
+        raft->handle_request_append_entries_response(bzn::create_raft_append_entries_reply("uuid2", 1, true, 3), this->mock_session);
+        raft->handle_request_append_entries_response(bzn::create_raft_append_entries_reply("uuid_new", 1, true, 3), this->mock_session);
+        raft->handle_request_append_entries_response(bzn::create_raft_append_entries_reply(TEST_NODE_UUID, 1, true, 3), this->mock_session);
         EXPECT_EQ(commit_handler_times_called, 2);
 
         entry = raft->raft_log->last_quorum_entry();
@@ -1916,9 +2675,9 @@ namespace bzn
         EXPECT_EQ(raft->get_state(), bzn::raft_state::candidate);
 
         // lets make sure we do not become leader after only 2 of four nodes vote for the node
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid2", 1, false), mock_session);
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid3", 1, true), mock_session);
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid4", 1, false), mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid2", 1, false), mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid3", 1, true), mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid4", 1, false), mock_session);
 
         // we expect 3 vote requests, node TEST_NODE_UUID will vote yes
         EXPECT_EQ(vote_requests, size_t(3));
@@ -1985,8 +2744,8 @@ namespace bzn
         wh(boost::system::error_code());
 
         // send the votes
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid1", 1, true), this->mock_session);
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid2", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid1", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid2", 1, true), this->mock_session);
 
         EXPECT_EQ(raft->get_state(), bzn::raft_state::leader);
 
@@ -2017,9 +2776,9 @@ namespace bzn
             // expire timer...
             wh(boost::system::error_code());
 
-            raft->handle_request_append_entries_response(bzn::create_append_entries_response("uuid1", 1, true, 1), mock_session);
-            raft->handle_request_append_entries_response(bzn::create_append_entries_response("uuid2", 1, true, 1), mock_session);
-            raft->handle_request_append_entries_response(bzn::create_append_entries_response(TEST_NODE_UUID, 1, true, 1), mock_session);
+            raft->handle_request_append_entries_response(bzn::create_raft_append_entries_reply("uuid1", 1, true, 1), mock_session);
+            raft->handle_request_append_entries_response(bzn::create_raft_append_entries_reply("uuid2", 1, true, 1), mock_session);
+            raft->handle_request_append_entries_response(bzn::create_raft_append_entries_reply(TEST_NODE_UUID, 1, true, 1), mock_session);
             wh(boost::system::error_code());
 
             auto entry = raft->raft_log->last_quorum_entry();
@@ -2124,8 +2883,8 @@ namespace bzn
         wh(boost::system::error_code());
 
         // now send in each vote...
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid1", 1, true), this->mock_session);
-        raft->handle_request_vote_response(bzn::create_request_vote_response("uuid2", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid1", 1, true), this->mock_session);
+        raft->handle_request_vote_response(bzn::create_raft_vote_response("uuid2", 1, true), this->mock_session);
 
         EXPECT_EQ(raft->get_state(), bzn::raft_state::leader);
 
@@ -0,0 +1,348 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <simulator/sim_io_context.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace bzn::sim;
+
+
+virtual_duration
+scheduler::now() const
+{
+    return this->clock;
+}
+
+
+void
+scheduler::schedule(virtual_duration delay, bzn::asio::task task)
+{
+    this->queue.push_back(event{this->clock + std::max(delay, virtual_duration(0)), this->next_order++, std::move(task)});
+    std::push_heap(this->queue.begin(), this->queue.end(), later());
+}
+
+
+bool
+scheduler::run_one()
+{
+    if (this->queue.empty())
+    {
+        return false;
+    }
+
+    std::pop_heap(this->queue.begin(), this->queue.end(), later());
+    event next = std::move(this->queue.back());
+    this->queue.pop_back();
+
+    this->clock = next.when;
+    this->run_count++;
+    next.task();
+
+    return true;
+}
+
+
+bool
+scheduler::run_until(const std::function<bool()>& predicate, virtual_duration deadline)
+{
+    while (!predicate())
+    {
+        if (this->queue.empty() || this->queue.front().when > deadline)
+        {
+            this->clock = std::max(this->clock, deadline);
+            return predicate();
+        }
+
+        this->run_one();
+    }
+
+    return true;
+}
+
+
+void
+scheduler::run_for(virtual_duration duration)
+{
+    this->run_until([]{ return false; }, this->clock + duration);
+}
+
+
+size_t
+scheduler::pending() const
+{
+    return this->queue.size();
+}
+
+
+void
+scheduler::clear()
+{
+    this->queue.clear();
+}
+
+
+uint64_t
+scheduler::events_run() const
+{
+    return this->run_count;
+}
+
+
+io_context::io_context(std::shared_ptr<bzn::sim::scheduler> scheduler)
+    : scheduler(std::move(scheduler))
+{
+}
+
+
+std::unique_ptr<bzn::asio::tcp_acceptor_base>
+io_context::make_unique_tcp_acceptor(const boost::asio::ip::tcp::endpoint& /*ep*/)
+{
+    throw std::runtime_error("tcp acceptors are not available in the simulator");
+}
+
+
+std::unique_ptr<bzn::asio::tcp_socket_base>
+io_context::make_unique_tcp_socket()
+{
+    throw std::runtime_error("tcp sockets are not available in the simulator");
+}
+
+
+std::unique_ptr<bzn::asio::udp_socket_base>
+io_context::make_unique_udp_socket()
+{
+    throw std::runtime_error("udp sockets are not available in the simulator");
+}
+
+
+std::unique_ptr<bzn::asio::steady_timer_base>
+io_context::make_unique_steady_timer()
+{
+    return std::make_unique<bzn::sim::steady_timer>(this->shared_from_this());
+}
+
+
+std::unique_ptr<bzn::asio::strand_base>
+io_context::make_unique_strand()
+{
+    return std::make_unique<bzn::sim::strand>(this->dummy_io_context);
+}
+
+
+void
+io_context::post(bzn::asio::task func)
+{
+    this->schedule(virtual_duration(0), std::move(func));
+}
+
+
+boost::asio::io_context::count_type
+io_context::run()
+{
+    boost::asio::io_context::count_type count = 0;
+
+    while (!*this->stopped && this->scheduler->run_one())
+    {
+        count++;
+    }
+
+    return count;
+}
+
+
+void
+io_context::stop()
+{
+    *this->stopped = true;
+
+    auto tasks = std::move(this->stop_tasks);
+    this->stop_tasks.clear();
+
+    for (const auto& task : tasks)
+    {
+        task();
+    }
+}
+
+
+boost::asio::io_context&
+io_context::get_io_context()
+{
+    return this->dummy_io_context;
+}
+
+
+void
+io_context::schedule(virtual_duration delay, bzn::asio::task func)
+{
+    if (*this->stopped)
+    {
+        return;
+    }
+
+    this->scheduler->schedule(delay, [stopped = this->stopped, func = std::move(func)]()
+    {
+        if (!*stopped)
+        {
+            func();
+        }
+    });
+}
+
+
+void
+io_context::on_stop(bzn::asio::task func)
+{
+    if (*this->stopped)
+    {
+        func();
+        return;
+    }
+
+    this->stop_tasks.emplace_back(std::move(func));
+}
+
+
+bool
+io_context::is_stopped() const
+{
+    return *this->stopped;
+}
+
+
+bzn::sim::scheduler&
+io_context::get_scheduler()
+{
+    return *this->scheduler;
+}
+
+
+steady_timer::steady_timer(std::shared_ptr<bzn::sim::io_context> io_context)
+    : io_context(std::move(io_context))
+    , timer(this->io_context->get_io_context())
+{
+    // handlers usually keep the timer's owner alive, as they would a real io_context's...
+    this->io_context->on_stop([weak_state = std::weak_ptr<state_t>(this->state)]()
+    {
+        if (auto state = weak_state.lock())
+        {
+            state->waiting.clear();
+        }
+    });
+}
+
+
+steady_timer::~steady_timer()
+{
+    // like asio, destroying a timer aborts whatever is still waiting on it
+    this->cancel_waiting();
+}
+
+
+void
+steady_timer::async_wait(bzn::asio::wait_handler handler)
+{
+    const uint64_t id = this->state->next_wait_id++;
+    this->state->waiting[id] = std::move(handler);
+
+    this->io_context->schedule(this->state->expiry - this->io_context->get_scheduler().now(),
+        [weak_state = std::weak_ptr<state_t>(this->state), id]()
+        {
+            auto state = weak_state.lock();
+            if (!state)
+            {
+                return;
+            }
+
+            auto it = state->waiting.find(id);
+            if (it == state->waiting.end())
+            {
+                return;
+            }
+
+            auto handler = std::move(it->second);
+            state->waiting.erase(it);
+            handler(boost::system::error_code());
+        });
+}
+
+
+std::size_t
+steady_timer::expires_from_now(const std::chrono::milliseconds& expiry_time)
+{
+    const size_t cancelled = this->cancel_waiting();
+    this->state->expiry = this->io_context->get_scheduler().now() + expiry_time;
+
+    return cancelled;
+}
+
+
+void
+steady_timer::cancel()
+{
+    this->cancel_waiting();
+}
+
+
+boost::asio::steady_timer&
+steady_timer::get_steady_timer()
+{
+    return this->timer;
+}
+
+
+size_t
+steady_timer::cancel_waiting()
+{
+    auto waiting = std::move(this->state->waiting);
+    this->state->waiting.clear();
+
+    for (auto& entry : waiting)
+    {
+        this->io_context->post([handler = std::move(entry.second)]()
+        {
+            handler(boost::asio::error::operation_aborted);
+        });
+    }
+
+    return waiting.size();
+}
+
+
+strand::strand(boost::asio::io_context& io_context)
+    : s(io_context)
+{
+}
+
+
+bzn::asio::write_handler
+strand::wrap(bzn::asio::write_handler handler)
+{
+    return handler;
+}
+
+
+bzn::asio::close_handler
+strand::wrap(bzn::asio::close_handler handler)
+{
+    return handler;
+}
+
+
+boost::asio::io_context::strand&
+strand::get_strand()
+{
+    return this->s;
+}
@@ -0,0 +1,187 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <include/boost_asio_beast.hpp>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <map>
+#include <vector>
+
+
+namespace bzn::sim
+{
+    using virtual_duration = std::chrono::microseconds;
+
+    /**
+     * Virtual clock and event queue shared by every replica of a simulated swarm. Events run in (time, insertion)
+     * order on the calling thread, so a run is fully reproducible and the clock jumps straight to the next event
+     * instead of waiting for it.
+     */
+    class scheduler
+    {
+    public:
+        virtual_duration now() const;
+
+        void schedule(virtual_duration delay, bzn::asio::task task);
+
+        /**
+         * Run the next event, advancing the clock to its due time
+         * @return false if there was nothing to run
+         */
+        bool run_one();
+
+        /**
+         * Run events until predicate returns true, the queue drains or the clock would pass deadline
+         * @return true if predicate was satisfied
+         */
+        bool run_until(const std::function<bool()>& predicate, virtual_duration deadline);
+
+        /**
+         * Run every event due up to and including deadline, then move the clock to deadline
+         */
+        void run_for(virtual_duration duration);
+
+        size_t pending() const;
+
+        /**
+         * Drop every queued event without running it
+         */
+        void clear();
+
+        uint64_t events_run() const;
+
+    private:
+        struct event
+        {
+            virtual_duration when;
+            uint64_t order;
+            bzn::asio::task task;
+        };
+
+        struct later
+        {
+            bool operator()(const event& lhs, const event& rhs) const
+            {
+                return lhs.when != rhs.when ? lhs.when > rhs.when : lhs.order > rhs.order;
+            }
+        };
+
+        std::vector<event> queue;
+        virtual_duration clock{0};
+        uint64_t next_order = 0;
+        uint64_t run_count = 0;
+    };
+
+
+    /**
+     * io_context_base for one simulated replica. Posted tasks and timers run on the shared scheduler; once stopped
+     * (the replica crashed) anything still queued for it is silently discarded.
+     */
+    class io_context final : public bzn::asio::io_context_base, public std::enable_shared_from_this<io_context>
+    {
+    public:
+        explicit io_context(std::shared_ptr<bzn::sim::scheduler> scheduler);
+
+        std::unique_ptr<bzn::asio::tcp_acceptor_base> make_unique_tcp_acceptor(const boost::asio::ip::tcp::endpoint& ep) override;
+
+        std::unique_ptr<bzn::asio::tcp_socket_base> make_unique_tcp_socket() override;
+
+        std::unique_ptr<bzn::asio::udp_socket_base> make_unique_udp_socket() override;
+
+        std::unique_ptr<bzn::asio::steady_timer_base> make_unique_steady_timer() override;
+
+        std::unique_ptr<bzn::asio::strand_base> make_unique_strand() override;
+
+        void post(bzn::asio::task func) override;
+
+        boost::asio::io_context::count_type run() override;
+
+        void stop() override;
+
+        boost::asio::io_context& get_io_context() override;
+
+        void schedule(virtual_duration delay, bzn::asio::task func);
+
+        /**
+         * Run func when the context is stopped, to let go of handlers that will now never be called
+         */
+        void on_stop(bzn::asio::task func);
+
+        bool is_stopped() const;
+
+        bzn::sim::scheduler& get_scheduler();
+
+    private:
+        const std::shared_ptr<bzn::sim::scheduler> scheduler;
+
+        // shared with queued tasks so a stop is seen by work that was scheduled before it
+        const std::shared_ptr<bool> stopped = std::make_shared<bool>(false);
+        std::vector<bzn::asio::task> stop_tasks;
+
+        // never run; only here for the rare caller that needs a real boost object
+        boost::asio::io_context dummy_io_context;
+    };
+
+
+    class steady_timer final : public bzn::asio::steady_timer_base
+    {
+    public:
+        explicit steady_timer(std::shared_ptr<bzn::sim::io_context> io_context);
+
+        ~steady_timer() override;
+
+        void async_wait(bzn::asio::wait_handler handler) override;
+
+        std::size_t expires_from_now(const std::chrono::milliseconds& expiry_time) override;
+
+        void cancel() override;
+
+        boost::asio::steady_timer& get_steady_timer() override;
+
+    private:
+        struct state_t
+        {
+            virtual_duration expiry{0};
+            uint64_t next_wait_id = 0;
+            std::map<uint64_t, bzn::asio::wait_handler> waiting;
+        };
+
+        size_t cancel_waiting();
+
+        const std::shared_ptr<bzn::sim::io_context> io_context;
+        const std::shared_ptr<state_t> state = std::make_shared<state_t>();
+        boost::asio::steady_timer timer;
+    };
+
+
+    class strand final : public bzn::asio::strand_base
+    {
+    public:
+        explicit strand(boost::asio::io_context& io_context);
+
+        // the simulation is single threaded, so there is nothing to serialize
+        bzn::asio::write_handler wrap(bzn::asio::write_handler handler) override;
+
+        bzn::asio::close_handler wrap(bzn::asio::close_handler handler) override;
+
+        boost::asio::io_context::strand& get_strand() override;
+
+    private:
+        boost::asio::io_context::strand s;
+    };
+
+} // namespace bzn::sim
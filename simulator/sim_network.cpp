@@ -0,0 +1,367 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <simulator/sim_network.hpp>
+
+using namespace bzn::sim;
+
+
+chaos::chaos(std::shared_ptr<bzn::sim::io_context> io_context, uint64_t seed, fault_model model)
+    : io_context(std::move(io_context))
+    , model(model)
+    , random(seed)
+{
+}
+
+
+void
+chaos::start()
+{
+}
+
+
+bool
+chaos::is_message_dropped()
+{
+    return this->model.drop_chance > 0.0 && this->model.drop_chance > this->random_float(this->random);
+}
+
+
+bool
+chaos::is_message_delayed()
+{
+    return this->model.delay_chance > 0.0 && this->model.delay_chance > this->random_float(this->random);
+}
+
+
+void
+chaos::reschedule_message(chaos_delay_callback callback) const
+{
+    this->io_context->schedule(this->model.delay, std::move(callback));
+}
+
+
+void
+chaos::set_model(fault_model model)
+{
+    this->model = model;
+}
+
+
+network::network(std::shared_ptr<bzn::sim::scheduler> scheduler, uint64_t seed, latency_model latency)
+    : scheduler(std::move(scheduler))
+    , random(seed)
+    , latency(latency)
+{
+}
+
+
+void
+network::attach(const endpoint_t& ep, std::shared_ptr<bzn::sim::node> node)
+{
+    this->nodes[ep] = node;
+}
+
+
+void
+network::send(const endpoint_t& from, const endpoint_t& to, std::shared_ptr<bzn::encoded_message> msg)
+{
+    this->sent_count++;
+    this->sent_bytes += msg->size();
+
+    auto it = this->nodes.find(to);
+    if (it == this->nodes.end() || !this->reachable(from, to))
+    {
+        this->lost_count++;
+        return;
+    }
+
+    auto delay = this->latency.base;
+    if (this->latency.jitter.count() > 0)
+    {
+        delay += virtual_duration(std::uniform_int_distribution<virtual_duration::rep>(0, this->latency.jitter.count())(this->random));
+    }
+
+    this->scheduler->schedule(delay, [target = it->second, from, msg = std::move(msg)]()
+    {
+        if (auto node = target.lock())
+        {
+            node->deliver(from, *msg);
+        }
+    });
+}
+
+
+void
+network::partition(const std::vector<std::vector<endpoint_t>>& groups)
+{
+    this->partition_of.clear();
+
+    for (size_t i = 0; i < groups.size(); i++)
+    {
+        for (const auto& ep : groups[i])
+        {
+            this->partition_of[ep] = i;
+        }
+    }
+}
+
+
+void
+network::heal()
+{
+    this->partition_of.clear();
+}
+
+
+void
+network::set_latency(latency_model latency)
+{
+    this->latency = latency;
+}
+
+
+uint64_t
+network::messages_sent() const
+{
+    return this->sent_count;
+}
+
+
+uint64_t
+network::messages_lost() const
+{
+    return this->lost_count;
+}
+
+
+uint64_t
+network::bytes_sent() const
+{
+    return this->sent_bytes;
+}
+
+
+bool
+network::reachable(const endpoint_t& from, const endpoint_t& to) const
+{
+    if (this->partition_of.empty() || from == to)
+    {
+        return true;
+    }
+
+    auto from_group = this->partition_of.find(from);
+    auto to_group = this->partition_of.find(to);
+
+    return from_group != this->partition_of.end() && to_group != this->partition_of.end()
+        && from_group->second == to_group->second;
+}
+
+
+node::node(std::shared_ptr<bzn::sim::io_context> io_context, std::shared_ptr<bzn::sim::network> network
+    , std::shared_ptr<bzn::chaos_base> chaos, endpoint_t ep, bzn::uuid_t uuid)
+    : io_context(std::move(io_context))
+    , network(std::move(network))
+    , chaos(std::move(chaos))
+    , ep(std::move(ep))
+    , uuid(std::move(uuid))
+{
+}
+
+
+bool
+node::register_for_message(const std::string& msg_type, bzn::message_handler /*msg_handler*/)
+{
+    LOG(warning) << "simulated nodes only carry protobuf messages, ignoring handler for " << msg_type;
+    return false;
+}
+
+
+bool
+node::register_for_message(const bzn_envelope::PayloadCase type, bzn::protobuf_handler msg_handler)
+{
+    return this->protobuf_handlers.emplace(type, std::move(msg_handler)).second;
+}
+
+
+void
+node::start()
+{
+    this->chaos->start();
+}
+
+
+void
+node::send_message_json(const endpoint_t& /*ep*/, std::shared_ptr<bzn::json_message> /*msg*/)
+{
+    LOG(warning) << "simulated nodes only carry protobuf messages, dropping json message";
+}
+
+
+void
+node::send_message(const endpoint_t& ep, std::shared_ptr<bzn_envelope> msg, bool close_session)
+{
+    if (msg->sender().empty())
+    {
+        msg->set_sender(this->uuid);
+    }
+
+    this->send_message_str(ep, std::make_shared<std::string>(msg->SerializeAsString()), close_session);
+}
+
+
+void
+node::send_message_str(const endpoint_t& ep, std::shared_ptr<bzn::encoded_message> msg, bool close_session)
+{
+    if (this->crashed || this->chaos->is_message_dropped())
+    {
+        return;
+    }
+
+    if (this->chaos->is_message_delayed())
+    {
+        this->chaos->reschedule_message(
+            [weak_self = this->weak_from_this(), ep, msg = std::move(msg), close_session]()
+            {
+                if (auto self = weak_self.lock(); self && !self->crashed)
+                {
+                    self->network->send(self->ep, ep, msg);
+                }
+            });
+        return;
+    }
+
+    this->network->send(this->ep, ep, std::move(msg));
+}
+
+
+void
+node::deliver(const endpoint_t& from, const bzn::encoded_message& msg)
+{
+    if (this->crashed)
+    {
+        return;
+    }
+
+    bzn_envelope env;
+    if (!env.ParseFromString(msg))
+    {
+        LOG(error) << "simulated node " << this->uuid << " failed to parse message";
+        return;
+    }
+
+    auto it = this->protobuf_handlers.find(env.payload_case());
+    if (it == this->protobuf_handlers.end())
+    {
+        LOG(debug) << "no handler for message type " << env.payload_case();
+        return;
+    }
+
+    it->second(env, std::make_shared<bzn::sim::session>(this->network, this->ep, from, ++this->next_session_id));
+}
+
+
+void
+node::crash()
+{
+    this->crashed = true;
+    this->io_context->stop();
+
+    // the handlers keep their owners alive, and a crashed node never calls them again
+    this->protobuf_handlers.clear();
+}
+
+
+bool
+node::is_crashed() const
+{
+    return this->crashed;
+}
+
+
+const endpoint_t&
+node::get_endpoint() const
+{
+    return this->ep;
+}
+
+
+session::session(std::shared_ptr<bzn::sim::network> network, endpoint_t local, endpoint_t remote, bzn::session_id id)
+    : network(std::move(network))
+    , local(std::move(local))
+    , remote(std::move(remote))
+    , id(id)
+{
+}
+
+
+void
+session::start(bzn::message_handler /*handler*/, bzn::protobuf_handler /*proto_handler*/)
+{
+}
+
+
+void
+session::send_message(std::shared_ptr<bzn::json_message> /*msg*/, bool end_session)
+{
+    LOG(warning) << "simulated sessions only carry protobuf messages, dropping json message";
+
+    if (end_session)
+    {
+        this->close();
+    }
+}
+
+
+void
+session::send_message(std::shared_ptr<bzn::encoded_message> msg, bool end_session)
+{
+    if (this->open)
+    {
+        this->network->send(this->local, this->remote, std::move(msg));
+    }
+
+    if (end_session)
+    {
+        this->close();
+    }
+}
+
+
+void
+session::send_datagram(std::shared_ptr<bzn::encoded_message> msg)
+{
+    this->send_message(std::move(msg), false);
+}
+
+
+void
+session::close()
+{
+    this->open = false;
+}
+
+
+bool
+session::is_open() const
+{
+    return this->open;
+}
+
+
+bzn::session_id
+session::get_session_id()
+{
+    return this->id;
+}
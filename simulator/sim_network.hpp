@@ -0,0 +1,201 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chaos/chaos_base.hpp>
+#include <node/node_base.hpp>
+#include <simulator/sim_io_context.hpp>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+
+
+namespace bzn::sim
+{
+    using endpoint_t = boost::asio::ip::tcp::endpoint;
+
+    /**
+     * Seeded fault model for messages leaving one replica. Mirrors the options understood by bzn::chaos, but every
+     * decision comes from a seeded generator and delays are served by the virtual clock instead of a steady_timer
+     * per message.
+     */
+    struct fault_model
+    {
+        double drop_chance = 0.0;
+        double delay_chance = 0.0;
+        virtual_duration delay{std::chrono::milliseconds(100)};
+    };
+
+
+    class chaos final : public bzn::chaos_base
+    {
+    public:
+        chaos(std::shared_ptr<bzn::sim::io_context> io_context, uint64_t seed, fault_model model);
+
+        // crashes are injected explicitly through the swarm, there is no death timer
+        void start() override;
+
+        bool is_message_dropped() override;
+
+        bool is_message_delayed() override;
+
+        void reschedule_message(chaos_delay_callback callback) const override;
+
+        void set_model(fault_model model);
+
+    private:
+        const std::shared_ptr<bzn::sim::io_context> io_context;
+        fault_model model;
+        std::mt19937_64 random;
+        std::uniform_real_distribution<> random_float{0.0, 1.0};
+    };
+
+
+    /**
+     * Transport latency between any two replicas: base plus a uniformly distributed jitter
+     */
+    struct latency_model
+    {
+        virtual_duration base{std::chrono::microseconds(500)};
+        virtual_duration jitter{std::chrono::microseconds(250)};
+    };
+
+
+    class node;
+
+    /**
+     * In-process network connecting simulated nodes by endpoint. Delivery is delayed by the seeded latency model and
+     * refused across partitions.
+     */
+    class network
+    {
+    public:
+        network(std::shared_ptr<bzn::sim::scheduler> scheduler, uint64_t seed, latency_model latency = {});
+
+        void attach(const endpoint_t& ep, std::shared_ptr<bzn::sim::node> node);
+
+        void send(const endpoint_t& from, const endpoint_t& to, std::shared_ptr<bzn::encoded_message> msg);
+
+        /**
+         * Split the network; endpoints in different groups (or in no group) can no longer reach each other
+         */
+        void partition(const std::vector<std::vector<endpoint_t>>& groups);
+
+        void heal();
+
+        void set_latency(latency_model latency);
+
+        uint64_t messages_sent() const;
+
+        uint64_t messages_lost() const;
+
+        uint64_t bytes_sent() const;
+
+    private:
+        bool reachable(const endpoint_t& from, const endpoint_t& to) const;
+
+        const std::shared_ptr<bzn::sim::scheduler> scheduler;
+        std::mt19937_64 random;
+        latency_model latency;
+
+        std::map<endpoint_t, std::weak_ptr<bzn::sim::node>> nodes;
+        std::map<endpoint_t, size_t> partition_of;
+
+        uint64_t sent_count = 0;
+        uint64_t lost_count = 0;
+        uint64_t sent_bytes = 0;
+    };
+
+
+    /**
+     * node_base for one simulated replica: messages go through its chaos model and then the shared network
+     */
+    class node final : public bzn::node_base, public std::enable_shared_from_this<node>
+    {
+    public:
+        node(std::shared_ptr<bzn::sim::io_context> io_context, std::shared_ptr<bzn::sim::network> network
+            , std::shared_ptr<bzn::chaos_base> chaos, endpoint_t ep, bzn::uuid_t uuid);
+
+        bool register_for_message(const std::string& msg_type, bzn::message_handler msg_handler) override;
+
+        bool register_for_message(const bzn_envelope::PayloadCase type, bzn::protobuf_handler msg_handler) override;
+
+        void start() override;
+
+        void send_message_json(const endpoint_t& ep, std::shared_ptr<bzn::json_message> msg) override;
+
+        void send_message(const endpoint_t& ep, std::shared_ptr<bzn_envelope> msg, bool close_session) override;
+
+        void send_message_str(const endpoint_t& ep, std::shared_ptr<bzn::encoded_message> msg, bool close_session) override;
+
+        /**
+         * Called by the network when a message for this node arrives
+         */
+        void deliver(const endpoint_t& from, const bzn::encoded_message& msg);
+
+        /**
+         * Stop the replica: nothing is sent or received and its pending timers never fire
+         */
+        void crash();
+
+        bool is_crashed() const;
+
+        const endpoint_t& get_endpoint() const;
+
+    private:
+        const std::shared_ptr<bzn::sim::io_context> io_context;
+        const std::shared_ptr<bzn::sim::network> network;
+        const std::shared_ptr<bzn::chaos_base> chaos;
+        const endpoint_t ep;
+        const bzn::uuid_t uuid;
+
+        std::map<bzn_envelope::PayloadCase, bzn::protobuf_handler> protobuf_handlers;
+        bzn::session_id next_session_id = 0;
+        bool crashed = false;
+    };
+
+
+    /**
+     * Session handed to message handlers so they can reply to the sender
+     */
+    class session final : public bzn::session_base
+    {
+    public:
+        session(std::shared_ptr<bzn::sim::network> network, endpoint_t local, endpoint_t remote, bzn::session_id id);
+
+        void start(bzn::message_handler handler, bzn::protobuf_handler proto_handler) override;
+
+        void send_message(std::shared_ptr<bzn::json_message> msg, bool end_session) override;
+
+        void send_message(std::shared_ptr<bzn::encoded_message> msg, bool end_session) override;
+
+        void send_datagram(std::shared_ptr<bzn::encoded_message> msg) override;
+
+        void close() override;
+
+        bool is_open() const override;
+
+        bzn::session_id get_session_id() override;
+
+    private:
+        const std::shared_ptr<bzn::sim::network> network;
+        const endpoint_t local;
+        const endpoint_t remote;
+        const bzn::session_id id;
+        bool open = true;
+    };
+
+} // namespace bzn::sim
@@ -0,0 +1,434 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <simulator/sim_swarm.hpp>
+#include <crypto/crypto.hpp>
+#include <options/options.hpp>
+#include <pbft/operations/pbft_operation_manager.hpp>
+#include <utils/make_endpoint.hpp>
+#include <boost/format.hpp>
+
+using namespace bzn::sim;
+
+namespace
+{
+    const std::string REPLICA_HOST{"127.0.0.1"};
+    const uint16_t FIRST_REPLICA_PORT{20000};
+    const uint16_t FIRST_REPLICA_HTTP_PORT{40000};
+
+    bzn::hash_t
+    chain_hash(const bzn::hash_t& state, const bzn::hash_t& request_hash)
+    {
+        // fnv-1a: cheap, and identical on every replica for the same sequence of requests
+        uint64_t hash = 14695981039346656037ull;
+        for (const auto& bytes : {std::cref(state), std::cref(request_hash)})
+        {
+            for (unsigned char c : bytes.get())
+            {
+                hash = (hash ^ c) * 1099511628211ull;
+            }
+        }
+
+        return std::to_string(hash);
+    }
+}
+
+
+service::service(std::shared_ptr<bzn::sim::io_context> io_context)
+    : io_context(std::move(io_context))
+{
+}
+
+
+void
+service::apply_operation(const std::shared_ptr<pbft_operation>& op)
+{
+    if (op->get_sequence() >= this->next_sequence)
+    {
+        this->waiting_operations[op->get_sequence()] = op;
+        this->execute_ready_operations();
+    }
+}
+
+
+bool
+service::apply_operation_now(const bzn_envelope& /*msg*/, std::shared_ptr<bzn::session_base> /*session*/)
+{
+    return false;
+}
+
+
+bzn::hash_t
+service::service_state_hash(uint64_t sequence_number) const
+{
+    auto it = this->saved_state_hashes.find(sequence_number);
+    return it == this->saved_state_hashes.end() ? bzn::hash_t{} : it->second;
+}
+
+
+std::shared_ptr<bzn::service_state_t>
+service::get_service_state(uint64_t sequence_number) const
+{
+    auto it = this->saved_state_hashes.find(sequence_number);
+    return it == this->saved_state_hashes.end() ? nullptr : std::make_shared<bzn::service_state_t>(it->second);
+}
+
+
+bool
+service::set_service_state(uint64_t sequence_number, const bzn::service_state_t& data, const bzn::hash_t& state_hash)
+{
+    // the rolling hash is the whole state of this service
+    if (data != state_hash)
+    {
+        return false;
+    }
+
+    this->state_hash = data;
+    this->saved_state_hashes[sequence_number] = data;
+    this->next_sequence = sequence_number + 1;
+    this->waiting_operations.erase(this->waiting_operations.begin(), this->waiting_operations.lower_bound(this->next_sequence));
+
+    this->execute_ready_operations();
+
+    return true;
+}
+
+
+std::shared_ptr<std::vector<bzn_envelope>>
+service::get_service_state_delta(uint64_t /*from_sequence*/, uint64_t /*to_sequence*/) const
+{
+    return nullptr;
+}
+
+
+bool
+service::apply_service_state_delta(uint64_t /*from_sequence*/, uint64_t /*to_sequence*/, const bzn::hash_t& /*state_hash*/, const std::vector<bzn_envelope>& /*requests*/)
+{
+    return false;
+}
+
+
+void
+service::save_service_state_at(uint64_t sequence_number)
+{
+    this->checkpoints_to_save.insert(sequence_number);
+}
+
+
+void
+service::consolidate_log(uint64_t sequence_number)
+{
+    this->saved_state_hashes.erase(this->saved_state_hashes.begin(), this->saved_state_hashes.lower_bound(sequence_number));
+}
+
+
+void
+service::register_execute_handler(bzn::execute_handler_t handler)
+{
+    this->execute_handler = std::move(handler);
+}
+
+
+bool
+service::is_saturated() const
+{
+    return false;
+}
+
+
+uint64_t
+service::executed_count() const
+{
+    return this->next_sequence - 1;
+}
+
+
+const bzn::hash_t&
+service::current_state_hash() const
+{
+    return this->state_hash;
+}
+
+
+void
+service::execute_ready_operations()
+{
+    for (auto it = this->waiting_operations.find(this->next_sequence); it != this->waiting_operations.end();
+         it = this->waiting_operations.find(this->next_sequence))
+    {
+        auto op = it->second;
+        this->waiting_operations.erase(it);
+
+        this->state_hash = chain_hash(this->state_hash, op->get_request_hash());
+
+        // like the database service, don't rely on pbft's request to save arriving before we execute this far
+        if (this->checkpoints_to_save.erase(this->next_sequence) || this->next_sequence % CHECKPOINT_INTERVAL == 0)
+        {
+            this->saved_state_hashes[this->next_sequence] = this->state_hash;
+        }
+
+        this->next_sequence++;
+
+        if (this->execute_handler)
+        {
+            this->io_context->post(std::bind(this->execute_handler, op));
+        }
+    }
+}
+
+
+swarm::swarm(size_t replica_count, uint64_t seed, latency_model latency, fault_model faults)
+    : scheduler(std::make_shared<bzn::sim::scheduler>())
+    , network(std::make_shared<bzn::sim::network>(this->scheduler, seed, latency))
+{
+    std::vector<bzn::peer_address_t> addresses;
+    for (size_t i = 0; i < replica_count; i++)
+    {
+        addresses.emplace_back(REPLICA_HOST, FIRST_REPLICA_PORT + i, FIRST_REPLICA_HTTP_PORT + i
+            , "replica" + std::to_string(i), str(boost::format("sim-replica-%03d") % i));
+        this->peers.insert(addresses.back());
+        this->replica_index[addresses.back().uuid] = i;
+    }
+
+    for (size_t i = 0; i < replica_count; i++)
+    {
+        auto options = std::make_shared<bzn::options>();
+        options->get_mutable_simple_options().set(bzn::option_names::NODE_UUID, addresses[i].uuid);
+        options->get_mutable_simple_options().set(bzn::option_names::CRYPTO_ENABLED_OUTGOING, "false");
+        options->get_mutable_simple_options().set(bzn::option_names::CRYPTO_ENABLED_INCOMING, "false");
+
+        replica_t replica;
+        replica.io_context = std::make_shared<bzn::sim::io_context>(this->scheduler);
+        replica.node = std::make_shared<bzn::sim::node>(replica.io_context, this->network
+            , std::make_shared<bzn::sim::chaos>(replica.io_context, seed + i + 1, faults)
+            , bzn::make_endpoint(addresses[i]), addresses[i].uuid);
+        replica.service = std::make_shared<bzn::sim::service>(replica.io_context);
+        replica.pbft = std::make_shared<bzn::pbft>(replica.node, replica.io_context, this->peers, options, replica.service
+            , std::make_shared<bzn::pbft_failure_detector>(replica.io_context), std::make_shared<bzn::crypto>(options)
+            , std::make_shared<bzn::pbft_operation_manager>());
+        replica.pbft->set_audit_enabled(false);
+
+        this->network->attach(replica.node->get_endpoint(), replica.node);
+        this->replicas.push_back(std::move(replica));
+    }
+}
+
+
+swarm::~swarm()
+{
+    // queued events and message handlers hold on to the replicas, which hold on to the scheduler...
+    for (auto& replica : this->replicas)
+    {
+        replica.node->crash();
+    }
+
+    this->scheduler->clear();
+}
+
+
+void
+swarm::start()
+{
+    for (auto& replica : this->replicas)
+    {
+        replica.node->start();
+        replica.pbft->start();
+    }
+}
+
+
+size_t
+swarm::size() const
+{
+    return this->replicas.size();
+}
+
+
+bzn::pbft&
+swarm::replica(size_t index)
+{
+    return *this->replicas.at(index).pbft;
+}
+
+
+const bzn::sim::service&
+swarm::service(size_t index) const
+{
+    return *this->replicas.at(index).service;
+}
+
+
+bzn::sim::node&
+swarm::node(size_t index)
+{
+    return *this->replicas.at(index).node;
+}
+
+
+bzn::sim::network&
+swarm::get_network()
+{
+    return *this->network;
+}
+
+
+bzn::sim::scheduler&
+swarm::get_scheduler()
+{
+    return *this->scheduler;
+}
+
+
+void
+swarm::submit(size_t index)
+{
+    this->submit(index, this->make_request());
+}
+
+
+void
+swarm::submit_to_all()
+{
+    const auto request = this->make_request();
+    for (size_t i = 0; i < this->replicas.size(); i++)
+    {
+        this->submit(i, request);
+    }
+}
+
+
+bzn_envelope
+swarm::make_request()
+{
+    const uint64_t request_id = ++this->next_request;
+
+    database_msg msg;
+    msg.mutable_header()->set_db_uuid("sim");
+    msg.mutable_header()->set_nonce(request_id);
+    msg.mutable_create()->set_key("key" + std::to_string(request_id));
+    msg.mutable_create()->set_value("value" + std::to_string(request_id));
+
+    bzn_envelope request;
+    request.set_sender("sim-client");
+    request.set_database_msg(msg.SerializeAsString());
+
+    // pbft checks request age against the wall clock, so requests are stamped with it rather than virtual time
+    request.set_timestamp(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+
+    return request;
+}
+
+
+void
+swarm::submit(size_t index, const bzn_envelope& request)
+{
+    auto& replica = this->replicas.at(index);
+    replica.io_context->post([pbft = replica.pbft, request]()
+    {
+        pbft->handle_database_message(request, nullptr);
+    });
+}
+
+
+void
+swarm::crash(size_t index)
+{
+    this->replicas.at(index).node->crash();
+}
+
+
+void
+swarm::partition(const std::vector<std::vector<size_t>>& groups)
+{
+    std::vector<std::vector<endpoint_t>> endpoints;
+    for (const auto& group : groups)
+    {
+        endpoints.emplace_back();
+        for (auto index : group)
+        {
+            endpoints.back().push_back(this->replicas.at(index).node->get_endpoint());
+        }
+    }
+
+    this->network->partition(endpoints);
+}
+
+
+void
+swarm::heal()
+{
+    this->network->heal();
+}
+
+
+std::optional<size_t>
+swarm::primary()
+{
+    for (auto& replica : this->replicas)
+    {
+        if (!replica.node->is_crashed() && replica.pbft->is_view_valid())
+        {
+            return this->replica_index.at(replica.pbft->get_primary().uuid);
+        }
+    }
+
+    return std::nullopt;
+}
+
+
+uint64_t
+swarm::min_executed() const
+{
+    uint64_t result = std::numeric_limits<uint64_t>::max();
+    for (const auto& replica : this->replicas)
+    {
+        if (!replica.node->is_crashed())
+        {
+            result = std::min(result, replica.service->executed_count());
+        }
+    }
+
+    return result;
+}
+
+
+uint64_t
+swarm::min_view()
+{
+    uint64_t result = std::numeric_limits<uint64_t>::max();
+    for (auto& replica : this->replicas)
+    {
+        if (!replica.node->is_crashed())
+        {
+            result = std::min(result, replica.pbft->is_view_valid() ? replica.pbft->get_view() : 0);
+        }
+    }
+
+    return result;
+}
+
+
+bool
+swarm::run_until(const std::function<bool()>& predicate, virtual_duration timeout)
+{
+    return this->scheduler->run_until(predicate, this->scheduler->now() + timeout);
+}
+
+
+void
+swarm::run_for(virtual_duration duration)
+{
+    this->scheduler->run_for(duration);
+}
@@ -0,0 +1,153 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <pbft/pbft.hpp>
+#include <pbft/pbft_failure_detector.hpp>
+#include <pbft/pbft_service_base.hpp>
+#include <simulator/sim_network.hpp>
+#include <map>
+#include <optional>
+#include <set>
+
+
+namespace bzn::sim
+{
+    /**
+     * Minimal replicated service: executes operations strictly in sequence order and keeps a rolling hash of
+     * everything executed so replicas can compare state at checkpoints.
+     */
+    class service final : public bzn::pbft_service_base
+    {
+    public:
+        explicit service(std::shared_ptr<bzn::sim::io_context> io_context);
+
+        void apply_operation(const std::shared_ptr<pbft_operation>& op) override;
+        bool apply_operation_now(const bzn_envelope& msg, std::shared_ptr<bzn::session_base> session) override;
+        bzn::hash_t service_state_hash(uint64_t sequence_number) const override;
+        std::shared_ptr<bzn::service_state_t> get_service_state(uint64_t sequence_number) const override;
+        bool set_service_state(uint64_t sequence_number, const bzn::service_state_t& data, const bzn::hash_t& state_hash) override;
+        std::shared_ptr<std::vector<bzn_envelope>> get_service_state_delta(uint64_t from_sequence, uint64_t to_sequence) const override;
+        bool apply_service_state_delta(uint64_t from_sequence, uint64_t to_sequence, const bzn::hash_t& state_hash, const std::vector<bzn_envelope>& requests) override;
+        void save_service_state_at(uint64_t sequence_number) override;
+        void consolidate_log(uint64_t sequence_number) override;
+        void register_execute_handler(bzn::execute_handler_t handler) override;
+        bool is_saturated() const override;
+
+        uint64_t executed_count() const;
+
+        const bzn::hash_t& current_state_hash() const;
+
+    private:
+        void execute_ready_operations();
+
+        const std::shared_ptr<bzn::sim::io_context> io_context;
+        bzn::execute_handler_t execute_handler;
+
+        uint64_t next_sequence = 1;
+        std::map<uint64_t, std::shared_ptr<pbft_operation>> waiting_operations;
+
+        bzn::hash_t state_hash;
+        std::set<uint64_t> checkpoints_to_save;
+        std::map<uint64_t, bzn::hash_t> saved_state_hashes;
+    };
+
+
+    /**
+     * A whole pbft swarm in one process: every replica runs the real pbft implementation on top of the simulated
+     * io_context, node and network, all driven by one virtual clock. The same seed always yields the same run.
+     */
+    class swarm
+    {
+    public:
+        swarm(size_t replica_count, uint64_t seed, latency_model latency = {}, fault_model faults = {});
+
+        ~swarm();
+
+        void start();
+
+        size_t size() const;
+
+        bzn::pbft& replica(size_t index);
+
+        const bzn::sim::service& service(size_t index) const;
+
+        bzn::sim::node& node(size_t index);
+
+        bzn::sim::network& get_network();
+
+        bzn::sim::scheduler& get_scheduler();
+
+        /**
+         * Hand a new client write to a replica, which forwards it to the primary if it isn't the primary itself
+         */
+        void submit(size_t index);
+
+        /**
+         * Hand the same new client write to every live replica, as a client does once its request has timed out
+         */
+        void submit_to_all();
+
+        void crash(size_t index);
+
+        /**
+         * Split the replicas into groups that can only talk among themselves
+         */
+        void partition(const std::vector<std::vector<size_t>>& groups);
+
+        void heal();
+
+        /**
+         * @return replica index of the primary of the current view, as seen by the first live replica
+         */
+        std::optional<size_t> primary();
+
+        /**
+         * @return lowest number of operations executed by any live replica
+         */
+        uint64_t min_executed() const;
+
+        /**
+         * @return lowest view held by any live replica, 0 while any of them is still changing views
+         */
+        uint64_t min_view();
+
+        bool run_until(const std::function<bool()>& predicate, virtual_duration timeout);
+
+        void run_for(virtual_duration duration);
+
+    private:
+        bzn_envelope make_request();
+        void submit(size_t index, const bzn_envelope& request);
+
+        struct replica_t
+        {
+            std::shared_ptr<bzn::sim::io_context> io_context;
+            std::shared_ptr<bzn::sim::node> node;
+            std::shared_ptr<bzn::sim::service> service;
+            std::shared_ptr<bzn::pbft> pbft;
+        };
+
+        const std::shared_ptr<bzn::sim::scheduler> scheduler;
+        const std::shared_ptr<bzn::sim::network> network;
+
+        bzn::peers_list_t peers;
+        std::vector<replica_t> replicas;
+        std::map<bzn::uuid_t, size_t> replica_index;
+
+        uint64_t next_request = 0;
+    };
+
+} // namespace bzn::sim
@@ -0,0 +1,181 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <simulator/sim_swarm.hpp>
+#include <gtest/gtest.h>
+#include <algorithm>
+
+using namespace ::testing;
+
+namespace
+{
+    const std::chrono::seconds TEST_TIMEOUT{60};
+
+
+    void
+    submit_and_execute(bzn::sim::swarm& swarm, size_t replica, size_t count)
+    {
+        const uint64_t target = swarm.min_executed() + count;
+        for (size_t i = 0; i < count; i++)
+        {
+            swarm.submit(replica);
+        }
+
+        ASSERT_TRUE(swarm.run_until([&]{ return swarm.min_executed() >= target; }, TEST_TIMEOUT));
+    }
+}
+
+
+TEST(simulator_test, test_that_scheduler_runs_events_in_virtual_time_order)
+{
+    bzn::sim::scheduler scheduler;
+    std::vector<int> order;
+
+    scheduler.schedule(std::chrono::milliseconds(20), [&]{ order.push_back(3); });
+    scheduler.schedule(std::chrono::milliseconds(10), [&]{ order.push_back(1); });
+    scheduler.schedule(std::chrono::milliseconds(10), [&]{ order.push_back(2); });
+
+    scheduler.run_for(std::chrono::milliseconds(15));
+    EXPECT_EQ(order, std::vector<int>({1, 2}));
+    EXPECT_EQ(scheduler.now(), std::chrono::milliseconds(15));
+
+    EXPECT_TRUE(scheduler.run_one());
+    EXPECT_EQ(order, std::vector<int>({1, 2, 3}));
+    EXPECT_EQ(scheduler.now(), std::chrono::milliseconds(20));
+    EXPECT_FALSE(scheduler.run_one());
+}
+
+
+TEST(simulator_test, test_that_timers_fire_and_cancel_in_virtual_time)
+{
+    auto scheduler = std::make_shared<bzn::sim::scheduler>();
+    auto io_context = std::make_shared<bzn::sim::io_context>(scheduler);
+
+    auto timer = io_context->make_unique_steady_timer();
+    std::vector<boost::system::error_code> results;
+
+    timer->expires_from_now(std::chrono::seconds(10));
+    timer->async_wait([&](const auto& ec){ results.push_back(ec); });
+
+    scheduler->run_for(std::chrono::seconds(9));
+    EXPECT_TRUE(results.empty());
+
+    scheduler->run_for(std::chrono::seconds(1));
+    ASSERT_EQ(results.size(), 1u);
+    EXPECT_FALSE(results[0]);
+
+    timer->expires_from_now(std::chrono::seconds(10));
+    timer->async_wait([&](const auto& ec){ results.push_back(ec); });
+    EXPECT_EQ(timer->expires_from_now(std::chrono::seconds(10)), 1u);
+
+    scheduler->run_for(std::chrono::seconds(1));
+    ASSERT_EQ(results.size(), 2u);
+    EXPECT_EQ(results[1], boost::asio::error::operation_aborted);
+
+    // nothing runs for a stopped (crashed) context
+    timer->async_wait([&](const auto& ec){ results.push_back(ec); });
+    io_context->stop();
+    scheduler->run_for(std::chrono::seconds(60));
+    EXPECT_EQ(results.size(), 2u);
+}
+
+
+TEST(simulator_test, test_that_swarm_executes_requests_on_every_replica)
+{
+    bzn::sim::swarm swarm(4, 1);
+    swarm.start();
+
+    ASSERT_TRUE(swarm.primary());
+    const size_t backup = (*swarm.primary() + 1) % swarm.size();
+
+    submit_and_execute(swarm, *swarm.primary(), 5);
+    submit_and_execute(swarm, backup, 5);
+
+    EXPECT_EQ(swarm.min_executed(), 10u);
+    for (size_t i = 1; i < swarm.size(); i++)
+    {
+        EXPECT_EQ(swarm.service(i).current_state_hash(), swarm.service(0).current_state_hash());
+    }
+}
+
+
+TEST(simulator_test, test_that_runs_with_the_same_seed_are_identical)
+{
+    auto run = [](uint64_t seed)
+    {
+        bzn::sim::swarm swarm(4, seed, {}, bzn::sim::fault_model{0.0, 0.3, std::chrono::milliseconds(5)});
+        swarm.start();
+        submit_and_execute(swarm, 0, 10);
+
+        return std::make_tuple(swarm.get_scheduler().now(), swarm.get_scheduler().events_run(), swarm.get_network().messages_sent());
+    };
+
+    EXPECT_EQ(run(7), run(7));
+    EXPECT_NE(std::get<0>(run(7)), std::get<0>(run(8)));
+}
+
+
+TEST(simulator_test, test_that_crashed_primary_is_replaced_by_view_change)
+{
+    bzn::sim::swarm swarm(4, 3);
+    swarm.start();
+
+    const size_t old_primary = *swarm.primary();
+    const size_t backup = (old_primary + 1) % swarm.size();
+    submit_and_execute(swarm, backup, 2);
+
+    const auto old_view = swarm.min_view();
+    swarm.crash(old_primary);
+
+    // the backups notice the primary is gone when the forwarded request does not execute
+    swarm.submit_to_all();
+    ASSERT_TRUE(swarm.run_until([&]{ return swarm.min_view() > old_view; }, TEST_TIMEOUT));
+
+    ASSERT_TRUE(swarm.primary());
+    EXPECT_NE(*swarm.primary(), old_primary);
+
+    submit_and_execute(swarm, backup, 2);
+}
+
+
+TEST(simulator_test, test_that_partitioned_minority_does_not_stop_the_majority)
+{
+    bzn::sim::swarm swarm(4, 5);
+    swarm.start();
+
+    const size_t primary = *swarm.primary();
+    const size_t isolated = (primary + 1) % swarm.size();
+    std::vector<size_t> majority;
+    for (size_t i = 0; i < swarm.size(); i++)
+    {
+        if (i != isolated)
+        {
+            majority.push_back(i);
+        }
+    }
+    swarm.partition({majority, {isolated}});
+
+    for (size_t i = 0; i < 3; i++)
+    {
+        swarm.submit(primary);
+    }
+
+    ASSERT_TRUE(swarm.run_until([&]
+    {
+        return std::all_of(majority.begin(), majority.end(), [&](auto i){ return swarm.service(i).executed_count() >= 3; });
+    }, TEST_TIMEOUT));
+
+    EXPECT_EQ(swarm.service(isolated).executed_count(), 0u);
+    EXPECT_GT(swarm.get_network().messages_lost(), 0u);
+}
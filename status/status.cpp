@@ -13,6 +13,7 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <status/status.hpp>
+#include <metrics/metrics.hpp>
 #include <swarm_version.hpp>
 #include <swarm_git_commit.hpp>
 #include <proto/status.pb.h>
@@ -66,6 +67,13 @@ status::start()
 }
 
 
+void
+status::set_startup_time(std::chrono::milliseconds startup_time)
+{
+    this->startup_time = startup_time;
+}
+
+
 bzn::json_message
 status::query_modules()
 {
@@ -96,11 +104,13 @@ status::handle_status_request_message(const bzn_envelope& /*msg*/, std::shared_p
     srm.set_swarm_version(SWARM_VERSION);
     srm.set_swarm_git_commit(SWARM_GIT_COMMIT);
     srm.set_uptime(get_uptime(this->start_time));
+    srm.set_startup_time_ms(this->startup_time.count());
     srm.set_pbft_enabled(true);
 
     Json::Value module_status;
     module_status[MODULE_KEY] = this->query_modules();
     srm.set_module_status_json(module_status.toStyledString());
+    srm.set_metrics_json(bzn::metrics::registry::instance().to_json().toStyledString());
 
     LOG(debug) << srm.DebugString().substr(0, MAX_MESSAGE_SIZE);
 
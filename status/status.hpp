@@ -33,6 +33,12 @@ namespace bzn
 
         void start();
 
+        /**
+         * Record how long the node took from launch until it was ready to serve requests
+         * @param startup_time  reported in every status response
+         */
+        void set_startup_time(std::chrono::milliseconds startup_time);
+
     private:
         void handle_status_request_message(const bzn_envelope& msg, std::shared_ptr<bzn::session_base> session);
 
@@ -44,6 +50,7 @@ namespace bzn
         std::once_flag start_once;
 
         const std::chrono::steady_clock::time_point start_time;
+        std::chrono::milliseconds startup_time{};
     };
 
 } // namespace bzn
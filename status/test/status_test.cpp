@@ -18,6 +18,7 @@
 #include <mocks/mock_status_provider_base.hpp>
 #include <mocks/mock_session_base.hpp>
 #include <mocks/mock_node_base.hpp>
+#include <metrics/metrics.hpp>
 
 using namespace bzn;
 using namespace testing;
@@ -56,6 +57,8 @@ TEST(status_test, test_that_status_request_queries_status_providers)
 
     auto status = std::make_shared<bzn::status>(mock_node, bzn::status::status_provider_list_t{mock_status_provider, mock_status_provider});
 
+    bzn::metrics::registry::instance().get_counter("status_test_total").increment(7);
+
     bzn::protobuf_handler pbh;
     EXPECT_CALL(*mock_node, register_for_message(bzn_envelope::kStatusRequest, _)).WillOnce(Invoke(
         [&](auto, auto handler)
@@ -65,6 +68,7 @@ TEST(status_test, test_that_status_request_queries_status_providers)
         }));
 
     status->start();
+    status->set_startup_time(std::chrono::milliseconds(1234));
 
     // make protobuf request...
     EXPECT_CALL(*mock_status_provider, get_name()).WillOnce(Invoke(
@@ -93,6 +97,7 @@ TEST(status_test, test_that_status_request_queries_status_providers)
             ASSERT_EQ(sr.swarm_version(), SWARM_VERSION);
             ASSERT_EQ(sr.swarm_git_commit(), SWARM_GIT_COMMIT);
             ASSERT_EQ(sr.uptime(), "0 days, 0 hours, 0 minutes");
+            ASSERT_EQ(sr.startup_time_ms(), uint64_t(1234));
 
             Json::Value ms;
             Json::Reader reader;
@@ -100,6 +105,10 @@ TEST(status_test, test_that_status_request_queries_status_providers)
             ASSERT_EQ(ms["module"].size(), size_t(2));
             ASSERT_EQ(ms["module"][0]["name"].asString(), "mock1");
             ASSERT_EQ(ms["module"][1]["name"].asString(), "mock2");
+
+            Json::Value metrics;
+            reader.parse(sr.metrics_json(), metrics);
+            ASSERT_EQ(metrics["counters"]["status_test_total"].asUInt64(), uint64_t(7));
         }));
 
     pbh(bzn_envelope(), mock_session);
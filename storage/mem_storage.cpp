@@ -13,6 +13,7 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <storage/mem_storage.hpp>
+#include <metrics/metrics.hpp>
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/serialization/unordered_map.hpp>
@@ -20,10 +21,20 @@
 
 using namespace bzn;
 
+namespace
+{
+    auto& create_latency = bzn::metrics::registry::instance().get_histogram("storage_create_latency_us");
+    auto& read_latency = bzn::metrics::registry::instance().get_histogram("storage_read_latency_us");
+    auto& update_latency = bzn::metrics::registry::instance().get_histogram("storage_update_latency_us");
+    auto& remove_latency = bzn::metrics::registry::instance().get_histogram("storage_remove_latency_us");
+}
+
 
 bzn::storage_result
 mem_storage::create(const bzn::uuid_t& uuid, const std::string& key, const std::string& value)
 {
+    bzn::metrics::scoped_timer timer(create_latency);
+
     std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
 
     if (value.size() > bzn::MAX_VALUE_SIZE)
@@ -50,6 +61,7 @@ mem_storage::create(const bzn::uuid_t& uuid, const std::string& key, const std::
     {
         // todo: test if insert failed?
         inner_db.insert(std::make_pair(key,value));
+        this->state_tree.insert(uuid, key, value);
     }
     else
     {
@@ -63,6 +75,8 @@ mem_storage::create(const bzn::uuid_t& uuid, const std::string& key, const std::
 std::optional<bzn::value_t>
 mem_storage::read(const bzn::uuid_t& uuid, const std::string& key)
 {
+    bzn::metrics::scoped_timer timer(read_latency);
+
     std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
 
     auto search = this->kv_store.find(uuid);
@@ -83,9 +97,37 @@ mem_storage::read(const bzn::uuid_t& uuid, const std::string& key)
 }
 
 
+std::vector<std::optional<bzn::value_t>>
+mem_storage::read_many(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys)
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+
+    std::vector<std::optional<bzn::value_t>> values(keys.size());
+
+    auto search = this->kv_store.find(uuid);
+
+    if (search == this->kv_store.end())
+    {
+        return values;
+    }
+
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        if (auto inner_search = search->second.find(keys[i]); inner_search != search->second.end())
+        {
+            values[i] = inner_search->second;
+        }
+    }
+
+    return values;
+}
+
+
 bzn::storage_result
 mem_storage::update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value)
 {
+    bzn::metrics::scoped_timer timer(update_latency);
+
     std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
 
     if (value.size() > bzn::MAX_VALUE_SIZE)
@@ -110,6 +152,7 @@ mem_storage::update(const bzn::uuid_t& uuid, const std::string& key, const std::
         return bzn::storage_result::not_found;
     }
 
+    this->state_tree.update(uuid, key, inner_search->second, value);
     inner_search->second = value;
     return bzn::storage_result::ok;
 }
@@ -118,6 +161,8 @@ mem_storage::update(const bzn::uuid_t& uuid, const std::string& key, const std::
 bzn::storage_result
 mem_storage::remove(const bzn::uuid_t& uuid, const std::string& key)
 {
+    bzn::metrics::scoped_timer timer(remove_latency);
+
     std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
 
     auto search = this->kv_store.find(uuid);
@@ -134,6 +179,7 @@ mem_storage::remove(const bzn::uuid_t& uuid, const std::string& key)
         return bzn::storage_result::not_found;
     }
 
+    this->state_tree.remove(uuid, key, record->second);
     search->second.erase(record);
     return bzn::storage_result::ok;
 }
@@ -196,6 +242,25 @@ mem_storage::get_size(const bzn::uuid_t& uuid)
 }
 
 
+std::size_t
+mem_storage::get_approximate_size()
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+
+    std::size_t size{};
+
+    for (const auto& database : this->kv_store)
+    {
+        for (const auto& record : database.second)
+        {
+            size += record.first.size() + record.second.size();
+        }
+    }
+
+    return size;
+}
+
+
 bzn::storage_result
 mem_storage::remove(const bzn::uuid_t& uuid)
 {
@@ -203,6 +268,11 @@ mem_storage::remove(const bzn::uuid_t& uuid)
 
     if (auto it = this->kv_store.find(uuid); it != this->kv_store.end())
     {
+        for (const auto& record : it->second)
+        {
+            this->state_tree.remove(uuid, record.first, record.second);
+        }
+
         this->kv_store.erase(it);
 
         return bzn::storage_result::ok;
@@ -215,44 +285,81 @@ mem_storage::remove(const bzn::uuid_t& uuid)
 bool
 mem_storage::create_snapshot()
 {
-    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
-
-    try
+    // copying the store is enough to fix its contents, writers are only held off for that long
+    auto store = std::make_shared<kv_store_t>();
     {
-        std::stringstream strm;
-        boost::archive::text_oarchive archive(strm);
-        archive << this->kv_store;
-        this->latest_snapshot = std::make_shared<std::string>(strm.str());
-
-        return true;
-    }
-    catch (std::exception& ex)
-    {
-        LOG(error) << "Exception creating snapshot: " << ex.what();
+        std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+        *store = this->kv_store;
     }
 
-    return false;
+    std::lock_guard<std::mutex> lock(this->snapshot_lock);
+    this->snapshot_store = std::move(store);
+    this->latest_snapshot.reset();
+
+    return true;
 }
 
 
 std::shared_ptr<std::string>
 mem_storage::get_snapshot()
 {
-    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+    std::lock_guard<std::mutex> lock(this->snapshot_lock);
+
+    // serialized on first request, so it can be done away from the thread that created the snapshot
+    if (this->snapshot_store)
+    {
+        try
+        {
+            std::stringstream strm;
+            boost::archive::text_oarchive archive(strm);
+            archive << *this->snapshot_store;
+            this->latest_snapshot = std::make_shared<std::string>(strm.str());
+            this->snapshot_store.reset();
+        }
+        catch (std::exception& ex)
+        {
+            LOG(error) << "Exception creating snapshot: " << ex.what();
+        }
+    }
+
     return this->latest_snapshot;
 }
 
 
 bool
-mem_storage::load_snapshot(const std::string& data)
+mem_storage::load_snapshot(const std::string& data, const bzn::hash_t& state_hash)
 {
-    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for write access
+    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
 
     try
     {
+        // loaded to the side, so the current contents survive a snapshot that isn't the expected state
+        kv_store_t kv_store;
         std::stringstream strm(data);
         boost::archive::text_iarchive archive(strm);
-        archive >> this->kv_store;
+        archive >> kv_store;
+
+        bzn::merkle_state_tree state_tree;
+        for (const auto& db : kv_store)
+        {
+            for (const auto& record : db.second)
+            {
+                state_tree.insert(db.first, record.first, record.second);
+            }
+        }
+
+        if (!state_hash.empty() && state_tree.root_hash() != state_hash)
+        {
+            LOG(error) << "snapshot state hash " << state_tree.root_hash() << " does not match: " << state_hash;
+
+            return false;
+        }
+
+        this->kv_store = std::move(kv_store);
+        this->state_tree = std::move(state_tree);
+
+        std::lock_guard<std::mutex> snapshot_lock(this->snapshot_lock);
+        this->snapshot_store.reset();
         this->latest_snapshot = std::make_shared<std::string>(data);
 
         return true;
@@ -264,3 +371,21 @@ mem_storage::load_snapshot(const std::string& data)
 
     return false;
 }
+
+
+bzn::hash_t
+mem_storage::get_state_hash()
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+
+    return this->state_tree.root_hash();
+}
+
+
+std::vector<bzn::hash_t>
+mem_storage::get_state_hash_buckets()
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+
+    return this->state_tree.get_bucket_hashes();
+}
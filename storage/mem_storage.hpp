@@ -16,8 +16,10 @@
 
 #include <include/bluzelle.hpp>
 #include <storage/storage_base.hpp>
+#include <storage/merkle_state_tree.hpp>
 #include <unordered_map>
 #include <shared_mutex>
+#include <mutex>
 
 
 namespace bzn
@@ -30,6 +32,8 @@ namespace bzn
 
         std::optional<bzn::value_t> read(const bzn::uuid_t& uuid, const std::string& key) override;
 
+        std::vector<std::optional<bzn::value_t>> read_many(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) override;
+
         bzn::storage_result update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value) override;
 
         bzn::storage_result remove(const bzn::uuid_t& uuid, const std::string& key) override;
@@ -40,20 +44,33 @@ namespace bzn
 
         std::pair<std::size_t, std::size_t> get_size(const bzn::uuid_t& uuid) override;
 
+        std::size_t get_approximate_size() override;
+
         bzn::storage_result remove(const bzn::uuid_t& uuid) override;
 
         bool create_snapshot() override;
 
         std::shared_ptr<std::string> get_snapshot() override;
 
-        bool load_snapshot(const std::string& data) override;
+        bool load_snapshot(const std::string& data, const bzn::hash_t& state_hash) override;
+
+        bzn::hash_t get_state_hash() override;
+
+        std::vector<bzn::hash_t> get_state_hash_buckets() override;
 
     private:
-        std::unordered_map<bzn::uuid_t, std::unordered_map<bzn::key_t, bzn::value_t>> kv_store;
+        using kv_store_t = std::unordered_map<bzn::uuid_t, std::unordered_map<bzn::key_t, bzn::value_t>>;
+
+        kv_store_t kv_store;
 
         std::shared_mutex lock; // for multi-reader and single writer access
 
+        // copy taken by create_snapshot, serialized into latest_snapshot by the next get_snapshot
+        std::shared_ptr<kv_store_t> snapshot_store;
         std::shared_ptr<std::string> latest_snapshot;
+        std::mutex snapshot_lock;
+
+        bzn::merkle_state_tree state_tree;
     };
 
 } // bzn
@@ -0,0 +1,245 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <storage/merkle_state_tree.hpp>
+#include <openssl/sha.h>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace bzn;
+
+namespace
+{
+    const uint8_t MAX_DEPTH = 20;
+
+    bzn::hash_t
+    sha256(const std::string& data)
+    {
+        bzn::hash_t digest(SHA256_DIGEST_LENGTH, '\0');
+        SHA256(reinterpret_cast<const unsigned char*>(data.data()), data.size(), reinterpret_cast<unsigned char*>(&digest[0]));
+        return digest;
+    }
+
+
+    // only the concatenation is hashed, so a database stored in the old uuid+key layout (which can't tell where
+    // the uuid ends) hashes the same records to the same digests as any other...
+    bzn::hash_t
+    record_key_digest(const bzn::uuid_t& uuid, const bzn::key_t& key)
+    {
+        return sha256(uuid + key);
+    }
+
+
+    // a leaf is the sum of its records' digests modulo 2^256, so records such as ("ab", "c") and ("a", "bc")
+    // with the same value add up rather than cancel each other out as they would under xor...
+    void
+    add_digest(bzn::hash_t& leaf, const bzn::hash_t& digest, bool subtract)
+    {
+        int carry = 0;
+        for (size_t i = leaf.size(); i-- > 0;)
+        {
+            const int sum = int(uint8_t(leaf[i])) + (subtract ? -int(uint8_t(digest[i])) : int(uint8_t(digest[i]))) + carry;
+            leaf[i] = char(uint8_t(sum & 0xff));
+            carry = (sum < 0) ? -1 : (sum >> 8);
+        }
+    }
+
+
+    size_t
+    bucket_from_digest(const bzn::hash_t& key_digest, size_t leaf_count)
+    {
+        uint32_t index{};
+        for (size_t i = 0; i < sizeof(index); ++i)
+        {
+            index = (index << 8) | uint8_t(key_digest[i]);
+        }
+
+        return index & (leaf_count - 1);
+    }
+
+
+    std::string
+    to_hex(const std::string& bytes)
+    {
+        static const char* digits = "0123456789abcdef";
+
+        std::string result;
+        result.reserve(bytes.size() * 2);
+
+        for (const auto c : bytes)
+        {
+            result.push_back(digits[(uint8_t(c) >> 4) & 0x0f]);
+            result.push_back(digits[uint8_t(c) & 0x0f]);
+        }
+
+        return result;
+    }
+}
+
+
+merkle_state_tree::merkle_state_tree(uint8_t depth)
+    : leaf_count(size_t(1) << std::min(depth, MAX_DEPTH))
+{
+    if (depth > MAX_DEPTH)
+    {
+        throw std::runtime_error("merkle state tree depth too large: " + std::to_string(depth));
+    }
+
+    this->clear();
+}
+
+
+void
+merkle_state_tree::insert(const bzn::uuid_t& uuid, const bzn::key_t& key, const bzn::value_t& value)
+{
+    const auto key_digest = record_key_digest(uuid, key);
+    const size_t bucket = bucket_from_digest(key_digest, this->leaf_count);
+
+    add_digest(this->nodes[this->leaf_count + bucket], sha256(key_digest + value), false);
+
+    this->rehash_path(bucket);
+}
+
+
+void
+merkle_state_tree::remove(const bzn::uuid_t& uuid, const bzn::key_t& key, const bzn::value_t& value)
+{
+    const auto key_digest = record_key_digest(uuid, key);
+    const size_t bucket = bucket_from_digest(key_digest, this->leaf_count);
+
+    add_digest(this->nodes[this->leaf_count + bucket], sha256(key_digest + value), true);
+
+    this->rehash_path(bucket);
+}
+
+
+void
+merkle_state_tree::update(const bzn::uuid_t& uuid, const bzn::key_t& key, const bzn::value_t& old_value, const bzn::value_t& new_value)
+{
+    const auto key_digest = record_key_digest(uuid, key);
+    const size_t bucket = bucket_from_digest(key_digest, this->leaf_count);
+
+    auto& leaf = this->nodes[this->leaf_count + bucket];
+    add_digest(leaf, sha256(key_digest + old_value), true);
+    add_digest(leaf, sha256(key_digest + new_value), false);
+
+    this->rehash_path(bucket);
+}
+
+
+void
+merkle_state_tree::clear()
+{
+    this->nodes.assign(this->leaf_count * 2, bzn::hash_t(SHA256_DIGEST_LENGTH, '\0'));
+
+    this->rehash();
+}
+
+
+void
+merkle_state_tree::rehash()
+{
+    for (size_t i = this->leaf_count - 1; i > 0; --i)
+    {
+        this->nodes[i] = sha256(this->nodes[2 * i] + this->nodes[2 * i + 1]);
+    }
+
+    this->root = to_hex(this->nodes[1]);
+}
+
+
+const bzn::hash_t&
+merkle_state_tree::root_hash() const
+{
+    return this->root;
+}
+
+
+size_t
+merkle_state_tree::bucket_count() const
+{
+    return this->leaf_count;
+}
+
+
+size_t
+merkle_state_tree::bucket_for(const bzn::uuid_t& uuid, const bzn::key_t& key) const
+{
+    return bucket_from_digest(record_key_digest(uuid, key), this->leaf_count);
+}
+
+
+std::vector<bzn::hash_t>
+merkle_state_tree::get_bucket_hashes() const
+{
+    return std::vector<bzn::hash_t>(this->nodes.begin() + this->leaf_count, this->nodes.end());
+}
+
+
+const bzn::hash_t&
+merkle_state_tree::get_bucket_hash(size_t bucket) const
+{
+    return this->nodes.at(this->leaf_count + bucket);
+}
+
+
+bool
+merkle_state_tree::set_bucket_hashes(const std::vector<bzn::hash_t>& hashes)
+{
+    if (hashes.size() != this->leaf_count || std::any_of(hashes.begin(), hashes.end(), [](const auto& hash)
+        {
+            return hash.size() != SHA256_DIGEST_LENGTH;
+        }))
+    {
+        return false;
+    }
+
+    std::copy(hashes.begin(), hashes.end(), this->nodes.begin() + this->leaf_count);
+
+    this->rehash();
+
+    return true;
+}
+
+
+std::vector<size_t>
+merkle_state_tree::diff_buckets(const std::vector<bzn::hash_t>& lhs, const std::vector<bzn::hash_t>& rhs)
+{
+    std::vector<size_t> result;
+
+    const size_t count = std::max(lhs.size(), rhs.size());
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (lhs.size() != rhs.size() || lhs[i] != rhs[i])
+        {
+            result.emplace_back(i);
+        }
+    }
+
+    return result;
+}
+
+
+void
+merkle_state_tree::rehash_path(size_t bucket)
+{
+    // rehash the path from this leaf to the root...
+    for (size_t index = (this->leaf_count + bucket) / 2; index > 0; index /= 2)
+    {
+        this->nodes[index] = sha256(this->nodes[2 * index] + this->nodes[2 * index + 1]);
+    }
+
+    this->root = to_hex(this->nodes[1]);
+}
@@ -0,0 +1,100 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <include/bluzelle.hpp>
+#include <vector>
+
+
+namespace bzn
+{
+    /**
+     * Incrementally maintained hashed-bucket Merkle tree over the key/value state of a storage instance.
+     *
+     * Every (uuid, key) pair is assigned to one of 2^depth leaf buckets by its hash. A bucket's digest is the
+     * sum of the digests of all records it holds, so adding or removing a record only touches one leaf and the
+     * depth interior nodes above it. The root is therefore always current and reading it is O(1).
+     *
+     * Two replicas holding the same records always produce the same tree, so comparing leaf digests
+     * (diff_buckets) identifies which buckets differ between them. Nothing transfers state bucket by bucket
+     * yet: a replica that falls behind still catches up from the requests since its checkpoint or the whole
+     * service state.
+     *
+     * This class is not thread safe; the owning storage serializes access with its own lock.
+     */
+    class merkle_state_tree
+    {
+    public:
+        static const uint8_t DEFAULT_DEPTH = 10;
+
+        explicit merkle_state_tree(uint8_t depth = DEFAULT_DEPTH);
+
+        void insert(const bzn::uuid_t& uuid, const bzn::key_t& key, const bzn::value_t& value);
+
+        void remove(const bzn::uuid_t& uuid, const bzn::key_t& key, const bzn::value_t& value);
+
+        void update(const bzn::uuid_t& uuid, const bzn::key_t& key, const bzn::value_t& old_value, const bzn::value_t& new_value);
+
+        void clear();
+
+        /**
+         * @return hex encoded root hash of the tree
+         */
+        const bzn::hash_t& root_hash() const;
+
+        size_t bucket_count() const;
+
+        /**
+         * @return index of the leaf bucket that a record with this uuid and key belongs to
+         */
+        size_t bucket_for(const bzn::uuid_t& uuid, const bzn::key_t& key) const;
+
+        /**
+         * @return binary digest of every leaf bucket, in bucket order
+         */
+        std::vector<bzn::hash_t> get_bucket_hashes() const;
+
+        /**
+         * @return binary digest of one leaf bucket
+         */
+        const bzn::hash_t& get_bucket_hash(size_t bucket) const;
+
+        /**
+         * Restore the tree from leaf digests saved with get_bucket_hashes, without the records they came from
+         * @return false, leaving the tree unchanged, unless there is one digest of the right size per bucket
+         */
+        bool set_bucket_hashes(const std::vector<bzn::hash_t>& hashes);
+
+        /**
+         * Compare two sets of leaf digests as returned by get_bucket_hashes (groundwork for bucket level state
+         * transfer, which is not wired into catch-up)
+         * @return indices of the buckets that differ, or every bucket if the trees are not the same shape
+         */
+        static std::vector<size_t> diff_buckets(const std::vector<bzn::hash_t>& lhs, const std::vector<bzn::hash_t>& rhs);
+
+    private:
+        void rehash_path(size_t bucket);
+
+        void rehash();
+
+        size_t leaf_count;
+
+        // heap ordered: nodes[1] is the root and the leaves live at [leaf_count, 2 * leaf_count)
+        std::vector<bzn::hash_t> nodes;
+
+        bzn::hash_t root;
+    };
+
+} // bzn
@@ -13,31 +13,84 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <storage/rocksdb_storage.hpp>
+#include <metrics/metrics.hpp>
 #include <boost/filesystem.hpp>
 #include <rocksdb/db_dump_tool.h>
+#include <rocksdb/utilities/checkpoint.h>
+#include <rocksdb/write_batch.h>
 #include <thread>
 
 using namespace bzn;
 
 namespace
 {
-    inline bzn::key_t generate_key(const bzn::uuid_t& uuid, const bzn::key_t& key)
+    // records are stored under "<uuid length>:<uuid><key>" so the uuid and key can be recovered from the
+    // database key, and so one uuid's records are never picked up by a scan for a shorter uuid that prefixes it...
+    inline bzn::key_t generate_prefix(const bzn::uuid_t& uuid)
     {
-        return uuid+key;
+        return std::to_string(uuid.size()) + ":" + uuid;
     }
+
+
+    bool split_key(const rocksdb::Slice& db_key, bzn::uuid_t& uuid, bzn::key_t& key)
+    {
+        const std::string str = db_key.ToString();
+
+        // the length is only ever a handful of digits, so anything longer isn't a record key...
+        const auto separator = str.find(':');
+        if (separator == 0 || separator > 9 || str.find_first_not_of("0123456789") != separator)
+        {
+            return false;
+        }
+
+        const size_t uuid_size = std::stoul(str.substr(0, separator));
+        if (str.size() - separator - 1 < uuid_size)
+        {
+            return false;
+        }
+
+        uuid = str.substr(separator + 1, uuid_size);
+        key = str.substr(separator + 1 + uuid_size);
+
+        return true;
+    }
+
+
+    // not a valid record key (those start with a digit), so it never turns up in a uuid's records. Databases
+    // written before it existed store records under plain uuid+key and are left that way (see check_key_format)
+    const std::string KEY_FORMAT_KEY{"#key_format"};
+    const std::string KEY_FORMAT_VERSION{"1"};
+
+    // the state tree's leaf digests, written in the same batch as the records they cover so that opening the
+    // database doesn't have to read and hash every record
+    const std::string STATE_TREE_PREFIX{"#state_tree/"};
+
+
+    inline std::string state_tree_key(size_t bucket)
+    {
+        // zero padded so the buckets iterate in order
+        const auto index = std::to_string(bucket);
+        return STATE_TREE_PREFIX + std::string(index.size() < 8 ? 8 - index.size() : 0, '0') + index;
+    }
+
+    auto& create_latency = bzn::metrics::registry::instance().get_histogram("storage_create_latency_us");
+    auto& read_latency = bzn::metrics::registry::instance().get_histogram("storage_read_latency_us");
+    auto& update_latency = bzn::metrics::registry::instance().get_histogram("storage_update_latency_us");
+    auto& remove_latency = bzn::metrics::registry::instance().get_histogram("storage_remove_latency_us");
 }
 
 
 rocksdb_storage::rocksdb_storage(const std::string& state_dir, const std::string& db_name, const bzn::uuid_t& uuid)
     : db_path(boost::filesystem::path(state_dir).append(uuid).append(db_name).string())
     , snapshot_file(boost::filesystem::path(state_dir).append(uuid).append("SNAPSHOT." + db_name).string())
+    , checkpoint_path(boost::filesystem::path(state_dir).append(uuid).append("CHECKPOINT." + db_name).string())
 {
     this->open();
 }
 
 
 void
-rocksdb_storage::open()
+rocksdb_storage::open(bool rebuild_tree)
 {
     rocksdb::Options options;
 
@@ -59,12 +112,151 @@ rocksdb_storage::open()
     }
 
     this->db.reset(rocksdb);
+
+    this->check_key_format();
+
+    if (rebuild_tree || !this->load_state_tree())
+    {
+        this->rebuild_state_tree();
+    }
+}
+
+
+void
+rocksdb_storage::check_key_format()
+{
+    this->legacy_keys = false;
+
+    std::string version;
+    if (this->db->Get(rocksdb::ReadOptions(), KEY_FORMAT_KEY, &version).ok())
+    {
+        if (version != KEY_FORMAT_VERSION)
+        {
+            throw std::runtime_error("Unknown database key format " + version + " in: " + this->db_path);
+        }
+        return;
+    }
+
+    // records written as plain uuid+key don't say where the uuid ends, so they can't be converted; keep using
+    // that layout rather than make the node throw its state away...
+    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
+    iter->SeekToFirst();
+    if (iter->Valid())
+    {
+        LOG(warning) << "Database uses the old uuid+key layout, a uuid that prefixes another will see its records: " << this->db_path;
+
+        this->legacy_keys = true;
+        return;
+    }
+
+    rocksdb::WriteOptions write_options;
+    write_options.sync = true;
+
+    const auto s = this->db->Put(write_options, KEY_FORMAT_KEY, KEY_FORMAT_VERSION);
+    if (!s.ok())
+    {
+        throw std::runtime_error("Could not write database key format: " + s.ToString());
+    }
+}
+
+
+bool
+rocksdb_storage::load_state_tree()
+{
+    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
+
+    std::vector<bzn::hash_t> hashes;
+    for (iter->Seek(STATE_TREE_PREFIX); iter->Valid() && iter->key().starts_with(STATE_TREE_PREFIX); iter->Next())
+    {
+        if (iter->key() != state_tree_key(hashes.size()))
+        {
+            return false;
+        }
+
+        hashes.emplace_back(iter->value().ToString());
+    }
+
+    // missing or from a tree of another shape...
+    return this->state_tree.set_bucket_hashes(hashes);
+}
+
+
+void
+rocksdb_storage::rebuild_state_tree()
+{
+    LOG(info) << "rebuilding state tree from every record in: " << this->db_path;
+
+    this->state_tree.clear();
+
+    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
+
+    bzn::uuid_t uuid;
+    bzn::key_t key;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next())
+    {
+        if (this->legacy_keys)
+        {
+            // the uuid and key can't be told apart, but the tree only hashes them together anyway
+            if (!iter->key().starts_with(STATE_TREE_PREFIX))
+            {
+                this->state_tree.insert({}, iter->key().ToString(), iter->value().ToString());
+            }
+        }
+        else if (split_key(iter->key(), uuid, key))
+        {
+            this->state_tree.insert(uuid, key, iter->value().ToString());
+        }
+    }
+
+    std::set<size_t> buckets;
+    for (size_t bucket = 0; bucket < this->state_tree.bucket_count(); ++bucket)
+    {
+        buckets.insert(bucket);
+    }
+
+    rocksdb::WriteBatch batch;
+    if (const auto s = this->write_batch(batch, buckets); !s.ok())
+    {
+        // not fatal, it just has to be done again next time
+        LOG(error) << "saving state tree failed: " << s.ToString();
+    }
+}
+
+
+rocksdb::Status
+rocksdb_storage::write_batch(rocksdb::WriteBatch& batch, const std::set<size_t>& buckets)
+{
+    for (const auto bucket : buckets)
+    {
+        batch.Put(state_tree_key(bucket), this->state_tree.get_bucket_hash(bucket));
+    }
+
+    rocksdb::WriteOptions write_options;
+    write_options.sync = true;
+
+    return this->db->Write(write_options, &batch);
+}
+
+
+bzn::key_t
+rocksdb_storage::record_prefix(const bzn::uuid_t& uuid) const
+{
+    return this->legacy_keys ? uuid : generate_prefix(uuid);
+}
+
+
+bzn::key_t
+rocksdb_storage::record_key(const bzn::uuid_t& uuid, const bzn::key_t& key) const
+{
+    return this->record_prefix(uuid) + key;
 }
 
 
 bzn::storage_result
 rocksdb_storage::create(const bzn::uuid_t& uuid, const std::string& key, const std::string& value)
 {
+    bzn::metrics::scoped_timer timer(create_latency);
+
     if (value.size() > bzn::MAX_VALUE_SIZE)
     {
         return bzn::storage_result::value_too_large;
@@ -75,20 +267,24 @@ rocksdb_storage::create(const bzn::uuid_t& uuid, const std::string& key, const s
         return bzn::storage_result::key_too_large;
     }
 
-    rocksdb::WriteOptions write_options;
-    write_options.sync = true;
-
     std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
 
     if (!this->has_priv(uuid, key))
     {
-        auto s = this->db->Put(write_options, generate_key(uuid, key), value);
+        this->state_tree.insert(uuid, key, value);
+
+        rocksdb::WriteBatch batch;
+        batch.Put(this->record_key(uuid, key), value);
+
+        auto s = this->write_batch(batch, {this->state_tree.bucket_for(uuid, key)});
 
         if (!s.ok())
         {
             LOG(error) << "save failed: " << uuid << ":" << key << ":" <<
                 value.substr(0,MAX_MESSAGE_SIZE) << "... - " << s.ToString();
 
+            this->state_tree.remove(uuid, key, value);
+
             return bzn::storage_result::not_saved;
         }
 
@@ -102,10 +298,12 @@ rocksdb_storage::create(const bzn::uuid_t& uuid, const std::string& key, const s
 std::optional<bzn::value_t>
 rocksdb_storage::read(const bzn::uuid_t& uuid, const std::string& key)
 {
+    bzn::metrics::scoped_timer timer(read_latency);
+
     std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
 
     bzn::value_t value;
-    auto s = this->db->Get(rocksdb::ReadOptions(), generate_key(uuid, key), &value);
+    auto s = this->db->Get(rocksdb::ReadOptions(), this->record_key(uuid, key), &value);
 
     if (!s.ok())
     {
@@ -116,9 +314,45 @@ rocksdb_storage::read(const bzn::uuid_t& uuid, const std::string& key)
 }
 
 
+std::vector<std::optional<bzn::value_t>>
+rocksdb_storage::read_many(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys)
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+
+    std::vector<bzn::key_t> db_keys;
+    db_keys.reserve(keys.size());
+
+    std::vector<rocksdb::Slice> slices;
+    slices.reserve(keys.size());
+
+    for (const auto& key : keys)
+    {
+        db_keys.emplace_back(this->record_key(uuid, key));
+        slices.emplace_back(db_keys.back());
+    }
+
+    std::vector<bzn::value_t> db_values;
+    auto statuses = this->db->MultiGet(rocksdb::ReadOptions(), slices, &db_values);
+
+    std::vector<std::optional<bzn::value_t>> values(keys.size());
+
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        if (statuses[i].ok())
+        {
+            values[i] = std::move(db_values[i]);
+        }
+    }
+
+    return values;
+}
+
+
 bzn::storage_result
 rocksdb_storage::update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value)
 {
+    bzn::metrics::scoped_timer timer(update_latency);
+
     if (value.size() > bzn::MAX_VALUE_SIZE)
     {
         return bzn::storage_result::value_too_large;
@@ -126,18 +360,23 @@ rocksdb_storage::update(const bzn::uuid_t& uuid, const std::string& key, const s
 
     std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
 
-    if (this->has_priv(uuid, key))
+    bzn::value_t old_value;
+    if (this->db->Get(rocksdb::ReadOptions(), this->record_key(uuid, key), &old_value).ok())
     {
-        rocksdb::WriteOptions write_options;
-        write_options.sync = true;
+        this->state_tree.update(uuid, key, old_value, value);
+
+        rocksdb::WriteBatch batch;
+        batch.Put(this->record_key(uuid, key), value);
 
-        auto s = this->db->Put(write_options, generate_key(uuid, key), value);
+        auto s = this->write_batch(batch, {this->state_tree.bucket_for(uuid, key)});
 
         if (!s.ok())
         {
             LOG(error) << "update failed: " << uuid << ":" << key << ":" <<
                 value.substr(0,MAX_MESSAGE_SIZE) << "... - " << s.ToString();
 
+            this->state_tree.update(uuid, key, value, old_value);
+
             return bzn::storage_result::not_saved;
         }
 
@@ -151,17 +390,22 @@ rocksdb_storage::update(const bzn::uuid_t& uuid, const std::string& key, const s
 bzn::storage_result
 rocksdb_storage::remove(const bzn::uuid_t& uuid, const std::string& key)
 {
-    rocksdb::WriteOptions write_options;
-    write_options.sync = true;
+    bzn::metrics::scoped_timer timer(remove_latency);
 
     std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
 
-    if (this->has_priv(uuid, key))
+    bzn::value_t old_value;
+    if (this->db->Get(rocksdb::ReadOptions(), this->record_key(uuid, key), &old_value).ok())
     {
-        auto s = this->db->Delete(write_options, generate_key(uuid, key));
+        this->state_tree.remove(uuid, key, old_value);
 
-        if (!s.ok())
+        rocksdb::WriteBatch batch;
+        batch.Delete(this->record_key(uuid, key));
+
+        if (!this->write_batch(batch, {this->state_tree.bucket_for(uuid, key)}).ok())
         {
+            this->state_tree.insert(uuid, key, old_value);
+
             return bzn::storage_result::not_found;
         }
 
@@ -179,10 +423,12 @@ rocksdb_storage::get_keys(const bzn::uuid_t& uuid)
 
     std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
 
+    const auto prefix = this->record_prefix(uuid);
+
     std::vector<bzn::key_t> v;
-    for (iter->Seek(uuid); iter->Valid() && iter->key().starts_with(uuid); iter->Next())
+    for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next())
     {
-        v.emplace_back(iter->key().ToString().substr(uuid.size()));
+        v.emplace_back(iter->key().ToString().substr(prefix.size()));
     }
 
     return v;
@@ -208,7 +454,8 @@ rocksdb_storage::get_size(const bzn::uuid_t& uuid)
 
     std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
 
-    for (iter->Seek(uuid); iter->Valid() && iter->key().starts_with(uuid); iter->Next())
+    const auto prefix = this->record_prefix(uuid);
+    for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next())
     {
         ++keys;
         size += iter->value().size();
@@ -218,42 +465,73 @@ rocksdb_storage::get_size(const bzn::uuid_t& uuid)
 }
 
 
+std::size_t
+rocksdb_storage::get_approximate_size()
+{
+    // rocksdb keeps these up to date itself, so no need to walk the files or iterate over records...
+    uint64_t sst_files_size{};
+    uint64_t mem_tables_size{};
+
+    this->db->GetIntProperty(rocksdb::DB::Properties::kTotalSstFilesSize, &sst_files_size);
+    this->db->GetIntProperty(rocksdb::DB::Properties::kCurSizeAllMemTables, &mem_tables_size);
+
+    return sst_files_size + mem_tables_size;
+}
+
+
 bzn::storage_result
 rocksdb_storage::remove(const bzn::uuid_t& uuid)
 {
-    rocksdb::WriteOptions write_options;
-    write_options.sync = true;
-
     std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
 
     std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
 
-    std::size_t keys_removed{};
+    // every record goes in one batch, so dropping a database is a single synced write...
+    rocksdb::WriteBatch batch;
+    std::set<size_t> buckets;
+    std::vector<std::pair<bzn::key_t, bzn::value_t>> removed;
 
-    for (iter->Seek(uuid); iter->Valid() && iter->key().starts_with(uuid); iter->Next())
+    const auto prefix = this->record_prefix(uuid);
+    for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next())
     {
-        auto s = this->db->Delete(write_options, iter->key());
+        removed.emplace_back(iter->key().ToString().substr(prefix.size()), iter->value().ToString());
+        const auto& [key, value] = removed.back();
 
-        if (!s.ok())
+        this->state_tree.remove(uuid, key, value);
+        buckets.insert(this->state_tree.bucket_for(uuid, key));
+        batch.Delete(iter->key());
+    }
+
+    if (removed.empty())
+    {
+        return bzn::storage_result::not_found;
+    }
+
+    if (const auto s = this->write_batch(batch, buckets); !s.ok())
+    {
+        LOG(error) << "delete failed: " << uuid << ":" <<  s.ToString();
+
+        for (const auto& [key, value] : removed)
         {
-            LOG(error) << "delete failed: " << uuid << ":" <<  s.ToString();
+            this->state_tree.insert(uuid, key, value);
         }
 
-        ++keys_removed;
+        return bzn::storage_result::not_saved;
     }
 
-    return (keys_removed) ? bzn::storage_result::ok : bzn::storage_result::not_found;
+    return bzn::storage_result::ok;
 }
 
 
 bool
 rocksdb_storage::has_priv(const bzn::uuid_t& uuid, const  std::string& key)
 {
-    const bzn::key_t has_key = generate_key(uuid, key);
+    const bzn::key_t has_key = this->record_key(uuid, key);
+    const bzn::key_t prefix = this->record_prefix(uuid);
 
     std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
 
-    for (iter->Seek(uuid); iter->Valid() && iter->key().starts_with(uuid); iter->Next())
+    for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next())
     {
         if (iter->key() == has_key)
         {
@@ -268,21 +546,66 @@ rocksdb_storage::has_priv(const bzn::uuid_t& uuid, const  std::string& key)
 bool
 rocksdb_storage::create_snapshot()
 {
-    rocksdb::DumpOptions dump_options;
+    std::lock_guard<std::mutex> snapshot_lock(this->snapshot_lock);
 
-    dump_options.db_path = this->db_path;
-    dump_options.dump_location = this->snapshot_file;
-    dump_options.anonymous = true;
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(this->checkpoint_path, ec);
+    this->checkpoint_pending = false;
 
+    // a checkpoint only hard links the current files, so this fixes the contents without holding off writers
+    // for a full dump; get_snapshot does that later (crud straight after, raft on its snapshot writer)...
     std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
 
-    return rocksdb::DbDumpTool().Run(dump_options);
+    rocksdb::Checkpoint* checkpoint;
+    auto s = rocksdb::Checkpoint::Create(this->db.get(), &checkpoint);
+    if (!s.ok())
+    {
+        LOG(error) << "creating checkpoint failed: " << s.ToString();
+
+        return false;
+    }
+
+    s = std::unique_ptr<rocksdb::Checkpoint>(checkpoint)->CreateCheckpoint(this->checkpoint_path);
+    if (!s.ok())
+    {
+        LOG(error) << "creating checkpoint failed: " << s.ToString();
+
+        return false;
+    }
+
+    this->checkpoint_pending = true;
+
+    return true;
 }
 
 
 std::shared_ptr<std::string>
 rocksdb_storage::get_snapshot()
 {
+    std::lock_guard<std::mutex> snapshot_lock(this->snapshot_lock);
+
+    if (this->checkpoint_pending)
+    {
+        rocksdb::DumpOptions dump_options;
+
+        dump_options.db_path = this->checkpoint_path;
+        dump_options.dump_location = this->snapshot_file;
+        dump_options.anonymous = true;
+
+        const bool dumped = rocksdb::DbDumpTool().Run(dump_options);
+
+        boost::system::error_code ec;
+        boost::filesystem::remove_all(this->checkpoint_path, ec);
+        this->checkpoint_pending = false;
+
+        if (!dumped)
+        {
+            LOG(error) << "failed to dump checkpoint " << this->checkpoint_path;
+
+            return {};
+        }
+    }
+
     std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
 
     std::stringstream snapshot;
@@ -305,14 +628,14 @@ rocksdb_storage::get_snapshot()
 
 
 bool
-rocksdb_storage::load_snapshot(const std::string& data)
+rocksdb_storage::load_snapshot(const std::string& data, const bzn::hash_t& state_hash)
 {
-    if (!boost::filesystem::exists(this->snapshot_file))
-    {
-        LOG(error) << "no snapshot found";
+    // a node that has never taken a snapshot may still be sent one to install, and it replaces any not yet dumped...
+    std::lock_guard<std::mutex> snapshot_lock(this->snapshot_lock);
 
-        return false;
-    }
+    boost::system::error_code checkpoint_ec;
+    boost::filesystem::remove_all(this->checkpoint_path, checkpoint_ec);
+    this->checkpoint_pending = false;
 
     std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
 
@@ -357,20 +680,36 @@ rocksdb_storage::load_snapshot(const std::string& data)
 
     if (rocksdb::DbUndumpTool().Run(undump_options))
     {
-        boost::system::error_code ec;
-        boost::filesystem::remove_all(tmp_path, ec);
-        boost::filesystem::remove(this->snapshot_file);
-        boost::filesystem::rename(tmp_snapshot, this->snapshot_file);
-
-        if (ec)
+        try
         {
-            LOG(error) << "failed to remove temporary db backup: " << ec.message();
-        }
+            // bring db back online (a snapshot of a database in the old layout keeps it), and don't take the
+            // sender's word for the state tree...
+            this->open(true);
+
+            // ...and only keep it if it holds the state we were promised, the old database is still there
+            if (!state_hash.empty() && this->state_tree.root_hash() != state_hash)
+            {
+                throw std::runtime_error("snapshot state hash " + this->state_tree.root_hash() + " does not match: " + state_hash);
+            }
+
+            boost::system::error_code ec;
+            boost::filesystem::remove_all(tmp_path, ec);
+            boost::filesystem::remove(this->snapshot_file);
+            boost::filesystem::rename(tmp_snapshot, this->snapshot_file);
+
+            if (ec)
+            {
+                LOG(error) << "failed to remove temporary db backup: " << ec.message();
+            }
 
-        // bring db back online...
-        this->open();
+            return true;
+        }
+        catch (const std::exception& ex)
+        {
+            LOG(error) << "failed to open loaded snapshot: " << ex.what();
 
-        return true;
+            this->db.reset();
+        }
     }
 
     LOG(error) << "failed to load snapshot";
@@ -385,3 +724,21 @@ rocksdb_storage::load_snapshot(const std::string& data)
 
     return false;
 }
+
+
+bzn::hash_t
+rocksdb_storage::get_state_hash()
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+
+    return this->state_tree.root_hash();
+}
+
+
+std::vector<bzn::hash_t>
+rocksdb_storage::get_state_hash_buckets()
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+
+    return this->state_tree.get_bucket_hashes();
+}
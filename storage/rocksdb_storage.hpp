@@ -16,8 +16,11 @@
 
 #include <include/bluzelle.hpp>
 #include <storage/storage_base.hpp>
+#include <storage/merkle_state_tree.hpp>
 #include <options/options_base.hpp>
 #include <rocksdb/db.h>
+#include <mutex>
+#include <set>
 #include <shared_mutex>
 
 
@@ -32,6 +35,8 @@ namespace bzn
 
         std::optional<bzn::value_t> read(const bzn::uuid_t& uuid, const std::string& key) override;
 
+        std::vector<std::optional<bzn::value_t>> read_many(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) override;
+
         bzn::storage_result update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value) override;
 
         bzn::storage_result remove(const bzn::uuid_t& uuid, const std::string& key) override;
@@ -42,25 +47,54 @@ namespace bzn
 
         std::pair<std::size_t, std::size_t> get_size(const bzn::uuid_t& uuid) override;
 
+        std::size_t get_approximate_size() override;
+
         bzn::storage_result remove(const bzn::uuid_t& uuid) override;
 
         bool create_snapshot() override;
 
         std::shared_ptr<std::string> get_snapshot() override;
 
-        bool load_snapshot(const std::string& data) override;
+        bool load_snapshot(const std::string& data, const bzn::hash_t& state_hash) override;
+
+        bzn::hash_t get_state_hash() override;
+
+        std::vector<bzn::hash_t> get_state_hash_buckets() override;
 
     private:
-        void open();
+        void open(bool rebuild_tree = false);
+
+        void check_key_format();
+
+        bool load_state_tree();
+
+        void rebuild_state_tree();
+
+        rocksdb::Status write_batch(rocksdb::WriteBatch& batch, const std::set<size_t>& buckets);
+
+        bzn::key_t record_prefix(const bzn::uuid_t& uuid) const;
+
+        bzn::key_t record_key(const bzn::uuid_t& uuid, const bzn::key_t& key) const;
 
         const std::string db_path;
         const std::string snapshot_file;
+        const std::string checkpoint_path;
 
         std::unique_ptr<rocksdb::DB> db;
 
+        // records stored under plain uuid+key, as in databases from before the key format was recorded. The
+        // state tree hashes uuid and key together, so their state hash matches databases in either layout;
+        // snapshots carry the layout, so replicas that catch up from one adopt it
+        bool legacy_keys = false;
+
         bool has_priv(const bzn::uuid_t& uuid, const  std::string& key);
 
         std::shared_mutex lock; // for multi-reader and single writer access
+
+        std::mutex snapshot_lock; // taken before lock
+        bool checkpoint_pending = false; // created but not yet dumped to snapshot_file
+
+        bzn::merkle_state_tree state_tree;
     };
 
 } // bzn
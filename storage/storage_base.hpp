@@ -59,6 +59,14 @@ namespace bzn
 
         virtual std::optional<bzn::value_t> read(const bzn::uuid_t& uuid, const std::string& key) = 0;
 
+        /**
+         * Read several keys from one database in a single pass over storage
+         * @param uuid  database
+         * @param keys  keys to read
+         * @return one result per key, in the order given
+         */
+        virtual std::vector<std::optional<bzn::value_t>> read_many(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) = 0;
+
         virtual bzn::storage_result update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value) = 0;
 
         virtual bzn::storage_result remove(const bzn::uuid_t& uuid, const std::string& key) = 0;
@@ -69,13 +77,48 @@ namespace bzn
 
         virtual std::pair<std::size_t, std::size_t> get_size(const bzn::uuid_t& uuid) = 0;
 
+        /**
+         * Estimate of the bytes used by every database in this store. Unlike get_size this does not visit
+         * each record, so it is cheap enough to call at startup.
+         * @return approximate size in bytes
+         */
+        virtual std::size_t get_approximate_size() = 0;
+
         virtual bzn::storage_result remove(const bzn::uuid_t& uuid) = 0;
 
+        /**
+         * Fix the current contents as the next snapshot. This should be cheap, as it is called on the thread
+         * that committed the writes; the serialization is left to get_snapshot.
+         * @return true on success
+         */
         virtual bool create_snapshot() = 0;
 
+        /**
+         * @return the serialized contents as of the last create_snapshot (or load_snapshot), or nullptr on error
+         */
         virtual std::shared_ptr<std::string> get_snapshot() = 0;
 
-        virtual bool load_snapshot(const std::string& data) = 0;
+        /**
+         * Replace the contents with a snapshot from get_snapshot.
+         * @param state_hash if not empty, the state hash the loaded records must have; if they don't, the
+         *        previous contents are kept
+         * @return true if the snapshot was loaded
+         */
+        virtual bool load_snapshot(const std::string& data, const bzn::hash_t& state_hash) = 0;
+
+        /**
+         * Root of the Merkle tree maintained over every record in storage. This is kept up to date on
+         * each write so reading it is cheap.
+         * @return hex encoded state hash
+         */
+        virtual bzn::hash_t get_state_hash() = 0;
+
+        /**
+         * Leaf digests of the state tree. Comparing these with another replica's identifies which
+         * buckets of records differ between the two.
+         * @return binary digest of each bucket, in bucket order
+         */
+        virtual std::vector<bzn::hash_t> get_state_hash_buckets() = 0;
     };
 
 } // bzn
@@ -0,0 +1,141 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <storage/merkle_state_tree.hpp>
+#include <gmock/gmock.h>
+
+using namespace ::testing;
+
+namespace
+{
+    const bzn::uuid_t USER_UUID = "4bba2aeb-44fe-441e-bb6b-8817561eb716";
+}
+
+
+TEST(merkle_state_tree, test_that_empty_trees_of_the_same_depth_match)
+{
+    bzn::merkle_state_tree tree1;
+    bzn::merkle_state_tree tree2;
+
+    EXPECT_EQ(tree1.root_hash(), tree2.root_hash());
+    EXPECT_EQ(size_t(64), tree1.root_hash().size());
+    EXPECT_EQ(size_t(1) << bzn::merkle_state_tree::DEFAULT_DEPTH, tree1.bucket_count());
+
+    EXPECT_NE(tree1.root_hash(), bzn::merkle_state_tree(4).root_hash());
+}
+
+
+TEST(merkle_state_tree, test_that_remove_reverts_insert)
+{
+    bzn::merkle_state_tree tree;
+    const auto empty_hash = tree.root_hash();
+
+    tree.insert(USER_UUID, "key1", "value1");
+    tree.insert(USER_UUID, "key2", "value2");
+    EXPECT_NE(empty_hash, tree.root_hash());
+
+    tree.remove(USER_UUID, "key2", "value2");
+    tree.remove(USER_UUID, "key1", "value1");
+    EXPECT_EQ(empty_hash, tree.root_hash());
+}
+
+
+TEST(merkle_state_tree, test_that_update_matches_remove_then_insert)
+{
+    bzn::merkle_state_tree tree1;
+    bzn::merkle_state_tree tree2;
+
+    tree1.insert(USER_UUID, "key", "old");
+    tree1.update(USER_UUID, "key", "old", "new");
+
+    tree2.insert(USER_UUID, "key", "new");
+
+    EXPECT_EQ(tree1.root_hash(), tree2.root_hash());
+    EXPECT_EQ(tree1.get_bucket_hashes(), tree2.get_bucket_hashes());
+}
+
+
+TEST(merkle_state_tree, test_that_records_with_the_same_digest_do_not_cancel_out)
+{
+    bzn::merkle_state_tree tree;
+    const auto empty_hash = tree.root_hash();
+
+    tree.insert("ab", "c", "value");
+    const auto one_hash = tree.root_hash();
+
+    tree.insert("a", "bc", "value");
+    EXPECT_NE(empty_hash, tree.root_hash());
+    EXPECT_NE(one_hash, tree.root_hash());
+
+    tree.remove("ab", "c", "value");
+    EXPECT_EQ(one_hash, tree.root_hash());
+
+    tree.remove("a", "bc", "value");
+    EXPECT_EQ(empty_hash, tree.root_hash());
+}
+
+
+TEST(merkle_state_tree, test_that_diff_buckets_finds_changed_buckets)
+{
+    bzn::merkle_state_tree tree1(4);
+    bzn::merkle_state_tree tree2(4);
+
+    for (int i = 0; i < 50; ++i)
+    {
+        tree1.insert(USER_UUID, "key" + std::to_string(i), "value");
+        tree2.insert(USER_UUID, "key" + std::to_string(i), "value");
+    }
+
+    EXPECT_TRUE(bzn::merkle_state_tree::diff_buckets(tree1.get_bucket_hashes(), tree2.get_bucket_hashes()).empty());
+
+    tree2.insert(USER_UUID, "extra", "value");
+
+    EXPECT_EQ(std::vector<size_t>{tree2.bucket_for(USER_UUID, "extra")},
+        bzn::merkle_state_tree::diff_buckets(tree1.get_bucket_hashes(), tree2.get_bucket_hashes()));
+
+    // trees of different shapes differ everywhere...
+    EXPECT_EQ(size_t(1) << bzn::merkle_state_tree::DEFAULT_DEPTH,
+        bzn::merkle_state_tree::diff_buckets(tree1.get_bucket_hashes(), bzn::merkle_state_tree().get_bucket_hashes()).size());
+}
+
+
+TEST(merkle_state_tree, test_that_a_tree_can_be_restored_from_its_bucket_hashes)
+{
+    bzn::merkle_state_tree tree(4);
+    for (int i = 0; i < 50; ++i)
+    {
+        tree.insert(USER_UUID, "key" + std::to_string(i), "value");
+    }
+
+    bzn::merkle_state_tree restored(4);
+    EXPECT_TRUE(restored.set_bucket_hashes(tree.get_bucket_hashes()));
+    EXPECT_EQ(tree.root_hash(), restored.root_hash());
+
+    // and it carries on from there like the original...
+    tree.remove(USER_UUID, "key7", "value");
+    restored.remove(USER_UUID, "key7", "value");
+    EXPECT_EQ(tree.root_hash(), restored.root_hash());
+
+    // ...but digests for a different shape of tree are refused
+    const auto root = restored.root_hash();
+    EXPECT_FALSE(restored.set_bucket_hashes(bzn::merkle_state_tree(5).get_bucket_hashes()));
+    EXPECT_FALSE(restored.set_bucket_hashes(std::vector<bzn::hash_t>(16, "short")));
+    EXPECT_EQ(root, restored.root_hash());
+}
+
+
+TEST(merkle_state_tree, test_that_excessive_depth_throws)
+{
+    EXPECT_THROW(bzn::merkle_state_tree(64), std::runtime_error);
+}
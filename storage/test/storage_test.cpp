@@ -110,6 +110,41 @@ TYPED_TEST(storageTest, test_that_storage_can_create_a_record_and_read_the_same_
 }
 
 
+TYPED_TEST(storageTest, test_that_approximate_size_grows_with_stored_records)
+{
+    const auto empty_size = this->storage->get_approximate_size();
+
+    for (size_t i = 0; i < 100; ++i)
+    {
+        EXPECT_EQ(bzn::storage_result::ok, this->storage->create(USER_UUID, "key" + std::to_string(i), generate_test_string(1000)));
+    }
+
+    EXPECT_GE(this->storage->get_approximate_size(), empty_size + 100 * 1000);
+}
+
+
+TYPED_TEST(storageTest, test_that_read_many_returns_each_key_in_order)
+{
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->create(USER_UUID, "key0", "value0"));
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->create(USER_UUID, "key2", "value2"));
+
+    const auto values = this->storage->read_many(USER_UUID, {"key2", "key1", "key0", "key2"});
+
+    ASSERT_EQ(values.size(), size_t(4));
+    EXPECT_EQ(values[0], std::optional<bzn::value_t>("value2"));
+    EXPECT_FALSE(values[1]);
+    EXPECT_EQ(values[2], std::optional<bzn::value_t>("value0"));
+    EXPECT_EQ(values[3], std::optional<bzn::value_t>("value2"));
+
+    // unknown database...
+    const auto missing = this->storage->read_many("no-such-db", {"key0"});
+    ASSERT_EQ(missing.size(), size_t(1));
+    EXPECT_FALSE(missing[0]);
+
+    EXPECT_TRUE(this->storage->read_many(USER_UUID, {}).empty());
+}
+
+
 TYPED_TEST(storageTest, test_that_storage_fails_to_create_a_record_that_already_exists)
 {
     EXPECT_EQ(bzn::storage_result::ok, this->storage->create(USER_UUID, KEY, value));
@@ -282,9 +317,227 @@ TYPED_TEST(storageTest, test_snapshot)
     auto state = this->storage->get_snapshot();
     EXPECT_NE(state, nullptr);
 
-    EXPECT_FALSE(this->storage->load_snapshot("aslkdfkslfdk"));
-    EXPECT_TRUE(this->storage->load_snapshot(*state));
+    EXPECT_FALSE(this->storage->load_snapshot("aslkdfkslfdk", ""));
+    EXPECT_TRUE(this->storage->load_snapshot(*state, ""));
     EXPECT_TRUE(this->storage->has(user_0, "key1"));
     EXPECT_FALSE(this->storage->has(user_0, "key2"));
     EXPECT_FALSE(this->storage->has(user_0, "key3"));
 }
+
+
+TYPED_TEST(storageTest, test_that_state_hash_tracks_writes)
+{
+    const auto empty_hash = this->storage->get_state_hash();
+    EXPECT_FALSE(empty_hash.empty());
+
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->create(USER_UUID, "key1", "value1"));
+    const auto one_record_hash = this->storage->get_state_hash();
+    EXPECT_NE(empty_hash, one_record_hash);
+
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->update(USER_UUID, "key1", "value2"));
+    EXPECT_NE(one_record_hash, this->storage->get_state_hash());
+
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->update(USER_UUID, "key1", "value1"));
+    EXPECT_EQ(one_record_hash, this->storage->get_state_hash());
+
+    // failed writes must not change the hash...
+    EXPECT_EQ(bzn::storage_result::exists, this->storage->create(USER_UUID, "key1", "value3"));
+    EXPECT_EQ(bzn::storage_result::not_found, this->storage->update(USER_UUID, "key2", "value3"));
+    EXPECT_EQ(one_record_hash, this->storage->get_state_hash());
+
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->remove(USER_UUID, "key1"));
+    EXPECT_EQ(empty_hash, this->storage->get_state_hash());
+
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->create(USER_UUID, "key1", "value1"));
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->create(USER_UUID, "key2", "value2"));
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->remove(USER_UUID));
+    EXPECT_EQ(empty_hash, this->storage->get_state_hash());
+}
+
+
+TYPED_TEST(storageTest, test_that_state_hash_is_independent_of_write_order_and_implementation)
+{
+    bzn::mem_storage reference;
+
+    for (int i = 0; i < 100; ++i)
+    {
+        this->storage->create(USER_UUID, "key" + std::to_string(i), "value" + std::to_string(i));
+        reference.create(USER_UUID, "key" + std::to_string(99 - i), "value" + std::to_string(99 - i));
+    }
+
+    EXPECT_EQ(reference.get_state_hash(), this->storage->get_state_hash());
+    EXPECT_EQ(reference.get_state_hash_buckets(), this->storage->get_state_hash_buckets());
+
+    reference.update(USER_UUID, "key42", "different");
+
+    EXPECT_NE(reference.get_state_hash(), this->storage->get_state_hash());
+
+    const auto diff = bzn::merkle_state_tree::diff_buckets(reference.get_state_hash_buckets(), this->storage->get_state_hash_buckets());
+    ASSERT_EQ(size_t(1), diff.size());
+    EXPECT_EQ(bzn::merkle_state_tree().bucket_for(USER_UUID, "key42"), diff.front());
+}
+
+
+TYPED_TEST(storageTest, test_that_loading_a_snapshot_restores_the_state_hash)
+{
+    this->storage->create(USER_UUID, "key1", "value1");
+    EXPECT_TRUE(this->storage->create_snapshot());
+    const auto snapshot_hash = this->storage->get_state_hash();
+
+    this->storage->create(USER_UUID, "key2", "value2");
+    this->storage->update(USER_UUID, "key1", "value3");
+    EXPECT_NE(snapshot_hash, this->storage->get_state_hash());
+
+    EXPECT_TRUE(this->storage->load_snapshot(*this->storage->get_snapshot(), snapshot_hash));
+    EXPECT_EQ(snapshot_hash, this->storage->get_state_hash());
+}
+
+
+TYPED_TEST(storageTest, test_that_a_snapshot_without_the_expected_state_hash_is_not_loaded)
+{
+    this->storage->create(USER_UUID, "key1", "value1");
+    EXPECT_TRUE(this->storage->create_snapshot());
+    const auto snapshot = this->storage->get_snapshot();
+    ASSERT_NE(snapshot, nullptr);
+
+    this->storage->create(USER_UUID, "key2", "value2");
+    const auto current_hash = this->storage->get_state_hash();
+
+    EXPECT_FALSE(this->storage->load_snapshot(*snapshot, current_hash));
+
+    // the current contents are untouched
+    EXPECT_EQ(current_hash, this->storage->get_state_hash());
+    EXPECT_TRUE(this->storage->has(USER_UUID, "key2"));
+}
+
+
+TYPED_TEST(storageTest, test_that_a_uuid_prefixing_another_does_not_see_its_records)
+{
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->create("ab", "c", "value"));
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->create("a", "bc", "value"));
+
+    EXPECT_EQ(std::vector<bzn::key_t>{"bc"}, this->storage->get_keys("a"));
+    EXPECT_EQ(size_t(1), this->storage->get_size("a").first);
+
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->remove("a"));
+    EXPECT_TRUE(this->storage->has("ab", "c"));
+
+    bzn::mem_storage reference;
+    reference.create("ab", "c", "value");
+    EXPECT_EQ(reference.get_state_hash(), this->storage->get_state_hash());
+}
+
+
+TEST(rocksdb_storage, test_that_state_hash_is_restored_when_the_database_is_reopened)
+{
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+
+    bzn::mem_storage reference;
+    bzn::hash_t hash;
+    {
+        bzn::rocksdb_storage storage("./", "utest", NODE_UUID);
+        for (int i = 0; i < 10; ++i)
+        {
+            storage.create(USER_UUID, "key" + std::to_string(i), "value" + std::to_string(i));
+            reference.create(USER_UUID, "key" + std::to_string(i), "value" + std::to_string(i));
+        }
+        storage.remove(USER_UUID, "key3");
+        reference.remove(USER_UUID, "key3");
+        hash = storage.get_state_hash();
+    }
+
+    bzn::rocksdb_storage storage("./", "utest", NODE_UUID);
+    EXPECT_EQ(hash, storage.get_state_hash());
+    EXPECT_EQ(reference.get_state_hash(), storage.get_state_hash());
+    EXPECT_EQ(size_t(9), storage.get_keys(USER_UUID).size());
+
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+}
+
+
+TEST(rocksdb_storage, test_that_state_tree_is_only_rebuilt_when_its_digests_are_missing)
+{
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+
+    const std::string db_path = NODE_UUID + "/utest";
+    bzn::hash_t hash;
+    {
+        bzn::rocksdb_storage storage("./", "utest", NODE_UUID);
+        storage.create(USER_UUID, "key1", "value1");
+        storage.create(USER_UUID, "key2", "value2");
+        hash = storage.get_state_hash();
+    }
+
+    // change a record behind the storage's back: a reopen trusts the saved digests rather than hashing records...
+    {
+        rocksdb::DB* db;
+        ASSERT_TRUE(rocksdb::DB::Open(rocksdb::Options(), db_path, &db).ok());
+        ASSERT_TRUE(db->Put(rocksdb::WriteOptions(), std::to_string(USER_UUID.size()) + ":" + USER_UUID + "key1", "changed").ok());
+        delete db;
+    }
+    {
+        bzn::rocksdb_storage storage("./", "utest", NODE_UUID);
+        EXPECT_EQ(hash, storage.get_state_hash());
+    }
+
+    // ...until one of them goes missing
+    {
+        rocksdb::DB* db;
+        ASSERT_TRUE(rocksdb::DB::Open(rocksdb::Options(), db_path, &db).ok());
+        ASSERT_TRUE(db->Delete(rocksdb::WriteOptions(), "#state_tree/00000007").ok());
+        delete db;
+    }
+
+    bzn::mem_storage reference;
+    reference.create(USER_UUID, "key1", "changed");
+    reference.create(USER_UUID, "key2", "value2");
+
+    bzn::rocksdb_storage storage("./", "utest", NODE_UUID);
+    EXPECT_EQ(reference.get_state_hash(), storage.get_state_hash());
+
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+}
+
+
+TEST(rocksdb_storage, test_that_a_database_in_the_old_key_layout_is_still_used)
+{
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+
+    const std::string db_path = NODE_UUID + "/utest";
+    {
+        boost::filesystem::create_directories(db_path);
+
+        rocksdb::Options options;
+        options.create_if_missing = true;
+
+        rocksdb::DB* db;
+        ASSERT_TRUE(rocksdb::DB::Open(options, db_path, &db).ok());
+        ASSERT_TRUE(db->Put(rocksdb::WriteOptions(), USER_UUID + "key1", "value1").ok());
+        ASSERT_TRUE(db->Put(rocksdb::WriteOptions(), USER_UUID + "key2", "value2").ok());
+        delete db;
+    }
+
+    bzn::hash_t hash;
+    {
+        bzn::rocksdb_storage storage("./", "utest", NODE_UUID);
+        EXPECT_EQ("value1", storage.read(USER_UUID, "key1").value_or(""));
+        EXPECT_EQ(size_t(2), storage.get_keys(USER_UUID).size());
+
+        EXPECT_EQ(bzn::storage_result::ok, storage.create(USER_UUID, "key3", "value3"));
+        EXPECT_EQ(bzn::storage_result::ok, storage.remove(USER_UUID, "key1"));
+        hash = storage.get_state_hash();
+    }
+
+    // the tree kept up by writes matches the one rebuilt from the old layout
+    bzn::rocksdb_storage storage("./", "utest", NODE_UUID);
+    EXPECT_EQ(hash, storage.get_state_hash());
+    EXPECT_EQ(std::vector<bzn::key_t>({"key2", "key3"}), storage.get_keys(USER_UUID));
+
+    // and with any node holding the same records in the new layout
+    bzn::mem_storage reference;
+    reference.create(USER_UUID, "key2", "value2");
+    reference.create(USER_UUID, "key3", "value3");
+    EXPECT_EQ(reference.get_state_hash(), hash);
+
+    system(std::string("rm -r -f " + NODE_UUID).c_str());
+}
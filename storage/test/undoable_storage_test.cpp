@@ -0,0 +1,115 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <storage/undoable_storage.hpp>
+#include <storage/mem_storage.hpp>
+#include <gmock/gmock.h>
+
+using namespace ::testing;
+
+namespace
+{
+    const bzn::uuid_t USER_UUID = "4bba2aeb-44fe-441e-bb6b-8817561eb716";
+    const bzn::uuid_t OTHER_UUID = "f1a6c1a4-5ad5-4c35-a48b-4b3c1a1b5c7e";
+}
+
+
+TEST(undoable_storage, test_that_undo_writes_restores_the_state_before_the_log_was_started)
+{
+    auto mem_storage = std::make_shared<bzn::mem_storage>();
+    bzn::undoable_storage storage(mem_storage);
+
+    ASSERT_EQ(bzn::storage_result::ok, storage.create(USER_UUID, "updated", "old"));
+    ASSERT_EQ(bzn::storage_result::ok, storage.create(USER_UUID, "removed", "value"));
+    ASSERT_EQ(bzn::storage_result::ok, storage.create(OTHER_UUID, "key1", "value1"));
+    ASSERT_EQ(bzn::storage_result::ok, storage.create(OTHER_UUID, "key2", "value2"));
+
+    const auto hash = storage.get_state_hash();
+
+    storage.start_undo_log();
+
+    EXPECT_EQ(bzn::storage_result::ok, storage.create(USER_UUID, "created", "value"));
+    EXPECT_EQ(bzn::storage_result::ok, storage.update(USER_UUID, "updated", "new"));
+    EXPECT_EQ(bzn::storage_result::ok, storage.update(USER_UUID, "updated", "newer"));
+    EXPECT_EQ(bzn::storage_result::ok, storage.remove(USER_UUID, "removed"));
+    EXPECT_EQ(bzn::storage_result::ok, storage.remove(OTHER_UUID));
+    EXPECT_EQ(bzn::storage_result::ok, storage.create(OTHER_UUID, "key1", "different"));
+    EXPECT_NE(hash, storage.get_state_hash());
+
+    EXPECT_TRUE(storage.undo_writes());
+
+    EXPECT_EQ(hash, storage.get_state_hash());
+    EXPECT_FALSE(mem_storage->has(USER_UUID, "created"));
+    EXPECT_EQ("old", *mem_storage->read(USER_UUID, "updated"));
+    EXPECT_EQ("value", *mem_storage->read(USER_UUID, "removed"));
+    EXPECT_EQ("value1", *mem_storage->read(OTHER_UUID, "key1"));
+    EXPECT_EQ("value2", *mem_storage->read(OTHER_UUID, "key2"));
+
+    // the log is closed, so later writes stay
+    EXPECT_EQ(bzn::storage_result::ok, storage.create(USER_UUID, "created", "value"));
+    EXPECT_TRUE(storage.undo_writes());
+    EXPECT_TRUE(mem_storage->has(USER_UUID, "created"));
+}
+
+
+TEST(undoable_storage, test_that_cleared_writes_are_kept)
+{
+    auto mem_storage = std::make_shared<bzn::mem_storage>();
+    bzn::undoable_storage storage(mem_storage);
+
+    storage.start_undo_log();
+    EXPECT_EQ(bzn::storage_result::ok, storage.create(USER_UUID, "key", "value"));
+    storage.clear_undo_log();
+
+    EXPECT_TRUE(storage.undo_writes());
+    EXPECT_EQ("value", *mem_storage->read(USER_UUID, "key"));
+}
+
+
+TEST(undoable_storage, test_that_failed_writes_are_not_recorded)
+{
+    auto mem_storage = std::make_shared<bzn::mem_storage>();
+    bzn::undoable_storage storage(mem_storage);
+
+    ASSERT_EQ(bzn::storage_result::ok, storage.create(USER_UUID, "key", "value"));
+
+    storage.start_undo_log();
+    EXPECT_EQ(bzn::storage_result::exists, storage.create(USER_UUID, "key", "other"));
+    EXPECT_EQ(bzn::storage_result::not_found, storage.update(USER_UUID, "missing", "value"));
+    EXPECT_EQ(bzn::storage_result::not_found, storage.remove(USER_UUID, "missing"));
+
+    EXPECT_TRUE(storage.undo_writes());
+    EXPECT_EQ("value", *mem_storage->read(USER_UUID, "key"));
+    EXPECT_FALSE(mem_storage->has(USER_UUID, "missing"));
+}
+
+
+TEST(undoable_storage, test_that_loading_a_snapshot_discards_the_undo_log)
+{
+    auto mem_storage = std::make_shared<bzn::mem_storage>();
+    bzn::undoable_storage storage(mem_storage);
+
+    ASSERT_TRUE(storage.create_snapshot());
+    const auto snapshot = storage.get_snapshot();
+    ASSERT_TRUE(snapshot);
+
+    storage.start_undo_log();
+    EXPECT_EQ(bzn::storage_result::ok, storage.create(USER_UUID, "key", "value"));
+    ASSERT_TRUE(storage.load_snapshot(*snapshot, ""));
+    EXPECT_EQ(bzn::storage_result::ok, storage.create(USER_UUID, "key", "value"));
+
+    // nothing to undo against the loaded state
+    EXPECT_TRUE(storage.undo_writes());
+    EXPECT_TRUE(mem_storage->has(USER_UUID, "key"));
+}
@@ -0,0 +1,274 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <storage/undoable_storage.hpp>
+
+using namespace bzn;
+
+
+undoable_storage::undoable_storage(std::shared_ptr<bzn::storage_base> storage)
+    : storage(std::move(storage))
+{
+}
+
+
+void
+undoable_storage::start_undo_log()
+{
+    std::lock_guard<std::mutex> lock(this->undo_lock);
+
+    this->undo_log.clear();
+    this->recording = true;
+}
+
+
+bool
+undoable_storage::undo_writes()
+{
+    std::lock_guard<std::mutex> lock(this->undo_lock);
+
+    this->recording = false;
+
+    bool success = true;
+    for (auto it = this->undo_log.rbegin(); it != this->undo_log.rend(); ++it)
+    {
+        const auto result = it->old_value ? (this->storage->has(it->uuid, it->key) ?
+            this->storage->update(it->uuid, it->key, *it->old_value) : this->storage->create(it->uuid, it->key, *it->old_value))
+            : this->storage->remove(it->uuid, it->key);
+
+        if (result != bzn::storage_result::ok)
+        {
+            LOG(error) << "failed to undo write of key " << it->key << " in " << it->uuid << ": "
+                << bzn::storage_result_msg.at(result);
+            success = false;
+        }
+    }
+
+    this->undo_log.clear();
+
+    return success;
+}
+
+
+void
+undoable_storage::clear_undo_log()
+{
+    std::lock_guard<std::mutex> lock(this->undo_lock);
+
+    this->recording = false;
+    this->undo_log.clear();
+}
+
+
+void
+undoable_storage::record(const bzn::uuid_t& uuid, const bzn::key_t& key, std::optional<bzn::value_t> old_value)
+{
+    this->undo_log.push_back({uuid, key, std::move(old_value)});
+}
+
+
+bzn::storage_result
+undoable_storage::create(const bzn::uuid_t& uuid, const std::string& key, const std::string& value)
+{
+    // writes outside an undo log don't need to wait on it...
+    if (!this->recording)
+    {
+        return this->storage->create(uuid, key, value);
+    }
+
+    std::lock_guard<std::mutex> lock(this->undo_lock);
+
+    const auto result = this->storage->create(uuid, key, value);
+
+    if (this->recording && result == bzn::storage_result::ok)
+    {
+        this->record(uuid, key, std::nullopt);
+    }
+
+    return result;
+}
+
+
+std::optional<bzn::value_t>
+undoable_storage::read(const bzn::uuid_t& uuid, const std::string& key)
+{
+    return this->storage->read(uuid, key);
+}
+
+
+std::vector<std::optional<bzn::value_t>>
+undoable_storage::read_many(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys)
+{
+    return this->storage->read_many(uuid, keys);
+}
+
+
+bzn::storage_result
+undoable_storage::update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value)
+{
+    if (!this->recording)
+    {
+        return this->storage->update(uuid, key, value);
+    }
+
+    std::lock_guard<std::mutex> lock(this->undo_lock);
+
+    // the log may have been closed while we waited for it
+    if (!this->recording)
+    {
+        return this->storage->update(uuid, key, value);
+    }
+
+    auto old_value = this->storage->read(uuid, key);
+    const auto result = this->storage->update(uuid, key, value);
+
+    if (result == bzn::storage_result::ok)
+    {
+        this->record(uuid, key, std::move(old_value));
+    }
+
+    return result;
+}
+
+
+bzn::storage_result
+undoable_storage::remove(const bzn::uuid_t& uuid, const std::string& key)
+{
+    if (!this->recording)
+    {
+        return this->storage->remove(uuid, key);
+    }
+
+    std::lock_guard<std::mutex> lock(this->undo_lock);
+
+    // the log may have been closed while we waited for it
+    if (!this->recording)
+    {
+        return this->storage->remove(uuid, key);
+    }
+
+    auto old_value = this->storage->read(uuid, key);
+    const auto result = this->storage->remove(uuid, key);
+
+    if (result == bzn::storage_result::ok && old_value)
+    {
+        this->record(uuid, key, std::move(old_value));
+    }
+
+    return result;
+}
+
+
+std::vector<bzn::key_t>
+undoable_storage::get_keys(const bzn::uuid_t& uuid)
+{
+    return this->storage->get_keys(uuid);
+}
+
+
+bool
+undoable_storage::has(const bzn::uuid_t& uuid, const std::string& key)
+{
+    return this->storage->has(uuid, key);
+}
+
+
+std::pair<std::size_t, std::size_t>
+undoable_storage::get_size(const bzn::uuid_t& uuid)
+{
+    return this->storage->get_size(uuid);
+}
+
+
+std::size_t
+undoable_storage::get_approximate_size()
+{
+    return this->storage->get_approximate_size();
+}
+
+
+bzn::storage_result
+undoable_storage::remove(const bzn::uuid_t& uuid)
+{
+    if (!this->recording)
+    {
+        return this->storage->remove(uuid);
+    }
+
+    std::lock_guard<std::mutex> lock(this->undo_lock);
+
+    // the log may have been closed while we waited for it
+    if (!this->recording)
+    {
+        return this->storage->remove(uuid);
+    }
+
+    const auto keys = this->storage->get_keys(uuid);
+    auto values = this->storage->read_many(uuid, keys);
+    const auto result = this->storage->remove(uuid);
+
+    if (result == bzn::storage_result::ok)
+    {
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            if (values[i])
+            {
+                this->record(uuid, keys[i], std::move(values[i]));
+            }
+        }
+    }
+
+    return result;
+}
+
+
+bool
+undoable_storage::create_snapshot()
+{
+    return this->storage->create_snapshot();
+}
+
+
+std::shared_ptr<std::string>
+undoable_storage::get_snapshot()
+{
+    return this->storage->get_snapshot();
+}
+
+
+bool
+undoable_storage::load_snapshot(const std::string& data, const bzn::hash_t& state_hash)
+{
+    std::lock_guard<std::mutex> lock(this->undo_lock);
+
+    // the recorded writes don't apply to the loaded state
+    this->recording = false;
+    this->undo_log.clear();
+
+    return this->storage->load_snapshot(data, state_hash);
+}
+
+
+bzn::hash_t
+undoable_storage::get_state_hash()
+{
+    return this->storage->get_state_hash();
+}
+
+
+std::vector<bzn::hash_t>
+undoable_storage::get_state_hash_buckets()
+{
+    return this->storage->get_state_hash_buckets();
+}
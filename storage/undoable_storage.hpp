@@ -0,0 +1,97 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <storage/storage_base.hpp>
+#include <atomic>
+#include <mutex>
+
+
+namespace bzn
+{
+    /**
+     * Forwards to another storage and, while an undo log is open, remembers how to reverse each write so a
+     * run of writes can be taken back without snapshotting the whole store first.
+     */
+    class undoable_storage : public bzn::storage_base
+    {
+    public:
+        undoable_storage(std::shared_ptr<bzn::storage_base> storage);
+
+        /**
+         * Start recording the writes that follow, discarding any earlier log
+         */
+        void start_undo_log();
+
+        /**
+         * Reverse every write recorded since start_undo_log, newest first, and close the log
+         * @return false if a write could not be reversed
+         */
+        bool undo_writes();
+
+        /**
+         * Keep the recorded writes and close the log
+         */
+        void clear_undo_log();
+
+        bzn::storage_result create(const bzn::uuid_t& uuid, const std::string& key, const std::string& value) override;
+
+        std::optional<bzn::value_t> read(const bzn::uuid_t& uuid, const std::string& key) override;
+
+        std::vector<std::optional<bzn::value_t>> read_many(const bzn::uuid_t& uuid, const std::vector<bzn::key_t>& keys) override;
+
+        bzn::storage_result update(const bzn::uuid_t& uuid, const std::string& key, const std::string& value) override;
+
+        bzn::storage_result remove(const bzn::uuid_t& uuid, const std::string& key) override;
+
+        std::vector<bzn::key_t> get_keys(const bzn::uuid_t& uuid) override;
+
+        bool has(const bzn::uuid_t& uuid, const  std::string& key) override;
+
+        std::pair<std::size_t, std::size_t> get_size(const bzn::uuid_t& uuid) override;
+
+        std::size_t get_approximate_size() override;
+
+        bzn::storage_result remove(const bzn::uuid_t& uuid) override;
+
+        bool create_snapshot() override;
+
+        std::shared_ptr<std::string> get_snapshot() override;
+
+        bool load_snapshot(const std::string& data, const bzn::hash_t& state_hash) override;
+
+        bzn::hash_t get_state_hash() override;
+
+        std::vector<bzn::hash_t> get_state_hash_buckets() override;
+
+    private:
+        struct undo_entry
+        {
+            bzn::uuid_t uuid;
+            bzn::key_t key;
+            std::optional<bzn::value_t> old_value; // nullopt if the write created the record
+        };
+
+        void record(const bzn::uuid_t& uuid, const bzn::key_t& key, std::optional<bzn::value_t> old_value);
+
+        const std::shared_ptr<bzn::storage_base> storage;
+
+        // checked before taking undo_lock, so writes only serialize on it while a log is open
+        std::atomic<bool> recording{false};
+        std::vector<undo_entry> undo_log;
+        std::mutex undo_lock;
+    };
+
+} // bzn
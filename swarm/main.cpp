@@ -22,24 +22,80 @@
 #include <crypto/crypto_base.hpp>
 #include <ethereum/ethereum.hpp>
 #include <http/server.hpp>
+#include <metrics/metrics.hpp>
 #include <node/node.hpp>
+#include <node/staged_node.hpp>
 #include <options/options.hpp>
 #include <options/simple_options.hpp>
 #include <pbft/pbft.hpp>
 #include <pbft/database_pbft_service.hpp>
 #include <pbft/pbft_failure_detector.hpp>
+#include <pbft/staged_pbft_service.hpp>
 #include <raft/raft.hpp>
 #include <status/status.hpp>
 #include <storage/mem_storage.hpp>
 #include <storage/rocksdb_storage.hpp>
+#include <boost/core/null_deleter.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/log/expressions.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/block_on_overflow.hpp>
+#include <boost/log/sinks/bounded_fifo_queue.hpp>
+#include <boost/log/sinks/text_file_backend.hpp>
+#include <boost/log/sinks/text_ostream_backend.hpp>
 #include <boost/log/support/date_time.hpp>
 #include <boost/log/utility/setup/common_attributes.hpp>
 #include <boost/log/utility/setup/console.hpp>
 #include <boost/log/utility/setup/file.hpp>
 #include <boost/program_options.hpp>
+#include <cstring>
+#include <future>
 #include <thread>
+#include <pthread.h>
+
+
+namespace
+{
+    const std::string PEERS_CACHE_FILE = "peers_cache.json";
+
+    // records queued beyond this are dropped rather than blocking the thread that logged them, unless they are errors
+    const size_t LOG_QUEUE_CAPACITY = 16384;
+
+    auto& dropped_log_records = bzn::metrics::registry::instance().get_counter("log_records_dropped_total");
+
+    // a full queue drops warnings and below, but makes the thread logging an error or worse wait for room
+    class drop_below_error_on_overflow : public boost::log::sinks::block_on_overflow
+    {
+    public:
+        template <typename LockT>
+        bool on_overflow(const boost::log::record_view& rec, LockT& lock)
+        {
+            const auto severity = rec[boost::log::trivial::severity];
+            if (severity && *severity >= boost::log::trivial::error)
+            {
+                return boost::log::sinks::block_on_overflow::on_overflow(rec, lock);
+            }
+
+            dropped_log_records.increment();
+            return false;
+        }
+    };
+
+    using log_queue_t = boost::log::sinks::bounded_fifo_queue<LOG_QUEUE_CAPACITY, drop_below_error_on_overflow>;
+    using file_sink_t = boost::log::sinks::asynchronous_sink<boost::log::sinks::text_file_backend, log_queue_t>;
+    using console_sink_t = boost::log::sinks::asynchronous_sink<boost::log::sinks::text_ostream_backend, log_queue_t>;
+
+    boost::shared_ptr<file_sink_t> file_sink;
+    boost::shared_ptr<console_sink_t> console_sink;
+
+    // threads running one io_context: network io, the pbft consensus core, or request execution
+    struct worker_stage
+    {
+        std::string name;
+        std::shared_ptr<bzn::asio::io_context_base> io_context;
+        size_t threads;
+    };
+}
 
 
 void
@@ -52,42 +108,55 @@ init_logging(const bzn::options& options)
             << " [" << boost::log::expressions::attr< boost::log::attributes::current_thread_id::value_type >("ThreadID")
             << "] [" << std::setw(5) << std::left << boost::log::trivial::severity << "] " << boost::log::expressions::smessage;
 
-    auto sink = boost::log::add_file_log
+    // records are formatted and written by the sink's own thread, so flushing each one no longer stalls the caller
+    auto file_backend = boost::make_shared<boost::log::sinks::text_file_backend>
         (
             keywords::file_name = options.get_logfile_dir() + "/bluzelle-%5N.log",
             keywords::rotation_size = options.get_logfile_rotation_size(),
             keywords::open_mode = std::ios_base::app,
-            keywords::auto_flush = true,
-            keywords::format = format
+            keywords::auto_flush = true
         );
 
+    file_backend->set_file_collector(boost::log::sinks::file::make_collector
+        (
+            keywords::target = options.get_logfile_dir(),
+            keywords::max_size = options.get_logfile_max_size()
+        ));
+
+    file_backend->scan_for_files();
+
+    file_sink = boost::make_shared<file_sink_t>(file_backend);
+    file_sink->set_formatter(format);
+
     boost::log::core::get()->add_global_attribute("TimeStamp", boost::log::attributes::utc_clock());
 
     if (options.get_log_to_stdout())
     {
-        boost::log::add_console_log(std::cout, boost::log::keywords::format = format);
-    }
+        auto console_backend = boost::make_shared<boost::log::sinks::text_ostream_backend>();
+        console_backend->add_stream(boost::shared_ptr<std::ostream>(&std::cout, boost::null_deleter()));
 
-    boost::log::add_common_attributes();
+        console_sink = boost::make_shared<console_sink_t>(console_backend);
+        console_sink->set_formatter(format);
 
-    sink->locked_backend()->set_file_collector(boost::log::sinks::file::make_collector
-        (
-            keywords::target = options.get_logfile_dir(),
-            keywords::max_size = options.get_logfile_max_size()
-        ));
+        boost::log::core::get()->add_sink(console_sink);
+    }
 
-    sink->locked_backend()->scan_for_files();
+    boost::log::add_common_attributes();
 
-    boost::log::core::get()->add_sink(sink);
+    boost::log::core::get()->add_sink(file_sink);
 
     if (options.get_debug_logging())
     {
+        bzn::utils::log_threshold = boost::log::trivial::debug;
+
         LOG(info) << "debug logging enabled";
 
         boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::debug);
     }
     else
     {
+        bzn::utils::log_threshold = boost::log::trivial::info;
+
         LOG(info) << "debug logging disabled";
 
         boost::log::core::get()->set_filter(boost::log::trivial::severity > boost::log::trivial::debug);
@@ -95,6 +164,26 @@ init_logging(const bzn::options& options)
 }
 
 
+void
+shutdown_logging()
+{
+    // drain whatever is still queued before the process exits
+    if (console_sink)
+    {
+        boost::log::core::get()->remove_sink(console_sink);
+        console_sink->stop();
+        console_sink->flush();
+    }
+
+    if (file_sink)
+    {
+        boost::log::core::get()->remove_sink(file_sink);
+        file_sink->stop();
+        file_sink->flush();
+    }
+}
+
+
 bool
 init_peers(bzn::bootstrap_peers& peers, const std::string& peers_file, const std::string& peers_url)
 {
@@ -123,49 +212,17 @@ init_peers(bzn::bootstrap_peers& peers, const std::string& peers_file, const std
 }
 
 
-boost::uintmax_t
-get_dir_size(const boost::filesystem::path& dir)
+void
+print_banner(const bzn::options& options, double eth_balance, const std::vector<std::shared_ptr<bzn::storage_base>>& storages,
+    std::chrono::milliseconds startup_time)
 {
-    namespace fs = boost::filesystem;
+    size_t used_storage{};
 
-    if (fs::is_directory(dir))
+    for (const auto& storage : storages)
     {
-        boost::uintmax_t size{};
-
-        fs::directory_iterator dir_it(dir);
-
-        for (dir_it = fs::begin(dir_it); dir_it != fs::end(dir_it); ++dir_it)
-        {
-            const fs::directory_entry& dir_entry = *dir_it;
-
-            if (fs::is_regular_file(dir_entry.path()))
-            {
-                size += fs::file_size(dir_entry.path());
-            }
-            else
-            {
-                if (fs::is_directory(dir_entry.path()))
-                {
-                    size += get_dir_size(dir_entry.path());
-                }
-            }
-        }
-        return size;
+        used_storage += storage->get_approximate_size();
     }
-    return 0;
-}
 
-
-size_t
-get_state_dir_size(const bzn::options& options)
-{
-    return get_dir_size(boost::filesystem::path{options.get_state_dir() + options.get_uuid()});
-}
-
-
-void
-print_banner(const bzn::options& options, double eth_balance)
-{
     std::stringstream ss;
 
     ss << '\n';
@@ -177,7 +234,8 @@ print_banner(const bzn::options& options, double eth_balance)
        << "         Token Balance: " << eth_balance << " ETH" << "\n"
        // todo: disabled for now...
        //<< "       Maximum Storage: " << options.get_max_storage() << " Bytes" << "\n"
-       << "          Used Storage: " << get_state_dir_size(options) << " Bytes" << "\n"
+       << "          Used Storage: " << used_storage << " Bytes" << "\n"
+       << "          Startup Time: " << startup_time.count() << " ms" << "\n"
        << '\n';
 
     std::cout << ss.str();
@@ -190,16 +248,41 @@ print_banner(const bzn::options& options, double eth_balance)
 
 
 void
-start_worker_threads_and_wait(std::shared_ptr<bzn::asio::io_context_base> io_context)
+pin_thread(std::thread& thread, size_t cpu)
+{
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+
+    if (auto result = pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus); result != 0)
+    {
+        LOG(warning) << "failed to pin thread to cpu " << cpu << ": " << std::strerror(result);
+    }
+}
+
+
+void
+start_worker_threads_and_wait(const std::vector<worker_stage>& stages, bool pin_threads)
 {
     std::vector<std::thread> workers;
+    size_t next_cpu = 0;
 
-    for (size_t i = 0; i < std::thread::hardware_concurrency(); ++i)
+    for (const auto& stage : stages)
     {
-        workers.emplace_back(std::thread([io_context]
+        LOG(info) << "starting " << stage.threads << " " << stage.name << " thread(s)";
+
+        for (size_t i = 0; i < stage.threads; ++i)
         {
-            io_context->run();
-        }));
+            workers.emplace_back(std::thread([io_context = stage.io_context]
+            {
+                io_context->run();
+            }));
+
+            if (pin_threads)
+            {
+                pin_thread(workers.back(), next_cpu++);
+            }
+        }
     }
 
     // wait for shutdown...
@@ -213,6 +296,17 @@ start_worker_threads_and_wait(std::shared_ptr<bzn::asio::io_context_base> io_con
 int
 main(int argc, const char* argv[])
 {
+    const auto launch_time = std::chrono::steady_clock::now();
+
+    // drain the log sinks however main is left; before init_logging there is nothing to drain
+    struct logging_guard_t
+    {
+        ~logging_guard_t()
+        {
+            shutdown_logging();
+        }
+    } logging_guard;
+
     try
     {
         auto options = std::make_shared<bzn::options>();
@@ -224,7 +318,21 @@ main(int argc, const char* argv[])
         init_logging(*options);
 
         // todo: right now we just want to check that an account "has" a balance...
-        double eth_balance = bzn::ethereum().get_ether_balance(options->get_ethererum_address(), options->get_ethererum_io_api_token());
+        // (fetched while the bootstrap peers are being read so the two round trips overlap)
+        auto eth_balance_result = std::async(std::launch::async, [options]()
+            {
+                return bzn::ethereum().get_ether_balance(options->get_ethererum_address(), options->get_ethererum_io_api_token());
+            });
+
+        boost::filesystem::create_directories(options->get_state_dir());
+
+        bzn::bootstrap_peers peers(options->peer_validation_enabled());
+        peers.set_url_cache_file(options->get_state_dir() + PEERS_CACHE_FILE);
+
+        if (!init_peers(peers, options->get_bootstrap_peers_file(), options->get_bootstrap_peers_url()))
+            throw std::runtime_error("Bootstrap peers initialization failed.");
+
+        double eth_balance = eth_balance_result.get();
 
         if (eth_balance == 0)
         {
@@ -232,21 +340,32 @@ main(int argc, const char* argv[])
             return 0;
         }
 
-        bzn::bootstrap_peers peers(options->peer_validation_enabled());
-        if (!init_peers(peers, options->get_bootstrap_peers_file(), options->get_bootstrap_peers_url()))
-            throw std::runtime_error("Bootstrap peers initialization failed.");
-
         auto io_context = std::make_shared<bzn::asio::io_context>();
+        auto consensus_context = std::make_shared<bzn::asio::io_context>();
+        auto execution_context = std::make_shared<bzn::asio::io_context>();
+
+        // the consensus and execution stages may sit idle, so keep their run() from returning early...
+        auto consensus_work = boost::asio::make_work_guard(consensus_context->get_io_context());
+        auto execution_work = boost::asio::make_work_guard(execution_context->get_io_context());
+
+        std::vector<worker_stage> stages{{"io", io_context, options->get_simple_options().get<size_t>(bzn::option_names::IO_THREADS)}};
+
+        if (stages.front().threads == 0)
+        {
+            stages.front().threads = std::max(1u, std::thread::hardware_concurrency());
+        }
 
         // setup signal handler...
         boost::asio::signal_set signals(io_context->get_io_context(), SIGINT, SIGTERM);
 
-        signals.async_wait([io_context](const boost::system::error_code& error, int signal_number)
+        signals.async_wait([io_context, consensus_context, execution_context](const boost::system::error_code& error, int signal_number)
             {
                 if (!error)
                 {
                     LOG(info) << "signal received -- shutting down (" << signal_number << ")";
                     io_context->stop();
+                    consensus_context->stop();
+                    execution_context->stop();
                 }
             });
 
@@ -255,8 +374,10 @@ main(int argc, const char* argv[])
         auto chaos = std::make_shared<bzn::chaos>(io_context, options);
         auto websocket = std::make_shared<bzn::beast::websocket>();
         auto node = std::make_shared<bzn::node>(io_context, websocket, chaos, options->get_ws_idle_timeout(), boost::asio::ip::tcp::endpoint{options->get_listener()}, crypto, options);
-        auto audit = std::make_shared<bzn::audit>(io_context, node, options->get_monitor_endpoint(io_context), options->get_uuid(), options->get_audit_mem_size());
+        auto audit = std::make_shared<bzn::audit>(io_context, node, options->get_monitor_endpoint(io_context), options->get_uuid(), options->get_audit_mem_size(),
+            std::chrono::milliseconds(options->get_simple_options().get<uint64_t>(bzn::option_names::MONITOR_FLUSH_INTERVAL)));
         std::shared_ptr<bzn::status> status;
+        std::vector<std::shared_ptr<bzn::storage_base>> storages;
 
         node->start();
         chaos->start();
@@ -268,7 +389,20 @@ main(int argc, const char* argv[])
 
         if (options->pbft_enabled())
         {
-            auto failure_detector = std::make_shared<bzn::pbft_failure_detector>(io_context);
+            // with a consensus thread, pbft's handlers and timers all run on one thread and the io threads only
+            // read, parse and verify messages before handing them over...
+            std::shared_ptr<bzn::asio::io_context_base> pbft_context = io_context;
+            std::shared_ptr<bzn::node_base> pbft_node = node;
+
+            if (options->get_simple_options().get<bool>(bzn::option_names::CONSENSUS_THREAD_ENABLED))
+            {
+                pbft_context = consensus_context;
+                pbft_node = std::make_shared<bzn::staged_node>(node, consensus_context);
+
+                stages.push_back({"consensus", consensus_context, 1});
+            }
+
+            auto failure_detector = std::make_shared<bzn::pbft_failure_detector>(pbft_context);
 
             // which type of storage?
             std::shared_ptr<bzn::storage_base> stable_storage;
@@ -289,11 +423,30 @@ main(int argc, const char* argv[])
                 unstable_storage = std::make_shared<bzn::rocksdb_storage>(options->get_state_dir(), "pbft", options->get_uuid());
             }
 
+            storages = {stable_storage, unstable_storage};
+
             auto crud = std::make_shared<bzn::crud>(stable_storage, std::make_shared<bzn::subscription_manager>(io_context));
             auto operation_manager = std::make_shared<bzn::pbft_operation_manager>();
 
-            auto pbft = std::make_shared<bzn::pbft>(node, io_context, peers.get_peers(), options,
-                std::make_shared<bzn::database_pbft_service>(io_context, unstable_storage, crud, options->get_uuid())
+            auto service = std::make_shared<bzn::database_pbft_service>(pbft_context, unstable_storage, crud, options->get_uuid());
+
+            if (options->get_simple_options().get<bool>(bzn::option_names::PBFT_FAST_READS_ENABLED))
+            {
+                service->enable_fast_reads(std::chrono::milliseconds(
+                    options->get_simple_options().get<uint64_t>(bzn::option_names::PBFT_FAST_READS_MAX_STALENESS)));
+            }
+
+            // ...and committed requests can be applied to storage by their own pool
+            std::shared_ptr<bzn::pbft_service_base> pbft_service = service;
+
+            if (auto execution_threads = options->get_simple_options().get<size_t>(bzn::option_names::EXECUTION_THREADS))
+            {
+                pbft_service = std::make_shared<bzn::staged_pbft_service>(service, execution_context);
+
+                stages.push_back({"execution", execution_context, execution_threads});
+            }
+
+            auto pbft = std::make_shared<bzn::pbft>(pbft_node, pbft_context, peers.get_peers(), options, pbft_service
                 ,failure_detector , crypto, operation_manager);
 
             pbft->set_audit_enabled(options->get_simple_options().get<bool>(bzn::option_names::AUDIT_ENABLED));
@@ -329,10 +482,14 @@ main(int argc, const char* argv[])
                 storage = std::make_shared<bzn::rocksdb_storage>(options->get_state_dir(), "db", options->get_uuid());
             }
 
+            storages = {storage};
+
             auto crud = std::make_shared<bzn::raft_crud>(node, raft, storage, std::make_shared<bzn::subscription_manager>(io_context));
             auto http_server = std::make_shared<bzn::http::server>(io_context, crud, ep);
 
             raft->set_audit_enabled(options->get_simple_options().get<bool>(bzn::option_names::AUDIT_ENABLED));
+            raft->set_snapshot_threshold(options->get_simple_options().get<size_t>(bzn::option_names::RAFT_SNAPSHOT_THRESHOLD));
+            raft->set_protobuf_enabled(options->get_simple_options().get<bool>(bzn::option_names::RAFT_PROTOBUF_ENABLED));
 
             raft->initialize_storage_from_log(storage);
 
@@ -342,9 +499,16 @@ main(int argc, const char* argv[])
             raft->start();
         }
 
-        print_banner(*options, eth_balance);
+        const auto startup_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - launch_time);
+
+        if (status)
+        {
+            status->set_startup_time(startup_time);
+        }
+
+        print_banner(*options, eth_balance, storages, startup_time);
 
-        start_worker_threads_and_wait(io_context);
+        start_worker_threads_and_wait(stages, options->get_simple_options().get<bool>(bzn::option_names::PIN_THREADS));
     }
     catch(std::exception& ex)
     {
@@ -18,8 +18,10 @@
 #include <boost/beast/http.hpp>
 #include <boost/asio/connect.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <future>
 #include <regex>
 #include <string>
+#include <thread>
 
 
 namespace
@@ -30,21 +32,50 @@ namespace
         R"(([^/\.]+\.[^/]+))"  // Domain must be something.something
         R"((/.*)?)"            // Target, if present, must be /something
     };
+
+    // asio resolves on a private thread that is joined when its io_context is destroyed, so a lookup stuck in
+    // getaddrinfo would outlast any timeout. Resolve on a detached thread instead so we can walk away from it.
+    boost::asio::ip::tcp::resolver::results_type
+    resolve(const std::string& host, std::chrono::milliseconds timeout)
+    {
+        using tcp = boost::asio::ip::tcp;
+
+        auto promise = std::make_shared<std::promise<tcp::resolver::results_type>>();
+        auto future = promise->get_future();
+
+        std::thread([host, promise]()
+            {
+                try
+                {
+                    boost::asio::io_context ioc;
+                    tcp::resolver resolver{ioc};
+                    promise->set_value(resolver.resolve(host, "80"));
+                }
+                catch (...)
+                {
+                    promise->set_exception(std::current_exception());
+                }
+            }).detach();
+
+        if (future.wait_for(timeout) != std::future_status::ready)
+        {
+            LOG(error) << "timed out resolving " << host;
+            throw boost::system::system_error(boost::asio::error::timed_out, "timed out resolving " + host);
+        }
+
+        return future.get();
+    }
 }
 
 
 namespace bzn::utils::http
 {
     // Performs an HTTP GET and returns the body of the HTTP response
-    std::string sync_get(const std::string& url)
+    std::string sync_get(const std::string& url, std::chrono::milliseconds timeout)
     {
         using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
         namespace http = boost::beast::http;    // from <boost/beast/http.hpp>
 
-        boost::asio::io_context ioc;
-        tcp::resolver resolver{ioc};
-        tcp::socket socket{ioc};
-
         std::smatch what;
         if (!std::regex_match(url, what, url_regex))
         {
@@ -55,24 +86,62 @@ namespace bzn::utils::http
         const std::string host{what[1]};
         const std::string target{what[2]};
 
-        auto const endpoint_iterator = resolver.resolve(host, "80");
-
-        LOG(info) << "Connecting to: " << host << "...";
-
-        boost::asio::connect(socket, endpoint_iterator);
-
         http::request<http::string_body> req{http::verb::get, target, 11};
         req.set(http::field::host, host);
         req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
 
-        http::write(socket, req);
-
         boost::beast::flat_buffer buffer;
         http::response<http::string_body> res;
 
-        http::read(socket, buffer, res);
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        const auto endpoints = resolve(host, timeout);
+
+        // run the exchange asynchronously so a slow or unresponsive host can't hold up the caller forever...
+        boost::asio::io_context ioc;
+        tcp::socket socket{ioc};
+        boost::system::error_code result;
+
+        LOG(info) << "Connecting to: " << host << "...";
+
+        boost::asio::async_connect(socket, endpoints,
+            [&](const boost::system::error_code& ec, const tcp::endpoint& /*endpoint*/)
+            {
+                if ((result = ec))
+                {
+                    return;
+                }
+
+                http::async_write(socket, req,
+                    [&](const boost::system::error_code& ec, std::size_t /*bytes*/)
+                    {
+                        if ((result = ec))
+                        {
+                            return;
+                        }
+
+                        http::async_read(socket, buffer, res,
+                            [&](const boost::system::error_code& ec, std::size_t /*bytes*/)
+                            {
+                                result = ec;
+                            });
+                    });
+            });
+
+        ioc.run_until(deadline);
+
+        if (!ioc.stopped())
+        {
+            LOG(error) << "timed out fetching " << url;
+            throw boost::system::system_error(boost::asio::error::timed_out, "timed out fetching " + url);
+        }
+
+        if (result)
+        {
+            throw boost::system::system_error(result);
+        }
 
-        socket.shutdown(tcp::socket::shutdown_both);
+        boost::system::error_code ec;
+        socket.shutdown(tcp::socket::shutdown_both, ec);
 
         return res.body();
     }
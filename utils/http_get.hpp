@@ -14,12 +14,15 @@
 
 #pragma once
 
+#include <chrono>
 #include <string>
 
 
 namespace bzn::utils::http
 {
-    // Performs an HTTP GET and returns the body of the HTTP response
-    std::string sync_get(const std::string& url);
+    const std::chrono::milliseconds DEFAULT_GET_TIMEOUT{10000};
+
+    // Performs an HTTP GET and returns the body of the HTTP response, throws if it takes longer than timeout
+    std::string sync_get(const std::string& url, std::chrono::milliseconds timeout = DEFAULT_GET_TIMEOUT);
 
 } // namespace bzn::http
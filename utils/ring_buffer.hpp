@@ -0,0 +1,89 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+namespace bzn
+{
+    /**
+     * Fixed capacity FIFO. All storage is allocated up front; once full, each push overwrites the oldest element
+     * in place, so a steady stream of pushes neither allocates nor frees.
+     */
+    template <typename T>
+    class ring_buffer
+    {
+    public:
+        explicit ring_buffer(size_t capacity)
+            : slots(capacity)
+        {
+        }
+
+        /**
+         * Append an element, evicting the oldest one if the buffer is full
+         * @param value element to append
+         * @return true if an element was evicted (or, with zero capacity, value was dropped)
+         */
+        bool push_back(const T& value)
+        {
+            if (this->slots.empty())
+            {
+                return true;
+            }
+
+            this->slots[(this->head + this->count) % this->slots.size()] = value;
+
+            if (this->count < this->slots.size())
+            {
+                ++this->count;
+                return false;
+            }
+
+            this->head = (this->head + 1) % this->slots.size();
+            return true;
+        }
+
+        /**
+         * @param index position counting from the oldest element held
+         */
+        const T& operator[](size_t index) const
+        {
+            return this->slots[(this->head + index) % this->slots.size()];
+        }
+
+        size_t size() const
+        {
+            return this->count;
+        }
+
+        size_t capacity() const
+        {
+            return this->slots.size();
+        }
+
+        bool empty() const
+        {
+            return this->count == 0;
+        }
+
+    private:
+        std::vector<T> slots;
+        size_t head = 0;
+        size_t count = 0;
+    };
+
+} // namespace bzn
@@ -0,0 +1,150 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace bzn
+{
+    /**
+     * Fixed capacity map from sequence number to value that only remembers the most recent `capacity` sequences.
+     * Each sequence owns the slot sequence % capacity, so inserting a new sequence evicts whatever older one shared
+     * its slot in O(1) without any allocation.
+     *
+     * Sequences more than `max_lead` ahead of the highest one recorded so far (or of the base the window is anchored
+     * at, while it is empty) are ignored, so that a single bogus sequence can't push the window past everything that
+     * is still to come.
+     */
+    template <typename T>
+    class sequence_window
+    {
+    public:
+        explicit sequence_window(size_t capacity)
+            : sequence_window(capacity, capacity)
+        {
+        }
+
+        sequence_window(size_t capacity, uint64_t max_lead, uint64_t base = 0)
+            : slots(capacity)
+            , max_lead(max_lead)
+            , highest(base)
+        {
+        }
+
+        /**
+         * Move the window forward to a sequence known from a trusted source, such as our own progress, so that
+         * sequences up to max_lead past it are accepted. Sequences that fall behind the window are forgotten.
+         * @param base trusted sequence, ignored if the window is already past it
+         */
+        void anchor(uint64_t base)
+        {
+            if (base > this->highest)
+            {
+                this->highest = base;
+            }
+        }
+
+        /**
+         * @param sequence sequence to look up
+         * @return the recorded value, or nullptr if the sequence was never recorded or has been evicted
+         */
+        const T* find(uint64_t sequence) const
+        {
+            if (!this->in_window(sequence))
+            {
+                return nullptr;
+            }
+
+            const auto& slot = this->slots[sequence % this->slots.size()];
+            return (slot.used && slot.sequence == sequence) ? &slot.value : nullptr;
+        }
+
+        /**
+         * Record (or overwrite) the value for a sequence
+         * @param sequence sequence to record
+         * @param value value to record
+         * @return false if the sequence is already too old to be held by the window, or too far ahead of it
+         */
+        bool insert(uint64_t sequence, const T& value)
+        {
+            if (!this->in_window(sequence))
+            {
+                return false;
+            }
+
+            auto& slot = this->slots[sequence % this->slots.size()];
+            if (!slot.used)
+            {
+                slot.used = true;
+                ++this->count;
+            }
+
+            slot.sequence = sequence;
+            slot.value = value;
+
+            if (sequence > this->highest)
+            {
+                this->highest = sequence;
+            }
+
+            return true;
+        }
+
+        /**
+         * @return number of occupied slots, never more than capacity
+         */
+        size_t size() const
+        {
+            return this->count;
+        }
+
+        size_t capacity() const
+        {
+            return this->slots.size();
+        }
+
+    private:
+        struct slot_t
+        {
+            uint64_t sequence = 0;
+            bool used = false;
+            T value{};
+        };
+
+        bool in_window(uint64_t sequence) const
+        {
+            if (this->slots.empty())
+            {
+                return false;
+            }
+
+            if (sequence > this->highest)
+            {
+                return sequence - this->highest <= this->max_lead;
+            }
+
+            return sequence + this->slots.size() > this->highest;
+        }
+
+        std::vector<slot_t> slots;
+        const uint64_t max_lead;
+        uint64_t highest;
+        size_t count = 0;
+    };
+
+} // namespace bzn
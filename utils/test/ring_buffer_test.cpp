@@ -0,0 +1,49 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <utils/ring_buffer.hpp>
+#include <gtest/gtest.h>
+#include <string>
+
+using namespace ::testing;
+
+
+TEST(ring_buffer_test, test_that_ring_buffer_overwrites_oldest_when_full)
+{
+    bzn::ring_buffer<std::string> buffer(3);
+    EXPECT_TRUE(buffer.empty());
+
+    EXPECT_FALSE(buffer.push_back("a"));
+    EXPECT_FALSE(buffer.push_back("b"));
+    EXPECT_FALSE(buffer.push_back("c"));
+    EXPECT_EQ(buffer.size(), 3u);
+
+    EXPECT_TRUE(buffer.push_back("d"));
+    EXPECT_TRUE(buffer.push_back("e"));
+    EXPECT_EQ(buffer.size(), 3u);
+    EXPECT_EQ(buffer.capacity(), 3u);
+
+    EXPECT_EQ(buffer[0], "c");
+    EXPECT_EQ(buffer[1], "d");
+    EXPECT_EQ(buffer[2], "e");
+}
+
+
+TEST(ring_buffer_test, test_that_zero_capacity_ring_buffer_drops_everything)
+{
+    bzn::ring_buffer<int> buffer(0);
+
+    EXPECT_TRUE(buffer.push_back(1));
+    EXPECT_TRUE(buffer.empty());
+}
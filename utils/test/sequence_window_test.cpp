@@ -0,0 +1,133 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <utils/sequence_window.hpp>
+#include <gtest/gtest.h>
+#include <limits>
+#include <string>
+
+using namespace ::testing;
+
+
+TEST(sequence_window_test, test_that_sequence_window_finds_recent_sequences)
+{
+    bzn::sequence_window<std::string> window(4);
+
+    EXPECT_EQ(window.find(1), nullptr);
+
+    EXPECT_TRUE(window.insert(1, "one"));
+    EXPECT_TRUE(window.insert(3, "three"));
+    ASSERT_NE(window.find(1), nullptr);
+    EXPECT_EQ(*window.find(1), "one");
+    EXPECT_EQ(*window.find(3), "three");
+    EXPECT_EQ(window.find(2), nullptr);
+    EXPECT_EQ(window.size(), 2u);
+
+    // overwrite in place
+    EXPECT_TRUE(window.insert(3, "THREE"));
+    EXPECT_EQ(*window.find(3), "THREE");
+    EXPECT_EQ(window.size(), 2u);
+}
+
+
+TEST(sequence_window_test, test_that_sequence_window_evicts_sequences_that_fall_out_of_the_window)
+{
+    bzn::sequence_window<int> window(4);
+
+    for (uint64_t seq = 0; seq < 100; seq++)
+    {
+        EXPECT_TRUE(window.insert(seq, static_cast<int>(seq)));
+        EXPECT_LE(window.size(), window.capacity());
+    }
+
+    for (uint64_t seq = 96; seq < 100; seq++)
+    {
+        ASSERT_NE(window.find(seq), nullptr);
+        EXPECT_EQ(*window.find(seq), static_cast<int>(seq));
+    }
+
+    EXPECT_EQ(window.find(95), nullptr);
+    EXPECT_EQ(window.find(0), nullptr);
+
+    // too old to be held any more
+    EXPECT_FALSE(window.insert(10, 10));
+    EXPECT_EQ(window.find(10), nullptr);
+
+    // jumping ahead leaves stale slots unreachable
+    EXPECT_TRUE(window.insert(103, 103));
+    EXPECT_EQ(window.find(99), nullptr);
+    EXPECT_EQ(*window.find(103), 103);
+}
+
+
+TEST(sequence_window_test, test_that_sequence_window_ignores_sequences_far_ahead)
+{
+    bzn::sequence_window<int> window(4, 10);
+
+    for (uint64_t seq = 1; seq <= 4; seq++)
+    {
+        EXPECT_TRUE(window.insert(seq, static_cast<int>(seq)));
+    }
+
+    // a bogus sequence must not push the window past the ones still to come
+    EXPECT_FALSE(window.insert(std::numeric_limits<uint64_t>::max(), 0));
+    EXPECT_FALSE(window.insert(15, 15));
+    EXPECT_EQ(window.find(15), nullptr);
+
+    EXPECT_TRUE(window.insert(5, 5));
+    EXPECT_EQ(*window.find(5), 5);
+    EXPECT_EQ(*window.find(2), 2);
+
+    // but legitimate gaps are fine
+    EXPECT_TRUE(window.insert(15, 15));
+    EXPECT_EQ(*window.find(15), 15);
+}
+
+
+TEST(sequence_window_test, test_that_a_huge_first_sequence_does_not_pin_an_empty_window)
+{
+    bzn::sequence_window<int> window(4, 10);
+
+    EXPECT_FALSE(window.insert(uint64_t(1) << 63, 0));
+    EXPECT_EQ(window.size(), 0u);
+
+    EXPECT_TRUE(window.insert(1, 1));
+    EXPECT_EQ(*window.find(1), 1);
+
+    // a window anchored further along accepts sequences relative to that instead
+    bzn::sequence_window<int> anchored(4, 10, 1000);
+
+    EXPECT_FALSE(anchored.insert(1, 1));
+    EXPECT_FALSE(anchored.insert(1011, 1011));
+    EXPECT_TRUE(anchored.insert(1005, 1005));
+
+    anchored.anchor(2000);
+    EXPECT_EQ(anchored.find(1005), nullptr);
+    EXPECT_TRUE(anchored.insert(2010, 2010));
+    EXPECT_EQ(*anchored.find(2010), 2010);
+
+    // anchoring never moves the window back
+    anchored.anchor(0);
+    EXPECT_EQ(*anchored.find(2010), 2010);
+}
+
+
+TEST(sequence_window_test, test_that_zero_capacity_sequence_window_holds_nothing)
+{
+    bzn::sequence_window<int> window(0);
+
+    EXPECT_FALSE(window.insert(1, 1));
+    EXPECT_EQ(window.find(1), nullptr);
+    EXPECT_EQ(window.size(), 0u);
+}